@@ -9,7 +9,6 @@ if [[ "$TRAVIS_OS_NAME" = "osx" ]]; then
 	brew outdated libtool || brew upgrade libtool
 	brew install doxygen
 	brew outdated gettext || brew upgrade gettext
-	brew install flex
 	brew install libidn
 	brew install xz
 	brew install lbzip2
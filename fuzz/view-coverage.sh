@@ -24,14 +24,14 @@ LCOV_INFO=coverage.info
 #./coverage.sh $fuzzer
 #lcov --capture --initial --directory ../libwget/.libs --directory . --output-file $LCOV_INFO
 #lcov --capture --directory ../libwget/.libs --output-file $LCOV_INFO
-#lcov --remove $LCOV_INFO '*/test_linking.c' '*/css_tokenizer.lex' '*/<stdout>' '*/*.h' -o $LCOV_INFO
+#lcov --remove $LCOV_INFO '*/test_linking.c' '*/<stdout>' '*/*.h' -o $LCOV_INFO
 #genhtml --prefix . --ignore-errors source $LCOV_INFO --legend --title "$1" --output-directory=lcov
 
 lcov --zerocounters --directory ../libwget/
 lcov --capture --initial --directory ../libwget/.libs --directory . --output-file $LCOV_INFO
 make check TESTS="$*" CFLAGS="$(CFLAGS) --coverage" LDFLAGS="$(LDFLAGS) --coverage"
 lcov --capture --directory ../libwget/.libs --output-file $LCOV_INFO
-lcov --remove $LCOV_INFO '*/test_linking.c' '*/css_tokenizer.lex' '*/*.h' -o $LCOV_INFO
+lcov --remove $LCOV_INFO '*/test_linking.c' '*/*.h' -o $LCOV_INFO
 genhtml --prefix . --ignore-errors source $LCOV_INFO --legend --title "$*" --output-directory=lcov
 
 xdg-open lcov/index.html
@@ -250,6 +250,8 @@ WGET_BEGIN_DECLS
 #define WGET_HTTP_BODY_SAVEAS           2018
 #define WGET_HTTP_USER_DATA             2019
 #define WGET_HTTP_RESPONSE_IGNORELENGTH 2020
+#define WGET_HTTP_PRIORITY              2021
+#define WGET_HTTP_DECOMPRESS_OFFLOAD    2022
 
 // definition of error conditions
 typedef enum {
@@ -368,6 +370,10 @@ WGETAPI int
 	wget_update_file(const char *fname, wget_update_load_fn *load_func, wget_update_save_fn *save_func, void *context);
 WGETAPI int
 	wget_truncate(const char *path, off_t length);
+WGETAPI void
+	wget_encoding_init(void);
+WGETAPI void
+	wget_encoding_exit(void);
 WGETAPI const char *
 	wget_local_charset_encoding(void);
 WGETAPI int
@@ -1155,6 +1161,10 @@ WGETAPI WGET_GCC_PURE wget_content_encoding
 	wget_content_encoding_by_name(const char *name);
 WGETAPI WGET_GCC_PURE const char * NULLABLE
 	wget_content_encoding_to_name(wget_content_encoding type);
+WGETAPI void
+	wget_decompress_init(void);
+WGETAPI void
+	wget_decompress_exit(void);
 WGETAPI wget_decompressor * NULLABLE
 	wget_decompress_open(wget_content_encoding encoding, wget_decompressor_sink_fn *data_sink, void *context);
 WGETAPI void
@@ -1165,6 +1175,8 @@ WGETAPI void
 	wget_decompress_set_error_handler(wget_decompressor *dc, wget_decompressor_error_handler *error_handler);
 WGETAPI void * NULLABLE
 	wget_decompress_get_context(wget_decompressor *dc);
+WGETAPI int
+	wget_decompress_set_offload(wget_decompressor *dc, bool offload);
 
 /*
  * URI/IRI routines
@@ -1784,6 +1796,17 @@ WGETAPI wget_html_parsed_result * NULLABLE
 	wget_html_get_urls_inline(const char *html, wget_vector *additional_tags, wget_vector *ignore_tags);
 WGETAPI void
 	wget_html_free_urls_inline(wget_html_parsed_result **res);
+
+typedef struct wget_html_url_parser_st wget_html_url_parser;
+
+WGETAPI wget_html_url_parser * NULLABLE
+	wget_html_url_parser_init(wget_vector *additional_tags, wget_vector *ignore_tags);
+WGETAPI wget_html_parsed_result * NULLABLE
+	wget_html_url_parser_feed(wget_html_url_parser *parser, const char *data, size_t len) WGET_GCC_NONNULL((1));
+WGETAPI wget_html_parsed_result * NULLABLE
+	wget_html_url_parser_finish(wget_html_url_parser *parser) WGET_GCC_NONNULL_ALL;
+WGETAPI void
+	wget_html_url_parser_free(wget_html_url_parser **parser);
 WGETAPI void
 	wget_sitemap_get_urls_inline(const char *sitemap, wget_vector **urls, wget_vector **sitemap_urls);
 WGETAPI void
@@ -1791,6 +1814,39 @@ WGETAPI void
 WGETAPI void
 	wget_rss_get_urls_inline(const char *rss, wget_vector **urls);
 
+typedef struct wget_sitemap_url_parser_st wget_sitemap_url_parser;
+
+WGETAPI wget_sitemap_url_parser * NULLABLE
+	wget_sitemap_url_parser_init(void);
+WGETAPI void
+	wget_sitemap_url_parser_feed(wget_sitemap_url_parser *parser, const char *data, size_t len, wget_vector **urls, wget_vector **sitemap_urls) WGET_GCC_NONNULL((1,4,5));
+WGETAPI void
+	wget_sitemap_url_parser_finish(wget_sitemap_url_parser *parser, wget_vector **urls, wget_vector **sitemap_urls) WGET_GCC_NONNULL_ALL;
+WGETAPI void
+	wget_sitemap_url_parser_free(wget_sitemap_url_parser **parser);
+
+typedef struct wget_atom_url_parser_st wget_atom_url_parser;
+
+WGETAPI wget_atom_url_parser * NULLABLE
+	wget_atom_url_parser_init(void);
+WGETAPI void
+	wget_atom_url_parser_feed(wget_atom_url_parser *parser, const char *data, size_t len, wget_vector **urls) WGET_GCC_NONNULL((1,4));
+WGETAPI void
+	wget_atom_url_parser_finish(wget_atom_url_parser *parser, wget_vector **urls) WGET_GCC_NONNULL_ALL;
+WGETAPI void
+	wget_atom_url_parser_free(wget_atom_url_parser **parser);
+
+typedef struct wget_rss_url_parser_st wget_rss_url_parser;
+
+WGETAPI wget_rss_url_parser * NULLABLE
+	wget_rss_url_parser_init(void);
+WGETAPI void
+	wget_rss_url_parser_feed(wget_rss_url_parser *parser, const char *data, size_t len, wget_vector **urls) WGET_GCC_NONNULL((1,4));
+WGETAPI void
+	wget_rss_url_parser_finish(wget_rss_url_parser *parser, wget_vector **urls) WGET_GCC_NONNULL_ALL;
+WGETAPI void
+	wget_rss_url_parser_free(wget_rss_url_parser **parser);
+
 /*
  * XML and HTML parsing routines
  */
@@ -1837,6 +1893,34 @@ WGETAPI void
 		void *user_ctx,
 		int hints) WGET_GCC_NONNULL((1));
 
+typedef struct wget_xml_parser_st wget_xml_parser;
+
+WGETAPI wget_xml_parser * NULLABLE
+	wget_xml_parser_init(
+		wget_xml_callback *callback,
+		void *user_ctx,
+		int hints);
+WGETAPI size_t
+	wget_xml_parser_feed(wget_xml_parser *parser, const char *data, size_t len) WGET_GCC_NONNULL((1));
+WGETAPI size_t
+	wget_xml_parser_finish(wget_xml_parser *parser) WGET_GCC_NONNULL_ALL;
+WGETAPI void
+	wget_xml_parser_free(wget_xml_parser **parser);
+
+typedef struct wget_xml_parser_st wget_html_parser;
+
+WGETAPI wget_html_parser * NULLABLE
+	wget_html_parser_init(
+		wget_xml_callback *callback,
+		void *user_ctx,
+		int hints);
+WGETAPI size_t
+	wget_html_parser_feed(wget_html_parser *parser, const char *data, size_t len) WGET_GCC_NONNULL((1));
+WGETAPI size_t
+	wget_html_parser_finish(wget_html_parser *parser) WGET_GCC_NONNULL_ALL;
+WGETAPI void
+	wget_html_parser_free(wget_html_parser **parser);
+
 /*
  * DNS caching routines
  */
@@ -1852,6 +1936,23 @@ WGETAPI struct addrinfo * NULLABLE
 WGETAPI int
 	wget_dns_cache_add(wget_dns_cache *cache, const char *host, uint16_t port, struct addrinfo **addrinfo);
 
+/*
+ * Alternative services (Alt-Svc) caching routines
+ */
+
+typedef struct wget_altsvc_cache_st wget_altsvc_cache;
+
+WGETAPI int
+	wget_altsvc_cache_init(wget_altsvc_cache **cache);
+WGETAPI void
+	wget_altsvc_cache_free(wget_altsvc_cache **cache);
+WGETAPI int
+	wget_altsvc_cache_update(wget_altsvc_cache *cache, const char *host, uint16_t port, const wget_vector *alt_svcs);
+WGETAPI int
+	wget_altsvc_cache_get(wget_altsvc_cache *cache, const char *host, uint16_t port, const char *protocol, const char **alt_host, uint16_t *alt_port);
+WGETAPI void
+	wget_altsvc_cache_mark_broken(wget_altsvc_cache *cache, const char *host, uint16_t port, const char *protocol, const char *alt_host, uint16_t alt_port);
+
 /*
  * DNS resolving routines
  */
@@ -2013,6 +2114,8 @@ WGETAPI int
 	wget_ssl_open(wget_tcp *tcp);
 WGETAPI void
 	wget_ssl_close(void **session);
+WGETAPI bool
+	wget_ssl_check_peer_hostname(void *session, const char *hostname);
 WGETAPI void
 	wget_ssl_set_check_certificate(char value);
 WGETAPI ssize_t
@@ -2071,6 +2174,22 @@ typedef struct {
 		params; //!< name/value pairs of the challenge
 } wget_http_challenge;
 
+/**
+ * Parsed Alt-Svc HTTP header (RFC 7838)
+ */
+typedef struct {
+	const char *
+		protocol; //!< ALPN protocol id of the alternative, e.g. 'h3'
+	const char *
+		host; //!< host of the alternative or NULL for the origin host
+	int64_t
+		maxage; //!< freshness lifetime in seconds (default 24 hours)
+	uint16_t
+		port; //!< port of the alternative
+	bool
+		persist : 1; //!< keep the alternative on network changes
+} wget_http_altsvc;
+
 typedef enum {
 	wget_transfer_encoding_identity = 0,
 	wget_transfer_encoding_chunked = 1
@@ -2079,6 +2198,7 @@ typedef enum {
 typedef struct wget_http_response_st wget_http_response;
 typedef int wget_http_header_callback(wget_http_response *, void *);
 typedef int wget_http_body_callback(wget_http_response *, void *, const char *, size_t);
+typedef void wget_http_recv_callback(wget_http_response *, void *, size_t);
 
 /**
  * HTTP request data
@@ -2088,24 +2208,34 @@ typedef struct {
 		headers; //!< list of HTTP headers
 	const char *
 		body; //!< body data to be sent or NULL
+	const char *
+		header_block; //!< pre-serialized header lines sent after \p headers, not owned by the request
 	wget_http_header_callback
 		*header_callback; //!< called after HTTP header has been received
 	wget_http_body_callback
 		*body_callback; //!< called for each body data packet received
+	wget_http_recv_callback
+		*recv_callback; //!< called by the receiving thread with the number of body bytes read from the network
 	void *
 		user_data; //!< user data for the request (used by async application code)
 	void *
 		header_user_data; //!< meant to be used in header callback function
 	void *
 		body_user_data; //!< meant to be used in body callback function
+	void *
+		recv_user_data; //!< meant to be used in recv callback function
 	wget_buffer
 		esc_resource; //!< URI escaped resource
 	wget_buffer
 		esc_host; //!< URI escaped host
 	size_t
 		body_length; //!< length of the body data
+	size_t
+		header_block_length; //!< length of \p header_block
 	int32_t
 		stream_id; //!< HTTP2 stream id
+	int
+		priority; //!< HTTP2 stream weight (1-256), 0 for the default weight
 	wget_iri_scheme
 		scheme; //!< scheme of the request for proxied connections
 	char
@@ -2118,6 +2248,8 @@ typedef struct {
 		response_keepheader : 1; //!< the application wants the response header data
 	bool
 		response_ignorelength : 1; //!< ignore the Content-Length in the response header
+	bool
+		decompress_offload : 1; //!< decompress the response body in a worker thread
 	bool
 		debug_skip_body : 1; //!< if set, do not print the request body (e.g. because it's binary)
 	long long
@@ -2141,6 +2273,8 @@ struct wget_http_response_st {
 		cookies;
 	wget_vector *
 		challenges;
+	wget_vector *
+		alt_svcs; //!< alternative services, NULL if there was no Alt-Svc header, empty for 'clear'
 	wget_hpkp *
 		hpkp;
 	const char *
@@ -2153,6 +2287,8 @@ struct wget_http_response_st {
 		location;
 	const char *
 		etag; //!< ETag value
+	const char *
+		vary; //!< Vary header value, comma separated header names or '*'
 	wget_buffer *
 		header; //!< the raw header data if requested by the application
 	wget_buffer *
@@ -2168,6 +2304,14 @@ struct wget_http_response_st {
 		last_modified;
 	int64_t
 		hsts_maxage;
+	int64_t
+		date; //!< value of the Date header, 0 if not given
+	int64_t
+		expires; //!< value of the Expires header, 0 if not given, 1 (in the past) if invalid
+	int64_t
+		age; //!< value of the Age header
+	int64_t
+		cache_maxage; //!< Cache-Control max-age, valid if cache_maxage_valid is set
 	char
 		reason[32]; //!< reason string after the status code
 	int
@@ -2189,7 +2333,10 @@ struct wget_http_response_st {
 		content_length_valid : 1,
 		length_inconsistent : 1, //!< set when length of data received is not same as Content-Length
 		hsts : 1, //!< if hsts_maxage and hsts_include_subdomains are valid
-		csp : 1;
+		csp : 1,
+		cache_maxage_valid : 1, //!< if cache_maxage is valid
+		cache_no_store : 1, //!< Cache-Control: no-store
+		cache_no_cache : 1; //!< Cache-Control: no-cache, the response must be revalidated before reuse
 };
 
 typedef struct wget_http_connection_st wget_http_connection;
@@ -2202,6 +2349,10 @@ WGETAPI wget_iri_scheme
 	wget_http_get_scheme(const wget_http_connection *conn) WGET_GCC_NONNULL_ALL;
 WGETAPI int
 	wget_http_get_protocol(const wget_http_connection *conn) WGET_GCC_NONNULL_ALL;
+WGETAPI int
+	wget_http_get_max_concurrent_streams(const wget_http_connection *conn) WGET_GCC_NONNULL_ALL;
+WGETAPI bool
+	wget_http_connection_can_coalesce(wget_http_connection *conn, const wget_iri *iri) WGET_GCC_NONNULL_ALL;
 
 WGETAPI bool
 	wget_http_isseparator(char c) WGET_GCC_CONST;
@@ -2228,6 +2379,10 @@ WGETAPI const char *
 	wget_http_parse_challenge(const char *s, wget_http_challenge *challenge) WGET_GCC_NONNULL_ALL;
 WGETAPI const char *
 	wget_http_parse_challenges(const char *s, wget_vector *challenges) WGET_GCC_NONNULL_ALL;
+WGETAPI const char *
+	wget_http_parse_alt_svc(const char *s, wget_http_altsvc *altsvc) WGET_GCC_NONNULL_ALL;
+WGETAPI const char *
+	wget_http_parse_alt_svcs(const char *s, wget_vector *alt_svcs) WGET_GCC_NONNULL_ALL;
 WGETAPI const char *
 	wget_http_parse_location(const char *s, const char **location) WGET_GCC_NONNULL_ALL;
 WGETAPI const char *
@@ -2240,6 +2395,8 @@ WGETAPI const char *
 	wget_http_parse_content_disposition(const char *s, const char **filename) WGET_GCC_NONNULL((1));
 WGETAPI const char *
 	wget_http_parse_strict_transport_security(const char *s, int64_t *maxage, bool *include_subdomains) WGET_GCC_NONNULL_ALL;
+WGETAPI const char *
+	wget_http_parse_cache_control(const char *s, int64_t *maxage, bool *no_store, bool *no_cache) WGET_GCC_NONNULL_ALL;
 WGETAPI const char *
 	wget_http_parse_public_key_pins(const char *s, wget_hpkp *hpkp) WGET_GCC_NONNULL((1));
 WGETAPI const char *
@@ -2270,6 +2427,8 @@ WGETAPI int
 	wget_http_set_https_proxy(const char *proxy, const char *encoding);
 WGETAPI int
 	wget_http_set_no_proxy(const char *no_proxy, const char *encoding);
+WGETAPI void
+	wget_http_set_altsvc_cache(wget_altsvc_cache *cache);
 WGETAPI int
 	wget_http_match_no_proxy(wget_vector *no_proxies, const char *host);
 WGETAPI void
@@ -2285,6 +2444,8 @@ WGETAPI void
 	wget_http_free_challenge(wget_http_challenge *challenge);
 WGETAPI void
 	wget_http_free_link(wget_http_link *link);
+WGETAPI void
+	wget_http_free_alt_svc(wget_http_altsvc *altsvc);
 
 WGETAPI void
 	wget_http_free_cookies(wget_vector **cookies);
@@ -2296,6 +2457,8 @@ WGETAPI void
 	wget_http_free_challenges(wget_vector **challenges);
 WGETAPI void
 	wget_http_free_links(wget_vector **links);
+WGETAPI void
+	wget_http_free_alt_svcs(wget_vector **alt_svcs);
 //WGETAPI void
 //	wget_http_free_header(HTTP_HEADER **header);
 WGETAPI void
@@ -2314,6 +2477,23 @@ WGETAPI wget_http_response * NULLABLE
 WGETAPI wget_http_response * NULLABLE
 	wget_http_get_response(wget_http_connection *conn) WGET_GCC_NONNULL((1));
 
+/**
+ * \ingroup libwget-http-chunked
+ *
+ * Decoder state for chunked transfer-encoding, see wget_http_chunked_decode().
+ */
+typedef struct wget_http_chunked_decoder_st wget_http_chunked_decoder;
+
+WGETAPI wget_http_chunked_decoder * NULLABLE
+	wget_http_chunked_decoder_alloc(void);
+WGETAPI void
+	wget_http_chunked_decoder_free(wget_http_chunked_decoder **decoder);
+WGETAPI bool
+	wget_http_chunked_decoder_done(const wget_http_chunked_decoder *decoder) WGET_GCC_NONNULL_ALL;
+WGETAPI int
+	wget_http_chunked_decode(wget_http_chunked_decoder *decoder, const char *data, size_t length,
+		size_t *consumed, const char **body, size_t *body_length) WGET_GCC_NONNULL_ALL;
+
 WGETAPI void
 	wget_http_init(void);
 WGETAPI void
@@ -2328,6 +2508,10 @@ WGETAPI void
 	wget_http_request_set_header_cb(wget_http_request *req, wget_http_header_callback *cb, void *user_data) WGET_GCC_NONNULL((1));
 WGETAPI void
 	wget_http_request_set_body_cb(wget_http_request *req, wget_http_body_callback *cb, void *user_data) WGET_GCC_NONNULL((1));
+WGETAPI void
+	wget_http_request_set_recv_cb(wget_http_request *req, wget_http_recv_callback *cb, void *user_data) WGET_GCC_NONNULL((1));
+WGETAPI void
+	wget_http_request_set_header_block(wget_http_request *req, const char *block, size_t length) WGET_GCC_NONNULL((1));
 WGETAPI void
 	wget_http_request_set_int(wget_http_request *req, int key, int value) WGET_GCC_NONNULL((1));
 WGETAPI int
@@ -2486,6 +2670,10 @@ WGETAPI int
 	wget_robots_get_sitemap_count(wget_robots *robots);
 WGETAPI const char * NULLABLE
 	wget_robots_get_sitemap(wget_robots *robots, int index);
+WGETAPI bool
+	wget_robots_is_allowed(const wget_robots *robots, const char *path) WGET_GCC_PURE;
+WGETAPI int
+	wget_robots_get_crawl_delay(const wget_robots *robots) WGET_GCC_PURE;
 
 /*
  * Progress bar routines
@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of libwget.
+ *
+ * Libwget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libwget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libwget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Cache for alternative services
+ *
+ * References
+ *   RFC 7838 HTTP Alternative Services
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <wget.h>
+#include "private.h"
+
+/**
+ * \file
+ * \brief Functions for caching alternative services
+ * \defgroup libwget-altsvc-caching Alt-Svc caching
+ *
+ * @{
+ *
+ * Alternative services are announced by servers with the Alt-Svc response header,
+ * e.g. to advertise HTTP/3 on a UDP port. The cache remembers them per origin (host and port)
+ * until they expire or are replaced by a newer announcement.
+ *
+ * An alternative that failed to connect should be marked as broken with wget_altsvc_cache_mark_broken(),
+ * so that the client falls back to the origin fast and does not retry the alternative for a while.
+ * The backoff starts at 5 minutes and doubles with each failure.
+ */
+
+#define BROKEN_BACKOFF 300 // seconds
+
+struct altsvc_entry {
+	const char *
+		protocol;
+	const char *
+		host;
+	int64_t
+		expires;
+	int64_t
+		broken_until;
+	unsigned
+		broken_count;
+	uint16_t
+		port;
+};
+
+struct altsvc_origin {
+	const char *
+		host;
+	wget_vector *
+		alternatives;
+	uint16_t
+		port;
+};
+
+struct wget_altsvc_cache_st {
+	wget_hashmap
+		*cache;
+	wget_thread_mutex
+		mutex;
+};
+
+#ifdef __clang__
+__attribute__((no_sanitize("integer")))
+#endif
+static unsigned int WGET_GCC_PURE hash_origin(const struct altsvc_origin *origin)
+{
+	unsigned int hash = origin->port;
+	const unsigned char *p = (unsigned char *) origin->host;
+
+	while (*p)
+		hash = hash * 101 + *p++;
+
+	return hash;
+}
+
+static int WGET_GCC_PURE compare_origin(const struct altsvc_origin *o1, const struct altsvc_origin *o2)
+{
+	if (o1->port < o2->port)
+		return -1;
+	if (o1->port > o2->port)
+		return 1;
+
+	return wget_strcasecmp(o1->host, o2->host);
+}
+
+static void free_origin(struct altsvc_origin *origin)
+{
+	wget_vector_free(&origin->alternatives);
+	xfree(origin);
+}
+
+static struct altsvc_entry *find_entry(const wget_vector *alternatives, const char *protocol, const char *host, uint16_t port)
+{
+	for (int it = 0; it < wget_vector_size(alternatives); it++) {
+		struct altsvc_entry *entry = wget_vector_get(alternatives, it);
+
+		if (entry->port == port && !strcmp(entry->protocol, protocol) && !wget_strcasecmp(entry->host, host))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/**
+ * \param[out] cache Pointer to return newly allocated and initialized wget_altsvc_cache instance
+ * \return WGET_E_SUCCESS if OK, WGET_E_MEMORY if out-of-memory or WGET_E_INVALID
+ *   if the mutex initialization failed.
+ *
+ * Allocates and initializes a wget_altsvc_cache instance.
+ */
+int wget_altsvc_cache_init(wget_altsvc_cache **cache)
+{
+	wget_altsvc_cache *_cache = wget_calloc(1, sizeof(wget_altsvc_cache));
+
+	if (!_cache)
+		return WGET_E_MEMORY;
+
+	if (wget_thread_mutex_init(&_cache->mutex)) {
+		xfree(_cache);
+		return WGET_E_INVALID;
+	}
+
+	if (!(_cache->cache = wget_hashmap_create(16, (wget_hashmap_hash_fn *) hash_origin, (wget_hashmap_compare_fn *) compare_origin))) {
+		wget_altsvc_cache_free(&_cache);
+		return WGET_E_MEMORY;
+	}
+
+	wget_hashmap_set_key_destructor(_cache->cache, (wget_hashmap_key_destructor *) free_origin);
+	wget_hashmap_set_value_destructor(_cache->cache, (wget_hashmap_value_destructor *) free_origin);
+
+	*cache = _cache;
+
+	return WGET_E_SUCCESS;
+}
+
+/**
+ * \param[in/out] cache Pointer to wget_altsvc_cache instance that will be freed and NULLified.
+ *
+ * Free the resources allocated by wget_altsvc_cache_init().
+ */
+void wget_altsvc_cache_free(wget_altsvc_cache **cache)
+{
+	if (cache && *cache) {
+		wget_thread_mutex_lock((*cache)->mutex);
+		wget_hashmap_free(&(*cache)->cache);
+		wget_thread_mutex_unlock((*cache)->mutex);
+
+		wget_thread_mutex_destroy(&(*cache)->mutex);
+		xfree(*cache);
+	}
+}
+
+/**
+ * \param[in] cache A `wget_altsvc_cache` instance, created by wget_altsvc_cache_init().
+ * \param[in] host Hostname of the origin
+ * \param[in] port Port of the origin
+ * \param[in] alt_svcs Vector of `wget_http_altsvc` as parsed from an Alt-Svc header (see wget_http_response.alt_svcs)
+ * \return WGET_E_SUCCESS on success, else a WGET_E_* error value
+ *
+ * Replace the cached alternatives of [host,port] by \p alt_svcs.
+ * An empty vector (Alt-Svc: clear) removes all alternatives of the origin.
+ *
+ * Alternatives that are announced again keep their broken state.
+ */
+int wget_altsvc_cache_update(wget_altsvc_cache *cache, const char *host, uint16_t port, const wget_vector *alt_svcs)
+{
+	if (!cache || !host)
+		return WGET_E_INVALID;
+
+	struct altsvc_origin *originp, origin = { .host = host, .port = port };
+	wget_vector *alternatives = wget_vector_create(2, NULL);
+	int64_t now = time(NULL);
+
+	wget_thread_mutex_lock(cache->mutex);
+
+	if (!wget_hashmap_get(cache->cache, &origin, &originp))
+		originp = NULL;
+
+	for (int it = 0; it < wget_vector_size(alt_svcs); it++) {
+		const wget_http_altsvc *altsvc = wget_vector_get(alt_svcs, it);
+		const char *alt_host = altsvc->host ? altsvc->host : host;
+		size_t protocol_len = strlen(altsvc->protocol) + 1, host_len = strlen(alt_host) + 1;
+		struct altsvc_entry *entry, *old;
+
+		if (altsvc->maxage <= 0)
+			continue;
+
+		if (!(entry = wget_malloc(sizeof(struct altsvc_entry) + protocol_len + host_len)))
+			continue;
+
+		entry->protocol = memcpy((char *) (entry + 1), altsvc->protocol, protocol_len);
+		entry->host = memcpy((char *) (entry + 1) + protocol_len, alt_host, host_len);
+		entry->port = altsvc->port;
+		entry->expires = altsvc->maxage < INT64_MAX - now ? now + altsvc->maxage : INT64_MAX;
+
+		if (originp && (old = find_entry(originp->alternatives, entry->protocol, entry->host, entry->port))) {
+			entry->broken_until = old->broken_until;
+			entry->broken_count = old->broken_count;
+		} else {
+			entry->broken_until = 0;
+			entry->broken_count = 0;
+		}
+
+		wget_vector_add(alternatives, entry);
+	}
+
+	if (wget_vector_size(alternatives) == 0) {
+		wget_vector_free(&alternatives);
+		if (originp)
+			wget_hashmap_remove(cache->cache, originp);
+	} else if (originp) {
+		wget_vector_free(&originp->alternatives);
+		originp->alternatives = alternatives;
+	} else {
+		size_t hostlen = strlen(host) + 1;
+
+		if (!(originp = wget_malloc(sizeof(struct altsvc_origin) + hostlen))) {
+			wget_thread_mutex_unlock(cache->mutex);
+			wget_vector_free(&alternatives);
+			return WGET_E_MEMORY;
+		}
+
+		originp->host = memcpy((char *) (originp + 1), host, hostlen);
+		originp->port = port;
+		originp->alternatives = alternatives;
+
+		// key and value are the same to make wget_hashmap_get() return the origin
+		wget_hashmap_put(cache->cache, originp, originp);
+	}
+
+	wget_thread_mutex_unlock(cache->mutex);
+
+	return WGET_E_SUCCESS;
+}
+
+/**
+ * \param[in] cache A `wget_altsvc_cache` instance, created by wget_altsvc_cache_init().
+ * \param[in] host Hostname of the origin
+ * \param[in] port Port of the origin
+ * \param[in] protocol ALPN protocol id to look for, e.g. 'h3'
+ * \param[out] alt_host Hostname of the alternative, to be freed by the caller
+ * \param[out] alt_port Port of the alternative
+ * \return WGET_E_SUCCESS if a usable alternative was found, else WGET_E_UNKNOWN
+ *
+ * Look up a fresh alternative for [host,port] that speaks \p protocol and is not marked as broken.
+ */
+int wget_altsvc_cache_get(wget_altsvc_cache *cache, const char *host, uint16_t port, const char *protocol, const char **alt_host, uint16_t *alt_port)
+{
+	if (!cache || !host || !protocol)
+		return WGET_E_UNKNOWN;
+
+	struct altsvc_origin *originp, origin = { .host = host, .port = port };
+	int64_t now = time(NULL);
+	int rc = WGET_E_UNKNOWN;
+
+	wget_thread_mutex_lock(cache->mutex);
+
+	if (wget_hashmap_get(cache->cache, &origin, &originp)) {
+		for (int it = 0; it < wget_vector_size(originp->alternatives); it++) {
+			struct altsvc_entry *entry = wget_vector_get(originp->alternatives, it);
+
+			if (entry->expires > now && entry->broken_until <= now && !strcmp(entry->protocol, protocol)) {
+				debug_printf("Found alternative service %s=%s:%hu for %s:%hu\n", entry->protocol, entry->host, entry->port, host, port);
+				*alt_host = wget_strdup(entry->host);
+				*alt_port = entry->port;
+				rc = WGET_E_SUCCESS;
+				break;
+			}
+		}
+	}
+
+	wget_thread_mutex_unlock(cache->mutex);
+
+	return rc;
+}
+
+/**
+ * \param[in] cache A `wget_altsvc_cache` instance, created by wget_altsvc_cache_init().
+ * \param[in] host Hostname of the origin
+ * \param[in] port Port of the origin
+ * \param[in] protocol ALPN protocol id of the alternative
+ * \param[in] alt_host Hostname of the alternative
+ * \param[in] alt_port Port of the alternative
+ *
+ * Mark an alternative as broken after a failed connection attempt.
+ * It is not returned by wget_altsvc_cache_get() until the backoff time has elapsed.
+ */
+void wget_altsvc_cache_mark_broken(wget_altsvc_cache *cache, const char *host, uint16_t port, const char *protocol, const char *alt_host, uint16_t alt_port)
+{
+	if (!cache || !host || !protocol || !alt_host)
+		return;
+
+	struct altsvc_origin *originp, origin = { .host = host, .port = port };
+	struct altsvc_entry *entry;
+
+	wget_thread_mutex_lock(cache->mutex);
+
+	if (wget_hashmap_get(cache->cache, &origin, &originp)
+		&& (entry = find_entry(originp->alternatives, protocol, alt_host, alt_port)))
+	{
+		unsigned shift = entry->broken_count < 9 ? entry->broken_count : 9;
+
+		entry->broken_count++;
+		entry->broken_until = time(NULL) + ((int64_t) BROKEN_BACKOFF << shift);
+		debug_printf("Alternative service %s=%s:%hu for %s:%hu marked broken for %lld seconds\n",
+			protocol, alt_host, alt_port, host, port, (long long) BROKEN_BACKOFF << shift);
+	}
+
+	wget_thread_mutex_unlock(cache->mutex);
+}
+
+/** @} */
@@ -48,6 +48,13 @@ struct atom_context {
 		*urls;
 };
 
+struct wget_atom_url_parser_st {
+	struct atom_context
+		context;
+	wget_xml_parser
+		*parser;
+};
+
 static void atom_get_url(void *context, int flags, const char *dir, const char *attr, const char *val, size_t len, size_t pos WGET_GCC_UNUSED)
 {
 	struct atom_context *ctx = context;
@@ -122,4 +129,55 @@ void wget_atom_get_urls_inline(const char *atom, wget_vector **urls)
 	*urls = context.urls;
 }
 
+/**
+ * \return A new Atom URL parser or NULL on memory allocation failure
+ *
+ * Creates a parser for Atom feed XML data that arrives in pieces, e.g. while it is being
+ * downloaded. Only the unparsed rest of the data is buffered.
+ *
+ * wget_atom_url_parser_feed() and wget_atom_url_parser_finish() return the URLs found
+ * by that call, the same as wget_atom_get_urls_inline() does for the whole data.
+ * The vector belongs to the parser, it and the pointers into the input stay valid
+ * until the next call.
+ *
+ * Free the parser with wget_atom_url_parser_free().
+ */
+wget_atom_url_parser *wget_atom_url_parser_init(void)
+{
+	wget_atom_url_parser *parser = wget_calloc(1, sizeof(wget_atom_url_parser));
+
+	if (!parser)
+		return NULL;
+
+	if (!(parser->parser = wget_xml_parser_init(atom_get_url, &parser->context, XML_HINT_REMOVE_EMPTY_CONTENT))) {
+		xfree(parser);
+		return NULL;
+	}
+
+	return parser;
+}
+
+void wget_atom_url_parser_feed(wget_atom_url_parser *parser, const char *data, size_t len, wget_vector **urls)
+{
+	wget_vector_clear(parser->context.urls);
+	wget_xml_parser_feed(parser->parser, data, len);
+	*urls = parser->context.urls;
+}
+
+void wget_atom_url_parser_finish(wget_atom_url_parser *parser, wget_vector **urls)
+{
+	wget_vector_clear(parser->context.urls);
+	wget_xml_parser_finish(parser->parser);
+	*urls = parser->context.urls;
+}
+
+void wget_atom_url_parser_free(wget_atom_url_parser **parser)
+{
+	if (parser && *parser) {
+		wget_xml_parser_free(&(*parser)->parser);
+		wget_vector_free(&(*parser)->context.urls);
+		xfree(*parser);
+	}
+}
+
 /**@}*/
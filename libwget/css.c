@@ -23,12 +23,10 @@
  * Changelog
  * 03.07.2012  Tim Ruehsen  created
  *
- * A parser using the flex tokenizer, created with flex tokens from
- *   https://www.w3.org/TR/css3-syntax/
- *
- * TODO:
- *  - since we are just interested in @import ... and url(...), we could use
- *    a simplistic hand-written parser which might be much smaller and faster
+ * A single-pass scanner that only looks for @import, @charset and url(...).
+ * It jumps over everything else, skips comments and strings and resolves
+ * escapes the way the tokenizer from https://www.w3.org/TR/css3-syntax/ does,
+ * without allocating or copying anything.
  */
 
 #include <config.h>
@@ -46,26 +44,232 @@
 #include <wget.h>
 #include "private.h"
 
-#include "css_tokenizer.h"
-
-// see css_tokenizer.c
-typedef void* yyscan_t;
-int yyget_leng(yyscan_t yyscanner);
-char *yyget_text(yyscan_t yyscanner);
-typedef struct yy_buffer_state *YY_BUFFER_STATE;
-int yylex_init(yyscan_t* scanner);
-YY_BUFFER_STATE yy_scan_string(const char * yystr, yyscan_t yyscanner);
-YY_BUFFER_STATE yy_scan_bytes(const char * yystr, int len, yyscan_t yyscanner);
-int yylex(yyscan_t yyscanner);
-int yylex_destroy(yyscan_t yyscanner);
-void *yyalloc(size_t size);
-void *yyrealloc(void *p, size_t size);
-
-void *yyalloc(size_t size) {
-	return wget_malloc(size);
+// characters that may start a comment, a string, an escape, an at-rule or url(
+static const unsigned char css_special[256] = {
+	['/'] = 1, ['"'] = 1, ['\''] = 1, ['\\'] = 1, ['@'] = 1, ['('] = 1,
+};
+
+#define css_isspace(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r' || (c) == '\f')
+#define css_isnewline(c) ((c) == '\n' || (c) == '\r' || (c) == '\f')
+
+// characters that continue an identifier, see 'nmchar' in the CSS grammar
+static inline bool css_isnmchar(unsigned char c)
+{
+	return c_isalnum(c) || c == '_' || c == '-' || c >= 0xA0;
+}
+
+// characters allowed in an unquoted url(...), see 'url' in the CSS grammar
+static inline bool css_isurlchar(unsigned char c)
+{
+	return (c >= '*' && c <= '~') || c == '!' || (c >= '#' && c <= '&') || c >= 0xA0;
+}
+
+static const char *skip_space(const char *p, const char *end)
+{
+	while (p < end && css_isspace(*p))
+		p++;
+
+	return p;
+}
+
+// p points to a backslash, returns the end of the escape or p if there is none
+static const char *skip_escape(const char *p, const char *end)
+{
+	if (p + 1 >= end || css_isnewline(p[1]))
+		return p;
+
+	if (!c_isxdigit(p[1]))
+		return p + 2;
+
+	const char *e = p + 2;
+	for (int n = 1; n < 6 && e < end && c_isxdigit(*e); n++)
+		e++;
+
+	// a single whitespace terminates a hex escape
+	if (e + 1 < end && e[0] == '\r' && e[1] == '\n')
+		e += 2;
+	else if (e < end && css_isspace(*e))
+		e++;
+
+	return e;
+}
+
+/*
+ * p points behind '@', returns the end of the at-keyword.
+ * The name is copied lowercase with escapes resolved, e.g. @\69mport is "import".
+ * It is left empty if it is longer than size - 1 or contains non-ASCII characters.
+ */
+static const char *get_at_keyword(const char *p, const char *end, char *name, size_t size)
+{
+	const char *e;
+	size_t n = 0;
+	bool valid = true;
+
+	while (p < end) {
+		unsigned c = (unsigned char) *p;
+
+		if (c == '\\') {
+			if ((e = skip_escape(p, end)) == p)
+				break;
+
+			if (c_isxdigit(p[1])) {
+				for (c = 0, p++; p < e && c_isxdigit(*p); p++)
+					c = c * 16 + (c_isdigit(*p) ? *p - '0' : c_tolower(*p) - 'a' + 10);
+			} else
+				c = (unsigned char) p[1];
+
+			p = e;
+		} else if (css_isnmchar(c))
+			p++;
+		else
+			break;
+
+		if (c == 0 || c >= 0x80 || n >= size - 1)
+			valid = false;
+		else
+			name[n++] = c_tolower(c);
+	}
+
+	name[valid ? n : 0] = 0;
+
+	return p;
+}
+
+// p points to a quote, returns the end of the string and whether it has been closed
+static const char *skip_string(const char *p, const char *end, bool *closed)
+{
+	char quote = *p++;
+
+	while (p < end) {
+		if (*p == quote) {
+			*closed = true;
+			return p + 1;
+		}
+
+		if (*p == '\\') {
+			if (p + 1 >= end)
+				break;
+
+			if (p[1] == '\r' && p + 2 < end && p[2] == '\n')
+				p += 3; // escaped CRLF
+			else if (css_isnewline(p[1]))
+				p += 2; // escaped newline
+			else
+				p = skip_escape(p, end);
+		} else if (css_isnewline(*p))
+			break; // bad string, ends before the newline
+		else
+			p++;
+	}
+
+	*closed = false;
+	return p < end ? p : end;
+}
+
+// p points behind /*, an unclosed comment extends to the end of input
+static const char *skip_comment(const char *p, const char *end)
+{
+	while ((p = memchr(p, '*', end - p))) {
+		if (++p < end && *p == '/')
+			return p + 1;
+	}
+
+	return end;
 }
-void *yyrealloc(void *p, size_t size) {
-	return wget_realloc(p, size);
+
+// "url" at u must not continue an identifier, number or hash
+static bool is_url_start(const char *buf, const char *u)
+{
+	if (u == buf)
+		return true;
+
+	unsigned char c = u[-1];
+
+	if (c == '-')
+		return u - buf >= 4 && !memcmp(u - 4, "<!--", 4);
+
+	return !css_isnmchar(c) && c != '#';
+}
+
+/*
+ * p points behind url(, returns the end of the url(...) token.
+ * On success *url and *urllen are set to the unquoted URL.
+ * Else the returned pointer is the end of the malformed url(...).
+ */
+static const char *parse_url(const char *p, const char *end, const char **url, size_t *urllen)
+{
+	const char *s, *e, *start = p;
+
+	*url = NULL;
+	p = skip_space(p, end);
+
+	if (p < end && (*p == '"' || *p == '\'')) {
+		bool closed;
+
+		s = p;
+		e = skip_string(p, end, &closed);
+		if (!closed)
+			return e;
+
+		p = skip_space(e, end);
+		if (p < end && *p == ')') {
+			*url = s + 1;
+			*urllen = e - s - 2;
+			return p + 1;
+		}
+
+		return p;
+	}
+
+	// a backslash is a valid URL character as well as the start of an escape,
+	// so follow both ways and remember the longest url(...) that can be closed
+	const char *close = NULL, *last = NULL;
+	unsigned reach = 1; // bit n set: p + n can be reached
+
+	for (s = p;; p++) {
+		if (reach & 1) {
+			e = skip_space(p, end);
+			if (e < end && *e == ')') {
+				last = p;
+				close = e + 1;
+			}
+
+			if (p >= end)
+				break;
+
+			if (css_isurlchar(*p))
+				reach |= 2;
+			if (*p == '\\' && (e = skip_escape(p, end)) != p)
+				reach |= 1U << (e - p);
+		}
+
+		if (!(reach >>= 1))
+			break;
+	}
+
+	// the malformed url(...) only takes a backslash as escape
+	for (p = s; p < end;) {
+		if (*p == '\\') {
+			if ((e = skip_escape(p, end)) == p)
+				break;
+			p = e;
+		} else if (css_isurlchar(*p))
+			p++;
+		else
+			break;
+	}
+	p = skip_space(p, end);
+
+	// the longer one wins, like in a tokenizer
+	if (!close || close < p)
+		return p;
+
+	// an escape may have swallowed a trailing whitespace
+	for (e = last; e > s && c_isspace(e[-1]); e--);
+
+	*url = e > s ? s : start;
+	*urllen = e - s;
+	return close;
 }
 
 void wget_css_parse_buffer(
@@ -75,87 +279,88 @@ void wget_css_parse_buffer(
 	wget_css_parse_encoding_callback *callback_encoding,
 	void *user_ctx)
 {
-	int token;
-	size_t length, pos = 0;
-	char *text;
-	yyscan_t scanner;
-
-	yylex_init(&scanner);
-	yy_scan_bytes(buf, (int) len, scanner);
-
-	while ((token = yylex(scanner)) != CSSEOF) {
-		if (token == IMPORT_SYM) {
-			// e.g. @import "https://example.com/index.html"
-			pos += yyget_leng(scanner);
-
-			// skip whitespace before URI/STRING
-			while ((token = yylex(scanner)) == S)
-				pos += yyget_leng(scanner);
-
-			// now token should be STRING or URI
-			if (token == STRING)
-				token = URI;
-		}
+	const char *p = buf, *end = buf + len, *mark, *url, *escaped = NULL;
+	size_t urllen;
+	char name[8];
+	bool closed;
 
-		if (token == URI && callback_uri) {
-			// e.g. url(https://example.com/index.html)
-			text = yyget_text(scanner);
-			length = yyget_leng(scanner);
+	while (p < end) {
+		// 'mark' is where the plain text starts, nothing before it may form url(
+		for (mark = p; p < end && !css_special[(unsigned char) *p]; p++);
 
-			if (*text == '\'' || *text == '\"') {
-				// a string - remove the quotes
-				callback_uri(user_ctx, text + 1, length - 2, pos + 1);
-			} else {
-				// extract URI from url(...)
-				if (!wget_strncasecmp_ascii(text, "url(", 4)) {
-					char *otext = text;
+		if (p >= end)
+			break;
 
-					// remove trailing ) and any spaces before
-					for (length--; c_isspace(text[length - 1]); length--);
+		switch (*p) {
+		case '/':
+			if (p + 1 < end && p[1] == '*')
+				p = skip_comment(p + 2, end);
+			else
+				p++;
+			break;
 
-					// remove leading url( and any spaces after
-					for (length -= 4, text += 4; length && c_isspace(*text); text++, length--);
+		case '"':
+		case '\'':
+			p = skip_string(p, end, &closed);
+			break;
 
-					// remove quotes
-					if (length && (*text == '\'' || *text == '\"')) {
-						text++;
-						length--;
-					}
+		case '\\':
+			// an escape starts or continues an identifier
+			if ((escaped = skip_escape(p, end)) == p)
+				p++;
+			else
+				p = escaped;
+			break;
 
-					if (length && (text[length - 1] == '\'' || text[length - 1] == '\"'))
-						length--;
+		case '(':
+			if (p - mark >= 3 && p - 3 != escaped && !wget_strncasecmp_ascii(p - 3, "url", 3) && is_url_start(buf, p - 3)) {
+				p = parse_url(p + 1, end, &url, &urllen);
+				if (url && callback_uri)
+					callback_uri(user_ctx, url, urllen, url - buf);
+			} else
+				p++;
+			break;
 
-					callback_uri(user_ctx, text, length, pos + (text - otext));
-				}
+		case '@':
+			if (end - p >= 9 && !wget_strncasecmp_ascii(p + 1, "charset ", 8)) {
+				// e.g. @charset "UTF-8", only these exact bytes select the encoding, see
+				// https://www.w3.org/TR/css-syntax-3/#determine-the-fallback-encoding
+				p = skip_space(p + 9, end);
+
+				if (p < end && (*p == '"' || *p == '\'')) {
+					const char *s = p;
+
+					p = skip_string(p, end, &closed);
+					if (closed && callback_encoding)
+						callback_encoding(user_ctx, s + 1, p - s - 2);
+					else if (callback_encoding)
+						error_printf(_("Unterminated string after @charset\n"));
+				} else if (callback_encoding)
+					error_printf(_("Missing string after @charset\n"));
+				break;
 			}
-		} else if (token == CHARSET_SYM && callback_encoding) {
-			// e.g. @charset "UTF-8"
-			pos += yyget_leng(scanner);
-
-			// skip whitespace before charset name
-			while ((token = yylex(scanner)) == S)
-				pos += yyget_leng(scanner);
-
-			// now token should be STRING
-			if (token == STRING) {
-				text = yyget_text(scanner);
-				length = yyget_leng(scanner);
-
-				if (*text == '\'' || *text == '\"') {
-					// a string - remove the quotes
-					callback_encoding(user_ctx, text + 1, length - 2);
-				} else {
-					// a string without quotes
-					callback_encoding(user_ctx, text, length);
+
+			p = get_at_keyword(p + 1, end, name, sizeof(name));
+
+			if (!strcmp(name, "import")) {
+				// e.g. @import "https://example.com/index.html"
+				p = skip_space(p, end);
+
+				if (p < end && (*p == '"' || *p == '\'')) {
+					const char *s = p;
+
+					p = skip_string(p, end, &closed);
+					if (closed && callback_uri)
+						callback_uri(user_ctx, s + 1, p - s - 2, s + 1 - buf);
+				} else if (end - p >= 4 && !wget_strncasecmp_ascii(p, "url(", 4)) {
+					p = parse_url(p + 4, end, &url, &urllen);
+					if (url && callback_uri)
+						callback_uri(user_ctx, url, urllen, url - buf);
 				}
-			} else {
-				error_printf(_("Unknown token after @charset: %d\n"), token);
 			}
+			break;
 		}
-		pos += yyget_leng(scanner);
 	}
-
-	yylex_destroy(scanner);
 }
 
 void wget_css_parse_file(
@@ -194,7 +399,6 @@ void wget_css_parse_file(
 			error_printf(_("Failed to open %s\n"), fname);
 	} else {
 		// read data from STDIN.
-		// maybe should use yy_scan_bytes instead of buffering into memory.
 		char tmp[4096];
 		ssize_t nbytes;
 		wget_buffer buf;
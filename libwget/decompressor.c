@@ -26,6 +26,11 @@
  * 02.01.2014  Tim Ruehsen  added BZIP2 decompression
  * 24.02.2017  Tim Ruehsen  added Brotli decompression
  *
+ * The decoders write into a large output buffer that is taken from a pool,
+ * so that the sink is called with big slices instead of many small ones.
+ * Optionally, decoding runs in a small pool of worker threads (see wget_decompress_set_offload()),
+ * so that the receiving thread keeps draining the socket.
+ *
  * References
  *   https://en.wikipedia.org/wiki/HTTP_compression
  *   https://wiki.mozilla.org/LZMA2_Compression
@@ -66,9 +71,24 @@
 #include <wget.h>
 #include "private.h"
 
+#define OUTPUT_BUFSIZE (128 * 1024) // size of the pooled output buffers
+#define OUTPUT_POOL_MAX 16 // max. number of unused output buffers kept in the pool
+#define OFFLOAD_MAX_QUEUED (4 * 1024 * 1024) // max. number of input bytes queued per decompressor
+#define OFFLOAD_MAX_WORKERS 4 // max. number of worker threads, shared by all decompressors
+
 typedef int wget_decompressor_decompress_fn(wget_decompressor *dc, const char *src, size_t srclen);
 typedef void wget_decompressor_exit_fn(wget_decompressor *dc);
 
+// input data queued for the worker thread
+struct input_chunk {
+	struct input_chunk
+		*next;
+	size_t
+		length;
+	char
+		data[];
+};
+
 struct wget_decompressor_st {
 #ifdef WITH_ZLIB
 	z_stream
@@ -105,10 +125,144 @@ struct wget_decompressor_st {
 		*exit;
 	void
 		*context; // given to sink()
+	char
+		*out; // pooled output buffer
+	size_t
+		out_len; // number of decompressed bytes in out
 	wget_content_encoding
 		encoding;
+
+	// offload mode, protected by offload_mutex
+	wget_thread_cond
+		cond; // signals free queue space and the end of work to the producer
+	struct input_chunk
+		*head,
+		*tail;
+	wget_decompressor
+		*next_ready; // next decompressor in the ready list
+	size_t
+		queued; // number of input bytes waiting for a worker
+	bool
+		offload,
+		busy; // in the ready list or being decompressed, not a bit field as the workers write it
 };
 
+static char
+	*output_pool[OUTPUT_POOL_MAX];
+static int
+	output_pool_size;
+static wget_thread_mutex
+	output_pool_mutex;
+
+// worker pool for offload mode
+static wget_thread
+	offload_workers[OFFLOAD_MAX_WORKERS];
+static int
+	offload_nworkers,
+	offload_idle;
+static wget_decompressor
+	*offload_ready_head, // decompressors with queued input, served round robin
+	*offload_ready_tail;
+static wget_thread_mutex
+	offload_mutex;
+static wget_thread_cond
+	offload_cond; // signals ready decompressors and shutdown to the workers
+static bool
+	offload_shutdown,
+	initialized;
+
+static void __attribute__ ((constructor)) decompressor_init(void)
+{
+	if (!initialized) {
+		wget_thread_mutex_init(&output_pool_mutex);
+		wget_thread_mutex_init(&offload_mutex);
+		wget_thread_cond_init(&offload_cond);
+		initialized = 1;
+	}
+}
+
+static void __attribute__ ((destructor)) decompressor_exit(void)
+{
+	// running workers are stopped by wget_decompress_exit()
+	if (initialized && !offload_nworkers) {
+		while (output_pool_size > 0) {
+			output_pool_size--;
+			xfree(output_pool[output_pool_size]);
+		}
+		wget_thread_cond_destroy(&offload_cond);
+		wget_thread_mutex_destroy(&offload_mutex);
+		wget_thread_mutex_destroy(&output_pool_mutex);
+		initialized = 0;
+	}
+}
+
+/**
+ * Decompression initialization, allocating/preparing the internal resources.
+ *
+ * On systems with automatic library constructors, this function
+ * doesn't have to be called explicitly.
+ *
+ * This function is not thread-safe.
+ */
+void wget_decompress_init(void)
+{
+	decompressor_init();
+}
+
+static void offload_stop_workers(void);
+
+/**
+ * Decompression deinitialization, stopping the worker threads and free'ing all internal resources.
+ *
+ * All decompressors have to be closed before.
+ *
+ * This function is not thread-safe.
+ */
+void wget_decompress_exit(void)
+{
+	if (initialized)
+		offload_stop_workers();
+
+	decompressor_exit();
+}
+
+static char *output_buffer_get(void)
+{
+	char *buf = NULL;
+
+	wget_thread_mutex_lock(output_pool_mutex);
+	if (output_pool_size > 0)
+		buf = output_pool[--output_pool_size];
+	wget_thread_mutex_unlock(output_pool_mutex);
+
+	return buf ? buf : wget_malloc(OUTPUT_BUFSIZE);
+}
+
+static void output_buffer_put(char *buf)
+{
+	if (!buf)
+		return;
+
+	wget_thread_mutex_lock(output_pool_mutex);
+	if (output_pool_size < OUTPUT_POOL_MAX) {
+		output_pool[output_pool_size++] = buf;
+		buf = NULL;
+	}
+	wget_thread_mutex_unlock(output_pool_mutex);
+
+	xfree(buf);
+}
+
+// hand the decompressed data to the sink
+static void flush_output(wget_decompressor *dc)
+{
+	if (dc->out_len) {
+		if (dc->sink)
+			dc->sink(dc->context, dc->out, dc->out_len);
+		dc->out_len = 0;
+	}
+}
+
 #ifdef WITH_ZLIB
 static int gzip_init(z_stream *strm)
 {
@@ -127,8 +281,8 @@ static int gzip_init(z_stream *strm)
 static int gzip_decompress(wget_decompressor *dc, const char *src, size_t srclen)
 {
 	z_stream *strm;
-	char dst[10240];
 	int status;
+	bool full;
 
 	if (!srclen) {
 		// special case to avoid decompress errors
@@ -143,17 +297,18 @@ static int gzip_decompress(wget_decompressor *dc, const char *src, size_t srclen
 	strm->avail_in = (unsigned int) srclen;
 
 	do {
-		strm->next_out = (unsigned char *) dst;
-		strm->avail_out = sizeof(dst);
+		strm->next_out = (unsigned char *) dc->out + dc->out_len;
+		strm->avail_out = (unsigned int) (OUTPUT_BUFSIZE - dc->out_len);
 
 		status = inflate(strm, Z_SYNC_FLUSH);
-		if ((status == Z_OK || status == Z_STREAM_END) && strm->avail_out < sizeof(dst)) {
-			if (dc->sink)
-				dc->sink(dc->context, dst, sizeof(dst) - strm->avail_out);
-		}
-	} while (status == Z_OK && !strm->avail_out);
-
-	if (status == Z_OK || status == Z_STREAM_END)
+		if (status == Z_OK || status == Z_STREAM_END)
+			dc->out_len = OUTPUT_BUFSIZE - strm->avail_out;
+		if ((full = !strm->avail_out))
+			flush_output(dc);
+	} while (status == Z_OK && full);
+
+	// no progress possible: all input consumed exactly when the output buffer was full
+	if (status == Z_OK || status == Z_STREAM_END || (status == Z_BUF_ERROR && !strm->avail_in))
 		return 0;
 
 	error_printf(_("Failed to uncompress gzip stream (%d)\n"), status);
@@ -199,8 +354,8 @@ static int lzma_init(lzma_stream *strm)
 static int lzma_decompress(wget_decompressor *dc, const char *src, size_t srclen)
 {
 	lzma_stream *strm;
-	char dst[10240];
 	int status;
+	bool full;
 
 	if (!srclen) {
 		// special case to avoid decompress errors
@@ -215,17 +370,17 @@ static int lzma_decompress(wget_decompressor *dc, const char *src, size_t srclen
 	strm->avail_in = srclen;
 
 	do {
-		strm->next_out = (unsigned char *) dst;
-		strm->avail_out = sizeof(dst);
+		strm->next_out = (unsigned char *) dc->out + dc->out_len;
+		strm->avail_out = OUTPUT_BUFSIZE - dc->out_len;
 
 		status = lzma_code(strm, LZMA_RUN);
-		if ((status == LZMA_OK || status == LZMA_STREAM_END) && strm->avail_out<sizeof(dst)) {
-			if (dc->sink)
-				dc->sink(dc->context, dst, sizeof(dst) - strm->avail_out);
-		}
-	} while (status == LZMA_OK && !strm->avail_out);
+		if (status == LZMA_OK || status == LZMA_STREAM_END)
+			dc->out_len = OUTPUT_BUFSIZE - strm->avail_out;
+		if ((full = !strm->avail_out))
+			flush_output(dc);
+	} while (status == LZMA_OK && full);
 
-	if (status == LZMA_OK || status == LZMA_STREAM_END)
+	if (status == LZMA_OK || status == LZMA_STREAM_END || (status == LZMA_BUF_ERROR && !strm->avail_in))
 		return 0;
 
 	error_printf(_("Failed to uncompress LZMA stream (%d)\n"), status);
@@ -253,7 +408,6 @@ static int brotli_decompress(wget_decompressor *dc, const char *src, size_t srcl
 {
 	BrotliDecoderState *strm;
 	BrotliDecoderResult status;
-	uint8_t dst[10240];
 	size_t available_in, available_out;
 	const uint8_t *next_in;
 	uint8_t *next_out;
@@ -271,14 +425,13 @@ static int brotli_decompress(wget_decompressor *dc, const char *src, size_t srcl
 	available_in = srclen;
 
 	do {
-		next_out = (unsigned char *)dst;
-		available_out = sizeof(dst);
+		next_out = (uint8_t *) dc->out + dc->out_len;
+		available_out = OUTPUT_BUFSIZE - dc->out_len;
 
 		status = BrotliDecoderDecompressStream(strm, &available_in, &next_in, &available_out, &next_out, NULL);
-		if (available_out != sizeof(dst)) {
-			if (dc->sink)
-				dc->sink(dc->context, (char *)dst, sizeof(dst) - available_out);
-		}
+		dc->out_len = OUTPUT_BUFSIZE - available_out;
+		if (!available_out)
+			flush_output(dc);
 	} while (status == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT);
 
 	if (status == BROTLI_DECODER_RESULT_SUCCESS || status == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT)
@@ -318,7 +471,7 @@ static int zstd_init(ZSTD_DStream **strm)
 static int zstd_decompress(wget_decompressor *dc, const char *src, size_t srclen)
 {
 	ZSTD_DStream *strm;
-	uint8_t dst[10240];
+	bool full = false;
 
 	if (!srclen) {
 		// special case to avoid decompress errors
@@ -332,8 +485,9 @@ static int zstd_decompress(wget_decompressor *dc, const char *src, size_t srclen
 
 	ZSTD_inBuffer input = { .src = src, .size = srclen, .pos = 0 };
 
-	while (input.pos < input.size) {
-		ZSTD_outBuffer output = { .dst = dst, .size = sizeof(dst), .pos = 0 };
+	// a full output buffer means the decoder might hold back more data
+	while (input.pos < input.size || full) {
+		ZSTD_outBuffer output = { .dst = dc->out, .size = OUTPUT_BUFSIZE, .pos = dc->out_len };
 
 		size_t rc = ZSTD_decompressStream(strm, &output , &input);
 		if (ZSTD_isError(rc)) {
@@ -341,8 +495,9 @@ static int zstd_decompress(wget_decompressor *dc, const char *src, size_t srclen
 			return -1;
 		}
 
-		if (output.pos && dc->sink)
-			dc->sink(dc->context, (char *)dst, output.pos);
+		dc->out_len = output.pos;
+		if ((full = output.pos == output.size))
+			flush_output(dc);
 	}
 
 	return 0;
@@ -376,13 +531,12 @@ static int lzip_init(struct LZ_Decoder **strm)
 static int lzip_drain(wget_decompressor *dc)
 {
 	struct LZ_Decoder *strm = dc->lzip_strm;
-	uint8_t dst[10240];
 	int rbytes;
 	enum LZ_Errno err;
 
-	while ((rbytes = LZ_decompress_read(strm, dst, sizeof(dst))) > 0) {
-		if (dc->sink)
-			dc->sink(dc->context, (char *) dst, rbytes);
+	while ((rbytes = LZ_decompress_read(strm, (uint8_t *) dc->out + dc->out_len, (int) (OUTPUT_BUFSIZE - dc->out_len))) > 0) {
+		if ((dc->out_len += rbytes) == OUTPUT_BUFSIZE)
+			flush_output(dc);
 	}
 
 	if ((err = LZ_decompress_errno(strm)) != LZ_ok) {
@@ -451,8 +605,8 @@ static int bzip2_init(bz_stream *strm)
 static int bzip2_decompress(wget_decompressor *dc, const char *src, size_t srclen)
 {
 	bz_stream *strm;
-	char dst[10240];
 	int status;
+	bool full;
 
 	if (!srclen) {
 		// special case to avoid decompress errors
@@ -467,15 +621,15 @@ static int bzip2_decompress(wget_decompressor *dc, const char *src, size_t srcle
 	strm->avail_in = (unsigned int) srclen;
 
 	do {
-		strm->next_out = dst;
-		strm->avail_out = sizeof(dst);
+		strm->next_out = dc->out + dc->out_len;
+		strm->avail_out = (unsigned int) (OUTPUT_BUFSIZE - dc->out_len);
 
 		status = BZ2_bzDecompress(strm);
-		if ((status == BZ_OK || status == BZ_STREAM_END) && strm->avail_out<sizeof(dst)) {
-			if (dc->sink)
-				dc->sink(dc->context, dst, sizeof(dst) - strm->avail_out);
-		}
-	} while (status == BZ_OK && !strm->avail_out);
+		if (status == BZ_OK || status == BZ_STREAM_END)
+			dc->out_len = OUTPUT_BUFSIZE - strm->avail_out;
+		if ((full = !strm->avail_out))
+			flush_output(dc);
+	} while (status == BZ_OK && full);
 
 	if (status == BZ_OK || status == BZ_STREAM_END)
 		return 0;
@@ -567,6 +721,11 @@ wget_decompressor *wget_decompress_open(
 		dc->decompress = identity;
 	}
 
+	if (!rc && dc->decompress != identity && !(dc->out = output_buffer_get())) {
+		dc->exit(dc);
+		rc = -1;
+	}
+
 	if (rc) {
 		xfree(dc);
 		return NULL;
@@ -578,24 +737,220 @@ wget_decompressor *wget_decompress_open(
 	return dc;
 }
 
+static void decompress_data(wget_decompressor *dc, const char *src, size_t srclen)
+{
+	int rc = dc->decompress(dc, src, srclen);
+
+	flush_output(dc);
+
+	if (rc && dc->error_handler)
+		dc->error_handler(dc, rc);
+}
+
+// called with offload_mutex held
+static void offload_ready_add(wget_decompressor *dc)
+{
+	dc->next_ready = NULL;
+	if (offload_ready_tail)
+		offload_ready_tail->next_ready = dc;
+	else
+		offload_ready_head = dc;
+	offload_ready_tail = dc;
+}
+
+static void *decompress_worker(void *p WGET_GCC_UNUSED)
+{
+	wget_decompressor *dc;
+	struct input_chunk *chunk;
+
+	wget_thread_mutex_lock(offload_mutex);
+
+	for (;;) {
+		while (!offload_ready_head && !offload_shutdown) {
+			offload_idle++;
+			wget_thread_cond_wait(offload_cond, offload_mutex, 0);
+			offload_idle--;
+		}
+
+		if (!(dc = offload_ready_head))
+			break; // shutdown and nothing left to do
+
+		if (!(offload_ready_head = dc->next_ready))
+			offload_ready_tail = NULL;
+
+		chunk = dc->head;
+		if (!(dc->head = chunk->next))
+			dc->tail = NULL;
+
+		// dc stays busy, so no other worker decompresses it meanwhile
+		wget_thread_mutex_unlock(offload_mutex);
+		decompress_data(dc, chunk->data, chunk->length);
+		wget_thread_mutex_lock(offload_mutex);
+
+		dc->queued -= chunk->length;
+		xfree(chunk);
+
+		// one chunk at a time, so that all decompressors make progress
+		if (dc->head)
+			offload_ready_add(dc);
+		else
+			dc->busy = 0;
+
+		// the producer might wait for queue space or for the end of work
+		wget_thread_cond_signal(dc->cond);
+	}
+
+	wget_thread_mutex_unlock(offload_mutex);
+
+	return NULL;
+}
+
+// called with offload_mutex held, returns whether at least one worker is running
+static bool offload_start_worker(void)
+{
+	if (!offload_idle && offload_nworkers < OFFLOAD_MAX_WORKERS) {
+		if (wget_thread_start(&offload_workers[offload_nworkers], decompress_worker, NULL, 0) == 0)
+			offload_nworkers++;
+		else
+			debug_printf("Failed to start decompression worker\n");
+	}
+
+	return offload_nworkers > 0;
+}
+
+static void offload_stop_workers(void)
+{
+	wget_thread_mutex_lock(offload_mutex);
+	offload_shutdown = 1;
+	wget_thread_cond_signal(offload_cond);
+	wget_thread_mutex_unlock(offload_mutex);
+
+	for (int it = 0; it < offload_nworkers; it++)
+		wget_thread_join(&offload_workers[it]);
+
+	offload_nworkers = 0;
+	offload_shutdown = 0;
+}
+
+/**
+ * \param[in] dc Decompressor, created by wget_decompress_open()
+ * \param[in] offload Whether to decompress in a worker thread
+ * \return WGET_E_SUCCESS on success, else a WGET_E_* error value
+ *
+ * In offload mode, wget_decompress() just queues a copy of the input and returns,
+ * while one of a few worker threads, shared by all decompressors, decompresses and calls the sink.
+ * The sink of \p dc is never called by two threads at the same time.
+ * If more than a few MB are waiting, wget_decompress() blocks until the workers catch up.
+ * wget_decompress_close() waits until all queued data has been decompressed.
+ *
+ * Must be called before the first call to wget_decompress().
+ * Data without Content-Encoding is never offloaded, there is nothing to gain.
+ */
+int wget_decompress_set_offload(wget_decompressor *dc, bool offload)
+{
+	bool started;
+
+	if (!dc)
+		return WGET_E_INVALID;
+
+	if (!offload || dc->offload || dc->decompress == identity)
+		return WGET_E_SUCCESS;
+
+	if (!wget_thread_support())
+		return WGET_E_UNSUPPORTED;
+
+	if (wget_thread_cond_init(&dc->cond))
+		return WGET_E_UNKNOWN;
+
+	wget_thread_mutex_lock(offload_mutex);
+	started = offload_start_worker();
+	wget_thread_mutex_unlock(offload_mutex);
+
+	if (!started) {
+		wget_thread_cond_destroy(&dc->cond);
+		return WGET_E_UNKNOWN;
+	}
+
+	dc->offload = 1;
+
+	return WGET_E_SUCCESS;
+}
+
 void wget_decompress_close(wget_decompressor *dc)
 {
 	if (dc) {
+		if (dc->offload) {
+			wget_thread_mutex_lock(offload_mutex);
+			while (dc->busy)
+				wget_thread_cond_wait(dc->cond, offload_mutex, 0);
+			wget_thread_mutex_unlock(offload_mutex);
+
+			wget_thread_cond_destroy(&dc->cond);
+		}
+
 		if (dc->exit)
 			dc->exit(dc);
+		flush_output(dc);
+		output_buffer_put(dc->out);
 		xfree(dc);
 	}
 }
 
 int wget_decompress(wget_decompressor *dc, const char *src, size_t srclen)
 {
-	if (dc) {
-		int rc = dc->decompress(dc, src, srclen);
+	if (!dc)
+		return 0;
+
+	if (dc->offload) {
+		struct input_chunk *chunk = wget_malloc(sizeof(struct input_chunk) + srclen);
+
+		if (chunk) {
+			chunk->next = NULL;
+			chunk->length = srclen;
+			memcpy(chunk->data, src, srclen);
+
+			wget_thread_mutex_lock(offload_mutex);
+
+			while (dc->queued >= OFFLOAD_MAX_QUEUED)
+				wget_thread_cond_wait(dc->cond, offload_mutex, 0);
+
+			if (dc->tail)
+				dc->tail->next = chunk;
+			else
+				dc->head = chunk;
+			dc->tail = chunk;
+			dc->queued += srclen;
+
+			if (!dc->busy) {
+				dc->busy = 1;
+				offload_ready_add(dc);
+				offload_start_worker();
+				wget_thread_cond_signal(offload_cond);
+			}
+
+			wget_thread_mutex_unlock(offload_mutex);
 
-		if (rc && dc->error_handler)
-			dc->error_handler(dc, rc);
+			return 0;
+		}
+
+		// out of memory: wait until the workers are done with dc and decompress here
+		wget_thread_mutex_lock(offload_mutex);
+		while (dc->busy)
+			wget_thread_cond_wait(dc->cond, offload_mutex, 0);
+		dc->busy = 1;
+		wget_thread_mutex_unlock(offload_mutex);
+
+		decompress_data(dc, src, srclen);
+
+		wget_thread_mutex_lock(offload_mutex);
+		dc->busy = 0;
+		wget_thread_mutex_unlock(offload_mutex);
+
+		return 0;
 	}
 
+	decompress_data(dc, src, srclen);
+
 	return 0;
 }
 
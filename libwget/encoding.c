@@ -61,56 +61,382 @@ const char *wget_local_charset_encoding(void)
 	return wget_strdup("ASCII");
 }
 
+// charsets converted to UTF-8 without iconv()
+enum {
+	CHARSET_OTHER,
+	CHARSET_ASCII,
+	CHARSET_LATIN1,
+	CHARSET_CP1252,
+	CHARSET_UTF8
+};
+
+static const struct {
+	const char *
+		name;
+	int
+		id;
+} charsets[] = {
+	{ "utf-8", CHARSET_UTF8 },
+	{ "utf8", CHARSET_UTF8 },
+	{ "iso-8859-1", CHARSET_LATIN1 },
+	{ "iso8859-1", CHARSET_LATIN1 },
+	{ "iso_8859-1", CHARSET_LATIN1 },
+	{ "latin1", CHARSET_LATIN1 },
+	{ "l1", CHARSET_LATIN1 },
+	{ "windows-1252", CHARSET_CP1252 },
+	{ "cp1252", CHARSET_CP1252 },
+	{ "us-ascii", CHARSET_ASCII },
+	{ "ascii", CHARSET_ASCII },
+	{ "ansi_x3.4-1968", CHARSET_ASCII },
+};
+
+// Unicode code points of CP1252 0x80-0x9F, 0 where the charset leaves the byte undefined
+static const unsigned short cp1252[32] = {
+	0x20AC, 0, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+	0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017D, 0,
+	0, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0, 0x017E, 0x0178
+};
+
+static int charset_id(const char *encoding)
+{
+	for (unsigned it = 0; it < countof(charsets); it++) {
+		if (!wget_strcasecmp_ascii(encoding, charsets[it].name))
+			return charsets[it].id;
+	}
+
+	return CHARSET_OTHER;
+}
+
+// returns the length of the leading run of 7-bit characters within s[0..len)
+static size_t ascii_length(const char *s, size_t len)
+{
+	size_t n = 0;
+
+	// check 16 bytes at once, memcpy() compiles into unaligned loads
+	for (; n + 16 <= len; n += 16) {
+		uint64_t a, b;
+
+		memcpy(&a, s + n, 8);
+		memcpy(&b, s + n + 8, 8);
+		if ((a | b) & 0x8080808080808080ULL)
+			break;
+	}
+
+	while (n < len && !(s[n] & 0x80))
+		n++;
+
+	return n;
+}
+
+// returns WGET_E_UNKNOWN if 'src' contains a byte undefined in 'charset', iconv() reports that
+static int to_utf8(int charset, const char *src, size_t srclen, char **out, size_t *outlen)
+{
+	const unsigned char *s, *end = (const unsigned char *) src + srclen;
+	size_t ascii = ascii_length(src, srclen), len = srclen;
+	unsigned char *dst, *d;
+	unsigned c;
+
+	// calculate the output length
+	for (s = (const unsigned char *) src + ascii; s < end; s++) {
+		if (*s < 0x80)
+			continue;
+		if (charset == CHARSET_ASCII)
+			return WGET_E_UNKNOWN;
+		if (charset == CHARSET_CP1252 && *s < 0xA0) {
+			if (!(c = cp1252[*s - 0x80]))
+				return WGET_E_UNKNOWN;
+			len += c >= 0x800 ? 2 : 1;
+		} else
+			len++;
+	}
+
+	if (outlen)
+		*outlen = len;
+
+	if (!out)
+		return WGET_E_SUCCESS;
+
+	if (!(*out = wget_malloc(len + 1)))
+		return WGET_E_MEMORY;
+
+	memcpy(*out, src, ascii);
+
+	for (s = (const unsigned char *) src + ascii, d = dst = (unsigned char *) *out + ascii; s < end; s++) {
+		if ((c = *s) < 0x80) {
+			*d++ = c;
+			continue;
+		}
+
+		if (charset == CHARSET_CP1252 && c < 0xA0)
+			c = cp1252[c - 0x80];
+
+		if (c < 0x800) {
+			*d++ = 0xC0 | (c >> 6);
+		} else {
+			*d++ = 0xE0 | (c >> 12);
+			*d++ = 0x80 | ((c >> 6) & 0x3F);
+		}
+		*d++ = 0x80 | (c & 0x3F);
+	}
+	*d = 0;
+
+	return WGET_E_SUCCESS;
+}
+
+#ifdef HAVE_ICONV
+/* \cond _hide_internal_symbols */
+#define ICONV_POOL_MAX 16
+/* \endcond */
+
+typedef struct {
+	char
+		*src_encoding,
+		*dst_encoding;
+	iconv_t
+		cd;
+} iconv_entry;
+
+// iconv_open() loads conversion tables, idle descriptors are kept for reuse
+static iconv_entry
+	iconv_pool[ICONV_POOL_MAX]; // least recently used first
+static int
+	iconv_pool_size;
+static wget_thread_mutex
+	iconv_pool_mutex;
+
+static void iconv_entry_close(iconv_entry *e)
+{
+	iconv_close(e->cd);
+	xfree(e->src_encoding);
+	xfree(e->dst_encoding);
+}
+#endif
+
+#if defined WITH_LIBIDN2 || defined WITH_LIBIDN
+/* \cond _hide_internal_symbols */
+#define IDN_CACHE_MAX 1024
+/* \endcond */
+
+// result of a hostname conversion, failed conversions are kept with their error code
+typedef struct {
+	int
+		rc;
+	char
+		ascii[];
+} idn_entry;
+
+// crawls see the same few IDN hostnames over and over again
+static wget_stringmap
+	*idn_cache; // Unicode hostname -> idn_entry
+static wget_thread_mutex
+	idn_cache_mutex;
+#endif
+
+static bool
+	initialized;
+
+static void __attribute__ ((constructor)) encoding_init(void)
+{
+	if (!initialized) {
+#ifdef HAVE_ICONV
+		wget_thread_mutex_init(&iconv_pool_mutex);
+#endif
+#if defined WITH_LIBIDN2 || defined WITH_LIBIDN
+		wget_thread_mutex_init(&idn_cache_mutex);
+#endif
+		initialized = 1;
+	}
+}
+
+static void __attribute__ ((destructor)) encoding_exit(void)
+{
+	if (initialized) {
+#ifdef HAVE_ICONV
+		while (iconv_pool_size > 0)
+			iconv_entry_close(&iconv_pool[--iconv_pool_size]);
+		wget_thread_mutex_destroy(&iconv_pool_mutex);
+#endif
+#if defined WITH_LIBIDN2 || defined WITH_LIBIDN
+		wget_stringmap_free(&idn_cache);
+		wget_thread_mutex_destroy(&idn_cache_mutex);
+#endif
+		initialized = 0;
+	}
+}
+
+/**
+ * Encoding API initialization, preparing the iconv descriptor pool and the IDN cache.
+ *
+ * On systems with automatic library constructors, this function
+ * doesn't have to be called explicitly.
+ *
+ * This function is not thread-safe.
+ */
+void wget_encoding_init(void)
+{
+	encoding_init();
+}
+
+/**
+ * Encoding API deinitialization, closing pooled iconv descriptors and freeing the IDN cache.
+ *
+ * On systems with automatic library destructors, this function
+ * doesn't have to be called explicitly.
+ *
+ * This function is not thread-safe.
+ */
+void wget_encoding_exit(void)
+{
+	encoding_exit();
+}
+
+#ifdef HAVE_ICONV
+// takes an idle descriptor out of the pool or opens a new one, a descriptor is used by one thread at a time
+static bool iconv_get(iconv_entry *e, const char *src_encoding, const char *dst_encoding)
+{
+	wget_thread_mutex_lock(iconv_pool_mutex);
+	for (int it = iconv_pool_size - 1; it >= 0; it--) {
+		if (!wget_strcasecmp_ascii(iconv_pool[it].src_encoding, src_encoding)
+			&& !wget_strcasecmp_ascii(iconv_pool[it].dst_encoding, dst_encoding))
+		{
+			*e = iconv_pool[it];
+			iconv_pool_size--;
+			memmove(&iconv_pool[it], &iconv_pool[it + 1], (iconv_pool_size - it) * sizeof(iconv_entry));
+			wget_thread_mutex_unlock(iconv_pool_mutex);
+			return true;
+		}
+	}
+	wget_thread_mutex_unlock(iconv_pool_mutex);
+
+	if ((e->cd = iconv_open(dst_encoding, src_encoding)) == (iconv_t)-1)
+		return false;
+
+	e->src_encoding = wget_strdup(src_encoding);
+	e->dst_encoding = wget_strdup(dst_encoding);
+
+	return true;
+}
+
+// returns the descriptor into the pool, the least recently used one is closed if the pool is full
+static void iconv_put(iconv_entry *e)
+{
+	iconv_entry lru;
+	bool evict = false;
+
+	if (!e->src_encoding || !e->dst_encoding) {
+		iconv_entry_close(e);
+		return;
+	}
+
+	iconv(e->cd, NULL, NULL, NULL, NULL); // back to the initial shift state
+
+	wget_thread_mutex_lock(iconv_pool_mutex);
+	if (iconv_pool_size == ICONV_POOL_MAX) {
+		lru = iconv_pool[0];
+		evict = true;
+		memmove(&iconv_pool[0], &iconv_pool[1], --iconv_pool_size * sizeof(iconv_entry));
+	}
+	iconv_pool[iconv_pool_size++] = *e;
+	wget_thread_mutex_unlock(iconv_pool_mutex);
+
+	if (evict)
+		iconv_entry_close(&lru);
+}
+
+// converts with iconv(), the output buffer grows as needed
+static int iconv_convert(iconv_t cd, const char *src, size_t srclen, char **out, size_t *outlen)
+{
+	char *tmp = (char *) src; // iconv won't change where src points to, but changes tmp itself
+	size_t tmp_len = srclen;
+	size_t dst_size = srclen * 2 + 16, dst_len_tmp = dst_size;
+	char *dst = wget_malloc(dst_size + 1), *dst_tmp = dst;
+	bool flush = false;
+
+	if (!dst)
+		return WGET_E_MEMORY;
+
+	for (;;) {
+		size_t rc;
+
+		errno = 0;
+		if (!flush)
+			rc = iconv(cd, (ICONV_CONST char **)&tmp, &tmp_len, &dst_tmp, &dst_len_tmp);
+		else
+			rc = iconv(cd, NULL, NULL, &dst_tmp, &dst_len_tmp);
+
+		if (rc == 0) {
+			if (flush)
+				break;
+			flush = true;
+		} else if (rc == (size_t)-1 && errno == E2BIG) {
+			size_t used = dst_tmp - dst;
+
+			dst_size *= 2;
+			if (!(dst_tmp = wget_realloc(dst, dst_size + 1))) {
+				xfree(dst);
+				return WGET_E_MEMORY;
+			}
+			dst = dst_tmp;
+			dst_tmp = dst + used;
+			dst_len_tmp = dst_size - used;
+		} else {
+			xfree(dst);
+			return WGET_E_UNKNOWN;
+		}
+	}
+
+	if (outlen)
+		*outlen = dst_tmp - dst;
+
+	if (out) {
+		size_t len = dst_tmp - dst;
+
+		// here we reduce the allocated memory size, if it fails we use the original memory chunk
+		if (!(tmp = wget_realloc(dst, len + 1)))
+			tmp = dst;
+		tmp[len] = 0;
+		*out = tmp;
+	} else
+		xfree(dst);
+
+	return WGET_E_SUCCESS;
+}
+#endif
+
 // void *wget_memiconv(const void *src, size_t length, const char *src_encoding, const char *dst_encoding)
 int wget_memiconv(const char *src_encoding, const void *src, size_t srclen, const char *dst_encoding, char **out, size_t *outlen)
 {
 	if (!src)
 		return WGET_E_INVALID;
 
-#ifdef HAVE_ICONV
 	if (!src_encoding)
 		src_encoding = "iso-8859-1"; // default character-set for most browsers
 	if (!dst_encoding)
 		dst_encoding = "iso-8859-1"; // default character-set for most browsers
 
 	if (wget_strcasecmp_ascii(src_encoding, dst_encoding)) {
-		int ret = WGET_E_UNKNOWN;
-		iconv_t cd = iconv_open(dst_encoding, src_encoding);
-
-		if (cd != (iconv_t)-1) {
-			char *tmp = (char *) src; // iconv won't change where src points to, but changes tmp itself
-			size_t tmp_len = srclen;
-			size_t dst_len = tmp_len * 6, dst_len_tmp = dst_len;
-			char *dst = wget_malloc(dst_len + 1), *dst_tmp = dst;
+		int ret = WGET_E_UNKNOWN, charset;
 
-			if (!dst) {
-				iconv_close(cd);
-				return WGET_E_MEMORY;
-			}
-
-			errno = 0;
-			if (iconv(cd, (ICONV_CONST char **)&tmp, &tmp_len, &dst_tmp, &dst_len_tmp) == 0
-				&& iconv(cd, NULL, NULL, &dst_tmp, &dst_len_tmp) == 0)
-			{
+		if (charset_id(dst_encoding) == CHARSET_UTF8
+			&& (charset = charset_id(src_encoding)) != CHARSET_OTHER && charset != CHARSET_UTF8)
+		{
+			if ((ret = to_utf8(charset, src, srclen, out, outlen)) == WGET_E_SUCCESS)
 				debug_printf("transcoded %zu bytes from '%s' to '%s'\n", srclen, src_encoding, dst_encoding);
-				if (out) {
-					// here we reduce the allocated memory size, if it fails we use the original memory chunk
-					tmp = wget_realloc(dst, dst_len - dst_len_tmp + 1);
-					if (!tmp)
-						tmp = dst;
-					tmp[dst_len - dst_len_tmp] = 0;
-					*out = tmp;
-				} else
-					xfree(dst);
+			if (ret != WGET_E_UNKNOWN)
+				return ret;
+		}
 
-				if (outlen)
-					*outlen = dst_len - dst_len_tmp;
+#ifdef HAVE_ICONV
+		iconv_entry e;
 
-				ret = WGET_E_SUCCESS;
+		if (iconv_get(&e, src_encoding, dst_encoding)) {
+			if ((ret = iconv_convert(e.cd, src, srclen, out, outlen)) == WGET_E_SUCCESS) {
+				debug_printf("transcoded %zu bytes from '%s' to '%s'\n", srclen, src_encoding, dst_encoding);
 			} else {
 				// erno == 0 means some codepoints were encoded non-reversible, treat as error
-				error_printf(_("Failed to transcode '%s' string into '%s' (%d)\n"), src_encoding, dst_encoding, errno);
-				xfree(dst);
+				if (ret != WGET_E_MEMORY)
+					error_printf(_("Failed to transcode '%s' string into '%s' (%d)\n"), src_encoding, dst_encoding, errno);
 
 				if (out)
 					*out = NULL;
@@ -119,13 +445,13 @@ int wget_memiconv(const char *src_encoding, const void *src, size_t srclen, cons
 					*outlen = 0;
 			}
 
-			iconv_close(cd);
+			iconv_put(&e);
 		} else
 			error_printf(_("Failed to prepare transcoding '%s' into '%s' (%d)\n"), src_encoding, dst_encoding, errno);
 
 		return ret;
-	}
 #endif
+	}
 
 	if (out)
 		*out = wget_strmemdup(src, srclen);
@@ -154,21 +480,23 @@ bool wget_str_needs_encoding(const char *s)
 	if (!s)
 		return false;
 
-	while (*s && (*s & ~0x7f) == 0) s++;
+	size_t len = strlen(s);
 
-	return *s != 0;
+	return ascii_length(s, len) != len;
 }
 
 bool wget_str_is_valid_utf8(const char *utf8)
 {
-	const unsigned char *s = (const unsigned char *) utf8;
+	const unsigned char *s = (const unsigned char *) utf8, *end;
 
 	if (!s)
 		return 0;
 
-	while (*s) {
+	end = s + strlen(utf8);
+
+	while (s < end) {
 		if ((*s & 0x80) == 0) /* 0xxxxxxx ASCII char */
-			s++;
+			s += ascii_length((const char *) s, end - s);
 		else if ((*s & 0xE0) == 0xC0) /* 110xxxxx 10xxxxxx */ {
 			if ((s[1] & 0xC0) != 0x80)
 				return 0;
@@ -236,51 +564,133 @@ static int WGET_GCC_PURE _utf8_is_valid(const char *utf8)
 }
 #endif
 
+#ifdef WITH_LIBIDN2
+// returns the ASCII hostname or NULL with the libidn2 error code in 'rc'
+static char *idn_to_ascii(const char *src, int *rc)
+{
+	char *asc = NULL;
+
+	if ((*rc = idn2_lookup_u8((uint8_t *)src, (uint8_t **)&asc, IDN2_NONTRANSITIONAL|IDN2_USE_STD3_ASCII_RULES)) != IDN2_OK)
+		*rc = idn2_lookup_u8((uint8_t *)src, (uint8_t **)&asc, IDN2_TRANSITIONAL|IDN2_USE_STD3_ASCII_RULES);
+	if (*rc != IDN2_OK)
+		return NULL;
+
+	debug_printf("idn2 '%s' -> '%s'\n", src, asc);
+#  ifdef _WIN32
+	char *tmp = wget_strdup(asc);
+	idn2_free(asc);
+	asc = tmp;
+#  endif
+
+	return asc;
+}
+
+static void idn_error(const char *src, int rc)
+{
+	error_printf(_("toASCII(%s) failed (%d): %s\n"), src, rc, idn2_strerror(rc));
+}
+#elif defined WITH_LIBIDN
+// returns the ASCII hostname or NULL with the libidn error code in 'rc', -1 for invalid UTF-8
+static char *idn_to_ascii(const char *src, int *rc)
+{
+	char *asc = NULL;
+
+	if (!_utf8_is_valid(src)) {
+		*rc = -1;
+		return NULL;
+	}
+
+	// idna_to_ascii_8z() automatically converts UTF-8 to lowercase
+	if ((*rc = idna_to_ascii_8z(src, &asc, IDNA_USE_STD3_ASCII_RULES)) != IDNA_SUCCESS)
+		return NULL;
+
+	// debug_printf("toASCII '%s' -> '%s'\n", src, asc);
+# ifdef _WIN32
+	char *tmp = wget_strdup(asc);
+	idn_free(asc);
+	asc = tmp;
+# endif
+
+	return asc;
+}
+
+static void idn_error(const char *src, int rc)
+{
+	if (rc == -1)
+		error_printf(_("Invalid UTF-8 sequence not converted: '%s'\n"), src);
+	else
+		error_printf(_("toASCII failed (%d): %s\n"), rc, idna_strerror(rc));
+}
+#endif
+
+#if defined WITH_LIBIDN2 || defined WITH_LIBIDN
+static void idn_cache_add(const char *src, const char *asc, int rc)
+{
+	size_t len = asc ? strlen(asc) : 0;
+	idn_entry *e;
+	char *key;
+
+	if (!asc && !rc)
+		return; // out of memory, not a conversion error
+
+	e = wget_malloc(sizeof(idn_entry) + len + 1);
+	key = wget_strdup(src);
+
+	if (!e || !key) {
+		xfree(e);
+		xfree(key);
+		return;
+	}
+
+	e->rc = rc;
+	memcpy(e->ascii, asc ? asc : "", len + 1);
+
+	wget_thread_mutex_lock(idn_cache_mutex);
+	if (!idn_cache)
+		idn_cache = wget_stringmap_create(128);
+	else if (wget_stringmap_size(idn_cache) >= IDN_CACHE_MAX)
+		wget_stringmap_clear(idn_cache); // cheaper than LRU bookkeeping on every lookup
+
+	if (!idn_cache || wget_stringmap_put(idn_cache, key, e) < 0) {
+		xfree(e);
+		xfree(key);
+	}
+	wget_thread_mutex_unlock(idn_cache_mutex);
+}
+#endif
+
 /* We convert hostnames and thus have to apply IDN2_USE_STD3_ASCII_RULES.
  * If we don't do, the result could contain any ascii characters,
  * e.g. 'evil.c\u2100.example.com' will be converted into
- * 'evil.ca/c.example.com', which seems no good idea. */
+ * 'evil.ca/c.example.com', which seems no good idea.
+ *
+ * Conversions, also failed ones, are cached, so repeated hostnames cost a hash lookup. */
 const char *wget_str_to_ascii(const char *src)
 {
-#ifdef WITH_LIBIDN2
+#if defined WITH_LIBIDN2 || defined WITH_LIBIDN
 	if (wget_str_needs_encoding(src)) {
+		idn_entry *e;
 		char *asc = NULL;
 		int rc;
-		if ((rc = idn2_lookup_u8((uint8_t *)src, (uint8_t **)&asc, IDN2_NONTRANSITIONAL|IDN2_USE_STD3_ASCII_RULES)) != IDN2_OK)
-			rc = idn2_lookup_u8((uint8_t *)src, (uint8_t **)&asc, IDN2_TRANSITIONAL|IDN2_USE_STD3_ASCII_RULES);
-		if (rc == IDN2_OK)
-		{
-			debug_printf("idn2 '%s' -> '%s'\n", src, asc);
-#  ifdef _WIN32
-				src = wget_strdup(asc);
-				idn2_free(asc);
-#  else
-				src = asc;
-#  endif
-		} else
-			error_printf(_("toASCII(%s) failed (%d): %s\n"), src, rc, idn2_strerror(rc));
-	}
-#elif defined WITH_LIBIDN
-	if (wget_str_needs_encoding(src)) {
-		char *asc = NULL;
-
-		if (_utf8_is_valid(src)) {
-			int rc;
 
-			// idna_to_ascii_8z() automatically converts UTF-8 to lowercase
-			if ((rc = idna_to_ascii_8z(src, &asc, IDNA_USE_STD3_ASCII_RULES)) == IDNA_SUCCESS) {
-				// debug_printf("toASCII '%s' -> '%s'\n", src, asc);
-# ifdef _WIN32
-				src = wget_strdup(asc);
-				idn_free(asc);
-# else
-				src = asc;
-# endif
-			} else
-				error_printf(_("toASCII failed (%d): %s\n"), rc, idna_strerror(rc));
+		wget_thread_mutex_lock(idn_cache_mutex);
+		if (wget_stringmap_get(idn_cache, src, &e)) {
+			// copy while locked, another thread may clear the cache
+			if ((rc = e->rc) == 0)
+				asc = wget_strdup(e->ascii);
+			wget_thread_mutex_unlock(idn_cache_mutex);
+		} else {
+			wget_thread_mutex_unlock(idn_cache_mutex);
+
+			asc = idn_to_ascii(src, &rc);
+			idn_cache_add(src, asc, rc);
 		}
-		else
-			error_printf(_("Invalid UTF-8 sequence not converted: '%s'\n"), src);
+
+		if (asc)
+			return asc;
+
+		if (rc)
+			idn_error(src, rc);
 	}
 #else
 	if (wget_str_needs_encoding(src)) {
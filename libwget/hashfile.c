@@ -789,14 +789,17 @@ int wget_hash_file_fd(const char *hashname, int fd, char *digest_hex, size_t dig
 		unsigned char digest[wget_hash_get_len(algorithm)];
 
 #ifdef HAVE_MMAP
-		char *buf = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, offset);
+		// mmap() needs a page aligned offset, which metalink pieces don't guarantee
+		off_t pagesize = sysconf(_SC_PAGESIZE) > 0 ? sysconf(_SC_PAGESIZE) : 4096;
+		off_t skip = offset % pagesize;
+		char *buf = mmap(NULL, length + skip, PROT_READ, MAP_PRIVATE, fd, offset - skip);
 
 		if (buf != MAP_FAILED) {
-			if (wget_hash_fast(algorithm, buf, length, digest) == 0) {
+			if (wget_hash_fast(algorithm, buf + skip, length, digest) == 0) {
 				wget_memtohex(digest, sizeof(digest), digest_hex, digest_hex_size);
 				ret = WGET_E_SUCCESS;
 			}
-			munmap(buf, length);
+			munmap(buf, length + skip);
 		} else {
 #endif
 			// Fallback to read
@@ -804,21 +807,21 @@ int wget_hash_file_fd(const char *hashname, int fd, char *digest_hex, size_t dig
 			wget_hash_hd *dig;
 			char tmp[65536];
 
+			if (lseek(fd, offset, SEEK_SET) == (off_t) -1)
+				return WGET_E_IO;
+
 			if ((ret = wget_hash_init(&dig, algorithm))) {
 				error_printf(_("%s: Hash init failed for type '%s': %s\n"), __func__, hashname, wget_strerror(ret));
 				return ret;
 			}
 
-			while (length > 0 && (nbytes = read(fd, tmp, sizeof(tmp))) > 0) {
+			while (length > 0 && (nbytes = read(fd, tmp, length < (off_t) sizeof(tmp) ? (size_t) length : sizeof(tmp))) > 0) {
 				if ((ret = wget_hash(dig, tmp, nbytes))) {
 					error_printf(_("%s: Hash update failed: %s\n"), __func__, wget_strerror(ret));
 					return ret;
 				}
 
-				if (nbytes <= length)
-					length -= nbytes;
-				else
-					length = 0;
+				length -= nbytes;
 			}
 
 			if ((ret = wget_hash_deinit(&dig, digest))) {
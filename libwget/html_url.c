@@ -46,18 +46,23 @@ typedef struct {
 		download;
 	int
 		uri_index;
-	size_t
-		css_start_offset;
 	char
 		found_robots,
 		found_content_type,
 		link_inline;
 	const char
-		* html,
+		* css_start,
 		* css_attr,
 		* css_dir;
 } html_context;
 
+struct wget_html_url_parser_st {
+	html_context
+		context;
+	wget_html_parser
+		*parser;
+};
+
 // see https://stackoverflow.com/questions/2725156/complete-list-of-html-tag-attributes-which-have-a-url-value
 static const char maybe[256] = {
 	['a'] = 1,
@@ -100,7 +105,7 @@ static void css_parse_uri(void *context, const char *url WGET_GCC_UNUSED, size_t
 	parsed_url->link_inline = 1;
 	wget_strscpy(parsed_url->attr, ctx->css_attr, sizeof(parsed_url->attr));
 	wget_strscpy(parsed_url->tag, ctx->css_dir, sizeof(parsed_url->tag));
-	parsed_url->url.p = (const char *) (ctx->html + ctx->css_start_offset + pos);
+	parsed_url->url.p = ctx->css_start + pos;
 	parsed_url->url.len = len;
 	parsed_url->download.p = NULL;
 	parsed_url->download.len = 0;
@@ -123,12 +128,13 @@ static void html_get_url(void *context, int flags, const char *tag, const char *
 	// Also ,we are interested in ROBOTS e.g.
 	//   <META name="ROBOTS" content="NOINDEX, NOFOLLOW">
 	if ((flags & XML_FLG_BEGIN)) {
+		// The download attribute is only valid for 'a' and 'area' tags.
+		// S 4.6.5 in https://html.spec.whatwg.org/multipage/links.html#downloading-resources
+		ctx->download.p = NULL;
+		ctx->download.len = 0;
+
 		if ((*tag|0x20) == 'a' && (tag[1] == 0 || !wget_strcasecmp_ascii(tag, "area"))) {
-			// The download attribute is only valid for 'a' and 'area' tags.
-			// S 4.6.5 in https://html.spec.whatwg.org/multipage/links.html#downloading-resources
 			ctx->uri_index = -1;
-			ctx->download.p = NULL;
-			ctx->download.len = 0;
 		}
 		else if ((*tag|0x20) == 'm' && !wget_strcasecmp_ascii(tag, "meta")) {
 			ctx->found_robots = ctx->found_content_type = 0;
@@ -215,7 +221,7 @@ static void html_get_url(void *context, int flags, const char *tag, const char *
 		if ((*attr|0x20) == 's' && !wget_strcasecmp_ascii(attr, "style") && len) {
 			ctx->css_dir = tag;
 			ctx->css_attr = "style";
-			ctx->css_start_offset = val - ctx->html;
+			ctx->css_start = val;
 			wget_css_parse_buffer(val, len, css_parse_uri, NULL, context);
 			return;
 		}
@@ -330,7 +336,7 @@ static void html_get_url(void *context, int flags, const char *tag, const char *
 	if (flags & XML_FLG_CONTENT && val && len && !wget_strcasecmp_ascii(tag, "style")) {
 		ctx->css_dir = "style";
 		ctx->css_attr = "";
-		ctx->css_start_offset = val - ctx->html;
+		ctx->css_start = val;
 		wget_css_parse_buffer(val, len, css_parse_uri, NULL, context);
 	}
 }
@@ -350,7 +356,6 @@ wget_html_parsed_result *wget_html_get_urls_inline(const char *html, wget_vector
 		.result.follow = 1,
 		.additional_tags = additional_tags,
 		.ignore_tags = ignore_tags,
-		.html = html,
 	};
 
 //	context.result.uris = wget_vector_create(32, -2, NULL);
@@ -358,3 +363,74 @@ wget_html_parsed_result *wget_html_get_urls_inline(const char *html, wget_vector
 
 	return wget_memdup(&context.result, sizeof(context.result));
 }
+
+/*
+ * The incremental variant of wget_html_get_urls_inline() for HTML that arrives in pieces.
+ *
+ * wget_html_url_parser_feed() and wget_html_url_parser_finish() return NULL if nothing
+ * has been parsed yet, else the URLs found by this call. 'base' is only set by the call
+ * that found it, 'encoding' and 'follow' describe the document parsed so far.
+ * The result and the pointers into the input stay valid until the next call.
+ */
+wget_html_url_parser *wget_html_url_parser_init(wget_vector *additional_tags, wget_vector *ignore_tags)
+{
+	wget_html_url_parser *parser = wget_calloc(1, sizeof(wget_html_url_parser));
+
+	if (!parser)
+		return NULL;
+
+	if (!(parser->parser = wget_html_parser_init(html_get_url, &parser->context, HTML_HINT_REMOVE_EMPTY_CONTENT))) {
+		xfree(parser);
+		return NULL;
+	}
+
+	parser->context.result.follow = 1;
+	parser->context.additional_tags = additional_tags;
+	parser->context.ignore_tags = ignore_tags;
+	parser->context.uri_index = -1;
+
+	return parser;
+}
+
+// forget the results of the previous call, they point into input that is going to be removed
+static void html_url_parser_reset(wget_html_url_parser *parser)
+{
+	html_context *ctx = &parser->context;
+
+	wget_vector_clear(ctx->result.uris);
+	ctx->result.base.p = NULL;
+	ctx->result.base.len = 0;
+	ctx->download.p = NULL;
+	ctx->download.len = 0;
+	ctx->uri_index = -1;
+}
+
+wget_html_parsed_result *wget_html_url_parser_feed(wget_html_url_parser *parser, const char *data, size_t len)
+{
+	html_url_parser_reset(parser);
+
+	if (!wget_html_parser_feed(parser->parser, data, len))
+		return NULL;
+
+	return &parser->context.result;
+}
+
+wget_html_parsed_result *wget_html_url_parser_finish(wget_html_url_parser *parser)
+{
+	html_url_parser_reset(parser);
+
+	if (!wget_html_parser_finish(parser->parser))
+		return NULL;
+
+	return &parser->context.result;
+}
+
+void wget_html_url_parser_free(wget_html_url_parser **parser)
+{
+	if (parser && *parser) {
+		wget_html_parser_free(&(*parser)->parser);
+		xfree((*parser)->context.result.encoding);
+		wget_vector_free(&(*parser)->context.result.uris);
+		xfree(*parser);
+	}
+}
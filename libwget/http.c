@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <c-ctype.h>
 #include <time.h>
 #include <errno.h>
@@ -60,6 +61,11 @@ static wget_vector
 	*https_proxies,
 	*no_proxies;
 
+static wget_altsvc_cache
+	*altsvc_cache;
+
+#define ALTSVC_CONNECT_TIMEOUT 3000 // milliseconds
+
 // protect access to the above vectors
 static wget_thread_mutex
 	proxy_mutex,
@@ -170,11 +176,53 @@ void wget_http_request_set_body_cb(wget_http_request *req, wget_http_body_callba
 	req->body_user_data = user_data;
 }
 
+/**
+ * \param[in] req HTTP request
+ * \param[in] callback Function to be called for each body data packet read from the network
+ * \param[in] user_data Context for \p callback
+ *
+ * Unlike the body callback, \p callback is always called by the thread that reads the response,
+ * with the number of (still compressed) bytes. That is the place for progress and rate limiting,
+ * the body callback may run in a worker thread (see WGET_HTTP_DECOMPRESS_OFFLOAD).
+ */
+void wget_http_request_set_recv_cb(wget_http_request *req, wget_http_recv_callback *callback, void *user_data)
+{
+	req->recv_callback = callback;
+	req->recv_user_data = user_data;
+}
+
+// account for body data read from the network, before it is decompressed
+static void body_received(wget_http_response *resp, size_t length)
+{
+	resp->cur_downloaded += length;
+
+	if (resp->req->recv_callback)
+		resp->req->recv_callback(resp, resp->req->recv_user_data, length);
+}
+
+/**
+ * \param[in] req HTTP request
+ * \param[in] block Header lines, each terminated by CRLF
+ * \param[in] length Length of \p block
+ *
+ * Set header lines that are sent as they are after the headers of \p req.
+ * This allows serializing headers that are the same for many requests just once.
+ *
+ * \p block is not copied and must stay valid until \p req is freed.
+ */
+void wget_http_request_set_header_block(wget_http_request *req, const char *block, size_t length)
+{
+	req->header_block = block;
+	req->header_block_length = length;
+}
+
 void wget_http_request_set_int(wget_http_request *req, int key, int value)
 {
 	switch (key) {
 	case WGET_HTTP_RESPONSE_KEEPHEADER: req->response_keepheader = value != 0; break;
 	case WGET_HTTP_RESPONSE_IGNORELENGTH: req->response_ignorelength = value != 0; break;
+	case WGET_HTTP_PRIORITY: req->priority = value; break;
+	case WGET_HTTP_DECOMPRESS_OFFLOAD: req->decompress_offload = value != 0; break;
 	default: error_printf(_("%s: Unknown key %d (or value must not be an integer)\n"), __func__, key);
 	}
 }
@@ -184,6 +232,8 @@ int wget_http_request_get_int(wget_http_request *req, int key)
 	switch (key) {
 	case WGET_HTTP_RESPONSE_KEEPHEADER: return req->response_keepheader;
 	case WGET_HTTP_RESPONSE_IGNORELENGTH: return req->response_ignorelength;
+	case WGET_HTTP_PRIORITY: return req->priority;
+	case WGET_HTTP_DECOMPRESS_OFFLOAD: return req->decompress_offload;
 	default:
 		error_printf(_("%s: Unknown key %d (or value must not be an integer)\n"), __func__, key);
 		return -1;
@@ -495,17 +545,98 @@ static int on_frame_send_callback(nghttp2_session *session WGET_GCC_UNUSED,
 	return 0;
 }
 
+// The receive windows start with HTTP2_INITIAL_WINDOW and are grown up to HTTP2_MAX_WINDOW
+// by estimating the bandwidth-delay product (BDP) of the connection:
+// the DATA received between sending a PING and receiving its ACK is what the
+// network holds during one round trip. If that comes close to the window size,
+// the window limits the throughput and is doubled.
+// Small windows let the server interleave streams according to their weights,
+// large windows are needed to fill long fat pipes.
+#define HTTP2_INITIAL_WINDOW (16 << 20)
+#define HTTP2_MAX_WINDOW (1 << 30)
+
+static const uint8_t bdp_ping_data[8] = "wgetbdp";
+
+// remember the alternative services announced by an origin on a direct HTTPS connection
+static void update_altsvc_cache(const wget_http_connection *conn, const wget_http_response *resp)
+{
+	if (altsvc_cache && resp->alt_svcs && !conn->proxied && conn->scheme == WGET_IRI_SCHEME_HTTPS)
+		wget_altsvc_cache_update(altsvc_cache, resp->req->esc_host.data, conn->port, resp->alt_svcs);
+}
+
+static int http2_set_window(wget_http_connection *conn, int32_t window)
+{
+	nghttp2_settings_entry iv[] = {
+		{NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, (uint32_t) window}, // applies to all open streams as well
+	};
+	int rc;
+
+	if ((rc = nghttp2_submit_settings(conn->http2_session, NGHTTP2_FLAG_NONE, iv, countof(iv))))
+		return rc;
+
+#if NGHTTP2_VERSION_NUM >= 0x010c00
+	if ((rc = nghttp2_session_set_local_window_size(conn->http2_session, NGHTTP2_FLAG_NONE, 0, window)))
+		debug_printf("Failed to set HTTP2 connection level window size (%d)\n", rc);
+#endif
+
+	conn->http2_window = window;
+
+	return 0;
+}
+
+static void http2_probe_bandwidth(wget_http_connection *conn, size_t len)
+{
+	if (conn->http2_window >= HTTP2_MAX_WINDOW)
+		return;
+
+	if (conn->http2_ping_time) {
+		conn->http2_ping_bytes += len;
+	} else if (nghttp2_submit_ping(conn->http2_session, NGHTTP2_FLAG_NONE, bdp_ping_data) == 0) {
+		conn->http2_ping_time = wget_get_timemillis();
+		conn->http2_ping_bytes = 0;
+	}
+}
+
+static void http2_update_window(wget_http_connection *conn)
+{
+	size_t bdp = conn->http2_ping_bytes;
+
+	debug_printf("HTTP2 BDP %zu bytes in %lld ms (window %d)\n",
+		bdp, wget_get_timemillis() - conn->http2_ping_time, (int) conn->http2_window);
+
+	conn->http2_ping_time = 0;
+
+	if (bdp >= (size_t) conn->http2_window / 3 * 2) {
+		int32_t window = bdp >= HTTP2_MAX_WINDOW / 2 ? HTTP2_MAX_WINDOW : (int32_t) bdp * 2;
+
+		if (window > conn->http2_window && http2_set_window(conn, window) == 0)
+			debug_printf("HTTP2 window increased to %d\n", (int) window);
+	}
+}
+
 static int on_frame_recv_callback(nghttp2_session *session,
-	const nghttp2_frame *frame, void *user_data WGET_GCC_UNUSED)
+	const nghttp2_frame *frame, void *user_data)
 {
 	print_frame_type(frame->hd.type, '<', frame->hd.stream_id);
 
+	if (frame->hd.type == NGHTTP2_PING) {
+		wget_http_connection *conn = user_data;
+
+		if ((frame->hd.flags & NGHTTP2_FLAG_ACK) && conn->http2_ping_time
+			&& !memcmp(frame->ping.opaque_data, bdp_ping_data, sizeof(bdp_ping_data)))
+			http2_update_window(conn);
+
+		return 0;
+	}
+
 	// header callback after receiving all header tags
 	if (frame->hd.type == NGHTTP2_HEADERS) {
 		struct http2_stream_context *ctx = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
 		wget_http_response *resp = ctx ? ctx->resp : NULL;
 
 		if (resp) {
+			update_altsvc_cache(user_data, resp);
+
 			if (resp->header && resp->req->header_callback) {
 				resp->req->header_callback(resp, resp->req->header_user_data);
 			}
@@ -515,6 +646,8 @@ static int on_frame_recv_callback(nghttp2_session *session,
 			if (!ctx->decompressor) {
 				ctx->decompressor = wget_decompress_open(resp->content_encoding, get_body, resp);
 				wget_decompress_set_error_handler(ctx->decompressor, decompress_error_handler);
+				if (resp->req->decompress_offload)
+					wget_decompress_set_offload(ctx->decompressor, true);
 			}
 		}
 	}
@@ -580,17 +713,19 @@ static int on_stream_close_callback(nghttp2_session *session, int32_t stream_id,
  */
 static int on_data_chunk_recv_callback(nghttp2_session *session,
 	uint8_t flags WGET_GCC_UNUSED, int32_t stream_id,
-	const uint8_t *data, size_t len,	void *user_data WGET_GCC_UNUSED)
+	const uint8_t *data, size_t len,	void *user_data)
 {
 	struct http2_stream_context *ctx = nghttp2_session_get_stream_user_data(session, stream_id);
 
+	http2_probe_bandwidth(user_data, len);
+
 	if (ctx) {
 		// debug_printf("[INFO] C <---------------------------- S%d (DATA chunk - %zu bytes)\n", stream_id, len);
 		// debug_printf("nbytes %zu\n", len);
 
 		ctx->resp->req->first_response_start = wget_get_timemillis();
 
-		ctx->resp->cur_downloaded += len;
+		body_received(ctx->resp, len);
 		wget_decompress(ctx->decompressor, (char *) data, len);
 	}
 	return 0;
@@ -607,6 +742,59 @@ static void setup_nghttp2_callbacks(nghttp2_session_callbacks *callbacks)
 }
 #endif
 
+// connect to an alternative service of the origin of 'iri' (RFC 7838),
+// the server certificate still has to be valid for the origin host.
+// Only TCP alternatives are tried, there is no QUIC transport for 'h3'.
+static int connect_altsvc(wget_http_connection *conn, const wget_iri *iri)
+{
+	static const char *protocols[] = {
+#ifdef WITH_LIBNGHTTP2
+		"h2",
+#endif
+		"http/1.1"
+	};
+
+	if (!altsvc_cache)
+		return WGET_E_UNKNOWN;
+
+	for (unsigned it = 0; it < countof(protocols); it++) {
+		const char *alt_host;
+		uint16_t alt_port;
+		int rc;
+
+		if (wget_altsvc_cache_get(altsvc_cache, iri->host, iri->port, protocols[it], &alt_host, &alt_port))
+			continue;
+
+		if (alt_port == iri->port && !wget_strcasecmp_ascii(alt_host, iri->host)) {
+			xfree(alt_host);
+			continue;
+		}
+
+		// fall back to the origin fast if the alternative doesn't respond
+		int connect_timeout = conn->tcp->connect_timeout;
+		if (connect_timeout < 0 || connect_timeout > ALTSVC_CONNECT_TIMEOUT)
+			wget_tcp_set_connect_timeout(conn->tcp, ALTSVC_CONNECT_TIMEOUT);
+
+		if ((rc = wget_tcp_connect(conn->tcp, alt_host, alt_port)) == WGET_E_SUCCESS) {
+			debug_printf("connected to alternative service %s:%hu for %s\n", alt_host, alt_port, iri->host);
+			wget_tcp_set_connect_timeout(conn->tcp, connect_timeout);
+			xfree(alt_host);
+			return WGET_E_SUCCESS;
+		}
+
+		debug_printf("alternative service %s:%hu for %s failed (%d)\n", alt_host, alt_port, iri->host, rc);
+		wget_altsvc_cache_mark_broken(altsvc_cache, iri->host, iri->port, protocols[it], alt_host, alt_port);
+		xfree(alt_host);
+
+		wget_tcp_deinit(&conn->tcp);
+		conn->tcp = wget_tcp_init();
+		wget_tcp_set_ssl(conn->tcp, 1);
+		wget_tcp_set_ssl_hostname(conn->tcp, iri->host);
+	}
+
+	return WGET_E_UNKNOWN;
+}
+
 int wget_http_open(wget_http_connection **_conn, const wget_iri *iri)
 {
 	static int next_http_proxy = -1;
@@ -654,7 +842,10 @@ int wget_http_open(wget_http_connection **_conn, const wget_iri *iri)
 		wget_tcp_set_ssl_hostname(conn->tcp, host); // enable host name checking
 	}
 
-	if ((rc = wget_tcp_connect(conn->tcp, host, port)) == WGET_E_SUCCESS) {
+	if ((ssl && !conn->proxied && connect_altsvc(conn, iri) == WGET_E_SUCCESS)
+		|| (rc = wget_tcp_connect(conn->tcp, host, port)) == WGET_E_SUCCESS)
+	{
+		rc = WGET_E_SUCCESS;
 		conn->esc_host = iri->host ? wget_strdup(iri->host) : NULL;
 		conn->port = iri->port;
 		conn->scheme = iri->scheme;
@@ -681,22 +872,17 @@ int wget_http_open(wget_http_connection **_conn, const wget_iri *iri)
 
 			nghttp2_settings_entry iv[] = {
 				// {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100},
-				{NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, 1 << 30}, // prevent window size changes
 				{NGHTTP2_SETTINGS_ENABLE_PUSH, 0}, // avoid push messages from server
 			};
 
-			if ((rc = nghttp2_submit_settings(conn->http2_session, NGHTTP2_FLAG_NONE, iv, countof(iv)))) {
+			if ((rc = nghttp2_submit_settings(conn->http2_session, NGHTTP2_FLAG_NONE, iv, countof(iv)))
+				|| (rc = http2_set_window(conn, HTTP2_INITIAL_WINDOW)))
+			{
 				error_printf(_("Failed to submit HTTP2 client settings (%d)\n"), rc);
 				wget_http_close(_conn);
 				return WGET_E_INVALID;
 			}
 
-#if NGHTTP2_VERSION_NUM >= 0x010c00
-			// without this we experience slow downloads on fast networks
-			if ((rc = nghttp2_session_set_local_window_size(conn->http2_session, NGHTTP2_FLAG_NONE, 0, 1 << 30)))
-				debug_printf("Failed to set HTTP2 connection level window size (%d)\n", rc);
-#endif
-
 			conn->received_http2_responses = wget_vector_create(16, NULL);
 		} else
 			conn->pending_requests = wget_vector_create(16, NULL);
@@ -739,6 +925,75 @@ void wget_http_close(wget_http_connection **conn)
 	}
 }
 
+/**
+ * \param[in] conn HTTP connection
+ * \return Maximum number of requests that may be in flight on \p conn
+ *
+ * For HTTP/2 this is the server's SETTINGS_MAX_CONCURRENT_STREAMS value, which is unlimited (INT_MAX)
+ * until the server announced it. For HTTP/1.1 this is 1 (no pipelining).
+ */
+int wget_http_get_max_concurrent_streams(const wget_http_connection *conn)
+{
+#ifdef WITH_LIBNGHTTP2
+	if (conn->protocol == WGET_PROTOCOL_HTTP_2_0 && conn->http2_session) {
+		uint32_t max_streams = nghttp2_session_get_remote_settings(conn->http2_session, NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS);
+
+		return max_streams > INT_MAX ? INT_MAX : (int) max_streams;
+	}
+#endif
+
+	return 1;
+}
+
+/**
+ * \param[in] conn HTTP connection
+ * \param[in] iri URL to be requested
+ * \return Whether \p iri may be requested over \p conn although it names a different host
+ *
+ * Connection reuse across host names as of RFC 7540 9.1.1: \p conn must be a direct HTTPS connection using HTTP/2,
+ * one of the addresses of the host of \p iri must match the connected address
+ * and the server certificate must be valid for the host of \p iri, including its HPKP pins.
+ *
+ * The host name of \p iri is resolved, which is cheap if a DNS cache is used.
+ * The TLS session of \p conn is inspected, so only the thread using \p conn may call this function.
+ */
+bool wget_http_connection_can_coalesce(wget_http_connection *conn, const wget_iri *iri)
+{
+#ifdef WITH_LIBNGHTTP2
+	if (conn->protocol != WGET_PROTOCOL_HTTP_2_0 || conn->proxied || iri->scheme != WGET_IRI_SCHEME_HTTPS
+		|| conn->scheme != iri->scheme || conn->port != iri->port || !iri->host)
+		return false;
+
+	if (!wget_strcmp(conn->esc_host, iri->host))
+		return true;
+
+	wget_tcp *tcp = conn->tcp;
+	struct addrinfo *addrinfo;
+	bool match = false;
+
+	if (!tcp->ip || !(addrinfo = wget_dns_resolve(tcp->dns, iri->host, iri->port, tcp->family, tcp->preferred_family)))
+		return false;
+
+	for (struct addrinfo *ai = addrinfo; ai && !match; ai = ai->ai_next) {
+		char adr[NI_MAXHOST];
+
+		if (getnameinfo(ai->ai_addr, ai->ai_addrlen, adr, sizeof(adr), NULL, 0, NI_NUMERICHOST) == 0)
+			match = !strcmp(adr, tcp->ip);
+	}
+
+	wget_dns_freeaddrinfo(tcp->dns, &addrinfo);
+
+	if (match && wget_ssl_check_peer_hostname(tcp->ssl_session, iri->host)) {
+		debug_printf("coalesce %s with HTTP/2 connection to %s (%s)\n", iri->host, conn->esc_host, tcp->ip);
+		return true;
+	}
+#else
+	(void) conn; (void) iri;
+#endif
+
+	return false;
+}
+
 #ifdef WITH_LIBNGHTTP2
 static ssize_t data_prd_read_callback(
 	nghttp2_session *session, int32_t stream_id, uint8_t *buf, size_t length,
@@ -776,6 +1031,8 @@ static void init_nv(nghttp2_nv *nv, const char *name, const char *value)
 }
 #endif
 
+static void request_head_to_buffer(wget_http_request *req, wget_buffer *buf, int proxied);
+
 int wget_http_send_request(wget_http_connection *conn, wget_http_request *req)
 {
 	ssize_t nbytes;
@@ -784,6 +1041,10 @@ int wget_http_send_request(wget_http_connection *conn, wget_http_request *req)
 	if (wget_tcp_get_protocol(conn->tcp) == WGET_PROTOCOL_HTTP_2_0) {
 		char length_str[32];
 		int n = 4 + wget_vector_size(req->headers);
+
+		for (const char *p = req->header_block; p && (p = memchr(p, '\n', req->header_block + req->header_block_length - p)); p++)
+			n++;
+
 		nghttp2_nv nvs[n], *nvp;
 		char resource[req->esc_resource.length + 2];
 
@@ -809,6 +1070,34 @@ int wget_http_send_request(wget_http_connection *conn, wget_http_request *req)
 			init_nv(nvp++, param->name, param->value);
 		}
 
+		// split the header block into name/value pairs, pointing into the block
+		const char *end = req->header_block + req->header_block_length;
+		for (const char *p = req->header_block, *eol; p && p < end; p = eol + 1) {
+			const char *colon, *value, *value_end;
+
+			if (!(eol = memchr(p, '\n', end - p)))
+				eol = end;
+
+			if (!(colon = memchr(p, ':', eol - p)))
+				continue;
+
+			for (value = colon + 1; value < eol && c_isblank(*value); value++)
+				;
+			for (value_end = eol; value_end > value && (value_end[-1] == '\r' || c_isblank(value_end[-1])); value_end--)
+				;
+
+			if ((colon - p == 10 && !wget_strncasecmp_ascii(p, "Connection", 10))
+				|| (colon - p == 17 && !wget_strncasecmp_ascii(p, "Transfer-Encoding", 17)))
+				continue;
+
+			nvp->name = (uint8_t *) p;
+			nvp->namelen = colon - p;
+			nvp->value = (uint8_t *) value;
+			nvp->valuelen = value_end - value;
+			nvp->flags = NGHTTP2_NV_FLAG_NONE;
+			nvp++;
+		}
+
 		if (req->body_length) {
 			wget_snprintf(length_str, sizeof(length_str), "%zu", req->body_length);
 			init_nv(nvp++, "Content-Length", length_str);
@@ -823,15 +1112,23 @@ int wget_http_send_request(wget_http_connection *conn, wget_http_request *req)
 		ctx->resp->keep_alive = 1;
 		req->request_start = wget_get_timemillis();
 
+		nghttp2_priority_spec pri_spec, *pri = NULL;
+
+		if (req->priority) {
+			nghttp2_priority_spec_init(&pri_spec, 0,
+				req->priority < NGHTTP2_MIN_WEIGHT ? NGHTTP2_MIN_WEIGHT : req->priority > NGHTTP2_MAX_WEIGHT ? NGHTTP2_MAX_WEIGHT : req->priority, 0);
+			pri = &pri_spec;
+		}
+
 		if (req->body_length) {
 			nghttp2_data_provider data_prd;
 			data_prd.source.ptr = (void *) req->body;
 			debug_printf("body length: %zu %zu\n", req->body_length, ctx->resp->req->body_length);
 			data_prd.read_callback = data_prd_read_callback;
-			req->stream_id = nghttp2_submit_request(conn->http2_session, NULL, nvs, nvp - nvs, &data_prd, ctx);
+			req->stream_id = nghttp2_submit_request(conn->http2_session, pri, nvs, nvp - nvs, &data_prd, ctx);
 		} else {
 			// nghttp2 does strdup of name+value and lowercase conversion of 'name'
-			req->stream_id = nghttp2_submit_request(conn->http2_session, NULL, nvs, nvp - nvs, NULL, ctx);
+			req->stream_id = nghttp2_submit_request(conn->http2_session, pri, nvs, nvp - nvs, NULL, ctx);
 		}
 
 		if (req->stream_id < 0) {
@@ -849,17 +1146,52 @@ int wget_http_send_request(wget_http_connection *conn, wget_http_request *req)
 	}
 #endif
 
-	if ((nbytes = wget_http_request_to_buffer(req, conn->buf, conn->proxied)) < 0) {
-		error_printf(_("Failed to create request buffer\n"));
-		return -1;
-	}
+	if (req->header_block_length) {
+		// send the invariant header block and the body without copying them into conn->buf
+		struct iovec iov[4];
+		int iovcnt = 0;
+
+		request_head_to_buffer(req, conn->buf, conn->proxied);
+
+		iov[iovcnt].iov_base = conn->buf->data;
+		iov[iovcnt++].iov_len = conn->buf->length;
+		iov[iovcnt].iov_base = (void *) req->header_block;
+		iov[iovcnt++].iov_len = req->header_block_length;
+		iov[iovcnt].iov_base = (void *) "\r\n";
+		iov[iovcnt++].iov_len = 2;
+		if (req->body && req->body_length) {
+			iov[iovcnt].iov_base = (void *) req->body;
+			iov[iovcnt++].iov_len = req->body_length;
+		}
 
-	req->request_start = wget_get_timemillis();
+		nbytes = conn->buf->length + req->header_block_length + 2 + (req->body ? req->body_length : 0);
 
-	if (wget_tcp_write(conn->tcp, conn->buf->data, nbytes) != nbytes) {
-		// An error will be written by the wget_tcp_write function.
-		// error_printf(_("Failed to send %zd bytes (%d)\n"), nbytes, errno);
-		return -1;
+		req->request_start = wget_get_timemillis();
+
+		if (tcp_writev(conn->tcp, iov, iovcnt) != nbytes) {
+			// An error will be written by the tcp_writev function.
+			return -1;
+		}
+
+		if (wget_logger_is_active(wget_get_logger(WGET_LOGGER_DEBUG))) {
+			wget_buffer_memcat(conn->buf, req->header_block, req->header_block_length);
+			wget_buffer_memcat(conn->buf, "\r\n", 2);
+			if (req->body && req->body_length)
+				wget_buffer_memcat(conn->buf, req->body, req->body_length);
+		}
+	} else {
+		if ((nbytes = wget_http_request_to_buffer(req, conn->buf, conn->proxied)) < 0) {
+			error_printf(_("Failed to create request buffer\n"));
+			return -1;
+		}
+
+		req->request_start = wget_get_timemillis();
+
+		if (wget_tcp_write(conn->tcp, conn->buf->data, nbytes) != nbytes) {
+			// An error will be written by the wget_tcp_write function.
+			// error_printf(_("Failed to send %zd bytes (%d)\n"), nbytes, errno);
+			return -1;
+		}
 	}
 
 	wget_vector_add(conn->pending_requests, req);
@@ -872,7 +1204,25 @@ int wget_http_send_request(wget_http_connection *conn, wget_http_request *req)
 	return 0;
 }
 
-ssize_t wget_http_request_to_buffer(wget_http_request *req, wget_buffer *buf, int proxied)
+// whether the pre-serialized header block contains a header line named 'name'
+static bool header_block_has(const wget_http_request *req, const char *name)
+{
+	size_t namelen = strlen(name);
+	const char *end = req->header_block + req->header_block_length;
+
+	for (const char *p = req->header_block, *eol; p && p < end; p = eol + 1) {
+		if (!(eol = memchr(p, '\n', end - p)))
+			eol = end;
+
+		if ((size_t) (eol - p) > namelen && p[namelen] == ':' && !wget_strncasecmp_ascii(p, name, namelen))
+			return true;
+	}
+
+	return false;
+}
+
+// request line and headers of the request, without header block and end-of-header
+static void request_head_to_buffer(wget_http_request *req, wget_buffer *buf, int proxied)
 {
 	char have_content_length = 0;
 	char check_content_length = req->body && req->body_length;
@@ -910,8 +1260,19 @@ ssize_t wget_http_request_to_buffer(wget_http_request *req, wget_buffer *buf, in
 		wget_buffer_strcat(buf, "Proxy-Connection: keep-alive\r\n");
 */
 
+	if (check_content_length && !have_content_length && header_block_has(req, "Content-Length"))
+		have_content_length = 1; // same for a Content-Length header in the header block
+
 	if (check_content_length && !have_content_length)
 		wget_buffer_printf_append(buf, "Content-Length: %zu\r\n", req->body_length);
+}
+
+ssize_t wget_http_request_to_buffer(wget_http_request *req, wget_buffer *buf, int proxied)
+{
+	request_head_to_buffer(req, buf, proxied);
+
+	if (req->header_block_length)
+		wget_buffer_memcat(buf, req->header_block, req->header_block_length);
 
 	wget_buffer_memcat(buf, "\r\n", 2); // end-of-header
 
@@ -921,9 +1282,34 @@ ssize_t wget_http_request_to_buffer(wget_http_request *req, wget_buffer *buf, in
 	return buf->length;
 }
 
+/*
+ * Incrementally search for the end of the response header ("\r\n\r\n").
+ * Only newlines are searched for (memchr is vectorized by the C library), and
+ * *scanned keeps the position up to which \p buf has been checked, so that each
+ * byte is looked at once, regardless of how the header is split over reads.
+ */
+static char *find_end_of_header(char *buf, size_t len, size_t *scanned)
+{
+	char *p = buf + *scanned, *end = buf + len;
+
+	while ((p = memchr(p, '\n', end - p))) {
+		if (end - p < 3)
+			break; // need more data to decide
+
+		if (p[1] == '\r' && p[2] == '\n' && p > buf && p[-1] == '\r')
+			return p - 1;
+
+		p++;
+	}
+
+	*scanned = p ? (size_t) (p - buf) : len;
+
+	return NULL;
+}
+
 wget_http_response *wget_http_get_response_cb(wget_http_connection *conn)
 {
-	size_t bufsize, body_len = 0, body_size = 0;
+	size_t bufsize, body_len = 0, scanned = 0;
 	ssize_t nbytes, nread = 0;
 	char *buf, *p = NULL;
 	wget_http_response *resp = NULL;
@@ -993,14 +1379,7 @@ wget_http_response *wget_http_get_response_cb(wget_http_connection *conn)
 		nread += nbytes;
 		buf[nread] = 0; // 0-terminate to allow string functions
 
-		if (nread < 4) continue;
-
-		if (nread == nbytes)
-			p = buf;
-		else
-			p = buf + nread - nbytes - 3;
-
-		if ((p = strstr(p, "\r\n\r\n"))) {
+		if ((p = find_end_of_header(buf, nread, &scanned))) {
 			// found end-of-header
 			*p = 0;
 
@@ -1028,6 +1407,8 @@ wget_http_response *wget_http_get_response_cb(wget_http_connection *conn)
 			if (server_stats_callback)
 				server_stats_callback(conn, resp);
 
+			update_altsvc_cache(conn, resp);
+
 			if (req->header_callback) {
 				req->header_callback(resp, req->header_user_data);
 			}
@@ -1042,8 +1423,9 @@ wget_http_response *wget_http_get_response_cb(wget_http_connection *conn)
 		}
 
 		if ((size_t)nread + 1024 > bufsize) {
-			if (wget_buffer_ensure_capacity(conn->buf, bufsize + 1024) != WGET_E_SUCCESS) {
-				error_printf(_("Failed to allocate %zu bytes\n"), bufsize + 1024);
+			// grow geometrically to keep the number of reallocations and reads low for large headers
+			if (wget_buffer_ensure_capacity(conn->buf, bufsize * 2) != WGET_E_SUCCESS) {
+				error_printf(_("Failed to allocate %zu bytes\n"), bufsize * 2);
 				goto cleanup;
 			}
 			buf = conn->buf->data;
@@ -1077,170 +1459,78 @@ wget_http_response *wget_http_get_response_cb(wget_http_connection *conn)
 
 	dc = wget_decompress_open(resp->content_encoding, get_body, resp);
 	wget_decompress_set_error_handler(dc, decompress_error_handler);
+	if (req->decompress_offload)
+		wget_decompress_set_offload(dc, true);
 
-	// calculate number of body bytes so far read
+	// calculate number of body bytes so far read, p points to them
 	body_len = nread - (p - buf);
-	// move already read body data to buf
-	memmove(buf, p, body_len);
-	buf[body_len] = 0;
-	resp->cur_downloaded = body_len;
 
 	if (resp->transfer_encoding == wget_transfer_encoding_chunked) {
-		size_t chunk_size = 0;
-		char *end;
-
-		debug_printf("method 1 %zu %zu:\n", body_len, body_size);
-		// RFC 2616 3.6.1
-		// Chunked-Body   = *chunk last-chunk trailer CRLF
-		// chunk          = chunk-size [ chunk-extension ] CRLF chunk-data CRLF
-		// chunk-size     = 1*HEX
-		// last-chunk     = 1*("0") [ chunk-extension ] CRLF
-		// chunk-extension= *( ";" chunk-ext-name [ "=" chunk-ext-val ] )
-		// chunk-ext-name = token
-		// chunk-ext-val  = token | quoted-string
-		// chunk-data     = chunk-size(OCTET)
-		// trailer        = *(entity-header CRLF)
-		// entity-header  = extension-header = message-header
-		// message-header = field-name ":" [ field-value ]
-		// field-name     = token
-		// field-value    = *( field-content | LWS )
-		// field-content  = <the OCTETs making up the field-value
-		//                  and consisting of either *TEXT or combinations
-		//                  of token, separators, and quoted-string>
-
-/*
-			length := 0
-			read chunk-size, chunk-extension (if any) and CRLF
-			while (chunk-size > 0) {
-				read chunk-data and CRLF
-				append chunk-data to entity-body
-				length := length + chunk-size
-				read chunk-size and CRLF
-			}
-			read entity-header
-			while (entity-header not empty) {
-				append entity-header to existing header fields
-				read entity-header
-			}
-			Content-Length := length
-			Remove "chunked" from Transfer-Encoding
-*/
-
-		// read each chunk, stripping the chunk info
-		p = buf;
-		for (;;) {
-			// read: chunk-size [ chunk-extension ] CRLF
-			while ((!(end = strchr(p, '\r')) || end[1] != '\n')) {
-				if (conn->abort_indicator || abort_indicator)
-					goto cleanup;
+		// RFC 7230 4.1, the body data is handed out in place, without copying
+		wget_http_chunked_decoder *decoder = wget_http_chunked_decoder_alloc();
+		const char *body;
+		char *small = NULL;
+		size_t consumed, body_length, small_length = 0;
+
+		debug_printf("method 1 %zu:\n", body_len);
+
+		while (decoder) {
+			for (; body_len > 0 && !wget_http_chunked_decoder_done(decoder); p += consumed, body_len -= consumed) {
+				if (wget_http_chunked_decode(decoder, p, body_len, &consumed, &body, &body_length) != WGET_E_SUCCESS) {
+					error_printf(_("Invalid chunked transfer-encoding\n"));
+					goto chunked_done;
+				}
 
-				if ((nbytes = wget_tcp_read(conn->tcp, buf + body_len, bufsize - body_len)) <= 0)
-					goto cleanup;
+				body_received(resp, body_length);
 
-				body_len += nbytes;
-				buf[body_len] = 0;
-				// debug_printf("a nbytes %zd body_len %zu\n", nbytes, body_len);
-			}
-			end += 2;
-
-			// now p points to chunk-size (hex)
-			chunk_size = (size_t) strtoll(p, NULL, 16);
-			// debug_printf("chunk size is %zu\n", chunk_size);
-			if (chunk_size == 0) {
-				// now read 'trailer CRLF' which is '*(entity-header CRLF) CRLF'
-				if (*end == '\r' && end[1] == '\n') // shortcut for the most likely case (empty trailer)
-					goto cleanup;
-
-				debug_printf("reading trailer\n");
-				while (!strstr(end, "\r\n\r\n")) {
-					if (body_len > 3) {
-						// just need to keep the last 3 bytes to avoid buffer resizing
-						memmove(buf, buf + body_len - 3, 4); // plus 0 terminator, just in case
-						body_len = 3;
+				if (body_length >= 4096) {
+					if (small_length) {
+						wget_decompress(dc, small, small_length);
+						small_length = 0;
 					}
-
-					if (conn->abort_indicator || abort_indicator)
-						goto cleanup;
-
-					if ((nbytes = wget_tcp_read(conn->tcp, buf + body_len, bufsize - body_len)) <= 0)
-						goto cleanup;
-
-					body_len += nbytes;
-					buf[body_len] = 0;
-					end = buf;
-					// debug_printf("a nbytes %zd\n", nbytes);
+					wget_decompress(dc, body, body_length);
+				} else if (body_length) {
+					// collect tiny chunks in place (over the already consumed chunk headers),
+					// to not call the decompressor and the body callback for each of them
+					if (!small_length)
+						small = (char *) body;
+					else if (small + small_length != body)
+						memmove(small + small_length, body, body_length);
+					small_length += body_length;
 				}
-				debug_printf("end of trailer \n");
-				goto cleanup;
 			}
 
-			// check for pointer overflow
-			if (chunk_size > SIZE_MAX/2 - 2 || end >= end + chunk_size + 2) {
-//			if (end > end + chunk_size || end >= end + chunk_size + 2) {
-				error_printf(_("Chunk size overflow: %lX\n"), chunk_size);
-				goto cleanup;
+			if (small_length) {
+				wget_decompress(dc, small, small_length);
+				small_length = 0;
 			}
 
-			p = end + chunk_size + 2;
-			if (p <= buf + body_len) {
-				// debug_printf("write full chunk, %zu bytes\n", chunk_size);
-				resp->cur_downloaded += chunk_size;
-				wget_decompress(dc, end, chunk_size);
-				continue;
+			if (wget_http_chunked_decoder_done(decoder)) {
+				debug_printf("end of chunked body\n");
+				break;
 			}
 
-			resp->cur_downloaded += (buf + body_len) - end;
-			wget_decompress(dc, end, (buf + body_len) - end);
-
-			chunk_size = (((uintptr_t) p) - ((uintptr_t) (buf + body_len))); // in fact needed bytes to have chunk_size+2 in buf
-
-			debug_printf("need at least %zu more bytes\n", chunk_size);
-
-			while (chunk_size > 0) {
-				if (conn->abort_indicator || abort_indicator)
-					goto cleanup;
+			if (conn->abort_indicator || abort_indicator)
+				break;
 
-				if ((nbytes = wget_tcp_read(conn->tcp, buf, bufsize)) <= 0)
-					goto cleanup;
-				// debug_printf("a nbytes=%zd chunk_size=%zu\n", nread, chunk_size);
+			if ((nbytes = wget_tcp_read(conn->tcp, buf, bufsize)) <= 0)
+				break;
 
-				if (chunk_size <= (size_t)nbytes) {
-					if (chunk_size == 1 || !strncmp(buf + chunk_size - 2, "\r\n", 2)) {
-						debug_printf("chunk completed\n");
-						// p=end+chunk_size+2;
-					} else {
-						error_printf(_("Expected end-of-chunk not found\n"));
-						goto cleanup;
-					}
-					if (chunk_size > 2) {
-						resp->cur_downloaded += chunk_size - 2;
-						wget_decompress(dc, buf, chunk_size - 2);
-					}
-					body_len = nbytes - chunk_size;
-					if (body_len)
-						memmove(buf, buf + chunk_size, body_len);
-					buf[body_len] = 0;
-					p = buf;
-					break;
-				} else {
-					chunk_size -= nbytes;
-					if (chunk_size >= 2) {
-						resp->cur_downloaded += nbytes;
-						wget_decompress(dc, buf, nbytes);
-					} else {
-						// special case: we got a partial end-of-chunk
-						resp->cur_downloaded += nbytes - 1;
-						wget_decompress(dc, buf, nbytes - 1);
-					}
-				}
-			}
+			p = buf;
+			body_len = nbytes;
 		}
+
+chunked_done:
+		if (small_length)
+			wget_decompress(dc, small, small_length);
+		wget_http_chunked_decoder_free(&decoder);
 	} else if (resp->content_length_valid && !resp->req->response_ignorelength) {
 		// read content_length bytes
 		debug_printf("method 2\n");
 
+		body_received(resp, body_len);
 		if (body_len)
-			wget_decompress(dc, buf, body_len);
+			wget_decompress(dc, p, body_len);
 
 		while (body_len < resp->content_length) {
 			if (conn->abort_indicator || abort_indicator)
@@ -1251,14 +1541,15 @@ wget_http_response *wget_http_get_response_cb(wget_http_connection *conn)
 
 			body_len += nbytes;
 			// debug_printf("nbytes %zd total %zu/%zu\n", nbytes, body_len, resp->content_length);
-			resp->cur_downloaded += nbytes;
+			body_received(resp, nbytes);
 			wget_decompress(dc, buf, nbytes);
 		}
 		if (nbytes < 0)
 			error_printf(_("Failed to read %zd bytes (%d)\n"), nbytes, errno);
 		if (body_len < resp->content_length) {
 			resp->length_inconsistent = true;
-			error_printf(_("Just got %zu of %zu bytes\n"), body_len, resp->content_length);
+			if (!conn->abort_indicator && !abort_indicator)
+				error_printf(_("Just got %zu of %zu bytes\n"), body_len, resp->content_length);
 		} else if (body_len > resp->content_length) {
 			resp->length_inconsistent = true;
 			error_printf(_("Body too large: %zu instead of %zu bytes\n"), body_len, resp->content_length);
@@ -1268,13 +1559,14 @@ wget_http_response *wget_http_get_response_cb(wget_http_connection *conn)
 		// read as long as we can
 		debug_printf("method 3\n");
 
+		body_received(resp, body_len);
 		if (body_len)
-			wget_decompress(dc, buf, body_len);
+			wget_decompress(dc, p, body_len);
 
 		while (!conn->abort_indicator && !abort_indicator && (nbytes = wget_tcp_read(conn->tcp, buf, bufsize)) > 0) {
 			body_len += nbytes;
 			// debug_printf("nbytes %zd total %zu\n", nbytes, body_len);
-			resp->cur_downloaded += nbytes;
+			body_received(resp, nbytes);
 			wget_decompress(dc, buf, nbytes);
 		}
 		resp->content_length = body_len;
@@ -1284,6 +1576,8 @@ cleanup:
 
 	if (resp)
 		resp->response_end = wget_get_timemillis();
+	else
+		wget_http_free_request(&req); // has been taken out of 'pending_requests'
 
 	wget_decompress_close(dc);
 
@@ -1415,6 +1709,25 @@ int wget_http_set_no_proxy(const char *no_proxy, const char *encoding)
 	return 0;
 }
 
+/**
+ * \param[in] cache Alt-Svc cache created by wget_altsvc_cache_init() or NULL
+ *
+ * Use alternative services (RFC 7838) for HTTPS connections that don't go through a proxy.
+ *
+ * Alt-Svc headers of responses are stored in \p cache. wget_http_open() then first tries to
+ * connect to a cached 'h2' or 'http/1.1' alternative of the origin. The server certificate must still be
+ * valid for the origin host. If the alternative fails, it is marked as broken and the origin is connected.
+ *
+ * Only alternatives over TCP are used. There is no QUIC transport, so 'h3' alternatives are stored
+ * but never connected to.
+ *
+ * \p cache must stay valid until it is unset by passing NULL.
+ */
+void wget_http_set_altsvc_cache(wget_altsvc_cache *cache)
+{
+	altsvc_cache = cache;
+}
+
 int wget_http_match_no_proxy(wget_vector *no_proxies_vec, const char *host)
 {
 	if (!no_proxies_vec || !host)
@@ -38,6 +38,12 @@ struct wget_http_connection_st {
 #ifdef WITH_LIBNGHTTP2
 	nghttp2_session *
 		http2_session;
+	long long
+		http2_ping_time; // when the bandwidth probe PING has been sent, 0 if none is in flight
+	size_t
+		http2_ping_bytes; // number of DATA bytes received since the bandwidth probe PING
+	int32_t
+		http2_window; // current stream and connection receive window size
 #endif
 	wget_vector
 		*pending_requests; // List of unresponsed requests (HTTP1 only)
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of libwget.
+ *
+ * Libwget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libwget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libwget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Decoder for HTTP chunked transfer-encoding
+ *
+ * References
+ *   RFC 7230 4.1 Chunked Transfer Coding
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <c-ctype.h>
+
+#include <wget.h>
+#include "private.h"
+
+/**
+ * \file
+ * \brief Decoder for HTTP chunked transfer-encoding
+ * \defgroup libwget-http-chunked Chunked transfer-encoding
+ * @{
+ *
+ * A resumable decoder for 'Transfer-Encoding: chunked' message bodies.
+ *
+ *     chunked-body   = *chunk last-chunk trailer-part CRLF
+ *     chunk          = chunk-size [ chunk-ext ] CRLF chunk-data CRLF
+ *     last-chunk     = 1*("0") [ chunk-ext ] CRLF
+ *     trailer-part   = *( header-field CRLF )
+ *
+ * The decoder keeps its state between calls, so the input may be split at any byte.
+ * Body data is not copied, but handed out as slices of the input buffer.
+ *
+ * Example:
+ *
+ *     while (!wget_http_chunked_decoder_done(decoder)) {
+ *         if ((nbytes = read(fd, buf, sizeof(buf))) <= 0)
+ *             return -1; // error or connection closed before the end of the body
+ *
+ *         for (const char *p = buf; nbytes > 0; p += consumed, nbytes -= consumed) {
+ *             if (wget_http_chunked_decode(decoder, p, nbytes, &consumed, &body, &body_length))
+ *                 return -1;
+ *             if (body_length)
+ *                 process(body, body_length);
+ *             if (consumed == 0)
+ *                 break; // end of the chunked body, the rest of buf belongs to the next message
+ *         }
+ *     }
+ */
+
+enum chunked_state {
+	CHUNK_SIZE_START,  // expect first hex digit of chunk-size
+	CHUNK_SIZE,        // hex digits of chunk-size
+	CHUNK_EXTENSION,   // skip chunk-ext up to LF
+	CHUNK_DATA,        // chunk-data
+	CHUNK_DATA_CR,     // CR after chunk-data
+	CHUNK_DATA_LF,     // LF after chunk-data
+	CHUNK_TRAILER,     // start of a trailer line
+	CHUNK_TRAILER_LINE,// skip trailer header field up to LF
+	CHUNK_TRAILER_LF,  // LF of the final CRLF
+	CHUNK_DONE
+};
+
+struct wget_http_chunked_decoder_st {
+	uint64_t
+		remaining; // number of bytes left in current chunk-data or value of the chunk-size being parsed
+	enum chunked_state
+		state;
+};
+
+/**
+ * \return New decoder, to be freed by wget_http_chunked_decoder_free()
+ *
+ * Create a decoder for a chunked message body.
+ */
+wget_http_chunked_decoder *wget_http_chunked_decoder_alloc(void)
+{
+	return wget_calloc(1, sizeof(wget_http_chunked_decoder));
+}
+
+/**
+ * \param[in] decoder Decoder to be freed
+ *
+ * Free the decoder and set \p *decoder to NULL.
+ */
+void wget_http_chunked_decoder_free(wget_http_chunked_decoder **decoder)
+{
+	if (decoder)
+		xfree(*decoder);
+}
+
+/**
+ * \param[in] decoder Decoder
+ * \return Whether the last chunk and the trailer have been decoded
+ */
+bool wget_http_chunked_decoder_done(const wget_http_chunked_decoder *decoder)
+{
+	return decoder->state == CHUNK_DONE;
+}
+
+/**
+ * \param[in] decoder Decoder
+ * \param[in] data Chunked input data
+ * \param[in] length Length of \p data
+ * \param[out] consumed Number of bytes of \p data that have been processed
+ * \param[out] body Set to the decoded body data, which is a slice of \p data
+ * \param[out] body_length Length of \p body, might be 0
+ * \return WGET_E_SUCCESS or WGET_E_INVALID if the input is not valid chunked encoding
+ *
+ * Decode \p data up to the end of the next piece of body data.
+ *
+ * Call this function repeatedly with the unconsumed rest of the input until everything
+ * has been consumed, then continue with the next input.
+ * After the final CRLF of the chunked body, nothing more is consumed and
+ * wget_http_chunked_decoder_done() returns true.
+ */
+int wget_http_chunked_decode(wget_http_chunked_decoder *decoder, const char *data, size_t length,
+	size_t *consumed, const char **body, size_t *body_length)
+{
+	const char *p = data, *end = data + length;
+
+	*body = NULL;
+	*body_length = 0;
+
+	while (p < end) {
+		switch (decoder->state) {
+		case CHUNK_SIZE_START:
+			if (!c_isxdigit(*p))
+				goto invalid;
+			decoder->remaining = 0;
+			decoder->state = CHUNK_SIZE;
+			// fallthrough
+		case CHUNK_SIZE:
+			for (; p < end && c_isxdigit(*p); p++) {
+				if (decoder->remaining > (UINT64_MAX >> 4))
+					goto invalid; // chunk size overflow
+				decoder->remaining = (decoder->remaining << 4) | (c_isdigit(*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+			}
+			if (p < end)
+				decoder->state = CHUNK_EXTENSION;
+			break;
+		case CHUNK_EXTENSION:
+			if (!(p = memchr(p, '\n', end - p))) {
+				p = end;
+				break;
+			}
+			p++;
+			decoder->state = decoder->remaining ? CHUNK_DATA : CHUNK_TRAILER;
+			break;
+		case CHUNK_DATA:
+		{
+			size_t n = (size_t) end - (size_t) p;
+
+			if (n > decoder->remaining)
+				n = (size_t) decoder->remaining;
+
+			*body = p;
+			*body_length = n;
+			p += n;
+
+			if (!(decoder->remaining -= n))
+				decoder->state = CHUNK_DATA_CR;
+
+			// hand out the body data in place
+			*consumed = p - data;
+			return WGET_E_SUCCESS;
+		}
+		case CHUNK_DATA_CR:
+			if (*p == '\r')
+				decoder->state = CHUNK_DATA_LF;
+			else if (*p == '\n')
+				decoder->state = CHUNK_SIZE_START;
+			else
+				goto invalid;
+			p++;
+			break;
+		case CHUNK_DATA_LF:
+			if (*p++ != '\n')
+				goto invalid;
+			decoder->state = CHUNK_SIZE_START;
+			break;
+		case CHUNK_TRAILER:
+			if (*p == '\r') {
+				decoder->state = CHUNK_TRAILER_LF;
+				p++;
+			} else if (*p == '\n') {
+				decoder->state = CHUNK_DONE;
+				p++;
+			} else
+				decoder->state = CHUNK_TRAILER_LINE;
+			break;
+		case CHUNK_TRAILER_LINE:
+			if (!(p = memchr(p, '\n', end - p))) {
+				p = end;
+				break;
+			}
+			p++;
+			decoder->state = CHUNK_TRAILER;
+			break;
+		case CHUNK_TRAILER_LF:
+			if (*p++ != '\n')
+				goto invalid;
+			decoder->state = CHUNK_DONE;
+			break;
+		case CHUNK_DONE:
+			*consumed = p - data;
+			return WGET_E_SUCCESS;
+		}
+	}
+
+	*consumed = p - data;
+	return WGET_E_SUCCESS;
+
+invalid:
+	*consumed = p - data;
+	return WGET_E_INVALID;
+}
+
+/** @} */
@@ -418,6 +418,93 @@ const char *wget_http_parse_challenges(const char *s, wget_vector *challenges)
 	return s;
 }
 
+// RFC 7838:
+// Alt-Svc       = clear / 1#alt-value
+// clear         = %s"clear"; "clear", case-sensitive
+// alt-value     = alternative *( OWS ";" OWS parameter )
+// alternative   = protocol-id "=" alt-authority
+// protocol-id   = token ; percent-encoded ALPN protocol name
+// alt-authority = quoted-string ; containing [ uri-host ] ":" port
+// parameter     = token "=" ( token / quoted-string )
+
+static bool parse_alt_authority(const char *authority, wget_http_altsvc *altsvc)
+{
+	const char *p = strrchr(authority, ':');
+	char *end;
+
+	if (!p || !c_isdigit(p[1]))
+		return false;
+
+	long port = strtol(p + 1, &end, 10);
+
+	if (*end || port < 1 || port > 65535)
+		return false;
+
+	altsvc->port = (uint16_t) port;
+
+	if (*authority == '[' && p > authority && p[-1] == ']')
+		altsvc->host = wget_strmemdup(authority + 1, p - authority - 2); // IPv6 address
+	else if (p > authority)
+		altsvc->host = wget_strmemdup(authority, p - authority);
+
+	return true;
+}
+
+const char *wget_http_parse_alt_svc(const char *s, wget_http_altsvc *altsvc)
+{
+	const char *authority, *name, *value;
+
+	memset(altsvc, 0, sizeof(*altsvc));
+	altsvc->maxage = 86400;
+
+	while (c_isblank(*s) || *s == ',') s++;
+	s = wget_http_parse_param(s, &altsvc->protocol, &authority);
+
+	while (c_isblank(*s)) s++;
+
+	while (*s == ';') {
+		s = wget_http_parse_param(s, &name, &value);
+		if (name && value) {
+			if (!wget_strcasecmp_ascii(name, "ma")) {
+				if ((altsvc->maxage = atoll(value)) < 0)
+					altsvc->maxage = 0;
+			} else if (!wget_strcasecmp_ascii(name, "persist"))
+				altsvc->persist = !strcmp(value, "1");
+		}
+
+		xfree(name);
+		xfree(value);
+		while (c_isblank(*s)) s++;
+	}
+
+	// skip anything we do not understand up to the next alt-value
+	while (*s && *s != ',') s++;
+
+	if (altsvc->protocol && *altsvc->protocol && authority && parse_alt_authority(authority, altsvc)) {
+		wget_percent_unescape((char *) altsvc->protocol);
+	} else {
+		xfree(altsvc->protocol);
+		xfree(altsvc->host);
+	}
+
+	xfree(authority);
+
+	return s;
+}
+
+const char *wget_http_parse_alt_svcs(const char *s, wget_vector *alt_svcs)
+{
+	wget_http_altsvc altsvc;
+
+	while (*s) {
+		s = wget_http_parse_alt_svc(s, &altsvc);
+		if (altsvc.protocol)
+			wget_vector_add_memdup(alt_svcs, &altsvc, sizeof(altsvc));
+	}
+
+	return s;
+}
+
 const char *wget_http_parse_location(const char *s, const char **location)
 {
 	const char *p;
@@ -674,6 +761,60 @@ const char *wget_http_parse_strict_transport_security(const char *s, int64_t *ma
 	return s;
 }
 
+// RFC 9111 5.2
+//
+// Cache-Control   = #cache-directive
+// cache-directive = token [ "=" ( token / quoted-string ) ]
+//
+// *maxage is set to -1 if there is no max-age directive
+
+const char *wget_http_parse_cache_control(const char *s, int64_t *maxage, bool *no_store, bool *no_cache)
+{
+	wget_http_header_param param;
+
+	*maxage = -1;
+	*no_store = 0;
+	*no_cache = 0;
+
+	while (*s) {
+		while (c_isblank(*s) || *s == ',') s++;
+
+		// not wget_http_parse_param(), which would swallow the ',' after a directive without value
+		param.value = NULL;
+		s = wget_http_parse_token(s, &param.name);
+		while (c_isblank(*s)) s++;
+
+		if (*s == '=') {
+			for (s++; c_isblank(*s); s++);
+			if (*s == '\"')
+				s = wget_http_parse_quoted_string(s, &param.value);
+			else
+				s = wget_http_parse_token(s, &param.value);
+		}
+
+		if (param.name) {
+			if (!wget_strcasecmp_ascii(param.name, "max-age")) {
+				if (param.value && c_isdigit(*param.value))
+					*maxage = (int64_t) atoll(param.value);
+				else
+					*maxage = 0; // invalid max-age, treat as stale
+			} else if (!wget_strcasecmp_ascii(param.name, "no-store")) {
+				*no_store = 1;
+			} else if (!wget_strcasecmp_ascii(param.name, "no-cache")) {
+				*no_cache = 1; // the field-name form also forces revalidation
+			}
+		}
+
+		xfree(param.name);
+		xfree(param.value);
+
+		// skip anything we do not understand up to the next directive
+		while (*s && *s != ',') s++;
+	}
+
+	return s;
+}
+
 // Content-Encoding  = "Content-Encoding" ":" 1#content-coding
 
 const char *wget_http_parse_content_encoding(const char *s, char *content_encoding)
@@ -1061,6 +1202,88 @@ static void cookie_free(void *cookie)
 		wget_cookie_free((wget_cookie **) &cookie);
 }
 
+enum http_header_id {
+	HEADER_UNKNOWN = 0,
+	HEADER_STATUS,
+	HEADER_AGE,
+	HEADER_ALT_SVC,
+	HEADER_CACHE_CONTROL,
+	HEADER_CONNECTION,
+	HEADER_CONTENT_DISPOSITION,
+	HEADER_CONTENT_ENCODING,
+	HEADER_CONTENT_LENGTH,
+	HEADER_CONTENT_SECURITY_POLICY,
+	HEADER_CONTENT_TYPE,
+	HEADER_DATE,
+	HEADER_DIGEST,
+	HEADER_ETAG,
+	HEADER_EXPIRES,
+	HEADER_ICY_METAINT,
+	HEADER_LAST_MODIFIED,
+	HEADER_LINK,
+	HEADER_LOCATION,
+	HEADER_PROXY_AUTHENTICATE,
+	HEADER_PUBLIC_KEY_PINS,
+	HEADER_SET_COOKIE,
+	HEADER_STRICT_TRANSPORT_SECURITY,
+	HEADER_TRANSFER_ENCODING,
+	HEADER_VARY,
+	HEADER_WWW_AUTHENTICATE,
+	HEADER_X_ARCHIVE_ORIG_LAST_MODIFIED,
+};
+
+static const struct http_header_name {
+	const char *
+		name;
+	unsigned char
+		len;
+	enum http_header_id
+		id;
+} header_names[128] = {
+	// index = (len + 4 * lower(first char) + lower(last char)) % 128, collision-free for these names
+	[2]   = { "content-length", 14, HEADER_CONTENT_LENGTH },
+	[3]   = { "content-encoding", 16, HEADER_CONTENT_ENCODING },
+	[4]   = { "connection", 10, HEADER_CONNECTION },
+	[5]   = { "cache-control", 13, HEADER_CACHE_CONTROL },
+	[10]  = { "digest", 6, HEADER_DIGEST },
+	[13]  = { "content-disposition", 19, HEADER_CONTENT_DISPOSITION },
+	[14]  = { "expires", 7, HEADER_EXPIRES },
+	[28]  = { "content-security-policy", 23, HEADER_CONTENT_SECURITY_POLICY },
+	[31]  = { "link", 4, HEADER_LINK },
+	[33]  = { "last-modified", 13, HEADER_LAST_MODIFIED },
+	[35]  = { "icy-metaint", 11, HEADER_ICY_METAINT },
+	[38]  = { "location", 8, HEADER_LOCATION },
+	[55]  = { "proxy-authenticate", 18, HEADER_PROXY_AUTHENTICATE },
+	[59]  = { "set-cookie", 10, HEADER_SET_COOKIE },
+	[66]  = { "public-key-pins", 15, HEADER_PUBLIC_KEY_PINS },
+	[72]  = { "transfer-encoding", 17, HEADER_TRANSFER_ENCODING },
+	[81]  = { "www-authenticate", 16, HEADER_WWW_AUTHENTICATE },
+	[85]  = { "vary", 4, HEADER_VARY },
+	[94]  = { "strict-transport-security", 25, HEADER_STRICT_TRANSPORT_SECURITY },
+	[96]  = { "x-archive-orig-last-modified", 28, HEADER_X_ARCHIVE_ORIG_LAST_MODIFIED },
+	[98]  = { ":status", 7, HEADER_STATUS },
+	[108] = { "age", 3, HEADER_AGE },
+	[110] = { "alt-svc", 7, HEADER_ALT_SVC },
+	[121] = { "date", 4, HEADER_DATE },
+	[125] = { "content-type", 12, HEADER_CONTENT_TYPE },
+	[127] = { "etag", 4, HEADER_ETAG },
+};
+
+// perfect hash lookup of the header names we are interested in
+static enum http_header_id get_header_id(const char *name, size_t namelen)
+{
+	if (namelen == 0 || namelen > 28)
+		return HEADER_UNKNOWN;
+
+	unsigned h = (unsigned) (namelen + 4 * c_tolower(name[0]) + c_tolower(name[namelen - 1])) % 128;
+	const struct http_header_name *entry = &header_names[h];
+
+	if (entry->len == namelen && !wget_strncasecmp_ascii(entry->name, name, namelen))
+		return entry->id;
+
+	return HEADER_UNKNOWN;
+}
+
 int wget_http_parse_header_line(wget_http_response *resp, const char *name, size_t namelen, const char *value, size_t valuelen)
 {
 	if (!name || !value)
@@ -1074,67 +1297,102 @@ int wget_http_parse_header_line(wget_http_response *resp, const char *name, size
 	if (!value0)
 		return WGET_E_MEMORY;
 
-	switch (*name | 0x20) {
-	case ':':
-		if (!memcmp(name, ":status", namelen) && valuelen == 3) {
+	switch (get_header_id(name, namelen)) {
+	case HEADER_STATUS:
+		if (valuelen == 3) {
 			resp->code = ((value[0] - '0') * 10 + (value[1] - '0')) * 10 + (value[2] - '0');
 		} else
 			ret = WGET_E_UNKNOWN;
 		break;
-	case 'c':
-		if (!wget_strncasecmp_ascii(name, "content-encoding", namelen)) {
-			wget_http_parse_content_encoding(value0, &resp->content_encoding);
-		} else if (!wget_strncasecmp_ascii(name, "content-type", namelen)) {
-			if (!resp->content_type && !resp->content_type_encoding)
-				wget_http_parse_content_type(value0, &resp->content_type, &resp->content_type_encoding);
-		} else if (!wget_strncasecmp_ascii(name, "content-length", namelen)) {
-			resp->content_length = (size_t)atoll(value0);
-			resp->content_length_valid = 1;
-		} else if (!wget_strncasecmp_ascii(name, "content-disposition", namelen)) {
-			if (!resp->content_filename)
-				wget_http_parse_content_disposition(value0, &resp->content_filename);
-		} else if (!wget_strncasecmp_ascii(name, "connection", namelen)) {
-			wget_http_parse_connection(value0, &resp->keep_alive);
-		} else if (!wget_strncasecmp_ascii(name, "Content-Security-Policy", namelen)) {
-			resp->csp = 1;
-		} else
-			ret = WGET_E_UNKNOWN;
+	case HEADER_AGE:
+		resp->age = atoll(value0);
 		break;
-	case 'd':
-		if (!wget_strncasecmp_ascii(name, "digest", namelen)) {
-			// https://tools.ietf.org/html/rfc3230
-			wget_http_digest digest;
-			wget_http_parse_digest(value0, &digest);
-			// debug_printf("%s: %s\n",digest.algorithm,digest.encoded_digest);
-			if (!resp->digests) {
-				resp->digests = wget_vector_create(4, NULL);
-				wget_vector_set_destructor(resp->digests, (wget_vector_destructor *) wget_http_free_digest);
-			}
-			wget_vector_add_memdup(resp->digests, &digest, sizeof(digest));
-		} else
-			ret = WGET_E_UNKNOWN;
+	case HEADER_ALT_SVC:
+		// https://tools.ietf.org/html/rfc7838, 'clear' leaves an empty vector
+		if (!resp->alt_svcs) {
+			resp->alt_svcs = wget_vector_create(2, NULL);
+			wget_vector_set_destructor(resp->alt_svcs, (wget_vector_destructor *) wget_http_free_alt_svc);
+		}
+		wget_http_parse_alt_svcs(value0, resp->alt_svcs);
 		break;
-	case 'e':
-		if (!wget_strncasecmp_ascii(name, "etag", namelen)) {
-			if (!resp->etag)
-				wget_http_parse_etag(value0, &resp->etag);
-		} else
-			ret = WGET_E_UNKNOWN;
+	case HEADER_CONTENT_ENCODING:
+		wget_http_parse_content_encoding(value0, &resp->content_encoding);
 		break;
-	case 'i':
-		if (!wget_strncasecmp_ascii(name, "icy-metaint", namelen)) {
-			resp->icy_metaint = atoi(value0);
-		} else
-			ret = WGET_E_UNKNOWN;
+	case HEADER_CONTENT_TYPE:
+		if (!resp->content_type && !resp->content_type_encoding)
+			wget_http_parse_content_type(value0, &resp->content_type, &resp->content_type_encoding);
+		break;
+	case HEADER_CONTENT_LENGTH:
+		resp->content_length = (size_t)atoll(value0);
+		resp->content_length_valid = 1;
+		break;
+	case HEADER_CONTENT_DISPOSITION:
+		if (!resp->content_filename)
+			wget_http_parse_content_disposition(value0, &resp->content_filename);
 		break;
-	case 'l':
-		if (!wget_strncasecmp_ascii(name, "last-modified", namelen)) {
-			// Last-Modified: Thu, 07 Feb 2008 15:03:24 GMT
-			resp->last_modified = wget_http_parse_full_date(value0);
-		} else if (resp->code / 100 == 3 && !wget_strncasecmp_ascii(name, "location", namelen)) {
+	case HEADER_CACHE_CONTROL:
+	{
+		int64_t maxage;
+		bool no_store, no_cache;
+
+		// there may be several Cache-Control headers
+		wget_http_parse_cache_control(value0, &maxage, &no_store, &no_cache);
+		if (maxage >= 0) {
+			resp->cache_maxage = maxage;
+			resp->cache_maxage_valid = 1;
+		}
+		resp->cache_no_store |= no_store;
+		resp->cache_no_cache |= no_cache;
+		break;
+	}
+	case HEADER_CONNECTION:
+		wget_http_parse_connection(value0, &resp->keep_alive);
+		break;
+	case HEADER_CONTENT_SECURITY_POLICY:
+		resp->csp = 1;
+		break;
+	case HEADER_DATE:
+		resp->date = wget_http_parse_full_date(value0);
+		break;
+	case HEADER_DIGEST:
+	{
+		// https://tools.ietf.org/html/rfc3230
+		wget_http_digest digest;
+		wget_http_parse_digest(value0, &digest);
+		// debug_printf("%s: %s\n",digest.algorithm,digest.encoded_digest);
+		if (!resp->digests) {
+			resp->digests = wget_vector_create(4, NULL);
+			wget_vector_set_destructor(resp->digests, (wget_vector_destructor *) wget_http_free_digest);
+		}
+		wget_vector_add_memdup(resp->digests, &digest, sizeof(digest));
+		break;
+	}
+	case HEADER_ETAG:
+		if (!resp->etag)
+			wget_http_parse_etag(value0, &resp->etag);
+		break;
+	case HEADER_EXPIRES:
+		// an invalid date (e.g. '0') means 'already expired'
+		if (!(resp->expires = wget_http_parse_full_date(value0)))
+			resp->expires = 1;
+		break;
+	case HEADER_ICY_METAINT:
+		resp->icy_metaint = atoi(value0);
+		break;
+	case HEADER_LAST_MODIFIED:
+	case HEADER_X_ARCHIVE_ORIG_LAST_MODIFIED:
+		// Last-Modified: Thu, 07 Feb 2008 15:03:24 GMT
+		resp->last_modified = wget_http_parse_full_date(value0);
+		break;
+	case HEADER_LOCATION:
+		if (resp->code / 100 == 3) {
 			if (!resp->location)
 				wget_http_parse_location(value0, &resp->location);
-		} else if (resp->code / 100 == 3 && !wget_strncasecmp_ascii(name, "link", namelen)) {
+		} else
+			ret = WGET_E_UNKNOWN;
+		break;
+	case HEADER_LINK:
+		if (resp->code / 100 == 3) {
 			// debug_printf("s=%.31s\n",s);
 			wget_http_link link;
 			wget_http_parse_link(value0, &link);
@@ -1147,83 +1405,69 @@ int wget_http_parse_header_line(wget_http_response *resp, const char *name, size
 		} else
 			ret = WGET_E_UNKNOWN;
 		break;
-	case 'p':
-		if (!wget_strncasecmp_ascii(name, "public-key-pins", namelen)) {
-			if (!resp->hpkp) {
-				resp->hpkp = wget_hpkp_new();
-				wget_http_parse_public_key_pins(value0, resp->hpkp);
-				debug_printf("new host pubkey pinnings added to hpkp db\n");
-			}
+	case HEADER_PUBLIC_KEY_PINS:
+		if (!resp->hpkp) {
+			resp->hpkp = wget_hpkp_new();
+			wget_http_parse_public_key_pins(value0, resp->hpkp);
+			debug_printf("new host pubkey pinnings added to hpkp db\n");
 		}
-		else if (!wget_strncasecmp_ascii(name, "proxy-authenticate", namelen)) {
-			wget_http_challenge *challenge = wget_malloc(sizeof(wget_http_challenge));
+		break;
+	case HEADER_PROXY_AUTHENTICATE:
+	case HEADER_WWW_AUTHENTICATE:
+	{
+		wget_http_challenge *challenge = wget_malloc(sizeof(wget_http_challenge));
 
-			if (!challenge) {
-				ret = WGET_E_MEMORY;
-				goto out;
-			}
+		if (!challenge) {
+			ret = WGET_E_MEMORY;
+			goto out;
+		}
 
-			wget_http_parse_challenge(value0, challenge);
+		wget_http_parse_challenge(value0, challenge);
 
-			if (!resp->challenges) {
-				resp->challenges = wget_vector_create(2, NULL);
-				wget_vector_set_destructor(resp->challenges, (wget_vector_destructor *) wget_http_free_challenge);
-			}
-			wget_vector_add(resp->challenges, challenge);
-		} else
-			ret = WGET_E_UNKNOWN;
+		if (!resp->challenges) {
+			resp->challenges = wget_vector_create(2, NULL);
+			wget_vector_set_destructor(resp->challenges, (wget_vector_destructor *) wget_http_free_challenge);
+		}
+		wget_vector_add(resp->challenges, challenge);
 		break;
-	case 's':
-		if (!wget_strncasecmp_ascii(name, "set-cookie", namelen)) {
-			// this is a parser. content validation must be done by higher level functions.
-			wget_cookie *cookie;
-			wget_http_parse_setcookie(value0, &cookie);
-
-			if (cookie) {
-				if (!resp->cookies) {
-					resp->cookies = wget_vector_create(4, NULL);
-					wget_vector_set_destructor(resp->cookies, cookie_free);
-				}
-				wget_vector_add(resp->cookies, cookie);
+	}
+	case HEADER_SET_COOKIE:
+	{
+		// this is a parser. content validation must be done by higher level functions.
+		wget_cookie *cookie;
+		wget_http_parse_setcookie(value0, &cookie);
+
+		if (cookie) {
+			if (!resp->cookies) {
+				resp->cookies = wget_vector_create(4, NULL);
+				wget_vector_set_destructor(resp->cookies, cookie_free);
 			}
+			wget_vector_add(resp->cookies, cookie);
 		}
-		else if (!wget_strncasecmp_ascii(name, "strict-transport-security", namelen)) {
-			resp->hsts = 1;
-			wget_http_parse_strict_transport_security(value0, &resp->hsts_maxage, &resp->hsts_include_subdomains);
-		} else
-			ret = WGET_E_UNKNOWN;
 		break;
-	case 't':
-		if (!wget_strncasecmp_ascii(name, "transfer-encoding", namelen)) {
-			wget_http_parse_transfer_encoding(value0, &resp->transfer_encoding);
-		} else
-			ret = WGET_E_UNKNOWN;
+	}
+	case HEADER_STRICT_TRANSPORT_SECURITY:
+		resp->hsts = 1;
+		wget_http_parse_strict_transport_security(value0, &resp->hsts_maxage, &resp->hsts_include_subdomains);
 		break;
-	case 'w':
-		if (!wget_strncasecmp_ascii(name, "www-authenticate", namelen)) {
-			wget_http_challenge *challenge = wget_malloc(sizeof(wget_http_challenge));
-
-			if (!challenge) {
-				ret = WGET_E_MEMORY;
-				goto out;
-			}
-
-			wget_http_parse_challenge(value0, challenge);
-
-			if (!resp->challenges) {
-				resp->challenges = wget_vector_create(2, NULL);
-				wget_vector_set_destructor(resp->challenges, (wget_vector_destructor *) wget_http_free_challenge);
-			}
-			wget_vector_add(resp->challenges, challenge);
-		} else
-			ret = WGET_E_UNKNOWN;
+	case HEADER_TRANSFER_ENCODING:
+		wget_http_parse_transfer_encoding(value0, &resp->transfer_encoding);
 		break;
-	case 'x':
-		if (!wget_strncasecmp_ascii(name, "x-archive-orig-last-modified", namelen)) {
-			resp->last_modified = wget_http_parse_full_date(value0);
-		} else
-			ret = WGET_E_UNKNOWN;
+	case HEADER_VARY:
+	{
+		// combine multiple Vary headers into one list
+		const char *p = value0;
+
+		while (c_isblank(*p)) p++;
+		if (!resp->vary)
+			resp->vary = wget_strdup(p);
+		else {
+			const char *vary = resp->vary;
+			resp->vary = wget_aprintf("%s, %s", vary, p);
+			xfree(vary);
+		}
 		break;
+	}
 	default:
 		ret = WGET_E_UNKNOWN;
 		break;
@@ -1236,39 +1480,79 @@ out:
 	return ret;
 }
 
+// parse a number of up to 3 characters, skipping leading whitespace (same as sscanf's %3hd)
+static char *parse_status_number(char *s, short *number)
+{
+	int n = 0, width = 3, negative = 0;
+
+	while (c_isspace(*s)) s++;
+
+	if (*s == '-' || *s == '+') {
+		negative = *s++ == '-';
+		width--;
+	}
+
+	if (!c_isdigit(*s))
+		return NULL;
+
+	while (width-- > 0 && c_isdigit(*s))
+		n = n * 10 + (*s++ - '0');
+
+	*number = (short) (negative ? -n : n);
+	return s;
+}
+
+// Parse 'HTTP/<major>.<minor> <code> <reason>' or 'ICY <code> <reason>'.
+// Returns a pointer behind the parsed data or NULL if the status line is invalid.
+static char *parse_status_line(char *s, wget_http_response *resp)
+{
+	while (c_isspace(*s)) s++;
+
+	if (!strncmp(s, "HTTP/", 5)) {
+		if (!(s = parse_status_number(s + 5, &resp->major)) || *s != '.')
+			return NULL;
+		if (!(s = parse_status_number(s + 1, &resp->minor)))
+			return NULL;
+	} else if (!strncmp(s, "ICY", 3)) {
+		s += 3;
+	} else
+		return NULL;
+
+	if (!(s = parse_status_number(s, &resp->code)))
+		return NULL;
+
+	while (c_isblank(*s)) s++;
+
+	size_t len;
+	for (len = 0; len < sizeof(resp->reason) - 1 && s[len] && s[len] != '\r' && s[len] != '\n'; len++)
+		;
+	memcpy(resp->reason, s, len);
+	resp->reason[len] = 0;
+
+	return s + len;
+}
+
 /* content of <buf> will be destroyed */
 /* buf must be 0-terminated */
 wget_http_response *wget_http_parse_response_header(char *buf)
 {
-	char *eol;
+	char *s, *eol;
 
 	wget_http_response *resp = wget_calloc(1, sizeof(wget_http_response));
 	if (!resp)
 		return NULL;
 
-	if (sscanf(buf, " HTTP/%3hd.%3hd %3hd %31[^\r\n] ",
-		&resp->major, &resp->minor, &resp->code, resp->reason) >= 3) {
-		if ((eol = strchr(buf + 10, '\n'))) {
-			// eol[-1]=0;
-			// debug_printf("# %s\n",buf);
-		} else {
-			// empty HTTP header
-			return resp;
-		}
-	} else if (sscanf(buf, " ICY %3hd %31[^\r\n] ", &resp->code, resp->reason) >= 1) {
-		if ((eol = strchr(buf + 4, '\n'))) {
-			// eol[-1]=0;
-			// debug_printf("# %s\n",buf);
-		} else {
-			// empty HTTP header
-			return resp;
-		}
-	} else {
+	if (!(s = parse_status_line(buf, resp))) {
 		error_printf(_("HTTP response header not found\n"));
 		xfree(resp);
 		return NULL;
 	}
 
+	if (!(eol = strchr(s, '\n'))) {
+		// empty HTTP header
+		return resp;
+	}
+
 	for (char *line = eol + 1; eol && *line && *line != '\r' && *line != '\n'; line = eol + 1) {
 		eol = strchr(line, '\n');
 		while (eol && c_isblank(eol[1])) { // handle split lines
@@ -1318,6 +1602,18 @@ void wget_http_free_links(wget_vector **links)
 	wget_vector_free(links);
 }
 
+void wget_http_free_alt_svc(wget_http_altsvc *altsvc)
+{
+	xfree(altsvc->protocol);
+	xfree(altsvc->host);
+	xfree(altsvc);
+}
+
+void wget_http_free_alt_svcs(wget_vector **alt_svcs)
+{
+	wget_vector_free(alt_svcs);
+}
+
 void wget_http_free_digest(wget_http_digest *digest)
 {
 	xfree(digest->algorithm);
@@ -1361,6 +1657,7 @@ void wget_http_free_response(wget_http_response **resp)
 		wget_http_free_links(&(*resp)->links);
 		wget_http_free_digests(&(*resp)->digests);
 		wget_http_free_challenges(&(*resp)->challenges);
+		wget_http_free_alt_svcs(&(*resp)->alt_svcs);
 		wget_http_free_cookies(&(*resp)->cookies);
 		wget_http_free_hpkp_entries(&(*resp)->hpkp);
 		xfree((*resp)->content_type);
@@ -1368,6 +1665,7 @@ void wget_http_free_response(wget_http_response **resp)
 		xfree((*resp)->content_filename);
 		xfree((*resp)->location);
 		xfree((*resp)->etag);
+		xfree((*resp)->vary);
 		// xfree((*resp)->reason);
 		wget_buffer_free(&(*resp)->header);
 		wget_buffer_free(&(*resp)->body);
@@ -92,7 +92,9 @@ void wget_global_init(int first_key, ...)
 
 	wget_console_init();
 	wget_random_init();
+	wget_encoding_init();
 	wget_http_init();
+	wget_decompress_init();
 
 	va_start (args, first_key);
 	for (key = first_key; key; key = va_arg(args, int)) {
@@ -213,6 +215,7 @@ void wget_global_deinit(void)
 
 		rc = wget_net_deinit();
 		wget_ssl_deinit();
+		wget_decompress_exit();
 		wget_http_set_http_proxy(NULL, NULL);
 		wget_http_set_https_proxy(NULL, NULL);
 		wget_http_set_no_proxy(NULL, NULL);
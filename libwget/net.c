@@ -39,6 +39,7 @@
 #include <time.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <netinet/in.h>
 
@@ -959,6 +960,71 @@ ssize_t wget_tcp_write(wget_tcp *tcp, const char *buf, size_t count)
 	return 0;
 }
 
+/*
+ * Write the buffers of \p iov in one go, like wget_tcp_write() does for a single buffer.
+ * Returns the number of bytes written, 0 on timeout or -1 on error.
+ */
+ssize_t tcp_writev(wget_tcp *tcp, const struct iovec *iov, int iovcnt)
+{
+#ifdef HAVE_WRITEV
+	// TLS and the first write of TCP Fast Open need a single buffer
+	if (!tcp->ssl_session && !(tcp->tcp_fastopen && tcp->first_send)) {
+		struct iovec vec[iovcnt];
+		ssize_t nwritten = 0;
+		int it = 0;
+
+		memcpy(vec, iov, sizeof(vec));
+
+		while (it < iovcnt) {
+			ssize_t n = writev(tcp->sockfd, vec + it, iovcnt - it);
+
+			if (n >= 0) {
+				nwritten += n;
+
+				// skip what has been written
+				for (; it < iovcnt && (size_t) n >= vec[it].iov_len; it++)
+					n -= vec[it].iov_len;
+
+				if (it < iovcnt) {
+					vec[it].iov_base = (char *) vec[it].iov_base + n;
+					vec[it].iov_len -= n;
+				}
+			} else {
+				if (errno != EAGAIN
+					&& errno != ENOTCONN
+					&& errno != EINPROGRESS)
+				{
+					error_printf(_("Failed to write %zd bytes (%d)\n"), nwritten, errno);
+					return -1;
+				}
+
+				if (tcp->timeout) {
+					int rc = wget_ready_2_write(tcp->sockfd, tcp->timeout);
+					if (rc <= 0)
+						return rc;
+				}
+			}
+		}
+
+		return nwritten;
+	}
+#endif
+
+	wget_buffer buf;
+	char sbuf[4096];
+	ssize_t n;
+
+	wget_buffer_init(&buf, sbuf, sizeof(sbuf));
+	for (int it = 0; it < iovcnt; it++)
+		wget_buffer_memcat(&buf, iov[it].iov_base, iov[it].iov_len);
+
+	n = wget_tcp_write(tcp, buf.data, buf.length);
+
+	wget_buffer_deinit(&buf);
+
+	return n;
+}
+
 /**
  * \param[in] tcp An active TCP connection.
  * \param[in] fmt Format string (like in `printf(3)`).
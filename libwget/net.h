@@ -29,6 +29,7 @@
 # define LIBWGET_NET_H
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netdb.h>
 
@@ -67,4 +68,6 @@ struct wget_tcp_st {
 		first_send : 1; // TCP_FASTOPEN's first packet is sent different
 };
 
+ssize_t tcp_writev(wget_tcp *tcp, const struct iovec *iov, int iovcnt);
+
 #endif /* LIBWGET_NET_H */
@@ -28,6 +28,7 @@
 #include <config.h>
 
 #include <string.h>
+#include <stdlib.h>
 #include <ctype.h>
 
 #include <wget.h>
@@ -42,13 +43,64 @@
  * The purpose of this set of functions is to parse a
  * Robots Exclusion Standard file into a data structure
  * for easy access.
+ *
+ * The rules that apply to the client are compiled into a path trie, so that
+ * wget_robots_is_allowed() walks the path once, however many rules there are.
+ * Matching follows RFC 9309:
+ *  - the groups naming the client's product token apply, else the groups for '*'
+ *  - the longest matching Allow or Disallow pattern wins, Allow wins a tie
+ *  - '*' matches any sequence of characters, a trailing '$' anchors the pattern at the end of the path
+ *
+ * References
+ *   RFC 9309 Robots Exclusion Protocol
  */
 
+enum {
+	RULE_NONE = 0,
+	RULE_DISALLOW = 1,
+	RULE_ALLOW = 2 // Allow wins a tie
+};
+
+typedef struct {
+	size_t
+		len; //!< length of the pattern
+	char
+		type; //!< RULE_ALLOW or RULE_DISALLOW
+	char
+		pattern[]; //!< 0-terminated pattern
+} robots_rule;
+
+struct robots_edge {
+	int
+		node; //!< index of the child node
+	char
+		c;
+};
+
+struct robots_node {
+	struct robots_edge
+		*edges;
+	int
+		nedges;
+	char
+		rule, //!< type of the pattern that ends here
+		rule_end; //!< type of the pattern with trailing '$' that ends here
+};
+
 struct wget_robots_st {
 	wget_vector
-		*paths;    //!< paths found in robots.txt (element: wget_string)
+		*paths;    //!< disallowed paths found in robots.txt (element: wget_string)
 	wget_vector
 		*sitemaps; //!< sitemaps found in robots.txt (element: char *)
+	wget_vector
+		*wildcards; //!< rules containing '*', longest first (element: robots_rule)
+	struct robots_node
+		*nodes; //!< path trie of the other rules, nodes[0] is the root
+	int
+		nnodes,
+		max_nodes;
+	int
+		crawl_delay; //!< Crawl-delay in milliseconds
 };
 
 static void path_free(void *path)
@@ -59,13 +111,208 @@ static void path_free(void *path)
 	xfree(p);
 }
 
+static int node_add(wget_robots *robots)
+{
+	if (robots->nnodes == robots->max_nodes) {
+		int max_nodes = robots->max_nodes ? robots->max_nodes * 2 : 64;
+		struct robots_node *nodes = wget_realloc(robots->nodes, max_nodes * sizeof(struct robots_node));
+
+		if (!nodes)
+			return -1;
+
+		robots->nodes = nodes;
+		robots->max_nodes = max_nodes;
+	}
+
+	memset(&robots->nodes[robots->nnodes], 0, sizeof(struct robots_node));
+
+	return robots->nnodes++;
+}
+
+static int WGET_GCC_PURE node_child(const wget_robots *robots, int node, char c)
+{
+	const struct robots_node *n = &robots->nodes[node];
+
+	for (int it = 0; it < n->nedges; it++) {
+		if (n->edges[it].c == c)
+			return n->edges[it].node;
+	}
+
+	return -1;
+}
+
+static int add_trie_rule(wget_robots *robots, const robots_rule *rule)
+{
+	size_t len = rule->len;
+	bool end = rule->pattern[len - 1] == '$';
+	int node = 0;
+
+	if (end)
+		len--;
+
+	for (size_t it = 0; it < len; it++) {
+		int child = node_child(robots, node, rule->pattern[it]);
+
+		if (child < 0) {
+			struct robots_node *n;
+			struct robots_edge *edges;
+
+			if ((child = node_add(robots)) < 0)
+				return WGET_E_MEMORY;
+
+			n = &robots->nodes[node];
+			if (!(edges = wget_realloc(n->edges, (n->nedges + 1) * sizeof(struct robots_edge))))
+				return WGET_E_MEMORY;
+
+			edges[n->nedges].c = rule->pattern[it];
+			edges[n->nedges].node = child;
+			n->edges = edges;
+			n->nedges++;
+		}
+
+		node = child;
+	}
+
+	if (end) {
+		if (robots->nodes[node].rule_end < rule->type)
+			robots->nodes[node].rule_end = rule->type;
+	} else if (robots->nodes[node].rule < rule->type)
+		robots->nodes[node].rule = rule->type;
+
+	return WGET_E_SUCCESS;
+}
+
+// longest rules first, Allow before Disallow of the same length
+static int compare_rule(const robots_rule *r1, const robots_rule *r2)
+{
+	if (r1->len != r2->len)
+		return r1->len < r2->len ? 1 : -1;
+
+	return r2->type - r1->type;
+}
+
+static int compile_rules(wget_robots *robots, const wget_vector *rules)
+{
+	if (node_add(robots) < 0) // root
+		return WGET_E_MEMORY;
+
+	for (int it = 0; it < wget_vector_size(rules); it++) {
+		const robots_rule *rule = wget_vector_get(rules, it);
+
+		if (rule->type == RULE_DISALLOW) {
+			// keep the list of disallowed paths for wget_robots_get_path()
+			wget_string path = { .len = rule->len };
+
+			if (!robots->paths) {
+				if (!(robots->paths = wget_vector_create(32, NULL)))
+					return WGET_E_MEMORY;
+				wget_vector_set_destructor(robots->paths, path_free);
+			}
+			if (!(path.p = wget_strmemdup(rule->pattern, rule->len)))
+				return WGET_E_MEMORY;
+			if (wget_vector_add_memdup(robots->paths, &path, sizeof(path)) < 0) {
+				xfree(path.p);
+				return WGET_E_MEMORY;
+			}
+		}
+
+		if (memchr(rule->pattern, '*', rule->len)) {
+			if (!robots->wildcards) {
+				if (!(robots->wildcards = wget_vector_create(8, (wget_vector_compare_fn *) compare_rule)))
+					return WGET_E_MEMORY;
+			}
+			if (wget_vector_add_memdup(robots->wildcards, rule, sizeof(robots_rule) + rule->len + 1) < 0)
+				return WGET_E_MEMORY;
+		} else if (add_trie_rule(robots, rule) != WGET_E_SUCCESS)
+			return WGET_E_MEMORY;
+	}
+
+	wget_vector_sort(robots->wildcards);
+
+	return WGET_E_SUCCESS;
+}
+
+// '*' matches any sequence, a trailing '$' anchors the end, else the pattern is a prefix
+static bool WGET_GCC_PURE wildcard_match(const char *pattern, size_t len, const char *path)
+{
+	const char *end = pattern + len, *star = NULL, *star_path = NULL;
+	bool anchored = len && end[-1] == '$';
+
+	if (anchored)
+		end--;
+
+	for (;;) {
+		if (pattern == end) {
+			if (!anchored || !*path)
+				return true;
+		} else if (*pattern == '*') {
+			star = ++pattern;
+			star_path = path;
+			continue;
+		} else if (*path && *pattern == *path) {
+			pattern++;
+			path++;
+			continue;
+		}
+
+		// mismatch: let the last '*' eat one more character
+		if (!star || !*star_path)
+			return false;
+
+		pattern = star;
+		path = ++star_path;
+	}
+}
+
+static const char *get_value(const char *data, const char *key, size_t key_length, size_t *value_length)
+{
+	const char *p;
+
+	if (wget_strncasecmp_ascii(data, key, key_length))
+		return NULL;
+
+	for (data += key_length; *data == ' ' || *data == '\t'; data++);
+	if (*data != ':')
+		return NULL;
+	for (data++; *data == ' ' || *data == '\t'; data++);
+
+	// the value ends at a comment or at the end of the line
+	for (p = data; *p && *p != '#' && *p != '\r' && *p != '\n'; p++);
+	while (p > data && (p[-1] == ' ' || p[-1] == '\t'))
+		p--;
+
+	*value_length = p - data;
+	return data;
+}
+
+static int add_rule(wget_vector **rules, char type, const char *pattern, size_t len)
+{
+	robots_rule *rule;
+
+	if (!*rules && !(*rules = wget_vector_create(32, NULL)))
+		return WGET_E_MEMORY;
+
+	if (!(rule = wget_malloc(sizeof(robots_rule) + len + 1)))
+		return WGET_E_MEMORY;
+
+	rule->len = len;
+	rule->type = type;
+	memcpy(rule->pattern, pattern, len);
+	rule->pattern[len] = 0;
+
+	if (wget_vector_add(*rules, rule) < 0)
+		return WGET_E_MEMORY;
+
+	return WGET_E_SUCCESS;
+}
+
 /**
  * \param[in] data Memory with robots.txt content (with trailing 0-byte)
  * \param[in] client Name of the client / user-agent
  * \return Return an allocated wget_robots structure or NULL on error
  *
  * The function parses the robots.txt \p data and returns a ROBOTS structure
- * including a list of the disallowed paths and including a list of the sitemap
+ * including the compiled rules that apply to \p client and including a list of the sitemap
  * files.
  *
  * The ROBOTS structure has to be freed by calling wget_robots_free().
@@ -73,10 +320,13 @@ static void path_free(void *path)
 int wget_robots_parse(wget_robots **_robots, const char *data, const char *client)
 {
 	wget_robots *robots;
-	wget_string path;
-	size_t client_length = client ? strlen(client) : 0;
-	int collect = 0;
-	const char *p;
+	wget_vector *client_rules = NULL, *star_rules = NULL;
+	size_t client_length = client ? strlen(client) : 0, len;
+	int client_delay = -1, star_delay = -1;
+	bool client_group = false, in_agents = false;
+	bool for_client = false, for_star = false; // current group applies to
+	const char *value, *p;
+	int rc = WGET_E_MEMORY;
 
 	if (!data || !*data || !_robots)
 		return WGET_E_INVALID;
@@ -85,76 +335,80 @@ int wget_robots_parse(wget_robots **_robots, const char *data, const char *clien
 		return WGET_E_MEMORY;
 
 	do {
-		if (collect < 2 && !wget_strncasecmp_ascii(data, "User-agent:", 11)) {
-			if (!collect) {
-				for (data += 11; *data == ' ' || *data == '\t'; data++);
-				if (client && !wget_strncasecmp_ascii(data, client, client_length)) {
-					collect = 1;
-				}
-				else if (*data == '*') {
-					collect = 1;
-				}
-			} else
-				collect = 2;
+		while (*data == ' ' || *data == '\t')
+			data++;
+
+		if ((value = get_value(data, "User-agent", 10, &len))) {
+			// consecutive User-agent lines form one group
+			if (!in_agents)
+				for_client = for_star = false;
+			in_agents = true;
+
+			// match the product token
+			for (p = value; p < value + len && *p != '/' && *p != ' ' && *p != '\t'; p++);
+			if (p - value == 1 && *value == '*')
+				for_star = true;
+			else if (client && (size_t) (p - value) == client_length && !wget_strncasecmp_ascii(value, client, client_length))
+				for_client = client_group = true;
+		}
+		else if ((value = get_value(data, "Disallow", 8, &len)) || (value = get_value(data, "Allow", 5, &len))) {
+			char type = (*data | 0x20) == 'a' ? RULE_ALLOW : RULE_DISALLOW;
+
+			in_agents = false;
+
+			// an empty value means no rule
+			if (len) {
+				if (for_client && add_rule(&client_rules, type, value, len) != WGET_E_SUCCESS)
+					goto out;
+				if (for_star && add_rule(&star_rules, type, value, len) != WGET_E_SUCCESS)
+					goto out;
+			}
 		}
-		else if (collect == 1 && !wget_strncasecmp_ascii(data, "Disallow:", 9)) {
-			for (data += 9; *data == ' ' || *data == '\t'; data++);
-			if (*data == '\r' || *data == '\n' || !*data) {
-				// all allowed
-				wget_vector_free(&robots->paths);
-				collect = 2;
-			} else {
-				if (!robots->paths) {
-					if (!(robots->paths = wget_vector_create(32, NULL)))
-						goto oom;
-					wget_vector_set_destructor(robots->paths, path_free);
-				}
-				for (p = data; *p && !isspace(*p); p++);
-				path.len = p - data;
-				if (!(path.p = wget_strmemdup(data, path.len)))
-					goto oom;
-				if (wget_vector_add_memdup(robots->paths, &path, sizeof(path)) < 0) {
-					xfree(path.p);
-					goto oom;
-				}
+		else if ((value = get_value(data, "Crawl-delay", 11, &len))) {
+			double seconds = atof(value);
+			int delay = seconds < 86400 ? (int) (seconds * 1000) : 86400 * 1000;
+
+			in_agents = false;
+
+			if (delay > 0) {
+				if (for_client)
+					client_delay = delay;
+				if (for_star)
+					star_delay = delay;
 			}
 		}
-		else if (!wget_strncasecmp_ascii(data, "Sitemap:", 8)) {
-			for (data += 8; *data==' ' || *data == '\t'; data++);
-			for (p = data; *p && !isspace(*p); p++);
+		else if ((value = get_value(data, "Sitemap", 7, &len))) {
+			for (p = value; p < value + len && !isspace(*p); p++);
 
 			if (!robots->sitemaps)
 				if (!(robots->sitemaps = wget_vector_create(4, NULL)))
-					goto oom;
+					goto out;
 
-			char *sitemap = wget_strmemdup(data, p - data);
+			char *sitemap = wget_strmemdup(value, p - value);
 			if (!sitemap)
-				goto oom;
+				goto out;
 			if (wget_vector_add(robots->sitemaps, sitemap) < 0)
-				goto oom;
+				goto out;
 		}
 
 		if ((data = strchr(data, '\n')))
 			data++; // point to next line
 	} while (data && *data);
 
-/*
-	for (int it = 0; it < wget_vector_size(robots->paths); it++) {
-		ROBOTS_PATH *path = wget_vector_get(robots->paths, it);
-		debug_printf("path '%s'\n", path->path);
-	}
-	for (int it = 0; it < wget_vector_size(robots->sitemaps); it++) {
-		const char *sitemap = wget_vector_get(robots->sitemaps, it);
-		debug_printf("sitemap '%s'\n", sitemap);
-	}
-*/
+	if (compile_rules(robots, client_group ? client_rules : star_rules) != WGET_E_SUCCESS)
+		goto out;
+
+	robots->crawl_delay = client_group ? client_delay : star_delay;
 
 	*(_robots) = robots;
-	return WGET_E_SUCCESS;
+	robots = NULL;
+	rc = WGET_E_SUCCESS;
 
-oom:
+out:
+	wget_vector_free(&client_rules);
+	wget_vector_free(&star_rules);
 	wget_robots_free(&robots);
-	return WGET_E_MEMORY;
+	return rc;
 }
 
 /**
@@ -167,6 +421,10 @@ void wget_robots_free(wget_robots **robots)
 	if (robots && *robots) {
 		wget_vector_free(&(*robots)->paths);
 		wget_vector_free(&(*robots)->sitemaps);
+		wget_vector_free(&(*robots)->wildcards);
+		for (int it = 0; it < (*robots)->nnodes; it++)
+			xfree((*robots)->nodes[it].edges);
+		xfree((*robots)->nodes);
 		xfree(*robots);
 		*robots = NULL;
 	}
@@ -222,4 +480,69 @@ const char *wget_robots_get_sitemap(wget_robots *robots, int index)
 	return NULL;
 }
 
+/**
+ * \param[in] robots Pointer to instance of wget_robots
+ * \param[in] path Absolute path of a URL, including the query, e.g. '/search?q=x'
+ * \return Whether \p path may be crawled
+ *
+ * The longest matching Allow or Disallow pattern decides, Allow wins a tie.
+ * Without a matching pattern and without \p robots, \p path is allowed.
+ */
+bool wget_robots_is_allowed(const wget_robots *robots, const char *path)
+{
+	size_t best_len = 0, it;
+	char best = RULE_NONE;
+
+	if (!robots || !path || !robots->nnodes || !strcmp(path, "/robots.txt"))
+		return true;
+
+	// walk down the trie, every node on the way is a matching prefix pattern
+	for (int node = 0, pos = 0; ; pos++) {
+		const struct robots_node *n = &robots->nodes[node];
+
+		if (n->rule && ((size_t) pos > best_len || ((size_t) pos == best_len && n->rule > best))) {
+			best_len = pos;
+			best = n->rule;
+		}
+
+		if (!path[pos]) {
+			// the '$' counts as part of the pattern length
+			if (n->rule_end && ((size_t) pos + 1 > best_len || ((size_t) pos + 1 == best_len && n->rule_end > best))) {
+				best_len = pos + 1;
+				best = n->rule_end;
+			}
+			break;
+		}
+
+		if ((node = node_child(robots, node, path[pos])) < 0)
+			break;
+	}
+
+	// rules with wildcards are sorted by length and type, stop at the first one that can't win
+	for (it = 0; it < (size_t) wget_vector_size(robots->wildcards); it++) {
+		const robots_rule *rule = wget_vector_get(robots->wildcards, (int) it);
+
+		if (rule->len < best_len || (rule->len == best_len && rule->type <= best))
+			break;
+
+		if (wildcard_match(rule->pattern, rule->len, path)) {
+			best_len = rule->len;
+			best = rule->type;
+		}
+	}
+
+	return best != RULE_DISALLOW;
+}
+
+/**
+ * \param[in] robots Pointer to instance of wget_robots
+ * \return The Crawl-delay of the group that applies, in milliseconds, or 0
+ *
+ * Crawl-delay is not part of RFC 9309, but widely used.
+ */
+int wget_robots_get_crawl_delay(const wget_robots *robots)
+{
+	return robots && robots->crawl_delay > 0 ? robots->crawl_delay : 0;
+}
+
 /**@}*/
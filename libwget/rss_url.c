@@ -40,6 +40,13 @@ struct rss_context {
 		*urls;
 };
 
+struct wget_rss_url_parser_st {
+	struct rss_context
+		context;
+	wget_xml_parser
+		*parser;
+};
+
 static void rss_get_url(void *context, int flags, const char *dir, const char *attr, const char *val, size_t len, size_t pos WGET_GCC_UNUSED)
 {
 	struct rss_context *ctx = context;
@@ -105,3 +112,54 @@ void wget_rss_get_urls_inline(const char *rss, wget_vector **urls)
 
 	*urls = context.urls;
 }
+
+/**
+ * \return A new RSS URL parser or NULL on memory allocation failure
+ *
+ * Creates a parser for RSS feed XML data that arrives in pieces, e.g. while it is being
+ * downloaded. Only the unparsed rest of the data is buffered.
+ *
+ * wget_rss_url_parser_feed() and wget_rss_url_parser_finish() return the URLs found
+ * by that call, the same as wget_rss_get_urls_inline() does for the whole data.
+ * The vector belongs to the parser, it and the pointers into the input stay valid
+ * until the next call.
+ *
+ * Free the parser with wget_rss_url_parser_free().
+ */
+wget_rss_url_parser *wget_rss_url_parser_init(void)
+{
+	wget_rss_url_parser *parser = wget_calloc(1, sizeof(wget_rss_url_parser));
+
+	if (!parser)
+		return NULL;
+
+	if (!(parser->parser = wget_xml_parser_init(rss_get_url, &parser->context, XML_HINT_REMOVE_EMPTY_CONTENT))) {
+		xfree(parser);
+		return NULL;
+	}
+
+	return parser;
+}
+
+void wget_rss_url_parser_feed(wget_rss_url_parser *parser, const char *data, size_t len, wget_vector **urls)
+{
+	wget_vector_clear(parser->context.urls);
+	wget_xml_parser_feed(parser->parser, data, len);
+	*urls = parser->context.urls;
+}
+
+void wget_rss_url_parser_finish(wget_rss_url_parser *parser, wget_vector **urls)
+{
+	wget_vector_clear(parser->context.urls);
+	wget_xml_parser_finish(parser->parser);
+	*urls = parser->context.urls;
+}
+
+void wget_rss_url_parser_free(wget_rss_url_parser **parser)
+{
+	if (parser && *parser) {
+		wget_xml_parser_free(&(*parser)->parser);
+		wget_vector_free(&(*parser)->context.urls);
+		xfree(*parser);
+	}
+}
@@ -50,6 +50,13 @@ struct sitemap_context {
 		*urls;
 };
 
+struct wget_sitemap_url_parser_st {
+	struct sitemap_context
+		context;
+	wget_xml_parser
+		*parser;
+};
+
 static void sitemap_get_url(void *context, int flags, const char *dir, const char *attr WGET_GCC_UNUSED, const char *val, size_t len, size_t pos WGET_GCC_UNUSED)
 {
 	struct sitemap_context *ctx = context;
@@ -111,4 +118,64 @@ void wget_sitemap_get_urls_inline(const char *sitemap, wget_vector **urls, wget_
 	*sitemap_urls = context.sitemap_urls;
 }
 
+/**
+ * \return A new Sitemap URL parser or NULL on memory allocation failure
+ *
+ * Creates a parser for Sitemap XML data that arrives in pieces, e.g. while it is being
+ * downloaded or decompressed. Only the unparsed rest of the data is buffered.
+ *
+ * wget_sitemap_url_parser_feed() and wget_sitemap_url_parser_finish() return the URLs
+ * and sitemap URLs found by that call, the same as wget_sitemap_get_urls_inline() does
+ * for the whole data. The vectors belong to the parser, they and the pointers into the
+ * input stay valid until the next call.
+ *
+ * Free the parser with wget_sitemap_url_parser_free().
+ */
+wget_sitemap_url_parser *wget_sitemap_url_parser_init(void)
+{
+	wget_sitemap_url_parser *parser = wget_calloc(1, sizeof(wget_sitemap_url_parser));
+
+	if (!parser)
+		return NULL;
+
+	if (!(parser->parser = wget_xml_parser_init(sitemap_get_url, &parser->context, XML_HINT_REMOVE_EMPTY_CONTENT))) {
+		xfree(parser);
+		return NULL;
+	}
+
+	return parser;
+}
+
+void wget_sitemap_url_parser_feed(wget_sitemap_url_parser *parser, const char *data, size_t len, wget_vector **urls, wget_vector **sitemap_urls)
+{
+	wget_vector_clear(parser->context.urls);
+	wget_vector_clear(parser->context.sitemap_urls);
+
+	wget_xml_parser_feed(parser->parser, data, len);
+
+	*urls = parser->context.urls;
+	*sitemap_urls = parser->context.sitemap_urls;
+}
+
+void wget_sitemap_url_parser_finish(wget_sitemap_url_parser *parser, wget_vector **urls, wget_vector **sitemap_urls)
+{
+	wget_vector_clear(parser->context.urls);
+	wget_vector_clear(parser->context.sitemap_urls);
+
+	wget_xml_parser_finish(parser->parser);
+
+	*urls = parser->context.urls;
+	*sitemap_urls = parser->context.sitemap_urls;
+}
+
+void wget_sitemap_url_parser_free(wget_sitemap_url_parser **parser)
+{
+	if (parser && *parser) {
+		wget_xml_parser_free(&(*parser)->parser);
+		wget_vector_free(&(*parser)->context.urls);
+		wget_vector_free(&(*parser)->context.sitemap_urls);
+		xfree(*parser);
+	}
+}
+
 /**@}*/
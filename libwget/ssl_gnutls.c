@@ -850,11 +850,10 @@ static int cert_verify_ocsp(gnutls_x509_crt_t cert, gnutls_x509_crt_t issuer)
 }
 #endif // WITH_OCSP
 
-static int cert_verify_hpkp(gnutls_x509_crt_t cert, const char *hostname, gnutls_session_t session)
+static int cert_verify_hpkp(gnutls_x509_crt_t cert, const char *hostname, wget_hpkp_stats_result *stats_hpkp)
 {
 	gnutls_pubkey_t key = NULL;
 	int rc, ret = -1;
-	struct session_context *ctx = gnutls_session_get_ptr(session);
 
 	if (!config.hpkp_cache)
 		return 0;
@@ -902,17 +901,17 @@ static int cert_verify_hpkp(gnutls_x509_crt_t cert, const char *hostname, gnutls
 	if (rc != -2) {
 		if (rc == 0) {
 			debug_printf("host has no pubkey pinnings stored in hpkp db\n");
-			ctx->stats_hpkp = WGET_STATS_HPKP_NO;
+			*stats_hpkp = WGET_STATS_HPKP_NO;
 		} else if (rc == 1) {
 			debug_printf("pubkey is matching a pinning\n");
-			ctx->stats_hpkp = WGET_STATS_HPKP_MATCH;
+			*stats_hpkp = WGET_STATS_HPKP_MATCH;
 		} else if (rc == -1) {
 			debug_printf("Error while checking pubkey pinning\n");
-			ctx->stats_hpkp = WGET_STATS_HPKP_ERROR;
+			*stats_hpkp = WGET_STATS_HPKP_ERROR;
 		}
 		ret = 0;
 	} else
-		ctx->stats_hpkp = WGET_STATS_HPKP_NOMATCH;
+		*stats_hpkp = WGET_STATS_HPKP_NOMATCH;
 
 out:
 	gnutls_pubkey_deinit(key);
@@ -1087,10 +1086,10 @@ static int verify_certificate_callback(gnutls_session_t session)
 			continue;
 		}
 
-		if (cert_verify_hpkp(cert, hostname, session) == 0)
+		if (cert_verify_hpkp(cert, hostname, &ctx->stats_hpkp) == 0)
 			pinning_ok = 1;
 
-		cert_verify_hpkp(cert, hostname, session);
+		cert_verify_hpkp(cert, hostname, &ctx->stats_hpkp);
 
 #ifdef WITH_OCSP
 		if (config.ocsp && it > nvalid) {
@@ -1836,6 +1835,54 @@ void wget_ssl_close(void **session)
 	}
 }
 
+/**
+ * \param[in] session An opaque pointer to an established SSL/TLS session
+ * \param[in] hostname Host name to check
+ * \return Whether the server certificate of \p session is valid for \p hostname and matches its HPKP pins
+ *
+ * This is used to reuse a connection for other host names (HTTP/2 connection coalescing, RFC 7540 9.1.1).
+ */
+bool wget_ssl_check_peer_hostname(void *session, const char *hostname)
+{
+	const gnutls_datum_t *cert_list;
+	unsigned int cert_list_size;
+	gnutls_x509_crt_t cert;
+	bool ok = false;
+
+	if (!session || !hostname || gnutls_certificate_type_get(session) != GNUTLS_CRT_X509)
+		return false;
+
+	if (!(cert_list = gnutls_certificate_get_peers(session, &cert_list_size)) || !cert_list_size)
+		return false;
+
+	if (gnutls_x509_crt_init(&cert) != GNUTLS_E_SUCCESS)
+		return false;
+
+	if (gnutls_x509_crt_import(cert, &cert_list[0], GNUTLS_X509_FMT_DER) == GNUTLS_E_SUCCESS)
+		ok = gnutls_x509_crt_check_hostname(cert, hostname) != 0;
+
+	if (ok && config.hpkp_cache) {
+		// like for a new connection, one of the certificates in the chain has to match the pins of 'hostname'
+		wget_hpkp_stats_result stats_hpkp;
+
+		ok = false;
+		for (unsigned it = 0; it < cert_list_size && !ok; it++) {
+			gnutls_x509_crt_deinit(cert);
+			gnutls_x509_crt_init(&cert);
+
+			if (gnutls_x509_crt_import(cert, &cert_list[it], GNUTLS_X509_FMT_DER) == GNUTLS_E_SUCCESS)
+				ok = cert_verify_hpkp(cert, hostname, &stats_hpkp) == 0;
+		}
+
+		if (!ok)
+			debug_printf("Public key pinning mismatch for %s\n", hostname);
+	}
+
+	gnutls_x509_crt_deinit(cert);
+
+	return ok;
+}
+
 /**
  * \param[in] session An opaque pointer to the SSL/TLS session (obtained with wget_ssl_open() or wget_ssl_server_open())
  * \param[in] buf Destination buffer where the read data will be placed
@@ -1518,6 +1518,38 @@ void wget_ssl_close(void **session)
 	}
 }
 
+/**
+ * \param[in] session An opaque pointer to an established SSL/TLS session
+ * \param[in] hostname Host name to check
+ * \return Whether the server certificate of \p session is valid for \p hostname and matches its HPKP pins
+ *
+ * This is used to reuse a connection for other host names (HTTP/2 connection coalescing, RFC 7540 9.1.1).
+ */
+bool wget_ssl_check_peer_hostname(void *session, const char *hostname)
+{
+	X509 *cert;
+	bool ok;
+
+	if (!session || !hostname || !(cert = SSL_get_peer_certificate((SSL *) session)))
+		return false;
+
+	ok = X509_check_host(cert, hostname, 0, 0, NULL) == 1;
+	X509_free(cert);
+
+	if (ok && config.hpkp_cache) {
+		// like for a new connection, the certificate chain has to match the pins of 'hostname'
+		STACK_OF(X509) *certs = SSL_get_peer_cert_chain((SSL *) session);
+		wget_hpkp_stats_result hpkp_stats;
+
+		if (!certs || !check_cert_chain_for_hpkp(certs, hostname, &hpkp_stats)) {
+			debug_printf("Public key pinning mismatch for %s\n", hostname);
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
 static int ssl_transfer(int want,
 		void *session, int timeout,
 		void *buf, int count)
@@ -1051,6 +1051,20 @@ void wget_ssl_close(void **session)
 	}
 }
 
+/**
+ * \param[in] session An opaque pointer to an established SSL/TLS session
+ * \param[in] hostname Host name to check
+ * \return Whether the server certificate of \p session is valid for \p hostname
+ *
+ * This is used to reuse a connection for other host names (HTTP/2 connection coalescing, RFC 7540 9.1.1).
+ *
+ * Not supported with WolfSSL, connections are not coalesced.
+ */
+bool wget_ssl_check_peer_hostname(void *session WGET_GCC_UNUSED, const char *hostname WGET_GCC_UNUSED)
+{
+	return false;
+}
+
 /**
  * \param[in] session An opaque pointer to the SSL/TLS session (obtained with wget_ssl_open() or wget_ssl_server_open())
  * \param[in] buf Destination buffer where the read data will be placed
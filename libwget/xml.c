@@ -56,7 +56,8 @@ typedef struct {
 		hints; // XML_HINT...
 	size_t
 		token_size, // size of token buffer
-		token_len; // used bytes of token buffer (not counting terminating 0 byte)
+		token_len, // used bytes of token buffer (not counting terminating 0 byte)
+		offset; // position of buf within the document, see wget_html_parser_feed()
 	void
 		*user_ctx; // user context (not needed if we were using nested functions)
 	wget_xml_callback
@@ -226,25 +227,30 @@ static int getValue(xml_context *context)
 
 static const char *getScriptContent(xml_context *context)
 {
-	int comment = 0, length_valid = 0;
+	int comment = 0, length_valid = 0, closed = 0;
 	const char *p;
 
 	for (p = context->token = context->p; *p; p++) {
 		if (comment) {
-			if (*p == '-' && !strncmp(p, "-->", 3)) {
-				p += 3 - 1;
-				comment = 0;
+			if (!(p = strstr(p, "-->"))) {
+				p = context->token + strlen(context->token);
+				break;
 			}
+			p += 3 - 1;
+			comment = 0;
 		} else {
-			if (*p == '<' && !strncmp(p, "<!--", 4)) {
+			if (!*(p = strchrnul(p, '<')))
+				break;
+			if (!strncmp(p, "<!--", 4)) {
 				p += 4 - 1;
 				comment = 1;
-			} else if (*p == '<' && !wget_strncasecmp_ascii(p, "</script", 8)) {
+			} else if (!wget_strncasecmp_ascii(p, "</script", 8)) {
 				context->token_len = p - context->token;
 				length_valid = 1;
 				for (p += 8; ascii_isspace(*p); p++);
 				if (*p == '>') {
 					p++;
+					closed = 1;
 					break; // found end of <script>
 				} else if (!*p)
 					break; // end of input
@@ -256,11 +262,12 @@ static const char *getScriptContent(xml_context *context)
 	if (!length_valid)
 		context->token_len = p - context->token;
 
-	if (!*p && !context->token_len)
+	// an empty <script></script> is reported, also if the input ends behind it
+	if (!closed && !context->token_len)
 		return NULL;
 
 	if (context->callback)
-		context->callback(context->user_ctx, XML_FLG_CONTENT | XML_FLG_END, "script", NULL, context->token, context->token_len, context->token - context->buf);
+		context->callback(context->user_ctx, XML_FLG_CONTENT | XML_FLG_END, "script", NULL, context->token, context->token_len, context->token - context->buf + context->offset);
 
 	return context->token;
 }
@@ -269,15 +276,14 @@ static const char *getUnparsed(xml_context *context, int flags, const char *end,
 {
 	int c;
 
-	if (len == 1) {
-		for (context->token = context->p; (c = *context->p) && c != *end; context->p++);
-	} else {
-		for (context->token = context->p; (c = *context->p); context->p++) {
-			if (c == *end && context->p[1] == end[1] && (len == 2 || context->p[2] == end[2])) {
-				break;
-			}
-		}
-	}
+	context->token = context->p;
+
+	if (len == 1)
+		context->p = strchrnul(context->p, *end);
+	else if (!(context->p = strstr(context->p, end)))
+		context->p = context->token + strlen(context->token);
+
+	c = *context->p;
 
 	context->token_len = context->p - context->token;
 	if (c) context->p += len;
@@ -298,7 +304,7 @@ static const char *getUnparsed(xml_context *context, int flags, const char *end,
 
 		if (notempty) {
 			if (context->callback)
-				context->callback(context->user_ctx, flags, directory, NULL, context->token, context->token_len, context->token - context->buf);
+				context->callback(context->user_ctx, flags, directory, NULL, context->token, context->token_len, context->token - context->buf + context->offset);
 		} else {
 			// ignore empty content
 			context->token_len = 0;
@@ -307,7 +313,7 @@ static const char *getUnparsed(xml_context *context, int flags, const char *end,
 	} else {
 */
 	if (context->callback)
-		context->callback(context->user_ctx, flags, directory, NULL, context->token, context->token_len, context->token - context->buf);
+		context->callback(context->user_ctx, flags, directory, NULL, context->token, context->token_len, context->token - context->buf + context->offset);
 
 //	}
 
@@ -333,7 +339,9 @@ static const char *getContent(xml_context *context, const char *directory)
 {
 	int c;
 
-		for (context->token = context->p; (c = *context->p) && c != '<'; context->p++);
+	context->token = context->p;
+	context->p = strchrnul(context->p, '<');
+	c = *context->p;
 
 	context->token_len = context->p - context->token;
 
@@ -342,7 +350,7 @@ static const char *getContent(xml_context *context, const char *directory)
 
 	// debug_printf("content=%.*s\n", (int)context->token_len, context->token);
 	if (context->callback && context->token_len)
-		context->callback(context->user_ctx, XML_FLG_CONTENT, directory, NULL, context->token, context->token_len, context->token - context->buf);
+		context->callback(context->user_ctx, XML_FLG_CONTENT, directory, NULL, context->token, context->token_len, context->token - context->buf + context->offset);
 
 	return context->token;
 }
@@ -429,7 +437,7 @@ static int parseXML(const char *dir, xml_context *context)
 					if (context->token_len) {
 						debug_printf("%s/@%s=%.*s\n", directory, attribute, (int)context->token_len, context->token);
 						if (context->callback)
-							context->callback(context->user_ctx, flags | XML_FLG_ATTRIBUTE, directory, attribute, context->token, context->token_len, context->token - context->buf);
+							context->callback(context->user_ctx, flags | XML_FLG_ATTRIBUTE, directory, attribute, context->token, context->token_len, context->token - context->buf + context->offset);
 					} else {
 						debug_printf("%s/@%s\n", directory, attribute);
 						if (context->callback)
@@ -478,6 +486,512 @@ static int parseXML(const char *dir, xml_context *context)
 	return WGET_E_SUCCESS;
 }
 
+/* \cond _hide_internal_symbols */
+// max. number of unparsed input bytes kept by wget_xml_parser_feed(), see xml_parser_limit()
+#define XML_PARSER_MAX_BUFFERED (10 * 1024 * 1024)
+
+// where the scanner of an incrementally fed document stands, see xml_scan()
+enum {
+	SCAN_CONTENT,
+	SCAN_LT, // behind '<'
+	SCAN_TAG, // between the tokens of a tag
+	SCAN_NAME, // within a name token
+	SCAN_WORD, // within any other unquoted token
+	SCAN_QUOTED, // within a quoted token
+	SCAN_COMMENT, // <!-- ... -->
+	SCAN_SPECIAL, // <! ... >
+	SCAN_PROCESSING, // <? ... ?>
+	SCAN_SCRIPT, // content of <script>
+	SCAN_SCRIPT_COMMENT // <!-- ... --> within <script>
+};
+
+// the token parseXML() reads next within a tag
+enum {
+	EXPECT_NAME, // element name
+	EXPECT_ATTRIBUTE, // attribute name or end of tag
+	EXPECT_EQUAL, // '=' or the next attribute
+	EXPECT_VALUE, // attribute value
+	EXPECT_END // the token closing an end tag
+};
+
+// the directories of the XML elements parseXML() is nested in, as lengths of the innermost one;
+// equal lengths are counted in one entry, so the lengths strictly increase
+typedef struct {
+	struct {
+		size_t
+			len,
+			count;
+	} entry[256];
+	int
+		n;
+} xml_levels;
+/* \endcond */
+
+struct wget_xml_parser_st {
+	wget_buffer
+		buf; // input that has not been parsed yet
+	wget_xml_callback
+		*callback;
+	void
+		*user_ctx;
+	size_t
+		consumed, // leading bytes of buf already parsed, removed with the next input
+		scan_pos, // scanner position within buf
+		boundary, // end of the last complete construct within buf that may be parsed, 0 if none
+		complete, // end of the last complete construct within buf, also within the head
+		skip, // leading bytes of buf that belong to a dropped construct, see xml_parser_limit()
+		offset, // position of buf within the document
+		name_pos, // the current element name within buf
+		name_len;
+	int
+		hints,
+		state, // SCAN_...
+		expect; // EXPECT_...
+	xml_levels
+		levels, // XML: the levels at the scanner position
+		start_levels; // XML: the levels at the start of buf
+	char
+		path[256], // XML: directory at the scanner position, see parseXML()
+		start_path[256], // XML: directory at the start of buf
+		quote; // the quote character in state SCAN_QUOTED
+	bool
+		end_tag : 1, // the current tag is an end tag
+		body : 1, // the document head is complete, always set for XML
+		skipping : 1, // the construct at the scanner position is being dropped
+		done : 1; // XML: the top level has been left, parseXML() ignores the rest
+};
+
+static bool is_element(const wget_xml_parser *parser, const char *name, size_t len)
+{
+	return parser->name_len == len && !wget_strncasecmp_ascii(parser->buf.data + parser->name_pos, name, len);
+}
+
+// the construct ending at 'pos' is complete, parseXML() would read content next
+static void scan_complete(wget_xml_parser *parser, size_t pos)
+{
+	parser->state = SCAN_CONTENT;
+
+	if (parser->skipping) {
+		// end of a dropped construct, parsing goes on behind it
+		parser->skipping = 0;
+		parser->skip = pos;
+		parser->start_levels = parser->levels;
+		memcpy(parser->start_path, parser->path, sizeof(parser->path));
+	}
+
+	parser->complete = pos;
+
+	// keep the head in one piece, it may set <base>, the charset or 'nofollow'
+	if (parser->body)
+		parser->boundary = pos;
+}
+
+static void xml_level_init(xml_levels *levels, char *path)
+{
+	levels->entry[0].len = 1;
+	levels->entry[0].count = 1;
+	levels->n = 1;
+	strcpy(path, "/");
+}
+
+// parseXML() descends into the element named by the current tag
+static void xml_level_push(wget_xml_parser *parser)
+{
+	xml_levels *levels = &parser->levels;
+	const char *name = parser->buf.data + parser->name_pos;
+	size_t len = parser->name_len, pos = levels->entry[levels->n - 1].len;
+	char *directory = parser->path;
+
+	if (len >= 2 && (*name == '\"' || *name == '\'')) {
+		// getToken() strips the quotes
+		name++;
+		len -= 2;
+	}
+
+	// see parseXML()
+	if (!pos || directory[pos - 1] != '/')
+		wget_snprintf(&directory[pos], sizeof(parser->path) - pos, "/%.*s", (int) len, name);
+	else
+		wget_snprintf(&directory[pos], sizeof(parser->path) - pos, "%.*s", (int) len, name);
+
+	if ((len = strlen(directory)) == pos)
+		levels->entry[levels->n - 1].count++;
+	else {
+		levels->entry[levels->n].len = len;
+		levels->entry[levels->n].count = 1;
+		levels->n++;
+	}
+}
+
+// parseXML() returns from the current level, returns false if that was the top level
+static bool xml_level_pop(xml_levels *levels, char *path)
+{
+	if (--levels->entry[levels->n - 1].count == 0 && --levels->n == 0)
+		return false;
+
+	path[levels->entry[levels->n - 1].len] = 0;
+	return true;
+}
+
+// parseXML() leaves the current level at 'pos' and reads content next
+static void scan_level_complete(wget_xml_parser *parser, size_t pos)
+{
+	if (!xml_level_pop(&parser->levels, parser->path))
+		parser->done = 1;
+
+	scan_complete(parser, pos);
+}
+
+// a tag ends at 'pos', 'close' is set if it ended with '>'
+static void scan_tag_complete(wget_xml_parser *parser, size_t pos, bool close)
+{
+	if (!(parser->hints & XML_HINT_HTML)) {
+		if (parser->end_tag) {
+			scan_level_complete(parser, pos);
+			return;
+		}
+		if (close)
+			xml_level_push(parser);
+	} else if (parser->end_tag) {
+		if (is_element(parser, "head", 4))
+			parser->body = 1;
+	} else if (close && is_element(parser, "script", 6)) {
+		parser->state = SCAN_SCRIPT;
+		return;
+	} else if (close && is_element(parser, "style", 5)) {
+		// parseXML() reads the style content together with the tag
+		parser->state = SCAN_CONTENT;
+		return;
+	} else if (is_element(parser, "body", 4) || is_element(parser, "frameset", 8))
+		parser->body = 1;
+
+	scan_complete(parser, pos);
+}
+
+// a token of a tag ends at 'pos', 'gt' is 1 for '>' and 2 for '/>'
+static void scan_token_complete(wget_xml_parser *parser, size_t pos, int gt)
+{
+	parser->state = SCAN_TAG;
+
+	switch (parser->expect) {
+	case EXPECT_NAME:
+		parser->name_len = pos - parser->name_pos;
+		parser->expect = parser->end_tag ? EXPECT_END : EXPECT_ATTRIBUTE;
+		break;
+	case EXPECT_ATTRIBUTE:
+		if (gt)
+			scan_tag_complete(parser, pos, gt == 1);
+		else
+			parser->expect = EXPECT_EQUAL;
+		break;
+	case EXPECT_VALUE:
+		parser->expect = EXPECT_ATTRIBUTE;
+		break;
+	case EXPECT_END:
+		scan_tag_complete(parser, pos, 0);
+		break;
+	}
+}
+
+/*
+ * Follows the input the way parseXML() tokenizes it and remembers where the last
+ * complete top-level construct ends. Stops where more input is needed to decide.
+ */
+static void xml_scan(wget_xml_parser *parser)
+{
+	const char *s = parser->buf.data, *p;
+	size_t len = parser->buf.length, pos = parser->scan_pos, n;
+	char c;
+
+	while (pos < len && !parser->done) {
+		c = s[pos];
+		n = len - pos; // number of bytes available at pos
+
+		switch (parser->state) {
+		case SCAN_CONTENT:
+			if ((p = memchr(s + pos, '<', n))) {
+				pos = p - s + 1;
+				parser->state = SCAN_LT;
+			} else
+				pos = len;
+			break;
+
+		case SCAN_LT:
+			if (c == '!') {
+				if (n < 3)
+					goto out;
+				if (s[pos + 1] == '-' && s[pos + 2] == '-') {
+					parser->state = SCAN_COMMENT;
+					pos += 3;
+				} else {
+					parser->state = SCAN_SPECIAL;
+					pos++;
+				}
+			} else if (c == '?') {
+				parser->state = SCAN_PROCESSING;
+				pos++;
+			} else {
+				parser->state = SCAN_TAG;
+				parser->expect = EXPECT_NAME;
+				parser->name_len = 0;
+				if ((parser->end_tag = (c == '/')))
+					pos++;
+			}
+			break;
+
+		case SCAN_TAG:
+			if (ascii_isspace(c)) {
+				pos++;
+				break;
+			}
+
+			if (parser->expect == EXPECT_EQUAL) {
+				if (c == '=') {
+					parser->expect = EXPECT_VALUE;
+					pos++;
+					break;
+				}
+				parser->expect = EXPECT_ATTRIBUTE; // attribute without value
+			}
+
+			if (parser->expect == EXPECT_NAME)
+				parser->name_pos = pos;
+
+			if (ascii_isalpha(c) || c == '_') {
+				parser->state = SCAN_NAME;
+				pos++;
+			} else if (c == '\"' || c == '\'') {
+				parser->state = SCAN_QUOTED;
+				parser->quote = c;
+				pos++;
+			} else if (c == '>') {
+				scan_token_complete(parser, ++pos, 1);
+			} else if (c == '=') {
+				scan_token_complete(parser, ++pos, 0);
+			} else if (c == '/' || c == '?') {
+				if (n < 2)
+					goto out;
+				if (s[pos + 1] == '>') {
+					pos += 2;
+					scan_token_complete(parser, pos, c == '/' ? 2 : 0);
+				} else if (c == '/' && !(parser->hints & XML_HINT_HTML)) {
+					// syntax error, getToken() consumed two bytes
+					pos += 2;
+					scan_level_complete(parser, pos);
+				} else {
+					parser->state = SCAN_WORD;
+					pos++;
+				}
+			} else if (c == '-') {
+				if (n < 3)
+					goto out;
+				if (s[pos + 1] == '-' && s[pos + 2] == '>') {
+					pos += 3;
+					scan_token_complete(parser, pos, 0);
+				} else {
+					parser->state = SCAN_WORD;
+					pos++;
+				}
+			} else if (c == '<') {
+				if (n < 4)
+					goto out;
+				if (s[pos + 1] == '?' || s[pos + 1] == '/')
+					pos += 2;
+				else if (s[pos + 1] == '!')
+					pos += (s[pos + 2] == '-' && s[pos + 3] == '-') ? 4 : 2;
+				else
+					pos++;
+				scan_token_complete(parser, pos, 0);
+			} else {
+				parser->state = SCAN_WORD;
+				pos++;
+			}
+			break;
+
+		case SCAN_NAME:
+			if (ascii_isspace(c) || c == '>' || c == '=')
+				scan_token_complete(parser, pos, 0);
+			else
+				pos++;
+			break;
+
+		case SCAN_WORD:
+			if (ascii_isspace(c))
+				scan_token_complete(parser, pos, 0);
+			else
+				pos++;
+			break;
+
+		case SCAN_QUOTED:
+			if ((p = memchr(s + pos, parser->quote, n))) {
+				pos = p - s + 1;
+				scan_token_complete(parser, pos, 0);
+			} else
+				pos = len;
+			break;
+
+		case SCAN_COMMENT:
+		case SCAN_SCRIPT_COMMENT:
+			if (c != '-') {
+				pos = (p = memchr(s + pos, '-', n)) ? (size_t) (p - s) : len;
+				break;
+			}
+			if (n < 3)
+				goto out;
+			if (s[pos + 1] == '-' && s[pos + 2] == '>') {
+				pos += 3;
+				if (parser->state == SCAN_COMMENT)
+					scan_complete(parser, pos);
+				else
+					parser->state = SCAN_SCRIPT;
+				break;
+			}
+			pos++;
+			break;
+
+		case SCAN_SPECIAL:
+			if ((p = memchr(s + pos, '>', n))) {
+				pos = p - s + 1;
+				scan_complete(parser, pos);
+			} else
+				pos = len;
+			break;
+
+		case SCAN_PROCESSING:
+			if (c != '?') {
+				pos = (p = memchr(s + pos, '?', n)) ? (size_t) (p - s) : len;
+				break;
+			}
+			if (n < 2)
+				goto out;
+			if (s[pos + 1] == '>') {
+				pos += 2;
+				scan_complete(parser, pos);
+				break;
+			}
+			pos++;
+			break;
+
+		case SCAN_SCRIPT:
+			// see getScriptContent()
+			if (c != '<') {
+				pos = (p = memchr(s + pos, '<', n)) ? (size_t) (p - s) : len;
+				break;
+			}
+			if (n < 8)
+				goto out;
+			if (!strncmp(s + pos, "<!--", 4)) {
+				parser->state = SCAN_SCRIPT_COMMENT;
+				pos += 4;
+				break;
+			}
+			if (!wget_strncasecmp_ascii(s + pos, "</script", 8)) {
+				size_t end;
+
+				for (end = pos + 8; end < len && ascii_isspace(s[end]); end++);
+				if (end == len)
+					goto out;
+				if (s[end] == '>')
+					scan_complete(parser, end + 1);
+				pos = end + 1;
+				break;
+			}
+			pos++;
+			break;
+		}
+	}
+
+out:
+	parser->scan_pos = pos;
+}
+
+// remove the input that has been parsed or dropped by the previous call
+static void xml_parser_discard(wget_xml_parser *parser)
+{
+	size_t n = parser->consumed;
+
+	if (!n)
+		return;
+
+	memmove(parser->buf.data, parser->buf.data + n, parser->buf.length - n + 1);
+	parser->buf.length -= n;
+	parser->scan_pos -= n;
+	if (parser->name_pos >= n)
+		parser->name_pos -= n;
+	else
+		parser->name_pos = parser->name_len = 0; // dropped with an endless tag
+	parser->complete = parser->complete >= n ? parser->complete - n : 0;
+	parser->skip = parser->skip >= n ? parser->skip - n : 0;
+	parser->offset += n;
+	parser->consumed = 0;
+}
+
+// call parseXML() for the level the input starts in and for each level it leaves before 'end'
+static void xml_parser_parse_levels(wget_xml_parser *parser, xml_context *context, const char *end)
+{
+	xml_levels *levels = &parser->start_levels;
+	char *path = parser->start_path;
+
+	while (parseXML(path, context), context->p < end) {
+		if (!xml_level_pop(levels, path))
+			break;
+	}
+
+	// the scanner stands at the end of the parsed input
+	*levels = parser->levels;
+	memcpy(path, parser->path, sizeof(parser->path));
+}
+
+// parse the input from 'start' to 'len', it is kept until the next call
+static void xml_parser_parse(wget_xml_parser *parser, size_t start, size_t len)
+{
+	char *data = parser->buf.data, c = data[len];
+	xml_context context = {
+		.buf = data,
+		.p = data + start,
+		.offset = parser->offset,
+		.user_ctx = parser->user_ctx,
+		.callback = parser->callback,
+		.hints = parser->hints,
+	};
+
+	data[len] = 0; // parseXML() stops at the 0 byte
+	if (parser->hints & XML_HINT_HTML)
+		parseXML("/", &context);
+	else
+		xml_parser_parse_levels(parser, &context, data + len);
+	data[len] = c;
+
+	parser->consumed = len;
+	parser->boundary = 0;
+}
+
+// called when the unparsed input reaches XML_PARSER_MAX_BUFFERED
+static void xml_parser_limit(wget_xml_parser *parser)
+{
+	size_t incomplete;
+
+	if (!parser->body) {
+		// no end of the head in sight, parse what is complete
+		parser->body = 1;
+		parser->boundary = parser->complete;
+	}
+
+	// the input up to the boundary is parsed anyway
+	incomplete = parser->scan_pos - (parser->boundary > parser->skip ? parser->boundary : parser->skip);
+	if (incomplete < XML_PARSER_MAX_BUFFERED / 2)
+		return;
+
+	if (parser->state == SCAN_CONTENT) {
+		// endless text, parseXML() reports it in pieces
+		parser->boundary = parser->scan_pos;
+	} else {
+		// an endless comment, script, tag, CDATA section ... is dropped, parsing goes on behind its end
+		debug_printf("Dropping incomplete construct of %zu bytes\n", incomplete);
+		parser->skipping = 1;
+	}
+}
+
 /**
  * \file
  * \brief XML parsing functions
@@ -512,6 +1026,7 @@ int wget_xml_parse_buffer(
 	context.token = NULL;
 	context.token_size = 0;
 	context.token_len = 0;
+	context.offset = 0;
 	context.buf = buf;
 	context.p = buf;
 	context.user_ctx = user_ctx;
@@ -621,4 +1136,185 @@ void wget_html_parse_file(
 	wget_xml_parse_file(fname, callback, user_ctx, hints | XML_HINT_HTML);
 }
 
+/**
+ * \param[in] callback Function called for each token scan result
+ * \param[in] user_ctx User-defined context variable, handed to \p callback
+ * \param[in] hints Flags to influence parsing
+ * \return A new XML parser or NULL on memory allocation failure
+ *
+ * Creates a parser for XML or HTML input that arrives in pieces, e.g. while it is being downloaded
+ * or decompressed. Feed the input with wget_xml_parser_feed() and call wget_xml_parser_finish()
+ * at the end of the input.
+ *
+ * \p callback is called the same way as with wget_xml_parse_buffer(), the position
+ * handed to it is relative to the start of the whole input.
+ *
+ * Only the unparsed rest of the input is buffered, so the memory needed does not
+ * grow with the size of the document.
+ *
+ * Free the parser with wget_xml_parser_free().
+ */
+wget_xml_parser *wget_xml_parser_init(wget_xml_callback *callback, void *user_ctx, int hints)
+{
+	wget_xml_parser *parser = wget_calloc(1, sizeof(wget_xml_parser));
+
+	if (!parser)
+		return NULL;
+
+	if (wget_buffer_init(&parser->buf, NULL, 16 * 1024) < 0) {
+		xfree(parser);
+		return NULL;
+	}
+
+	parser->callback = callback;
+	parser->user_ctx = user_ctx;
+	parser->hints = hints;
+
+	if (!(hints & XML_HINT_HTML)) {
+		parser->body = 1; // XML has no head to wait for
+		xml_level_init(&parser->levels, parser->path);
+		xml_level_init(&parser->start_levels, parser->start_path);
+	}
+
+	return parser;
+}
+
+/**
+ * \param[in] parser XML parser from wget_xml_parser_init()
+ * \param[in] data Next piece of the input
+ * \param[in] len Length of \p data
+ * \return The number of input bytes that have been parsed by this call
+ *
+ * Appends \p data to the input and parses all complete elements, comments and scripts.
+ * An incomplete construct at the end is kept until more input arrives.
+ *
+ * In HTML mode, the document head is not parsed before it is complete, so that e.g. a `<base>` or
+ * `<meta>` element is seen before any link of the body.
+ *
+ * The buffered input is limited to about 10 MB: a head without end is parsed as is, text is
+ * parsed in pieces and any other construct exceeding the limit (e.g. an unterminated comment,
+ * script or quote) is dropped up to its end.
+ *
+ * The token pointers handed to the callback stay valid until the next call of
+ * wget_xml_parser_feed(), wget_xml_parser_finish() or wget_xml_parser_free().
+ */
+size_t wget_xml_parser_feed(wget_xml_parser *parser, const char *data, size_t len)
+{
+	xml_parser_discard(parser);
+
+	if (parser->done)
+		return 0; // wget_xml_parse_buffer() would have stopped here
+
+	wget_buffer_memcat(&parser->buf, data, len);
+	if (parser->buf.error)
+		return 0;
+
+	xml_scan(parser);
+
+	// don't buffer without bounds, e.g. a document without </head> or an endless comment
+	if (parser->buf.length >= XML_PARSER_MAX_BUFFERED)
+		xml_parser_limit(parser);
+
+	size_t start = parser->skip, parsed = 0;
+
+	if (parser->boundary > start) {
+		xml_parser_parse(parser, start, parser->boundary);
+		parsed = parser->consumed - start;
+	}
+
+	if (parser->skipping)
+		parser->consumed = parser->scan_pos; // drop the incomplete construct
+	else if (parser->consumed < start)
+		parser->consumed = start; // drop the end of a construct
+
+	return parsed;
+}
+
+/**
+ * \param[in] parser XML parser from wget_xml_parser_init()
+ * \return The number of input bytes that have been parsed by this call
+ *
+ * Parses the rest of the input, including an incomplete construct at the end.
+ *
+ * The token pointers handed to the callback stay valid until the next call of
+ * wget_xml_parser_feed(), wget_xml_parser_finish() or wget_xml_parser_free().
+ */
+size_t wget_xml_parser_finish(wget_xml_parser *parser)
+{
+	xml_parser_discard(parser);
+
+	parser->state = SCAN_CONTENT;
+	parser->scan_pos = parser->buf.length;
+
+	if (parser->skipping || parser->skip >= parser->buf.length || parser->done)
+		return 0;
+
+	xml_parser_parse(parser, parser->skip, parser->buf.length);
+
+	return parser->consumed - parser->skip;
+}
+
+/**
+ * \param[in] parser Pointer to XML parser from wget_xml_parser_init()
+ *
+ * Frees the parser and its buffered input and sets \p *parser to NULL.
+ */
+void wget_xml_parser_free(wget_xml_parser **parser)
+{
+	if (parser && *parser) {
+		wget_buffer_deinit(&(*parser)->buf);
+		xfree(*parser);
+	}
+}
+
+/**
+ * \param[in] callback Function called for each token scan result
+ * \param[in] user_ctx User-defined context variable, handed to \p callback
+ * \param[in] hints Flags to influence parsing
+ * \return A new HTML parser or NULL on memory allocation failure
+ *
+ * Convenience function that calls wget_xml_parser_init() with HTML parsing turned on.
+ *
+ * Feed the input with wget_html_parser_feed() and call wget_html_parser_finish() at the end of the input.
+ * Free the parser with wget_html_parser_free().
+ */
+wget_html_parser *wget_html_parser_init(wget_xml_callback *callback, void *user_ctx, int hints)
+{
+	return wget_xml_parser_init(callback, user_ctx, hints | XML_HINT_HTML);
+}
+
+/**
+ * \param[in] parser HTML parser from wget_html_parser_init()
+ * \param[in] data Next piece of the HTML input
+ * \param[in] len Length of \p data
+ * \return The number of input bytes that have been parsed by this call
+ *
+ * Same as wget_xml_parser_feed().
+ */
+size_t wget_html_parser_feed(wget_html_parser *parser, const char *data, size_t len)
+{
+	return wget_xml_parser_feed(parser, data, len);
+}
+
+/**
+ * \param[in] parser HTML parser from wget_html_parser_init()
+ * \return The number of input bytes that have been parsed by this call
+ *
+ * Same as wget_xml_parser_finish().
+ */
+size_t wget_html_parser_finish(wget_html_parser *parser)
+{
+	return wget_xml_parser_finish(parser);
+}
+
+/**
+ * \param[in] parser Pointer to HTML parser from wget_html_parser_init()
+ *
+ * Same as wget_xml_parser_free().
+ */
+void wget_html_parser_free(wget_html_parser **parser)
+{
+	wget_xml_parser_free(parser);
+}
+
 /** @} */
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Persistent cache files with one entry per URL and line
+ *
+ * Used by the HTTP cache index and the robots.txt cache.
+ * Fields are separated by whitespace, '-' stands for an empty field.
+ * Lines starting with '#' are comments.
+ *
+ * The file is read at startup and written at exit. Entries that another
+ * process has written meanwhile are merged in, entries of this run win.
+ * This includes removals: removed URLs are remembered, so that the merge
+ * doesn't bring them back.
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <wget.h>
+
+#include "wget_main.h"
+#include "wget_log.h"
+#include "wget_cache_file.h"
+
+/**
+ * \param[in,out] linep Pointer to the rest of the line, moved behind the field
+ * \return The next field or NULL if it is empty or '-'
+ */
+const char *cache_file_next_field(char **linep)
+{
+	char *p = *linep, *field;
+
+	while (isspace(*p)) p++;
+	for (field = p; *p && !isspace(*p); p++);
+
+	if (*p)
+		*p++ = 0;
+	*linep = p;
+
+	return *field && strcmp(field, "-") ? field : NULL;
+}
+
+static int cache_file_load(void *context, FILE *fp)
+{
+	CACHE_FILE *cache = context;
+	char *buf = NULL, *linep;
+	size_t bufsize = 0;
+	const char *url;
+
+	while (wget_getline(&buf, &bufsize, fp) >= 0) {
+		linep = buf;
+
+		while (isspace(*linep)) linep++; // ignore leading whitespace
+		if (!*linep || *linep == '#')
+			continue; // skip empty lines and comments
+
+		if (!(url = cache_file_next_field(&linep))
+			|| wget_stringmap_contains(cache->entries, url)
+			|| wget_stringmap_contains(cache->removed, url))
+			continue; // entries and removals of this run are newer than those of the file
+
+		cache->load_entry(url, linep);
+	}
+
+	xfree(buf);
+
+	return ferror(fp) ? -1 : 0;
+}
+
+static int cache_file_save(void *context, FILE *fp)
+{
+	CACHE_FILE *cache = context;
+
+	wget_fprintf(fp, "#%s 1.0 file\n", cache->name);
+	fputs("#Generated by Wget2 " PACKAGE_VERSION ". Edit at your own risk.\n", fp);
+	wget_fprintf(fp, "# %s\n", cache->format);
+
+	wget_stringmap_browse(cache->entries, cache->save_entry, fp);
+
+	return ferror(fp) ? -1 : 0;
+}
+
+/**
+ * \param[in] cache Cache with name, format and callbacks set
+ * \param[in] fname Name of the cache file or NULL to not cache at all
+ * \param[in] max Expected number of entries
+ *
+ * Create the entries of \p cache and load them from \p fname.
+ * If the file can't be read, the cache starts empty.
+ */
+void cache_file_init(CACHE_FILE *cache, const char *fname, int max)
+{
+	if (!fname)
+		return;
+
+	cache->entries = wget_stringmap_create(max);
+	wget_stringmap_set_key_destructor(cache->entries, NULL); // the key is freed with the entry
+	wget_stringmap_set_value_destructor(cache->entries, cache->free_entry);
+	cache->removed = wget_stringmap_create(16);
+	wget_thread_mutex_init(&cache->mutex);
+
+	if (wget_update_file(fname, cache_file_load, NULL, cache)) {
+		error_printf(_("Failed to read %s file '%s'\n"), cache->name, fname);
+		return;
+	}
+
+	debug_printf("Loaded %d entries from %s file '%s'\n", wget_stringmap_size(cache->entries), cache->name, fname);
+}
+
+/**
+ * \param[in] cache Cache initialized by cache_file_init()
+ * \param[in] fname Name of the cache file
+ *
+ * Write the entries of \p cache to \p fname and free them.
+ */
+void cache_file_exit(CACHE_FILE *cache, const char *fname)
+{
+	if (!cache->entries)
+		return;
+
+	// entries that have been written meanwhile by another process are merged in
+	if (wget_update_file(fname, cache_file_load, cache_file_save, cache))
+		error_printf(_("Failed to write %s file '%s'\n"), cache->name, fname);
+
+	wget_stringmap_free(&cache->entries);
+	wget_stringmap_free(&cache->removed);
+	wget_thread_mutex_destroy(&cache->mutex);
+}
+
+/**
+ * \param[in] cache Cache initialized by cache_file_init()
+ * \param[in] url URL of the entry
+ * \param[in] entry Entry that owns \p url as key
+ *
+ * Add \p entry to \p cache, replacing an entry of the same URL.
+ * The caller must hold cache->mutex.
+ */
+void cache_file_put(CACHE_FILE *cache, const char *url, void *entry)
+{
+	wget_stringmap_remove(cache->removed, url);
+	wget_stringmap_put(cache->entries, url, entry);
+}
+
+/**
+ * \param[in] cache Cache initialized by cache_file_init()
+ * \param[in] url URL of the entry
+ *
+ * Remove the entry of \p url from \p cache and keep it from being merged in again
+ * from the file by cache_file_exit(). The caller must hold cache->mutex.
+ */
+void cache_file_remove(CACHE_FILE *cache, const char *url)
+{
+	wget_stringmap_remove(cache->entries, url);
+
+	if (!wget_stringmap_contains(cache->removed, url))
+		wget_stringmap_put(cache->removed, wget_strdup(url), NULL);
+}
@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Content-addressed deduplication store
+ *
+ * Downloaded files are hashed while being written. After a download the file
+ * is looked up in the store by its digest:
+ *  - unknown content is linked into the store as <dir>/<xx>/<rest>, where <xx> are the
+ *    first two and <rest> the remaining 62 hex digits of the SHA-256 digest
+ *  - known content replaces the downloaded file by a link to the stored object
+ *
+ * Hard links share the inode (and with it mtime and extended attributes),
+ * so they are only used when no per-file metadata or later modification is expected.
+ * Otherwise (and when hard linking fails) a reflink (copy-on-write clone) is tried.
+ * Before a hard linked file is written again (e.g. re-downloaded), dedup_unshare()
+ * replaces it by a private copy, so the store and the other copies stay intact.
+ * Store objects are compared with the downloaded file before they are linked.
+ *
+ * The file <dir>/index gets a line '<digest>  <path>' (same format as sha256sum output)
+ * whenever a downloaded file is linked with the store, <path> as given on the command line
+ * or derived from the URL, i.e. relative to the working directory of that run.
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#  include <sys/ioctl.h>
+#  include <linux/fs.h> // FICLONE
+#endif
+
+#include <wget.h>
+
+#include "safe-read.h"
+#include "safe-write.h"
+
+#include "wget_main.h"
+#include "wget_log.h"
+#include "wget_options.h"
+#include "wget_utils.h"
+#include "wget_dedup.h"
+
+static wget_thread_mutex
+	mutex;
+static int
+	index_fd = -1,
+	ndedup;
+static long long
+	saved_bytes;
+static bool
+	hardlinks;
+
+int dedup_init(void)
+{
+	if (!config.dedup_dir)
+		return 0;
+
+	// hard linked files share metadata and content, which breaks these options
+	hardlinks = !(config.xattr || config.convert_links || config.convert_file_only || config.timestamping);
+
+	char *fname = wget_aprintf("%s/index", config.dedup_dir);
+
+	mkdir_path(fname, true);
+
+	if ((index_fd = open(fname, O_WRONLY | O_APPEND | O_CREAT | O_BINARY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
+		error_printf(_("Failed to open deduplication index '%s' (%d)\n"), fname, errno);
+		set_exit_status(EXIT_STATUS_IO);
+		xfree(fname);
+		return -1;
+	}
+
+	xfree(fname);
+	wget_thread_mutex_init(&mutex);
+
+	return 0;
+}
+
+void dedup_exit(void)
+{
+	if (!config.dedup_dir)
+		return;
+
+	if (ndedup) {
+		char buf[16];
+
+		info_printf(_("Deduplicated: %d files, %s bytes\n"), ndedup, wget_human_readable(buf, sizeof(buf), saved_bytes));
+	}
+
+	if (index_fd != -1) {
+		close(index_fd);
+		index_fd = -1;
+	}
+
+	wget_thread_mutex_destroy(&mutex);
+}
+
+static int reflink(const char *src, const char *dst)
+{
+#ifdef FICLONE
+	int sfd, dfd, rc = -1;
+
+	if ((sfd = open(src, O_RDONLY | O_BINARY)) != -1) {
+		if ((dfd = open(dst, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) != -1) {
+			if ((rc = ioctl(dfd, FICLONE, sfd)))
+				unlink(dst);
+			close(dfd);
+		}
+		close(sfd);
+	}
+
+	return rc;
+#else
+	(void) src; (void) dst;
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+static int link_or_clone(const char *src, const char *dst)
+{
+	if (hardlinks && link(src, dst) == 0)
+		return 0;
+
+	return reflink(src, dst);
+}
+
+// copy 'src' into the new file 'dst', as a reflink if possible
+static int copy_file(const char *src, const char *dst)
+{
+	char buf[65536];
+	ssize_t nbytes;
+	int sfd, dfd, rc = 0;
+
+	if (reflink(src, dst) == 0)
+		return 0;
+
+	if ((sfd = open(src, O_RDONLY | O_BINARY)) == -1)
+		return -1;
+
+	if ((dfd = open(dst, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
+		close(sfd);
+		return -1;
+	}
+
+	while ((nbytes = read(sfd, buf, sizeof(buf))) > 0) {
+		if (safe_write(dfd, buf, nbytes) != (size_t) nbytes) {
+			rc = -1;
+			break;
+		}
+	}
+
+	if (nbytes < 0)
+		rc = -1;
+
+	close(sfd);
+	if (close(dfd))
+		rc = -1;
+
+	if (rc)
+		unlink(dst);
+
+	return rc;
+}
+
+// compare the content of two files of the same size
+static bool same_content(const char *fname1, const char *fname2)
+{
+	char buf1[65536], buf2[sizeof(buf1)];
+	size_t n1, n2;
+	int fd1, fd2;
+	bool same = false;
+
+	if ((fd1 = open(fname1, O_RDONLY | O_BINARY)) == -1)
+		return false;
+
+	if ((fd2 = open(fname2, O_RDONLY | O_BINARY)) != -1) {
+		for (;;) {
+			n1 = safe_read(fd1, buf1, sizeof(buf1));
+			n2 = safe_read(fd2, buf2, sizeof(buf2));
+
+			if (n1 != n2 || n1 == SAFE_READ_ERROR || memcmp(buf1, buf2, n1))
+				break;
+
+			if (n1 == 0) {
+				same = true;
+				break;
+			}
+		}
+
+		close(fd2);
+	}
+
+	close(fd1);
+
+	return same;
+}
+
+/**
+ * \param[in] fname Name of a file that is about to be written
+ * \param[in] keep_content Whether the current content is still needed (e.g. when appending)
+ *
+ * A hard linked file shares its inode with the store object and all other copies,
+ * writing into it would change all of them. So \p fname is removed or replaced
+ * by a private copy if it has more than one link.
+ */
+void dedup_unshare(const char *fname, bool keep_content)
+{
+	struct stat st;
+
+	if (index_fd == -1)
+		return;
+
+	// several threads may write parts of the same file
+	wget_thread_mutex_lock(mutex);
+
+	if (stat(fname, &st) || !S_ISREG(st.st_mode) || st.st_nlink < 2) {
+		wget_thread_mutex_unlock(mutex);
+		return;
+	}
+
+	if (!keep_content) {
+		if (unlink(fname) < 0 && errno != ENOENT)
+			error_printf(_("Failed to unlink '%s' (errno=%d)\n"), fname, errno);
+		else
+			debug_printf("'%s' unlinked from the deduplication store\n", fname);
+	} else {
+		char *tmp = wget_aprintf("%s.dedup", fname);
+
+		unlink(tmp);
+		if (copy_file(fname, tmp) == 0 && rename(tmp, fname) == 0)
+			debug_printf("'%s' copied out of the deduplication store\n", fname);
+		else {
+			error_printf(_("Failed to copy '%s' out of the deduplication store (%d)\n"), fname, errno);
+			set_exit_status(EXIT_STATUS_IO);
+			unlink(tmp);
+		}
+
+		xfree(tmp);
+	}
+
+	wget_thread_mutex_unlock(mutex);
+}
+
+static void add_index_entry(const char *digest, const char *fname)
+{
+	wget_buffer buf;
+	char sbuf[256];
+
+	wget_buffer_init(&buf, sbuf, sizeof(sbuf));
+	wget_buffer_printf(&buf, "%s  %s\n", digest, fname);
+
+	if (safe_write(index_fd, buf.data, buf.length) != buf.length)
+		error_printf(_("Failed to write deduplication index (%d)\n"), errno);
+
+	wget_buffer_deinit(&buf);
+}
+
+/**
+ * \param[in] fname Name of the downloaded file
+ * \param[in] hash Hash handle that has been fed with the file content, freed here
+ *
+ * Replace \p fname by a link to an identical object of the store, or
+ * add \p fname to the store if its content is not known yet.
+ */
+void dedup_file(const char *fname, wget_hash_hd **hash)
+{
+	int len = wget_hash_get_len(DEDUP_DIGTYPE);
+	unsigned char digest[len];
+	char digest_hex[len * 2 + 1];
+	struct stat st_obj, st_file;
+
+	wget_hash_deinit(hash, digest);
+
+	if (!fname || index_fd == -1 || stat(fname, &st_file) || !S_ISREG(st_file.st_mode))
+		return;
+
+	wget_memtohex(digest, len, digest_hex, sizeof(digest_hex));
+
+	char *object = wget_aprintf("%s/%.2s/%s", config.dedup_dir, digest_hex, digest_hex + 2);
+
+	wget_thread_mutex_lock(mutex);
+
+	if (stat(object, &st_obj) == 0) {
+		if (st_obj.st_ino == st_file.st_ino && st_obj.st_dev == st_file.st_dev) {
+			debug_printf("'%s' is already deduplicated\n", fname);
+		} else if (st_obj.st_size != st_file.st_size || !same_content(object, fname)) {
+			// the object has been modified outside of wget, replace it by the downloaded file
+			char *tmp = wget_aprintf("%s.tmp", object);
+
+			error_printf(_("Deduplication object '%s' doesn't match its digest, replacing it\n"), object);
+
+			unlink(tmp);
+			if (link_or_clone(fname, tmp) == 0 && rename(tmp, object) == 0)
+				add_index_entry(digest_hex, fname);
+			else {
+				debug_printf("Failed to replace '%s' (%d)\n", object, errno);
+				unlink(tmp);
+			}
+
+			xfree(tmp);
+		} else {
+			// link the object next to the downloaded file and atomically replace it
+			char *tmp = wget_aprintf("%s.dedup", fname);
+
+			unlink(tmp);
+			if (link_or_clone(object, tmp) == 0 && rename(tmp, fname) == 0) {
+				debug_printf("'%s' deduplicated (%s)\n", fname, digest_hex);
+				add_index_entry(digest_hex, fname);
+				saved_bytes += st_file.st_size;
+				ndedup++;
+			} else {
+				debug_printf("Failed to link '%s' to '%s' (%d)\n", fname, object, errno);
+				unlink(tmp);
+			}
+
+			xfree(tmp);
+		}
+	} else {
+		mkdir_path(object, true);
+
+		if (link_or_clone(fname, object) == 0)
+			add_index_entry(digest_hex, fname);
+		else
+			debug_printf("Failed to add '%s' to the deduplication store (%d)\n", fname, errno);
+	}
+
+	wget_thread_mutex_unlock(mutex);
+
+	xfree(object);
+}
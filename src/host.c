@@ -143,6 +143,9 @@ struct _find_free_job_context {
 	JOB *job;
 	long long now;
 	long long pause;
+	HOST *via;
+	bool any_host;
+	bool unverified;
 };
 
 static int _search_queue_for_free_job(struct _find_free_job_context *ctx, JOB *job)
@@ -160,6 +163,19 @@ static int _search_queue_for_free_job(struct _find_free_job_context *ctx, JOB *j
 				return 1;
 			}
 		}
+
+		// all parts are in use, help the slowest downloader
+		long long pause = 0;
+		PART *part = job_steal_part(job, &pause);
+
+		if (part) {
+			job->part = part;
+			ctx->job = job;
+			return 1;
+		}
+
+		if (pause && (!ctx->pause || ctx->pause > pause))
+			ctx->pause = pause;
 	} else if (!job->inuse) {
 		// job may be paused due to a failure (retry later)
 		long long pause = job->retry_ts - ctx->now;
@@ -188,6 +204,15 @@ static int WGET_GCC_NONNULL_ALL _search_host_for_free_job(struct _find_free_job_
 		return 0;
 	}
 
+	if (ctx->via && (host->http2_via != ctx->via || (ctx->unverified && host->http2_verified)))
+		return 0;
+
+	// the downloader owning the HTTP/2 session multiplexes all jobs of the host
+	if (ctx->any_host && host->http2_session) {
+		debug_printf("host %s is served by a shared HTTP/2 session\n", host->host);
+		return 0;
+	}
+
 	// host may be pause due to a failure (retry later)
 	long long pause = host->retry_ts - ctx->now;
 	if (pause > 0) {
@@ -233,8 +258,29 @@ JOB *host_get_job(HOST *host, long long *pause)
 	struct _find_free_job_context ctx = { .now = wget_get_timemillis() };
 
 	if (host) {
-		_search_host_for_free_job(&ctx, host);
+		bool shared;
+
+		// hosts that have just been coalesced with the HTTP/2 connection to host come first,
+		// so that the owner of the connection soon checks whether it is valid for them
+		wget_thread_mutex_lock(hosts_mutex);
+		if ((shared = host->http2_session)) {
+			ctx.via = host;
+			ctx.unverified = 1;
+			wget_hashmap_browse(hosts, (wget_hashmap_browse_fn *) _search_host_for_free_job, &ctx);
+			ctx.via = NULL;
+			ctx.unverified = 0;
+		}
+		wget_thread_mutex_unlock(hosts_mutex);
+
+		if (!ctx.job && !_search_host_for_free_job(&ctx, host) && shared) {
+			// also serve the hosts that have been coalesced with the HTTP/2 connection to host
+			ctx.via = host;
+			wget_thread_mutex_lock(hosts_mutex);
+			wget_hashmap_browse(hosts, (wget_hashmap_browse_fn *) _search_host_for_free_job, &ctx);
+			wget_thread_mutex_unlock(hosts_mutex);
+		}
 	} else {
+		ctx.any_host = 1;
 		wget_thread_mutex_lock(hosts_mutex);
 		wget_hashmap_browse(hosts, (wget_hashmap_browse_fn *) _search_host_for_free_job, &ctx);
 		wget_thread_mutex_unlock(hosts_mutex);
@@ -257,7 +303,7 @@ static int _release_job(wget_thread_id *ctx, JOB *job)
 			if (part->inuse && part->used_by == self) {
 				part->inuse = 0;
 				part->used_by = 0;
-				debug_printf("released chunk %d/%d %s\n", it + 1, wget_vector_size(job->parts), job->blacklist_entry->local_filename);
+				debug_printf("released chunk %d/%d %s\n", it + 1, wget_vector_size(job->parts), job->metalink->name);
 			}
 		}
 	} else if (job->inuse && job->used_by == self) {
@@ -269,15 +315,8 @@ static int _release_job(wget_thread_id *ctx, JOB *job)
 	return 0;
 }
 
-void host_release_jobs(HOST *host)
+static void _release_host_jobs(HOST *host, wget_thread_id self)
 {
-	if (!host)
-		return;
-
-	wget_thread_id self = wget_thread_self();
-
-	wget_thread_mutex_lock(hosts_mutex);
-
 	if (host->robot_job) {
 		if (host->robot_job->inuse && host->robot_job->used_by == self) {
 			host->robot_job->inuse = host->robot_job->done = 0;
@@ -287,6 +326,28 @@ void host_release_jobs(HOST *host)
 	}
 
 	wget_list_browse(host->queue, (wget_list_browse_fn *) _release_job, &self);
+}
+
+static int _release_coalesced_jobs(HOST *via, HOST *host)
+{
+	if (host->http2_via == via)
+		_release_host_jobs(host, wget_thread_self());
+
+	return 0;
+}
+
+void host_release_jobs(HOST *host)
+{
+	if (!host)
+		return;
+
+	wget_thread_mutex_lock(hosts_mutex);
+
+	_release_host_jobs(host, wget_thread_self());
+
+	// jobs of coalesced hosts are served by the same downloader
+	if (host->http2_session)
+		wget_hashmap_browse(hosts, (wget_hashmap_browse_fn *) _release_coalesced_jobs, host);
 
 	wget_thread_mutex_unlock(hosts_mutex);
 }
@@ -359,6 +420,38 @@ void host_add_robotstxt_job(HOST *host, const wget_iri *base, const char *encodi
 	wget_thread_mutex_unlock(hosts_mutex);
 }
 
+/**
+ * \param[in] host Host with parsed robots.txt
+ * \param[in] iri IRI to check
+ * \return Whether robots.txt of \p host allows to follow \p iri
+ *
+ * robots.txt rules match the path including the query.
+ */
+bool host_robots_allowed(const HOST *host, const wget_iri *iri)
+{
+	char sbuf[256];
+	wget_buffer buf;
+	bool allowed;
+
+	if (!host->robots)
+		return true;
+
+	wget_buffer_init(&buf, sbuf, sizeof(sbuf));
+	wget_buffer_memset(&buf, '/', 1);
+	if (iri->path)
+		wget_buffer_strcat(&buf, iri->path);
+	if (iri->query) {
+		wget_buffer_memcat(&buf, "?", 1);
+		wget_buffer_strcat(&buf, iri->query);
+	}
+
+	allowed = wget_robots_is_allowed(host->robots, buf.data);
+
+	wget_buffer_deinit(&buf);
+
+	return allowed;
+}
+
 static void _host_remove_job(HOST *host, JOB *job)
 {
 	debug_printf("%s: %p\n", __func__, (void *)job);
@@ -384,14 +477,9 @@ static void _host_remove_job(HOST *host, JOB *job)
 				if (thejob->sitemap)
 						continue;
 
-				for (int it = 0, n = wget_robots_get_path_count(host->robots); it < n; it++) {
-					wget_string *path = wget_robots_get_path(host->robots, it);
-
-					if (path->len && !strncmp(path->p + 1, thejob->iri->path ? thejob->iri->path : "", path->len - 1)) {
-						info_printf(_("URL '%s' not followed (disallowed by robots.txt)\n"), thejob->iri->uri);
-						_host_remove_job(host, thejob);
-						break;
-					}
+				if (!host_robots_allowed(host, thejob->iri)) {
+					info_printf(_("URL '%s' not followed (disallowed by robots.txt)\n"), thejob->iri->uri);
+					_host_remove_job(host, thejob);
 				}
 			}
 		}
@@ -470,6 +558,111 @@ void host_reset_failure(HOST *host)
 	wget_thread_mutex_unlock(hosts_mutex);
 }
 
+/**
+ * \param[in] host Host
+ * \return Whether the caller became the owner of the shared HTTP/2 session of \p host
+ *
+ * While a shared session is active, host_get_job(NULL, ...) does not hand out jobs of \p host,
+ * so that other downloaders do not open additional connections to it.
+ * Only the first downloader claiming the session becomes its owner.
+ */
+bool host_claim_http2_session(HOST *host)
+{
+	bool claimed;
+
+	wget_thread_mutex_lock(hosts_mutex);
+	if ((claimed = !host->http2_session))
+		host->http2_session = 1;
+	wget_thread_mutex_unlock(hosts_mutex);
+
+	return claimed;
+}
+
+static int _release_coalesced_host(HOST *via, HOST *host)
+{
+	if (host->http2_via == via) {
+		host->http2_via = NULL;
+		host->http2_session = 0;
+		host->http2_verified = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * \param[in] host Host
+ *
+ * Release the shared HTTP/2 session of \p host, to be called by the owner.
+ * Hosts coalesced with the session are released as well.
+ */
+void host_release_http2_session(HOST *host)
+{
+	wget_thread_mutex_lock(hosts_mutex);
+	host->http2_session = 0;
+	wget_hashmap_browse(hosts, (wget_hashmap_browse_fn *) _release_coalesced_host, host);
+	wget_thread_mutex_unlock(hosts_mutex);
+}
+
+/**
+ * \param[in] host Host to be served by the HTTP/2 session of \p via
+ * \param[in] via Host with a shared HTTP/2 session
+ * \return Whether \p host has been coalesced with the session of \p via
+ *
+ * The owner of the session of \p via then also serves the jobs of \p host (see host_get_job()).
+ * Only the owner may use its connection, so it has to check whether the connection is valid for \p host
+ * with host_verify_http2_session() before sending requests for \p host.
+ */
+bool host_coalesce_http2_session(HOST *host, HOST *via)
+{
+	bool coalesced = false;
+
+	wget_thread_mutex_lock(hosts_mutex);
+	if (!host->http2_session && !host->http2_refused && via->http2_session && !via->http2_via && host != via) {
+		host->http2_session = 1;
+		host->http2_via = via;
+		coalesced = true;
+	}
+	wget_thread_mutex_unlock(hosts_mutex);
+
+	return coalesced;
+}
+
+/**
+ * \param[in] host Host coalesced with the HTTP/2 session of another host
+ * \param[in] valid Whether the connection of the session is valid for \p host
+ *
+ * To be called by the owner of the session.
+ * If the connection is not valid for \p host, the jobs of \p host held by the caller are released
+ * and \p host gets a connection of its own. In this case, the main mutex has to be locked.
+ */
+void host_verify_http2_session(HOST *host, bool valid)
+{
+	wget_thread_mutex_lock(hosts_mutex);
+	if (valid) {
+		host->http2_verified = 1;
+	} else {
+		host->http2_via = NULL;
+		host->http2_session = 0;
+		host->http2_verified = 0;
+		host->http2_refused = 1;
+		_release_host_jobs(host, wget_thread_self());
+	}
+	wget_thread_mutex_unlock(hosts_mutex);
+}
+
+/**
+ * \param[in] host Host
+ * \return Whether another downloader serves \p host through a shared HTTP/2 session
+ */
+bool host_has_http2_session(HOST *host)
+{
+	wget_thread_mutex_lock(hosts_mutex);
+	bool active = host->http2_session;
+	wget_thread_mutex_unlock(hosts_mutex);
+
+	return active;
+}
+
 /**
  * @return Whether the job queue is empty or not.
  */
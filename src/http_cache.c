@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Local HTTP cache index (RFC 9111)
+ *
+ * The downloaded files are the cache, the index remembers per URL
+ *  - the validators (ETag, Last-Modified) for conditional requests
+ *  - how long the file is fresh (Cache-Control max-age, Expires or heuristic)
+ *  - the Vary header and the varied request header values
+ *  - the content type, needed to parse the local file in recursive mode
+ *  - the target of permanent redirects (301, 308)
+ *
+ * Fresh files are not requested again, stale files are revalidated.
+ * Fresh redirects are followed without asking the server.
+ *
+ * File format, one entry per line, '-' for empty fields:
+ * <url> <fresh until> <last-modified> <size> <etag> <content-type> <charset> <vary> <vary key> <location>
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include <wget.h>
+
+#include "wget_main.h"
+#include "wget_log.h"
+#include "wget_options.h"
+#include "wget_cache_file.h"
+#include "wget_http_cache.h"
+
+// heuristic freshness is 10% of the time since last modification, but at most a week (RFC 9111 4.2.2)
+#define HEURISTIC_MAX_LIFETIME (7 * 86400)
+// heuristic freshness of permanent redirects without Last-Modified
+#define HEURISTIC_REDIRECT_LIFETIME HEURISTIC_MAX_LIFETIME
+
+static CACHE_FILE cache; // defined below, along with the callbacks
+
+static void free_entry(HTTP_CACHE_ENTRY *entry)
+{
+	xfree(entry->url);
+	xfree(entry->etag);
+	xfree(entry->content_type);
+	xfree(entry->content_type_encoding);
+	xfree(entry->vary);
+	xfree(entry->vary_key);
+	xfree(entry->location);
+	xfree(entry);
+}
+
+void http_cache_free_entry(HTTP_CACHE_ENTRY **entry)
+{
+	if (entry && *entry) {
+		free_entry(*entry);
+		*entry = NULL;
+	}
+}
+
+static void add_entry(HTTP_CACHE_ENTRY *entry)
+{
+	// the key is owned by the entry
+	cache_file_put(&cache, entry->url, entry);
+}
+
+static void load_entry(const char *url, char *linep)
+{
+	HTTP_CACHE_ENTRY *entry = wget_calloc(1, sizeof(HTTP_CACHE_ENTRY));
+	const char *field;
+
+	entry->url = wget_strdup(url);
+	entry->fresh_until = (field = cache_file_next_field(&linep)) ? atoll(field) : 0;
+	entry->last_modified = (field = cache_file_next_field(&linep)) ? atoll(field) : 0;
+	entry->size = (field = cache_file_next_field(&linep)) ? atoll(field) : -1;
+	entry->etag = wget_strdup(cache_file_next_field(&linep));
+	entry->content_type = wget_strdup(cache_file_next_field(&linep));
+	entry->content_type_encoding = wget_strdup(cache_file_next_field(&linep));
+	entry->vary = wget_strdup(cache_file_next_field(&linep));
+	entry->vary_key = wget_strdup(cache_file_next_field(&linep));
+	entry->location = wget_strdup(cache_file_next_field(&linep));
+
+	if (entry->location ? !entry->fresh_until : (entry->size < 0 || (!entry->etag && !entry->last_modified && !entry->fresh_until))) {
+		error_printf(_("Failed to parse HTTP cache line for '%s'\n"), entry->url);
+		free_entry(entry);
+		return;
+	}
+
+	add_entry(entry);
+}
+
+static int save_entry(void *context, WGET_GCC_UNUSED const char *key, void *value)
+{
+	FILE *fp = context;
+	HTTP_CACHE_ENTRY *entry = value;
+
+#define FIELD(s) ((s) ? (s) : "-")
+	wget_fprintf(fp, "%s %lld %lld %lld %s %s %s %s %s %s\n",
+		entry->url, (long long) entry->fresh_until, (long long) entry->last_modified, entry->size,
+		FIELD(entry->etag), FIELD(entry->content_type), FIELD(entry->content_type_encoding),
+		FIELD(entry->vary), FIELD(entry->vary_key), FIELD(entry->location));
+#undef FIELD
+
+	return 0;
+}
+
+static CACHE_FILE cache = {
+	.name = "HTTP cache",
+	.format = "<url> <fresh until> <last-modified> <size> <etag> <content-type> <charset> <vary> <vary key> <location>",
+	.load_entry = load_entry,
+	.save_entry = save_entry,
+	.free_entry = (wget_stringmap_value_destructor *) free_entry,
+};
+
+int http_cache_init(void)
+{
+	cache_file_init(&cache, config.http_cache_file, 1024);
+
+	return 0;
+}
+
+void http_cache_exit(void)
+{
+	cache_file_exit(&cache, config.http_cache_file);
+}
+
+/**
+ * \param[in] url URL to look up
+ * \return Copy of the cache entry or NULL, to be freed by http_cache_free_entry()
+ */
+HTTP_CACHE_ENTRY *http_cache_get(const char *url)
+{
+	HTTP_CACHE_ENTRY *entry, *copy = NULL;
+
+	if (!cache.entries)
+		return NULL;
+
+	wget_thread_mutex_lock(cache.mutex);
+
+	if (wget_stringmap_get(cache.entries, url, &entry)) {
+		copy = wget_memdup(entry, sizeof(*entry));
+		copy->url = wget_strdup(entry->url);
+		copy->etag = wget_strdup(entry->etag);
+		copy->content_type = wget_strdup(entry->content_type);
+		copy->content_type_encoding = wget_strdup(entry->content_type_encoding);
+		copy->vary = wget_strdup(entry->vary);
+		copy->vary_key = wget_strdup(entry->vary_key);
+		copy->location = wget_strdup(entry->location);
+	}
+
+	wget_thread_mutex_unlock(cache.mutex);
+
+	return copy;
+}
+
+/**
+ * \param[in] url URL to look up
+ * \return Target of a fresh permanent redirect of \p url or NULL, to be freed by the caller
+ *
+ * A redirect that leads back to \p url through fresh redirects is removed,
+ * so that the server is asked again instead of the loop being kept.
+ */
+char *http_cache_get_redirect(const char *url)
+{
+	HTTP_CACHE_ENTRY *entry, *next;
+	char *location = NULL;
+	int64_t now = time(NULL);
+
+	if (!cache.entries)
+		return NULL;
+
+	wget_thread_mutex_lock(cache.mutex);
+
+	if (wget_stringmap_get(cache.entries, url, &entry) && entry->location && entry->fresh_until > now) {
+		const char *target = entry->location;
+
+		// the number of entries bounds loops that don't include url
+		for (int hops = wget_stringmap_size(cache.entries); hops > 0; hops--) {
+			if (!strcmp(target, url)) {
+				debug_printf("Removing cached redirect loop of %s\n", url);
+				cache_file_remove(&cache, url);
+				entry = NULL;
+				break;
+			}
+
+			if (!wget_stringmap_get(cache.entries, target, &next) || !next->location || next->fresh_until <= now)
+				break;
+
+			target = next->location;
+		}
+
+		if (entry)
+			location = wget_strdup(entry->location);
+	}
+
+	wget_thread_mutex_unlock(cache.mutex);
+
+	return location;
+}
+
+// RFC 9111 4.2.1 and 4.2.3, heuristic is the lifetime used without explicit freshness or Last-Modified
+static int64_t fresh_until(const wget_http_response *resp, int64_t now, int64_t heuristic)
+{
+	int64_t request_time = resp->req ? resp->req->request_start / 1000 : now;
+	int64_t date = resp->date ? resp->date : now;
+	int64_t lifetime;
+
+	if (resp->cache_no_cache)
+		return 0;
+
+	if (resp->cache_maxage_valid)
+		lifetime = resp->cache_maxage;
+	else if (resp->expires)
+		lifetime = resp->expires - date;
+	else if (resp->last_modified && resp->last_modified < date) {
+		lifetime = (date - resp->last_modified) / 10;
+		if (lifetime > HEURISTIC_MAX_LIFETIME)
+			lifetime = HEURISTIC_MAX_LIFETIME;
+	} else if (!(lifetime = heuristic))
+		return 0;
+
+	int64_t apparent_age = now > date ? now - date : 0;
+	int64_t corrected_age = resp->age + (now > request_time ? now - request_time : 0);
+	int64_t age = apparent_age > corrected_age ? apparent_age : corrected_age;
+
+	if (lifetime <= age)
+		return 0;
+
+	return now + (lifetime - age);
+}
+
+/**
+ * \param[in] url URL of the response
+ * \param[in] resp A 200 or 304 response to a GET request, stored as local file
+ * \param[in] vary_key Digest of the request header values listed in resp->vary or NULL
+ * \param[in] size Size of the local file
+ *
+ * Remember the validators and the freshness of \p resp.
+ * A 304 (Not Modified) response updates an existing entry.
+ */
+void http_cache_store(const char *url, const wget_http_response *resp, const char *vary_key, long long size)
+{
+	HTTP_CACHE_ENTRY *entry;
+	int64_t now = time(NULL);
+
+	if (!cache.entries || strpbrk(url, " \t\r\n"))
+		return;
+
+	if (resp->cache_no_store || (resp->vary && strchr(resp->vary, '*'))) {
+		http_cache_remove(url);
+		return;
+	}
+
+	wget_thread_mutex_lock(cache.mutex);
+
+	if (resp->code == 304) {
+		if (wget_stringmap_get(cache.entries, url, &entry)) {
+			// RFC 9111 4.3.4: update the stored response with the header fields of the 304
+			entry->fresh_until = fresh_until(resp, now, 0);
+			if (resp->etag) {
+				xfree(entry->etag);
+				entry->etag = wget_strdup(resp->etag);
+			}
+			if (resp->last_modified)
+				entry->last_modified = resp->last_modified;
+		}
+	} else if (resp->etag || resp->last_modified || resp->cache_maxage_valid || resp->expires) {
+		entry = wget_calloc(1, sizeof(HTTP_CACHE_ENTRY));
+		entry->url = wget_strdup(url);
+		entry->etag = wget_strdup(resp->etag);
+		entry->content_type = wget_strdup(resp->content_type);
+		entry->content_type_encoding = wget_strdup(resp->content_type_encoding);
+		entry->vary = wget_strdup(resp->vary);
+		entry->vary_key = wget_strdup(vary_key);
+		entry->last_modified = resp->last_modified;
+		entry->fresh_until = fresh_until(resp, now, 0);
+		entry->size = size;
+
+		// fields are stored space separated
+		if (entry->etag && strpbrk(entry->etag, " \t"))
+			xfree(entry->etag);
+		if (entry->vary) {
+			char *d = (char *) entry->vary;
+
+			for (const char *s = entry->vary; *s; s++)
+				if (!isspace(*s))
+					*d++ = *s;
+			*d = 0;
+		}
+
+		if (entry->etag || entry->last_modified || entry->fresh_until)
+			add_entry(entry);
+		else
+			free_entry(entry);
+	} else
+		cache_file_remove(&cache, url);
+
+	wget_thread_mutex_unlock(cache.mutex);
+}
+
+/**
+ * \param[in] url URL of the response
+ * \param[in] resp A 301 or 308 response to a GET request
+ * \param[in] location Absolute URL of the redirection target
+ *
+ * Remember a permanent redirect, so that it can be followed without asking the server.
+ */
+void http_cache_store_redirect(const char *url, const wget_http_response *resp, const char *location)
+{
+	HTTP_CACHE_ENTRY *entry;
+	int64_t until;
+
+	if (!cache.entries || strpbrk(url, " \t\r\n") || strpbrk(location, " \t\r\n"))
+		return;
+
+	// redirects that depend on request headers are not worth the trouble
+	if (resp->cache_no_store || resp->vary || !(until = fresh_until(resp, time(NULL), HEURISTIC_REDIRECT_LIFETIME))) {
+		http_cache_remove(url);
+		return;
+	}
+
+	entry = wget_calloc(1, sizeof(HTTP_CACHE_ENTRY));
+	entry->url = wget_strdup(url);
+	entry->location = wget_strdup(location);
+	entry->fresh_until = until;
+	entry->size = -1;
+
+	wget_thread_mutex_lock(cache.mutex);
+	add_entry(entry);
+	wget_thread_mutex_unlock(cache.mutex);
+}
+
+void http_cache_remove(const char *url)
+{
+	if (!cache.entries)
+		return;
+
+	wget_thread_mutex_lock(cache.mutex);
+	cache_file_remove(&cache, url);
+	wget_thread_mutex_unlock(cache.mutex);
+}
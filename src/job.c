@@ -36,12 +36,55 @@
 
 #include <wget.h>
 
+#include "nproc.h"
+#include "safe-read.h"
+
 #include "wget_main.h"
 //#include "wget_log.h"
 #include "wget_job.h"
 
+// the remaining range of a part is split only if both halves have at least this size
+#define STEAL_MIN_SIZE (256 * 1024)
+// a part is worth to be split if it is expected to take longer than this (milliseconds)
+#define STEAL_MIN_ETA 2000
+// a part is considered stalled if it received no data for this time (milliseconds)
+#define STALL_TIMEOUT 10000
+
+// protects the streaming file hashes of all jobs
+static wget_thread_mutex
+	hash_mutex;
+// protects the lengths and the progress of the parts of all jobs
+static wget_thread_mutex
+	parts_mutex;
+
+void job_module_init(void)
+{
+	wget_thread_mutex_init(&hash_mutex);
+	wget_thread_mutex_init(&parts_mutex);
+}
+
+void job_module_exit(void)
+{
+	wget_thread_mutex_destroy(&hash_mutex);
+	wget_thread_mutex_destroy(&parts_mutex);
+}
+
+static void file_hash_reset(JOB *job)
+{
+	if (job->file_hash) {
+		unsigned char digest[64];
+		wget_hash_deinit(&job->file_hash, digest);
+	}
+
+	wget_vector_free(&job->file_hash_pending);
+	job->file_hash_pos = 0;
+	job->file_hash_result = 0;
+}
+
 void job_free(JOB *job)
 {
+	file_hash_reset(job);
+
 	if (job->challenges_alloc)
 		wget_http_free_challenges(&job->challenges);
 	wget_http_free_challenges(&job->proxy_challenges);
@@ -89,6 +132,343 @@ void job_create_parts(JOB *job)
 	}
 }
 
+/**
+ * \param[in] job Job with metalink information
+ * \param[in] part Part of the file
+ * \return The metalink piece with checksum that is covered completely by \p part or NULL
+ */
+wget_metalink_piece *job_get_piece(JOB *job, PART *part)
+{
+	wget_metalink_piece *piece;
+
+	if (!job->metalink || !(piece = wget_vector_get(job->metalink->pieces, part->id - 1)))
+		return NULL;
+
+	if (!*piece->hash.type || part->position != piece->position)
+		return NULL;
+
+	// the last piece may be shorter
+	if (part->length != piece->length && part->position + part->length != job->metalink->size)
+		return NULL;
+
+	return piece;
+}
+
+/**
+ * \param[in] part Part of the file
+ *
+ * Reset the progress and the piece hash state of \p part when its response starts.
+ */
+void job_start_part(PART *part)
+{
+	wget_thread_mutex_lock(parts_mutex);
+	part->downloaded = 0;
+	part->verified = part->corrupt = 0;
+	part->start_ms = part->last_ms = wget_get_timemillis();
+	wget_thread_mutex_unlock(parts_mutex);
+}
+
+/**
+ * \param[in] part Part of the file
+ * \param[in] length Number of bytes received
+ * \return Number of bytes that belong to \p part
+ *
+ * Account \p length received bytes to \p part.
+ * The return value is less than \p length if another downloader took over the tail of \p part.
+ * In this case (and if the return value is 0) the caller should stop downloading.
+ */
+size_t job_receive_part(PART *part, size_t length)
+{
+	wget_thread_mutex_lock(parts_mutex);
+
+	if ((off_t) length > part->length - part->downloaded)
+		length = part->length > part->downloaded ? (size_t) (part->length - part->downloaded) : 0;
+
+	part->downloaded += length;
+	part->last_ms = wget_get_timemillis();
+
+	wget_thread_mutex_unlock(parts_mutex);
+
+	return length;
+}
+
+/**
+ * \param[in] job Job with parts
+ * \param[in] part Part of \p job that has been downloaded
+ * \return Whether \p part was the last missing part of \p job
+ *
+ * Mark \p part as done. Exactly one caller gets true for a job, all others must not access
+ * \p job afterwards since it may be removed at any time.
+ */
+bool job_part_done(JOB *job, PART *part)
+{
+	bool done = true;
+
+	wget_thread_mutex_lock(parts_mutex);
+	part->done = 1;
+	for (int it = 0; it < wget_vector_size(job->parts); it++) {
+		PART *p = wget_vector_get(job->parts, it);
+
+		if (!p->done) {
+			done = false;
+			break;
+		}
+	}
+	wget_thread_mutex_unlock(parts_mutex);
+
+	return done;
+}
+
+/**
+ * \param[in] job Job with parts
+ * \param[in] part Part of \p job whose request has been answered with the complete file
+ * \return Whether \p job is complete
+ *
+ * The server ignored the Range header and the complete file has been written.
+ * Mark \p part and all parts that are not in use by other downloaders as done. Parts in use are
+ * finished by their downloaders, like with job_part_done() exactly one caller gets true for a job.
+ *
+ * Must be called with the job queue locked, so that no part is dequeued meanwhile.
+ */
+bool job_file_done(JOB *job, PART *part)
+{
+	bool done = true;
+
+	wget_thread_mutex_lock(parts_mutex);
+	for (int it = 0; it < wget_vector_size(job->parts); it++) {
+		PART *p = wget_vector_get(job->parts, it);
+
+		if (p == part || !p->inuse) {
+			p->inuse = 1;
+			p->done = 1;
+		} else if (!p->done)
+			done = false;
+	}
+	wget_thread_mutex_unlock(parts_mutex);
+
+	return done;
+}
+
+/**
+ * \param[in] job Job with parts
+ * \param[out] pause Set to a time to wait before trying again, if a part may become worth to split later
+ * \return A new part, already in use by the calling thread, or NULL
+ *
+ * Work stealing for idle downloaders when all parts of \p job are in use.
+ *
+ * The part with the longest expected remaining download time (measured by its throughput) is
+ * split. The victim keeps the share of its remaining range that it would download in the time the
+ * stealer (expected to be as fast as the average downloader) needs for the rest.
+ * A stalled part (no data received for a while) loses its complete remaining range.
+ *
+ * The victim notices the shortened length via job_receive_part() and stops downloading.
+ */
+PART *job_steal_part(JOB *job, long long *pause)
+{
+	PART *victim = NULL, *part = NULL;
+	long long now = wget_get_timemillis(), victim_eta = 0;
+	double rate_sum = 0; // bytes per millisecond
+	int nrates = 0;
+	bool stalled = false;
+
+	wget_thread_mutex_lock(parts_mutex);
+
+	for (int it = 0; it < wget_vector_size(job->parts); it++) {
+		PART *p = wget_vector_get(job->parts, it);
+		off_t remaining = p->length - p->downloaded;
+		long long elapsed = now - p->start_ms, eta;
+
+		if (!p->inuse || p->done || !p->start_ms || remaining < 2 * STEAL_MIN_SIZE)
+			continue;
+
+		if (p->downloaded && now - p->last_ms > STALL_TIMEOUT) {
+			victim = p;
+			stalled = true;
+			break;
+		}
+
+		if (!p->downloaded || elapsed < 1000) {
+			// too early to measure the throughput, look again later
+			if (pause)
+				*pause = 1000;
+			continue;
+		}
+
+		rate_sum += (double) p->downloaded / elapsed;
+		nrates++;
+
+		if ((eta = (long long) ((double) remaining * elapsed / p->downloaded)) > victim_eta) {
+			victim = p;
+			victim_eta = eta;
+		}
+	}
+
+	if (victim && (stalled || victim_eta >= STEAL_MIN_ETA)) {
+		off_t remaining = victim->length - victim->downloaded, keep = 0;
+
+		if (!stalled) {
+			double victim_rate = (double) victim->downloaded / (now - victim->start_ms);
+			double stealer_rate = rate_sum / nrates;
+
+			keep = (off_t) (remaining * (victim_rate / (victim_rate + stealer_rate)));
+			if (keep < STEAL_MIN_SIZE)
+				keep = STEAL_MIN_SIZE;
+			else if (keep > remaining - STEAL_MIN_SIZE)
+				keep = remaining - STEAL_MIN_SIZE;
+		}
+
+		part = wget_calloc(1, sizeof(PART));
+		part->position = victim->position + victim->downloaded + keep;
+		part->length = remaining - keep;
+		part->id = wget_vector_size(job->parts) + 1;
+		part->inuse = 1;
+		part->used_by = wget_thread_self();
+
+		victim->length -= part->length;
+
+		wget_vector_add(job->parts, part);
+
+		debug_printf("%s part %d (%lld bytes left), stole %lld bytes at %lld as part %d\n",
+			stalled ? "stalled" : "slow", victim->id, (long long) remaining,
+			(long long) part->length, (long long) part->position, part->id);
+	} else if (victim && pause)
+		*pause = 1000; // the victim might slow down, look again later
+
+	wget_thread_mutex_unlock(parts_mutex);
+
+	return part;
+}
+
+// hash the given range of a file into 'hash'
+static int hash_file_range(wget_hash_hd *hash, const char *fname, off_t offset, off_t length)
+{
+	char buf[65536];
+	size_t nbytes;
+	int fd, rc = 0;
+
+	if ((fd = open(fname, O_RDONLY | O_BINARY)) == -1)
+		return -1;
+
+	if (lseek(fd, offset, SEEK_SET) == (off_t) -1)
+		rc = -1;
+
+	while (rc == 0 && length > 0) {
+		nbytes = safe_read(fd, buf, length < (off_t) sizeof(buf) ? (size_t) length : sizeof(buf));
+
+		if (nbytes == SAFE_READ_ERROR || nbytes == 0) {
+			rc = -1;
+			break;
+		}
+
+		wget_hash(hash, buf, nbytes);
+		length -= nbytes;
+	}
+
+	close(fd);
+	return rc;
+}
+
+static int compare_part_position(const PART *p1, const PART *p2)
+{
+	return p1->position < p2->position ? -1 : p1->position > p2->position;
+}
+
+static void file_hash_finish(JOB *job)
+{
+	wget_metalink_hash *hash = wget_vector_get(job->metalink->hashes, job->file_hash_idx);
+	int len = wget_hash_get_len(wget_hash_get_algorithm(hash->type));
+	unsigned char digest[len];
+	char digest_hex[len * 2 + 1];
+
+	wget_hash_deinit(&job->file_hash, digest);
+	wget_memtohex(digest, len, digest_hex, sizeof(digest_hex));
+
+	job->file_hash_result = wget_strcasecmp_ascii(digest_hex, hash->hash_hex) ? -1 : 1;
+	debug_printf("streaming checksum for '%s': %s\n", job->metalink->name, job->file_hash_result == 1 ? "ok" : "failed");
+}
+
+/**
+ * \param[in] job Job with metalink information
+ * \param[in] part Part that has been downloaded completely
+ * \param[in] data Downloaded data of \p part or NULL
+ * \param[in] length Length of \p data
+ *
+ * Feed a downloaded part into the streaming hash of the complete file.
+ * Parts arriving in order are hashed from memory, parts arriving ahead are remembered
+ * and read back from disk when the hash position reaches them.
+ * The result is used by job_validate_file() instead of re-reading the whole file.
+ */
+void job_hash_part(JOB *job, PART *part, const char *data, size_t length)
+{
+	wget_metalink *metalink = job->metalink;
+
+	if (!metalink || wget_vector_size(metalink->hashes) == 0)
+		return;
+
+	wget_thread_mutex_lock(hash_mutex);
+
+	// a verified piece covering the whole file is as good as the file checksum
+	if (part->verified && part->position == 0 && part->length == metalink->size) {
+		job->file_hash_result = 1;
+		goto out;
+	}
+
+	if (!job->file_hash) {
+		if (job->file_hash_pos || job->file_hash_result)
+			goto out; // hashing has been given up or is finished
+
+		for (int it = 0; it < wget_vector_size(metalink->hashes); it++) {
+			wget_metalink_hash *hash = wget_vector_get(metalink->hashes, it);
+
+			if (wget_hash_init(&job->file_hash, wget_hash_get_algorithm(hash->type)) == WGET_E_SUCCESS) {
+				job->file_hash_idx = it;
+				break;
+			}
+		}
+
+		if (!job->file_hash) {
+			job->file_hash_pos = -1; // no supported hash type, don't try again
+			goto out;
+		}
+	}
+
+	if (part->position != job->file_hash_pos) {
+		if (!job->file_hash_pending)
+			job->file_hash_pending = wget_vector_create(16, (wget_vector_compare_fn *) compare_part_position);
+
+		wget_vector_insert_sorted(job->file_hash_pending, wget_memdup(part, sizeof(PART)));
+		goto out;
+	}
+
+	if (data && length == (size_t) part->length)
+		wget_hash(job->file_hash, data, length);
+	else if (hash_file_range(job->file_hash, metalink->name, part->position, part->length)) {
+		file_hash_reset(job);
+		job->file_hash_pos = -1;
+		goto out;
+	}
+	job->file_hash_pos += part->length;
+
+	// catch up with parts that have been downloaded ahead
+	PART *pending;
+	while ((pending = wget_vector_get(job->file_hash_pending, 0)) && pending->position == job->file_hash_pos) {
+		if (hash_file_range(job->file_hash, metalink->name, pending->position, pending->length)) {
+			file_hash_reset(job);
+			job->file_hash_pos = -1;
+			goto out;
+		}
+
+		job->file_hash_pos += pending->length;
+		wget_vector_remove(job->file_hash_pending, 0);
+	}
+
+	if (job->file_hash_pos == metalink->size)
+		file_hash_finish(job);
+
+out:
+	wget_thread_mutex_unlock(hash_mutex);
+}
+
 // check hash for part of a file
 // -1: error
 //  0: not ok
@@ -132,6 +512,117 @@ static int check_file_fd(wget_metalink_hash *hash, int fd)
 	return -1;
 }
 
+struct piece_check_context {
+	wget_thread_mutex
+		mutex;
+	const char
+		*fname;
+	wget_vector
+		*pieces;
+	PART
+		*parts;
+	bool
+		*ok;
+	int
+		nparts,
+		next;
+};
+
+// worker: take the next unchecked piece until all are done
+static void *piece_check_thread(void *p)
+{
+	struct piece_check_context *ctx = p;
+	int fd = open(ctx->fname, O_RDONLY|O_BINARY), it;
+
+	for (;;) {
+		wget_thread_mutex_lock(ctx->mutex);
+		it = ctx->next < ctx->nparts ? ctx->next++ : -1;
+		wget_thread_mutex_unlock(ctx->mutex);
+
+		if (it < 0)
+			break;
+
+		wget_metalink_piece *piece = wget_vector_get(ctx->pieces, it);
+		PART *part = &ctx->parts[it];
+
+		// each worker has its own fd, wget_hash_file_fd() mmaps or seeks the range
+		ctx->ok[it] = fd != -1 && check_piece_hash(&piece->hash, fd, part->position, part->length) == 1;
+	}
+
+	if (fd != -1)
+		close(fd);
+
+	return NULL;
+}
+
+// check all pieces in parallel and re-queue the ones that are missing or corrupt
+static void check_pieces(JOB *job, off_t fsize)
+{
+	struct piece_check_context ctx = {
+		.fname = job->metalink->name,
+		.pieces = job->metalink->pieces,
+		.nparts = wget_vector_size(job->metalink->pieces)
+	};
+	off_t position = 0;
+	int nworkers;
+
+	if (ctx.nparts <= 0)
+		return;
+
+	ctx.parts = wget_calloc(ctx.nparts, sizeof(PART));
+	ctx.ok = wget_calloc(ctx.nparts, sizeof(bool));
+
+	for (int it = 0; it < ctx.nparts; it++) {
+		wget_metalink_piece *piece = wget_vector_get(ctx.pieces, it);
+		PART *part = &ctx.parts[it];
+
+		part->position = position;
+		part->length = fsize >= piece->length ? piece->length : fsize;
+		part->id = it + 1;
+
+		position += part->length;
+		fsize -= piece->length;
+	}
+
+	nworkers = (int) num_processors(NPROC_CURRENT);
+	if (nworkers > ctx.nparts)
+		nworkers = ctx.nparts;
+
+	wget_thread_mutex_init(&ctx.mutex);
+
+	if (nworkers > 1 && wget_thread_support()) {
+		wget_thread tids[nworkers - 1];
+		int nthreads;
+
+		for (nthreads = 0; nthreads < nworkers - 1; nthreads++) {
+			if (wget_thread_start(&tids[nthreads], piece_check_thread, &ctx, 0))
+				break;
+		}
+
+		piece_check_thread(&ctx); // the calling thread works as well
+
+		while (--nthreads >= 0)
+			wget_thread_join(&tids[nthreads]);
+	} else
+		piece_check_thread(&ctx);
+
+	wget_thread_mutex_destroy(&ctx.mutex);
+
+	for (int it = 0; it < ctx.nparts; it++) {
+		PART *part = &ctx.parts[it];
+
+		if (!ctx.ok[it]) {
+			info_printf(_("Piece %d/%d not OK - requeuing\n"), it + 1, ctx.nparts);
+			wget_vector_add_memdup(job->parts, part, sizeof(PART));
+			debug_printf("  need to download %llu bytes from pos=%llu\n",
+				(unsigned long long)part->length, (unsigned long long)part->position);
+		}
+	}
+
+	xfree(ctx.ok);
+	xfree(ctx.parts);
+}
+
 int job_validate_file(JOB *job)
 {
 	PART part;
@@ -143,6 +634,16 @@ int job_validate_file(JOB *job)
 	if (!(metalink = job->metalink))
 		return 0;
 
+	// the checksum has already been computed while downloading
+	if (job->file_hash_result == 1) {
+		info_printf(_("Checksum OK for '%s'\n"), metalink->name);
+		return 1; // we are done
+	}
+
+	wget_thread_mutex_lock(hash_mutex);
+	file_hash_reset(job);
+	wget_thread_mutex_unlock(hash_mutex);
+
 	memset(&part, 0, sizeof(PART));
 
 	// Metalink may be used without pieces...
@@ -195,7 +696,12 @@ int job_validate_file(JOB *job)
 		for (int it = 0; errno != EINTR && it < wget_vector_size(metalink->hashes); it++) {
 			wget_metalink_hash *hash = wget_vector_get(metalink->hashes, it);
 
-			if ((rc = check_file_fd(hash, fd)) == -1)
+			if (real_fsize < fsize) {
+				// an incomplete file can't match, so don't waste time on hashing it
+				if (wget_hash_get_algorithm(hash->type) == WGET_DIGTYPE_UNKNOWN)
+					continue;
+				rc = 0;
+			} else if ((rc = check_file_fd(hash, fd)) == -1)
 				continue; // hash type not available, try next
 
 			break;
@@ -214,34 +720,11 @@ int job_validate_file(JOB *job)
 			return 1; // we are done
 		}
 
-		info_printf(_("Bad checksum for '%s'\n"), metalink->name);
-
-//		if (vec_size(metalink->pieces) < 1)
-//			return;
+		if (real_fsize == fsize)
+			info_printf(_("Bad checksum for '%s'\n"), metalink->name);
 
-		for (int it = 0; errno != EINTR && it < wget_vector_size(metalink->pieces); it++) {
-			wget_metalink_piece *piece = wget_vector_get(metalink->pieces, it);
-			wget_metalink_hash *hash = &piece->hash;
-
-			if (fsize >= piece->length) {
-				part.length = piece->length;
-			} else {
-				part.length = (size_t)fsize;
-			}
-
-			part.id = it + 1;
-
-			if ((rc = check_piece_hash(hash, fd, part.position, part.length)) != 1) {
-				info_printf(_("Piece %d/%d not OK - requeuing\n"), it + 1, wget_vector_size(metalink->pieces));
-				wget_vector_add_memdup(job->parts, &part, sizeof(PART));
-				debug_printf("  need to download %llu bytes from pos=%llu\n",
-					(unsigned long long)part.length, (unsigned long long)part.position);
-			}
-
-			part.position += part.length;
-			fsize -= piece->length;
-		}
 		close(fd);
+		check_pieces(job, fsize);
 	} else {
 //		info_printf("real_fsize = %lld\n", (long long) real_fsize);
 
@@ -1168,6 +1168,7 @@ struct config config = {
 	.read_timeout = 900 * 1000, // 900s
 	.max_redirect = 20,
 	.max_threads = 5,
+	.parser_threads = -1,
 	.dns_caching = 1,
 	.tcp_fastopen = 1,
 	.user_agent = PACKAGE_NAME"/"PACKAGE_VERSION,
@@ -1197,7 +1198,7 @@ struct config config = {
 
 #if defined WITH_LIBNGHTTP2
 	.http2 = 1,
-	.http2_request_window = 30,
+	.http2_request_window = 0, // 0: as many streams as the server allows
 #endif
 	.ocsp = 1,
 	.ocsp_date = 1,
@@ -1220,7 +1221,9 @@ struct config config = {
 	.default_http_port = 80,
 	.default_https_port = 443,
 	.hyperlink = false,
-	.if_modified_since = 1
+	.if_modified_since = 1,
+	.warc_cdx = 1,
+	.warc_compression = 1
 };
 
 static int parse_execute(option_t opt, const char *val, const char invert);
@@ -1248,6 +1251,13 @@ static const struct optionw options[] = {
 		  "(default: off)\n"
 		}
 	},
+	{ "alt-svc", &config.alt_svc, parse_bool, -1, 0,
+		SECTION_DOWNLOAD,
+		{ "Use h2 and http/1.1 alternative services over TCP\n",
+		  "announced by HTTPS servers with the Alt-Svc header.\n",
+		  "HTTP/3 (h3) alternatives are ignored. (default: off)\n"
+		}
+	},
 	{ "append-output", &config.logfile_append, parse_string, 1, 'a',
 		SECTION_STARTUP,
 		{ "File where messages are appended to, '-' for STDOUT\n"
@@ -1442,6 +1452,18 @@ static const struct optionw options[] = {
 		{ "Print debugging messages.(default: off)\n"
 		}
 	},
+	{ "decompress-offload", &config.decompress_offload, parse_bool, -1, 0,
+		SECTION_HTTP,
+		{ "Decompress compressed responses in worker\n",
+		  "threads. (default: off)\n"
+		}
+	},
+	{ "dedup-dir", &config.dedup_dir, parse_filename, 1, 0,
+		SECTION_DOWNLOAD,
+		{ "Store identical downloaded content only once\n",
+		  "in this directory and link it into place.\n"
+		}
+	},
 	{ "default-http-port", &config.default_http_port, parse_uint16, 1, 0,
 		SECTION_HTTP,
 		{ "Set default port for HTTP. (default: 80)\n"
@@ -1659,6 +1681,13 @@ static const struct optionw options[] = {
 		{ "Obsoleted by --adjust-extension\n"
 		}
 	}, // obsolete, replaced by --adjust-extension
+	{ "http-cache-file", &config.http_cache_file, parse_filename, 1, 0,
+		SECTION_HTTP,
+		{ "Keep an index of the downloaded files in this\n",
+		  "file. Fresh files are not requested again,\n",
+		  "stale ones are revalidated. (default: off)\n"
+		}
+	},
 	{ "http-keep-alive", &config.keep_alive, parse_bool, -1, 0,
 		SECTION_HTTP,
 		{ "Keep connection open for further requests.\n",
@@ -1708,7 +1737,8 @@ static const struct optionw options[] = {
 	{ "http2-request-window", &config.http2_request_window, parse_integer, 1, 0,
 		SECTION_DOWNLOAD,
 		{ "Max. number of parallel streams per HTTP/2\n",
-                  "connection. (default: 30)\n"
+                  "connection. 0 means the limit announced by\n",
+                  "the server. (default: 0)\n"
 		}
 	},
 	{ "https-enforce", &config.https_enforce, parse_https_enforce, 1, 0,
@@ -1942,6 +1972,13 @@ static const struct optionw options[] = {
 		{ "Ascend above parent directory. (default: on)\n"
 		}
 	},
+	{ "parser-threads", &config.parser_threads, parse_integer, 1, 0,
+		SECTION_DOWNLOAD,
+		{ "Number of threads that parse downloaded\n",
+		  "documents in recursive mode, 0 to parse on the\n",
+		  "download threads. (default: number of CPU cores)\n"
+		}
+	},
 	{ "password", &config.password, parse_string, 1, 0,
 		SECTION_DOWNLOAD,
 		{ "Password for Authentication.\n",
@@ -2110,6 +2147,12 @@ static const struct optionw options[] = {
 		  "downloads. (default: on)\n"
 		}
 	},
+	{ "robots-cache-file", &config.robots_cache_file, parse_filename, 1, 0,
+		SECTION_DOWNLOAD,
+		{ "Remember robots.txt of each host in this file\n",
+		  "for up to 24 hours. (default: off)\n"
+		}
+	},
 	{ "save-content-on", &config.save_content_on, parse_stringlist, 1, 0,
 		SECTION_DOWNLOAD,
 		{ "Specify a list of response codes that requires it's\n",
@@ -2311,6 +2354,31 @@ static const struct optionw options[] = {
 		  "(per thread). (default: 10)\n"
 		}
 	},
+	{ "warc-cdx", &config.warc_cdx, parse_bool, -1, 0,
+		SECTION_DOWNLOAD,
+		{ "Write a CDX index file along with the WARC\n",
+		  "files. (default: on)\n"
+		}
+	},
+	{ "warc-compression", &config.warc_compression, parse_bool, -1, 0,
+		SECTION_DOWNLOAD,
+		{ "Compress each WARC record with gzip.\n",
+		  "(default: on)\n"
+		}
+	},
+	{ "warc-file", &config.warc_file, parse_filename, 1, 0,
+		SECTION_DOWNLOAD,
+		{ "Write requests and responses into WARC files\n",
+		  "with the given prefix instead of saving\n",
+		  "each document into a file of its own.\n"
+		}
+	},
+	{ "warc-max-size", &config.warc_max_size, parse_numbytes, 1, 0,
+		SECTION_DOWNLOAD,
+		{ "Start a new WARC file when the current\n",
+		  "one exceeds the given size. (default: 0)\n"
+		}
+	},
 	{ "xattr", &config.xattr, parse_bool, -1, 0,
 		SECTION_DOWNLOAD,
 		{ "Save extended file attributes. (default: off)\n"\
@@ -3002,6 +3070,7 @@ static int use_askpass(void)
 
 static wget_dns_cache *dns_cache;
 static wget_dns *dns;
+static wget_altsvc_cache *altsvc_cache;
 
 static int preload_dns_cache(const char *fname)
 {
@@ -3345,7 +3414,7 @@ int init(int argc, const char **argv)
 	wget_iri_set_defaultport(WGET_IRI_SCHEME_HTTPS, config.default_https_port);
 
 	// check for correct settings
-	if (config.max_threads < 1 || (config.max_threads > 1 && config.chunk_size))
+	if (config.max_threads < 1)
 		config.max_threads = 1;
 
 	if (config.hyperlink) {
@@ -3548,6 +3617,14 @@ int init(int argc, const char **argv)
 	wget_dns_set_timeout(dns, config.dns_timeout);
 	wget_tcp_set_dns(NULL, dns);
 
+	if (config.alt_svc) {
+		if ((rc = wget_altsvc_cache_init(&altsvc_cache))) {
+			wget_error_printf(_("Failed to init Alt-Svc cache (%d)"), rc);
+			return -1;
+		}
+		wget_http_set_altsvc_cache(altsvc_cache);
+	}
+
 	if (config.stats_dns_args) {
 		config.stats_dns_args->fp =
 			config.stats_dns_args->filename && *config.stats_dns_args->filename && strcmp(config.stats_dns_args->filename, "-")
@@ -3703,6 +3780,8 @@ void deinit(void)
 
 	wget_dns_free(&dns);
 	wget_dns_cache_free(&dns_cache);
+	wget_http_set_altsvc_cache(NULL);
+	wget_altsvc_cache_free(&altsvc_cache);
 
 	wget_cookie_db_free(&config.cookie_db);
 	wget_hsts_db_free(&config.hsts_db);
@@ -3722,11 +3801,13 @@ void deinit(void)
 	xfree(config.cert_file);
 	xfree(config.cookie_suffixes);
 	xfree(config.crl_file);
+	xfree(config.dedup_dir);
 	xfree(config.default_page);
 	xfree(config.directory_prefix);
 	xfree(config.egd_file);
 	xfree(config.hsts_file);
 	xfree(config.hpkp_file);
+	xfree(config.http_cache_file);
 	xfree(config.http_password);
 	xfree(config.http_proxy);
 	xfree(config.http_proxy_password);
@@ -3754,12 +3835,14 @@ void deinit(void)
 	xfree(config.referer);
 	xfree(config.reject_regex);
 	xfree(config.remote_encoding);
+	xfree(config.robots_cache_file);
 	xfree(config.save_cookies);
 	xfree(config.secure_protocol);
 	xfree(config.tls_session_file);
 	xfree(config.user_agent);
 	xfree(config.use_askpass_bin);
 	xfree(config.username);
+	xfree(config.warc_file);
 	xfree(config.gnupg_homedir);
 	xfree(config.stats_all);
 	xfree(config.user_config);
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Thread pool for parsing downloaded documents
+ *
+ * Downloaders hand the bodies of HTML, CSS, sitemap and feed documents over to the pool
+ * and continue with the next request on their connection while the links are extracted.
+ *
+ * The queue is bounded: a downloader that submits to a full queue waits, so that
+ * bodies do not pile up in memory faster than they can be parsed.
+ *
+ */
+
+#include <config.h>
+
+#include <wget.h>
+
+#include "nproc.h"
+
+#include "wget_main.h"
+#include "wget_log.h"
+#include "wget_parser_pool.h"
+
+static wget_thread
+	*workers;
+static int
+	nworkers;
+static wget_list
+	*tasks;
+static int
+	ntasks,
+	max_tasks;
+static bool
+	stopping;
+static wget_thread_mutex
+	mutex;
+static wget_thread_cond
+	task_cond, // signaled whenever a task is added
+	space_cond; // signaled whenever a task is taken
+static parser_pool_task_fn
+	*run_task,
+	*discard_task;
+
+static void *worker_thread(WGET_GCC_UNUSED void *p)
+{
+	void **taskp, *task;
+
+	wget_thread_mutex_lock(mutex);
+
+	for (;;) {
+		while (!tasks && !stopping)
+			wget_thread_cond_wait(task_cond, mutex, 0);
+
+		if (stopping)
+			break;
+
+		taskp = wget_list_getfirst(tasks);
+		task = *taskp;
+		wget_list_remove(&tasks, taskp);
+		ntasks--;
+		wget_thread_cond_signal(space_cond);
+
+		wget_thread_mutex_unlock(mutex);
+		run_task(task);
+		wget_thread_mutex_lock(mutex);
+	}
+
+	wget_thread_mutex_unlock(mutex);
+
+	return NULL;
+}
+
+/**
+ * \param[in] n Number of parser threads, -1 for the number of CPU cores
+ * \param[in] run Function that parses a task, called by the parser threads
+ * \param[in] discard Function that frees a task that has not been parsed when the pool is stopped
+ * \return Number of parser threads started, 0 to parse on the calling threads
+ */
+int parser_pool_init(int n, parser_pool_task_fn *run, parser_pool_task_fn *discard)
+{
+	if (n < 0)
+		n = (int) num_processors(NPROC_CURRENT);
+
+	if (n <= 0 || !wget_thread_support())
+		return 0;
+
+	run_task = run;
+	discard_task = discard;
+	max_tasks = n * 2;
+	stopping = false;
+
+	wget_thread_mutex_init(&mutex);
+	wget_thread_cond_init(&task_cond);
+	wget_thread_cond_init(&space_cond);
+
+	workers = wget_calloc(n, sizeof(wget_thread));
+
+	for (nworkers = 0; nworkers < n; nworkers++) {
+		int rc;
+
+		if ((rc = wget_thread_start(&workers[nworkers], worker_thread, NULL, 0)) != 0) {
+			error_printf(_("Failed to start parser thread, error %d\n"), rc);
+			break;
+		}
+	}
+
+	if (!nworkers)
+		parser_pool_exit();
+
+	debug_printf("Started %d parser threads\n", nworkers);
+
+	return nworkers;
+}
+
+/**
+ * Stop the parser threads. Tasks that have not been started yet are discarded.
+ */
+void parser_pool_exit(void)
+{
+	if (!workers)
+		return;
+
+	wget_thread_mutex_lock(mutex);
+	stopping = true;
+	wget_thread_cond_signal(task_cond);
+	wget_thread_cond_signal(space_cond);
+	wget_thread_mutex_unlock(mutex);
+
+	for (int it = 0; it < nworkers; it++)
+		wget_thread_join(&workers[it]);
+
+	while (tasks) {
+		void **taskp = wget_list_getfirst(tasks);
+
+		discard_task(*taskp);
+		wget_list_remove(&tasks, taskp);
+	}
+
+	xfree(workers);
+	nworkers = ntasks = 0;
+
+	wget_thread_cond_destroy(&space_cond);
+	wget_thread_cond_destroy(&task_cond);
+	wget_thread_mutex_destroy(&mutex);
+}
+
+/**
+ * \param[in] task Task to be parsed by one of the parser threads
+ * \return true if the pool took \p task, false if the caller has to parse it
+ *
+ * Waits while the queue is full.
+ */
+bool parser_pool_submit(void *task)
+{
+	if (!workers)
+		return false;
+
+	wget_thread_mutex_lock(mutex);
+
+	while (ntasks >= max_tasks && !stopping)
+		wget_thread_cond_wait(space_cond, mutex, 0);
+
+	if (stopping) {
+		wget_thread_mutex_unlock(mutex);
+		return false;
+	}
+
+	wget_list_append(&tasks, &task, sizeof(task));
+	ntasks++;
+	wget_thread_cond_signal(task_cond);
+
+	wget_thread_mutex_unlock(mutex);
+
+	return true;
+}
@@ -587,6 +587,19 @@ int plugin_db_forward_downloaded_file(const wget_iri *iri, int64_t size, const c
 	return ret;
 }
 
+// Returns 1 if any plugin wants to see the downloaded files
+int plugin_db_has_post_processor(void)
+{
+	for (int i = 0; i < wget_vector_size(plugin_list); i++) {
+		plugin_priv_t *priv = (plugin_priv_t *) wget_vector_get(plugin_list, i);
+
+		if (priv->post_processor)
+			return 1;
+	}
+
+	return 0;
+}
+
 // Initializes the plugin framework
 void plugin_db_init(void)
 {
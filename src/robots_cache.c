@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Persistent robots.txt cache (RFC 9309 2.4)
+ *
+ * Remembers the robots.txt of each host between runs, so that a crawl does not
+ * start with downloading robots.txt again for every host.
+ * A missing robots.txt (4xx) is remembered as empty file, meaning all allowed.
+ * Server errors are not remembered.
+ *
+ * Entries expire after 24 hours or earlier when Cache-Control max-age says so.
+ *
+ * File format, one entry per line, '-' for an empty robots.txt:
+ * <robots.txt url> <expires> <base64 encoded robots.txt>
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <wget.h>
+
+#include "wget_main.h"
+#include "wget_log.h"
+#include "wget_options.h"
+#include "wget_cache_file.h"
+#include "wget_robots_cache.h"
+
+// RFC 9309 2.4: cached robots.txt SHOULD NOT be used for more than 24 hours
+#define ROBOTS_MAX_LIFETIME 86400
+
+typedef struct {
+	const char *
+		url;
+	const char *
+		data; // content of robots.txt, empty if there is none
+	int64_t
+		expires;
+} ROBOTS_CACHE_ENTRY;
+
+static CACHE_FILE cache; // defined below, along with the callbacks
+
+static void free_entry(ROBOTS_CACHE_ENTRY *entry)
+{
+	xfree(entry->url);
+	xfree(entry->data);
+	xfree(entry);
+}
+
+static void load_entry(const char *url, char *linep)
+{
+	const char *field;
+	int64_t expires;
+
+	if (!(field = cache_file_next_field(&linep)) || (expires = atoll(field)) <= time(NULL))
+		return; // drop expired entries
+
+	ROBOTS_CACHE_ENTRY *entry = wget_calloc(1, sizeof(ROBOTS_CACHE_ENTRY));
+
+	entry->url = wget_strdup(url);
+	entry->expires = expires;
+	if ((field = cache_file_next_field(&linep)))
+		entry->data = wget_base64_decode_alloc(field, strlen(field), NULL);
+	else
+		entry->data = wget_strdup("");
+
+	if (!entry->data) {
+		error_printf(_("Failed to parse robots cache line for '%s'\n"), entry->url);
+		free_entry(entry);
+		return;
+	}
+
+	wget_stringmap_put(cache.entries, entry->url, entry);
+}
+
+static int save_entry(void *context, WGET_GCC_UNUSED const char *key, void *value)
+{
+	FILE *fp = context;
+	ROBOTS_CACHE_ENTRY *entry = value;
+
+	if (*entry->data) {
+		char *data = wget_base64_encode_alloc(entry->data, strlen(entry->data));
+
+		wget_fprintf(fp, "%s %lld %s\n", entry->url, (long long) entry->expires, data);
+		xfree(data);
+	} else
+		wget_fprintf(fp, "%s %lld -\n", entry->url, (long long) entry->expires);
+
+	return 0;
+}
+
+static CACHE_FILE cache = {
+	.name = "robots.txt cache",
+	.format = "<robots.txt url> <expires> <base64 encoded robots.txt>",
+	.load_entry = load_entry,
+	.save_entry = save_entry,
+	.free_entry = (wget_stringmap_value_destructor *) free_entry,
+};
+
+int robots_cache_init(void)
+{
+	cache_file_init(&cache, config.robots_cache_file, 128);
+
+	return 0;
+}
+
+void robots_cache_exit(void)
+{
+	cache_file_exit(&cache, config.robots_cache_file);
+}
+
+/**
+ * \param[in] url URL of robots.txt
+ * \return Copy of the cached robots.txt, an empty string if the host has none, or NULL if unknown or expired
+ */
+char *robots_cache_get(const char *url)
+{
+	ROBOTS_CACHE_ENTRY *entry;
+	char *data = NULL;
+
+	if (!cache.entries)
+		return NULL;
+
+	wget_thread_mutex_lock(cache.mutex);
+
+	if (wget_stringmap_get(cache.entries, url, &entry)) {
+		if (entry->expires > time(NULL))
+			data = wget_strdup(entry->data);
+		else // not a removal, a fresh entry written by another process may still be merged in
+			wget_stringmap_remove(cache.entries, url);
+	}
+
+	wget_thread_mutex_unlock(cache.mutex);
+
+	return data;
+}
+
+/**
+ * \param[in] url URL of robots.txt
+ * \param[in] resp Response to the robots.txt request
+ *
+ * Remember a downloaded robots.txt, or that there is none.
+ */
+void robots_cache_store(const char *url, const wget_http_response *resp)
+{
+	ROBOTS_CACHE_ENTRY *entry;
+	int64_t lifetime = ROBOTS_MAX_LIFETIME;
+	const char *data;
+
+	if (!cache.entries || strpbrk(url, " \t\r\n"))
+		return;
+
+	if (resp->code / 100 == 2 && resp->body)
+		data = resp->body->data;
+	else if (resp->code / 100 == 4)
+		data = ""; // RFC 9309 2.3.1.3: unavailable, all allowed
+	else
+		return; // redirects are followed, server errors are temporary
+
+	if (resp->cache_no_store || resp->cache_no_cache) {
+		wget_thread_mutex_lock(cache.mutex);
+		cache_file_remove(&cache, url);
+		wget_thread_mutex_unlock(cache.mutex);
+		return;
+	}
+
+	if (resp->cache_maxage_valid && resp->cache_maxage < lifetime)
+		lifetime = resp->cache_maxage;
+	if (lifetime <= 0)
+		return;
+
+	entry = wget_calloc(1, sizeof(ROBOTS_CACHE_ENTRY));
+	entry->url = wget_strdup(url);
+	entry->data = wget_strdup(data);
+	entry->expires = time(NULL) + lifetime;
+
+	wget_thread_mutex_lock(cache.mutex);
+	cache_file_put(&cache, entry->url, entry);
+	wget_thread_mutex_unlock(cache.mutex);
+}
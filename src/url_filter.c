@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Precompiled URL filters
+ *
+ * The accept/reject patterns and regular expressions, the include/exclude directories
+ * and the domain lists are compiled once after option parsing:
+ *  - regular expressions are compiled (and JIT compiled with PCRE)
+ *  - literal patterns go into hash tables, so that a lookup per distinct pattern length
+ *    replaces the comparison with each pattern
+ *  - only patterns with wildcards are still matched one by one with fnmatch()
+ *
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <regex.h>
+
+#ifdef WITH_LIBPCRE2
+# define PCRE2_CODE_UNIT_WIDTH 8
+# include <pcre2.h>
+#elif defined WITH_LIBPCRE
+# include <pcre.h>
+# ifndef PCRE_STUDY_JIT_COMPILE
+#  define PCRE_STUDY_JIT_COMPILE 0
+# endif
+#endif
+
+#include <wget.h>
+
+#include "wget_main.h"
+#include "wget_log.h"
+#include "wget_options.h"
+#include "wget_url_filter.h"
+
+typedef enum {
+	MATCH_TAIL, // the string ends with the pattern (--accept, --reject)
+	MATCH_HOST  // the pattern ends with the host name (--domains, --exclude-domains)
+} match_type;
+
+typedef struct {
+	wget_stringmap
+		*literals; // patterns without wildcards, the keys point into the pattern strings
+	wget_vector
+		*globs; // patterns with wildcards
+	size_t
+		*lengths; // distinct lengths of the literal patterns, ascending (MATCH_TAIL only)
+	int
+		nlengths;
+	match_type
+		type;
+	bool
+		ignore_case : 1;
+} pattern_list;
+
+typedef struct {
+	const char *
+		pattern; // without prefix and leading slash
+	int
+		pos; // position in the list, the last matching entry wins
+	bool
+		exclude : 1;
+} directory_entry;
+
+typedef struct {
+	wget_stringmap
+		*literals; // directory -> last directory_entry without wildcards
+	directory_entry
+		*entries;
+	int
+		nentries;
+	bool
+		default_exclude : 1; // if -I was given: exclude all by default
+} directory_list;
+
+typedef struct {
+#ifdef WITH_LIBPCRE2
+	pcre2_code
+		*pcre;
+#elif defined WITH_LIBPCRE
+	pcre
+		*pcre;
+	pcre_extra
+		*extra;
+#endif
+	regex_t
+		posix;
+	bool
+		posix_valid : 1;
+} compiled_regex;
+
+static pattern_list
+	accept_patterns,
+	reject_patterns,
+	domains,
+	exclude_domains;
+static directory_list
+	directories;
+static compiled_regex
+	accept_regex,
+	reject_regex;
+// --domains grows with the hosts of the start URLs
+static wget_thread_mutex
+	domains_mutex;
+
+static bool has_wildcards(const char *pattern)
+{
+	return strpbrk(pattern, "*?[]") != NULL;
+}
+
+static void pattern_list_add(pattern_list *list, const char *pattern)
+{
+	if (has_wildcards(pattern)) {
+		wget_vector_add(list->globs, pattern);
+	} else if (list->type == MATCH_HOST) {
+		// every tail of the pattern matches
+		for (const char *p = pattern; *p; p++)
+			wget_stringmap_put(list->literals, p, NULL);
+	} else {
+		size_t len = strlen(pattern);
+		int it;
+
+		wget_stringmap_put(list->literals, pattern, NULL);
+
+		for (it = 0; it < list->nlengths && list->lengths[it] < len; it++)
+			;
+
+		if (it == list->nlengths || list->lengths[it] != len) {
+			list->lengths = wget_realloc(list->lengths, (list->nlengths + 1) * sizeof(size_t));
+			memmove(list->lengths + it + 1, list->lengths + it, (list->nlengths - it) * sizeof(size_t));
+			list->lengths[it] = len;
+			list->nlengths++;
+		}
+	}
+}
+
+static void pattern_list_init(pattern_list *list, const wget_vector *patterns, match_type type, bool ignore_case)
+{
+	list->type = type;
+	list->ignore_case = ignore_case;
+	list->literals = ignore_case ? wget_stringmap_create_nocase(16) : wget_stringmap_create(16);
+	wget_stringmap_set_key_destructor(list->literals, NULL);
+	wget_stringmap_set_value_destructor(list->literals, NULL);
+	list->globs = wget_vector_create(4, NULL);
+	wget_vector_set_destructor(list->globs, NULL);
+
+	for (int it = 0; it < wget_vector_size(patterns); it++)
+		pattern_list_add(list, wget_vector_get(patterns, it));
+}
+
+static void pattern_list_deinit(pattern_list *list)
+{
+	wget_stringmap_free(&list->literals);
+	wget_vector_free(&list->globs);
+	xfree(list->lengths);
+	list->nlengths = 0;
+}
+
+static bool pattern_list_match(const pattern_list *list, const char *s)
+{
+	if (list->type == MATCH_HOST) {
+		if (wget_stringmap_contains(list->literals, s))
+			return true;
+	} else {
+		size_t len = strlen(s);
+
+		for (int it = 0; it < list->nlengths && list->lengths[it] <= len; it++) {
+			if (wget_stringmap_contains(list->literals, s + len - list->lengths[it]))
+				return true;
+		}
+	}
+
+	for (int it = 0; it < wget_vector_size(list->globs); it++) {
+		if (!fnmatch(wget_vector_get(list->globs, it), s, list->ignore_case ? FNM_CASEFOLD : 0))
+			return true;
+	}
+
+	return false;
+}
+
+static void directory_list_init(directory_list *list, const wget_vector *patterns)
+{
+	list->literals = config.ignore_case ? wget_stringmap_create_nocase(16) : wget_stringmap_create(16);
+	wget_stringmap_set_key_destructor(list->literals, NULL);
+	wget_stringmap_set_value_destructor(list->literals, NULL);
+
+	if (!(list->nentries = wget_vector_size(patterns)))
+		return;
+
+	list->entries = wget_malloc(list->nentries * sizeof(directory_entry));
+	list->default_exclude = *(const char *) wget_vector_get(patterns, 0) == INCLUDED_DIRECTORY_PREFIX;
+
+	for (int it = 0; it < list->nentries; it++) {
+		const char *pattern = wget_vector_get(patterns, it);
+		directory_entry *entry = &list->entries[it];
+
+		entry->exclude = *pattern++ != INCLUDED_DIRECTORY_PREFIX;
+		if (*pattern == '/')
+			pattern++;
+		entry->pattern = pattern;
+		entry->pos = it;
+
+		if (!has_wildcards(pattern))
+			wget_stringmap_put(list->literals, pattern, entry); // replaces earlier entries
+	}
+}
+
+static void directory_list_deinit(directory_list *list)
+{
+	wget_stringmap_free(&list->literals);
+	xfree(list->entries);
+	list->nentries = 0;
+}
+
+static bool directory_list_match(const directory_list *list, const char *fname)
+{
+	const directory_entry *best = NULL, *entry;
+	char *path;
+
+	if (!fname)
+		return false;
+
+	if (*fname == '/')
+		fname++;
+
+	const char *e = strrchr(fname, '/');
+	if (!e)
+		path = wget_strdup("/");
+	else
+		path = wget_strmemdup(fname, e - fname);
+
+	// a literal directory matches the path and its subdirectories, so look up all
+	// leading components of the path; "" only matches the root directory
+	if (!strcmp(path, "/") && wget_stringmap_get(list->literals, "", &entry))
+		best = entry;
+
+	for (char *p = path + 1; *path; p++) {
+		if (*p == '/' || !*p) {
+			char c = *p;
+
+			*p = 0;
+			if (wget_stringmap_get(list->literals, path, &entry) && (!best || entry->pos > best->pos))
+				best = entry;
+			if (!(*p = c))
+				break;
+		}
+	}
+
+	// path="/we/all/love/wget" wouldn't match "/*/all/*" but "/*/all/*/*"
+	for (int it = list->nentries - 1; it >= 0 && (!best || it > best->pos); it--) {
+		entry = &list->entries[it];
+
+		if (has_wildcards(entry->pattern)
+			&& !fnmatch(entry->pattern, path, FNM_PATHNAME | (config.ignore_case ? FNM_CASEFOLD : 0)))
+		{
+			best = entry;
+			break;
+		}
+	}
+
+	wget_free(path);
+
+	return best ? best->exclude : list->default_exclude;
+}
+
+static void regex_compile(compiled_regex *re, const char *pattern)
+{
+#ifdef WITH_LIBPCRE2
+	if (config.regex_type == WGET_REGEX_TYPE_PCRE) {
+		int errornumber;
+		PCRE2_SIZE erroroffset;
+
+		if (!(re->pcre = pcre2_compile((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED, 0, &errornumber, &erroroffset, NULL))) {
+			error_printf(_("Failed to compile regex '%s'\n"), pattern);
+			return;
+		}
+
+		// without JIT support, pcre2_match() falls back to the interpreter
+		pcre2_jit_compile(re->pcre, PCRE2_JIT_COMPLETE);
+		return;
+	}
+#elif defined WITH_LIBPCRE
+	if (config.regex_type == WGET_REGEX_TYPE_PCRE) {
+		const char *error_msg = NULL;
+		int error;
+
+		if (!(re->pcre = pcre_compile(pattern, 0, &error_msg, &error, NULL))) {
+			error_printf(_("Failed to compile regex '%s'\n"), pattern);
+			return;
+		}
+
+		error_msg = NULL;
+		re->extra = pcre_study(re->pcre, PCRE_STUDY_JIT_COMPILE, &error_msg);
+		if (error_msg) {
+			error_printf(_("Failed to compile regex '%s'\n"), pattern);
+			pcre_free(re->pcre);
+			re->pcre = NULL;
+		}
+		return;
+	}
+#endif
+
+	if (regcomp(&re->posix, pattern, REG_EXTENDED|REG_NOSUB) == 0)
+		re->posix_valid = 1;
+	else
+		error_printf(_("Failed to compile regex '%s'\n"), pattern);
+}
+
+static void regex_free(compiled_regex *re)
+{
+#ifdef WITH_LIBPCRE2
+	if (re->pcre) {
+		pcre2_code_free(re->pcre);
+		re->pcre = NULL;
+	}
+#elif defined WITH_LIBPCRE
+	if (re->extra) {
+#ifdef PCRE_CONFIG_JIT
+		pcre_free_study(re->extra);
+#else
+		pcre_free(re->extra);
+#endif
+		re->extra = NULL;
+	}
+	if (re->pcre) {
+		pcre_free(re->pcre);
+		re->pcre = NULL;
+	}
+#endif
+
+	if (re->posix_valid) {
+		regfree(&re->posix);
+		re->posix_valid = 0;
+	}
+}
+
+// an invalid regex never matches
+static bool regex_match(const compiled_regex *re, const char *string)
+{
+#ifdef WITH_LIBPCRE2
+	if (re->pcre) {
+		pcre2_match_data *match_data = pcre2_match_data_create(1, NULL);
+		int rc = pcre2_match(re->pcre, (PCRE2_SPTR) string, strlen(string), 0, 0, match_data, NULL);
+
+		pcre2_match_data_free(match_data);
+		return rc >= 0;
+	}
+#elif defined WITH_LIBPCRE
+	if (re->pcre) {
+		int offsets[8];
+
+		return pcre_exec(re->pcre, re->extra, string, (int) strlen(string), 0, 0, offsets, 8) >= 0;
+	}
+#endif
+
+	return re->posix_valid && regexec(&re->posix, string, 0, NULL, 0) == 0;
+}
+
+int url_filter_init(void)
+{
+	if (wget_thread_mutex_init(&domains_mutex))
+		return -1;
+
+	pattern_list_init(&accept_patterns, config.accept_patterns, MATCH_TAIL, config.ignore_case);
+	pattern_list_init(&reject_patterns, config.reject_patterns, MATCH_TAIL, config.ignore_case);
+	pattern_list_init(&domains, config.domains, MATCH_HOST, false);
+	pattern_list_init(&exclude_domains, config.exclude_domains, MATCH_HOST, false);
+	directory_list_init(&directories, config.exclude_directories);
+
+	if (config.accept_regex)
+		regex_compile(&accept_regex, config.accept_regex);
+	if (config.reject_regex)
+		regex_compile(&reject_regex, config.reject_regex);
+
+	return 0;
+}
+
+void url_filter_exit(void)
+{
+	pattern_list_deinit(&accept_patterns);
+	pattern_list_deinit(&reject_patterns);
+	pattern_list_deinit(&domains);
+	pattern_list_deinit(&exclude_domains);
+	directory_list_deinit(&directories);
+	regex_free(&accept_regex);
+	regex_free(&reject_regex);
+	wget_thread_mutex_destroy(&domains_mutex);
+}
+
+/**
+ * \param[in] s URL or file name
+ * \return Whether \p s passes --accept and --accept-regex
+ */
+bool url_filter_accepted(const char *s)
+{
+	if (config.accept_patterns && !pattern_list_match(&accept_patterns, s))
+		return false;
+
+	if (config.accept_regex && !regex_match(&accept_regex, s))
+		return false;
+
+	return true;
+}
+
+/**
+ * \param[in] s URL or file name
+ * \return Whether \p s is matched by --reject or --reject-regex
+ */
+bool url_filter_rejected(const char *s)
+{
+	return (config.reject_patterns && pattern_list_match(&reject_patterns, s))
+		|| (config.reject_regex && regex_match(&reject_regex, s));
+}
+
+/**
+ * \param[in] path Path of a URL or file name
+ * \return Whether the directory of \p path is excluded by --include-directories / --exclude-directories
+ */
+bool url_filter_directory_excluded(const char *path)
+{
+	return config.exclude_directories && directory_list_match(&directories, path);
+}
+
+bool url_filter_in_domains(const char *host)
+{
+	bool match;
+
+	wget_thread_mutex_lock(domains_mutex);
+	match = pattern_list_match(&domains, host);
+	wget_thread_mutex_unlock(domains_mutex);
+
+	return match;
+}
+
+bool url_filter_in_exclude_domains(const char *host)
+{
+	return pattern_list_match(&exclude_domains, host);
+}
+
+/**
+ * \param[in] host Host name, must stay valid until url_filter_exit()
+ *
+ * Add \p host to the compiled --domains list.
+ */
+void url_filter_add_domain(const char *host)
+{
+	wget_thread_mutex_lock(domains_mutex);
+	pattern_list_add(&domains, host);
+	wget_thread_mutex_unlock(domains_mutex);
+}
@@ -0,0 +1,713 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * WARC output routines
+ *
+ * Each response is written as a 'request' and a 'response' record.
+ * With compression, every record is a gzip member of its own, so readers
+ * (and the CDX index) are able to seek directly to a record.
+ *
+ * Resources:
+ * ISO 28500:2017 (WARC/1.1), we write WARC/1.0 for compatibility
+ * http://iipc.github.io/warc-specifications/specifications/cdx-format/cdx-2015/
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include <wget.h>
+
+#include "safe-write.h"
+
+#include "wget_main.h"
+#include "wget_log.h"
+#include "wget_options.h"
+#include "wget_warc.h"
+
+// payloads larger than this are spooled into a temporary file
+#define WARC_SPOOL_MEMORY (1024 * 1024)
+
+struct warc_record_st {
+	wget_buffer
+		*request; // the serialized HTTP request
+	wget_buffer
+		*payload; // the response payload as long as it fits into memory
+	FILE
+		*spool; // temporary file for large payloads
+	wget_hash_hd
+		*payload_hash;
+	uint64_t
+		payload_length;
+	int64_t
+		date; // time the request has been sent
+	bool
+		spool_failed, // keep the payload in memory
+		error; // the payload could not be stored completely
+};
+
+// 'fd', 'offset' and the CDX file are protected by 'mutex'
+static wget_thread_mutex
+	mutex;
+static int
+	fd = -1,
+	cdx_fd = -1;
+static unsigned
+	serial;
+static long long
+	offset; // size of the current WARC file
+static char
+	*filename,
+	warcinfo_id[48];
+
+typedef struct {
+	wget_buffer
+		*buf; // output buffer
+	FILE
+		*file; // output file if 'buf' is NULL, else write directly into the WARC file
+#ifdef WITH_ZLIB
+	z_stream
+		z;
+#endif
+	long long
+		length; // number of bytes written (after compression)
+	bool
+		compress,
+		error;
+} record_writer;
+
+static void writer_output(record_writer *w, const char *data, size_t length)
+{
+	if (!length)
+		return;
+
+	if (w->buf)
+		wget_buffer_memcat(w->buf, data, length);
+	else if (w->file) {
+		if (fwrite(data, 1, length, w->file) != length)
+			w->error = true;
+	} else if (safe_write(fd, data, length) != length)
+		w->error = true;
+
+	w->length += length;
+}
+
+static void writer_init(record_writer *w, wget_buffer *buf, FILE *file, bool compress)
+{
+	memset(w, 0, sizeof(*w));
+	w->buf = buf;
+	w->file = file;
+
+#ifdef WITH_ZLIB
+	// windowBits + 16 means gzip format
+	if ((w->compress = compress) && deflateInit2(&w->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		w->error = true;
+#else
+	(void) compress;
+#endif
+}
+
+static void writer_add(record_writer *w, const char *data, size_t length, bool finish)
+{
+#ifdef WITH_ZLIB
+	if (w->compress) {
+		char out[16384];
+		int rc;
+
+		w->z.next_in = (unsigned char *) data;
+		w->z.avail_in = (unsigned) length;
+
+		for (;;) {
+			w->z.next_out = (unsigned char *) out;
+			w->z.avail_out = sizeof(out);
+
+			if ((rc = deflate(&w->z, finish ? Z_FINISH : Z_NO_FLUSH)) == Z_STREAM_ERROR) {
+				w->error = true;
+				break;
+			}
+
+			writer_output(w, out, sizeof(out) - w->z.avail_out);
+
+			if (finish ? rc == Z_STREAM_END : w->z.avail_out != 0)
+				break;
+		}
+
+		return;
+	}
+#endif
+
+	writer_output(w, data, length);
+}
+
+// add the content of a temporary file
+static void writer_add_file(record_writer *w, FILE *fp)
+{
+	char buf[16384];
+	size_t nbytes;
+
+	rewind(fp);
+	while ((nbytes = fread(buf, 1, sizeof(buf), fp)) > 0)
+		writer_add(w, buf, nbytes, false);
+
+	if (ferror(fp))
+		w->error = true;
+}
+
+static void writer_deinit(record_writer *w)
+{
+#ifdef WITH_ZLIB
+	if (w->compress)
+		deflateEnd(&w->z);
+#else
+	(void) w;
+#endif
+}
+
+static void generate_record_id(char *buf, size_t size)
+{
+	unsigned char r[16];
+
+	for (unsigned it = 0; it < sizeof(r); it++)
+		r[it] = (unsigned char) wget_random();
+
+	// UUID version 4 (random), variant RFC 4122
+	r[6] = (r[6] & 0x0F) | 0x40;
+	r[8] = (r[8] & 0x3F) | 0x80;
+
+	wget_snprintf(buf, size,
+		"<urn:uuid:%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x>",
+		r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7],
+		r[8], r[9], r[10], r[11], r[12], r[13], r[14], r[15]);
+}
+
+// WARC payload digests are base32 encoded (RFC 4648)
+static void base32_encode(char *dst, const unsigned char *src, size_t length)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+	unsigned value = 0, bits = 0;
+
+	for (size_t it = 0; it < length; it++) {
+		value = (value << 8) | src[it];
+		bits += 8;
+
+		while (bits >= 5) {
+			bits -= 5;
+			*dst++ = alphabet[(value >> bits) & 31];
+		}
+	}
+
+	if (bits)
+		*dst++ = alphabet[(value << (5 - bits)) & 31];
+
+	*dst = 0;
+}
+
+// e.g. 2020-06-01T12:00:00Z
+static void print_warc_date(int64_t t, char *buf, size_t size)
+{
+	time_t tt = (time_t) t;
+	struct tm tm;
+
+	if (!gmtime_r(&tt, &tm) || !strftime(buf, size, "%Y-%m-%dT%H:%M:%SZ", &tm))
+		*buf = 0;
+}
+
+// e.g. 20200601120000
+static void print_cdx_date(int64_t t, char *buf, size_t size)
+{
+	time_t tt = (time_t) t;
+	struct tm tm;
+
+	if (!gmtime_r(&tt, &tm) || !strftime(buf, size, "%Y%m%d%H%M%S", &tm))
+		*buf = 0;
+}
+
+// 'info_id' is the ID of the warcinfo record of the file the record is written to, NULL if none
+static void add_warc_header(wget_buffer *buf, const char *type, const char *record_id, const char *info_id,
+	const char *uri, int64_t date, const char *content_type, uint64_t length)
+{
+	char warc_date[32];
+
+	print_warc_date(date, warc_date, sizeof(warc_date));
+
+	wget_buffer_printf_append(buf,
+		"WARC/1.0\r\n"
+		"WARC-Type: %s\r\n"
+		"WARC-Record-ID: %s\r\n"
+		"WARC-Date: %s\r\n",
+		type, record_id, warc_date);
+
+	if (uri)
+		wget_buffer_printf_append(buf, "WARC-Target-URI: %s\r\n", uri);
+
+	if (info_id && *info_id)
+		wget_buffer_printf_append(buf, "WARC-Warcinfo-ID: %s\r\n", info_id);
+
+	wget_buffer_printf_append(buf,
+		"Content-Type: %s\r\n"
+		"Content-Length: %llu\r\n",
+		content_type, (unsigned long long) length);
+}
+
+// append the record block plus the record end marker and compress the result (if enabled)
+static void finish_record(wget_buffer *buf, const char *block, size_t length)
+{
+	wget_buffer *out = wget_buffer_alloc(buf->length + length + 16);
+	record_writer w;
+
+	writer_init(&w, out, NULL, config.warc_compression);
+	writer_add(&w, buf->data, buf->length, false);
+	writer_add(&w, block, length, false);
+	writer_add(&w, "\r\n\r\n", 4, true);
+	writer_deinit(&w);
+
+	wget_buffer_memcpy(buf, out->data, out->length);
+	wget_buffer_free(&out);
+}
+
+static int open_warc_file(void)
+{
+	const char *ext = config.warc_compression ? "warc.gz" : "warc";
+	const char *base;
+
+	xfree(filename);
+	if (config.warc_max_size)
+		filename = wget_aprintf("%s-%05u.%s", config.warc_file, serial++, ext);
+	else
+		filename = wget_aprintf("%s.%s", config.warc_file, ext);
+
+	if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
+		error_printf(_("Failed to open WARC file '%s' (%d)\n"), filename, errno);
+		set_exit_status(EXIT_STATUS_IO);
+		return -1;
+	}
+
+	info_printf(_("Writing WARC file '%s'\n"), filename);
+	offset = 0;
+
+	if ((base = strrchr(filename, '/')))
+		base++;
+	else
+		base = filename;
+
+	// every WARC file starts with a 'warcinfo' record
+	wget_buffer fields, record;
+	bool error;
+
+	wget_buffer_init(&fields, NULL, 256);
+	wget_buffer_init(&record, NULL, 512);
+
+	wget_buffer_printf(&fields,
+		"software: " PACKAGE_NAME "/" PACKAGE_VERSION "\r\n"
+		"format: WARC File Format 1.0\r\n"
+		"robots: %s\r\n",
+		config.robots ? "classic" : "off");
+
+	generate_record_id(warcinfo_id, sizeof(warcinfo_id));
+	add_warc_header(&record, "warcinfo", warcinfo_id, NULL, NULL, time(NULL), "application/warc-fields", fields.length);
+	wget_buffer_printf_append(&record, "WARC-Filename: %s\r\n\r\n", base);
+	finish_record(&record, fields.data, fields.length);
+
+	error = safe_write(fd, record.data, record.length) != record.length;
+	offset += record.length;
+
+	wget_buffer_deinit(&record);
+	wget_buffer_deinit(&fields);
+
+	if (error) {
+		error_printf(_("Failed to write WARC file '%s' (%d)\n"), filename, errno);
+		set_exit_status(EXIT_STATUS_IO);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void close_warc_file(void)
+{
+	if (fd != -1) {
+		if (config.fsync_policy && fsync(fd) < 0 && errno == EIO) {
+			error_printf(_("Failed to fsync errno=%d\n"), errno);
+			set_exit_status(EXIT_STATUS_IO);
+		}
+
+		close(fd);
+		fd = -1;
+	}
+}
+
+int warc_init(void)
+{
+	if (!config.warc_file)
+		return 0;
+
+#ifndef WITH_ZLIB
+	if (config.warc_compression) {
+		info_printf(_("Wget2 built without zlib support. Disabling WARC compression\n"));
+		config.warc_compression = false;
+	}
+#endif
+
+	wget_thread_mutex_init(&mutex);
+
+	if (open_warc_file() < 0)
+		return -1;
+
+	if (config.warc_cdx) {
+		char *cdx_name = wget_aprintf("%s.cdx", config.warc_file);
+
+		if ((cdx_fd = open(cdx_name, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
+			error_printf(_("Failed to open CDX file '%s' (%d)\n"), cdx_name, errno);
+			set_exit_status(EXIT_STATUS_IO);
+		} else {
+			// a: original url, b: date, m: mime type, s: status code, k: payload digest,
+			// r: redirect, M: meta tags, S: record length, V: record offset, g: file name
+			static const char header[] = " CDX a b m s k r M S V g\n";
+
+			if (safe_write(cdx_fd, header, sizeof(header) - 1) != sizeof(header) - 1)
+				error_printf(_("Failed to write CDX file '%s' (%d)\n"), cdx_name, errno);
+		}
+
+		xfree(cdx_name);
+	}
+
+	return 0;
+}
+
+void warc_exit(void)
+{
+	if (!config.warc_file)
+		return;
+
+	close_warc_file();
+
+	if (cdx_fd != -1) {
+		close(cdx_fd);
+		cdx_fd = -1;
+	}
+
+	xfree(filename);
+	wget_thread_mutex_destroy(&mutex);
+}
+
+warc_record *warc_record_alloc(wget_http_request *req)
+{
+	warc_record *record = wget_calloc(1, sizeof(warc_record));
+
+	record->request = wget_buffer_alloc(512 + req->body_length);
+	if (wget_http_request_to_buffer(req, record->request, 0) < 0)
+		wget_buffer_reset(record->request);
+
+	record->payload = wget_buffer_alloc(10240);
+	record->date = time(NULL);
+
+	if (wget_hash_init(&record->payload_hash, WGET_DIGTYPE_SHA1))
+		record->payload_hash = NULL;
+
+	return record;
+}
+
+void warc_record_free(warc_record **record)
+{
+	if (*record) {
+		if ((*record)->payload_hash) {
+			unsigned char digest[20];
+			wget_hash_deinit(&(*record)->payload_hash, digest);
+		}
+
+		if ((*record)->spool)
+			fclose((*record)->spool);
+
+		wget_buffer_free(&(*record)->payload);
+		wget_buffer_free(&(*record)->request);
+		xfree(*record);
+	}
+}
+
+void warc_record_append(warc_record *record, const char *data, size_t length)
+{
+	if (!length)
+		return;
+
+	if (record->payload_hash)
+		wget_hash(record->payload_hash, data, length);
+
+	record->payload_length += length;
+
+	if (record->error)
+		return;
+
+	if (record->payload && record->payload->length + length > WARC_SPOOL_MEMORY && !record->spool_failed) {
+		// too large to keep in memory, move what we have into a temporary file
+		if ((record->spool = tmpfile())) {
+			if (fwrite(record->payload->data, 1, record->payload->length, record->spool) != record->payload->length)
+				record->error = true;
+			wget_buffer_free(&record->payload);
+		} else {
+			error_printf(_("Failed to create temporary file for WARC record (%d)\n"), errno);
+			record->spool_failed = true;
+		}
+	}
+
+	if (record->payload)
+		wget_buffer_memcat(record->payload, data, length);
+	else if (!record->error && fwrite(data, 1, length, record->spool) != length)
+		record->error = true;
+
+	if (record->error) {
+		error_printf(_("Failed to write temporary file for WARC record (%d)\n"), errno);
+		set_exit_status(EXIT_STATUS_IO);
+	}
+}
+
+// Build an HTTP/1.1 header from the response header.
+// HTTP/2 headers come without status line and the payload is stored decoded (de-chunked and decompressed),
+// so the original transfer headers are renamed to keep the record consistent.
+static void add_http_header(wget_buffer *buf, wget_http_response *resp, uint64_t payload_length)
+{
+	const char *line, *eol, *data = resp->header ? resp->header->data : "";
+
+	if (resp->major == 2 || !strchr(data, '\n'))
+		wget_buffer_printf_append(buf, "HTTP/1.1 %d %s\r\n", resp->code, resp->reason);
+	else if ((eol = strchr(data, '\n'))) {
+		wget_buffer_memcat(buf, data, eol - data + 1);
+		data = eol + 1;
+	}
+
+	for (line = data; *line; line = *eol ? eol + 1 : eol) {
+		size_t length;
+
+		if (!(eol = strchr(line, '\n')))
+			eol = line + strlen(line);
+
+		if ((length = eol - line) && line[length - 1] == '\r')
+			length--;
+
+		if (!length || *line == ':' || *line == '\r')
+			continue;
+
+		if (!wget_strncasecmp_ascii(line, "Transfer-Encoding:", 18)
+			|| !wget_strncasecmp_ascii(line, "Content-Encoding:", 17)
+			|| !wget_strncasecmp_ascii(line, "Content-Length:", 15))
+			wget_buffer_memcat(buf, "X-Crawler-", 10);
+
+		wget_buffer_memcat(buf, line, length);
+		wget_buffer_memcat(buf, "\r\n", 2);
+	}
+
+	wget_buffer_printf_append(buf, "Content-Length: %llu\r\n\r\n", (unsigned long long) payload_length);
+}
+
+static void write_cdx_line(wget_http_response *resp, const char *uri, const char *digest,
+	int64_t date, long long length, long long record_offset)
+{
+	char cdx_date[16], *p;
+	const char *base = (p = strrchr(filename, '/')) ? p + 1 : filename;
+	wget_buffer buf;
+
+	print_cdx_date(date, cdx_date, sizeof(cdx_date));
+
+	wget_buffer_init(&buf, NULL, 256);
+	wget_buffer_printf(&buf, "%s %s %s %d %s %s - %lld %lld %s\n",
+		uri, cdx_date, resp->content_type ? resp->content_type : "-", resp->code, digest,
+		resp->location ? resp->location : "-", length, record_offset, base);
+
+	if (safe_write(cdx_fd, buf.data, buf.length) != buf.length)
+		error_printf(_("Failed to write CDX file (%d)\n"), errno);
+
+	wget_buffer_deinit(&buf);
+}
+
+/*
+ * Build the request and the response record, referring to the warcinfo record 'info_id'.
+ * Spooled responses are only built up to the payload, which is added when writing,
+ * or, with compression, compressed into '*compressed'.
+ */
+static bool build_records(warc_record *record, wget_http_response *resp, const char *uri, const char *info_id,
+	const char *request_id, const char *response_id, const char *digest,
+	wget_buffer *request, wget_buffer *response, FILE **compressed)
+{
+	wget_buffer header;
+
+	wget_buffer_reset(request);
+	add_warc_header(request, "request", request_id, info_id, uri, record->date, "application/http;msgtype=request", record->request->length);
+	wget_buffer_printf_append(request, "WARC-Concurrent-To: %s\r\n\r\n", response_id);
+	finish_record(request, record->request->data, record->request->length);
+
+	wget_buffer_init(&header, NULL, 1024);
+	add_http_header(&header, resp, record->payload_length);
+
+	wget_buffer_reset(response);
+	add_warc_header(response, "response", response_id, info_id, uri, record->date, "application/http;msgtype=response",
+		header.length + record->payload_length);
+	if (*digest != '-')
+		wget_buffer_printf_append(response, "WARC-Payload-Digest: %s\r\n", digest);
+	wget_buffer_memcat(response, "\r\n", 2);
+	wget_buffer_bufcat(response, &header);
+	wget_buffer_deinit(&header);
+
+	if (*compressed) {
+		fclose(*compressed);
+		*compressed = NULL;
+	}
+
+	if (record->payload) {
+		wget_buffer_bufcat(response, record->payload);
+		finish_record(response, NULL, 0);
+	} else if (config.warc_compression) {
+		// compress the spooled payload into another temporary file, the lock is only held for the append
+		record_writer w;
+
+		if (!(*compressed = tmpfile())) {
+			error_printf(_("Failed to create temporary file for WARC record (%d)\n"), errno);
+			return false;
+		}
+
+		writer_init(&w, NULL, *compressed, true);
+		writer_add(&w, response->data, response->length, false);
+		writer_add_file(&w, record->spool);
+		writer_add(&w, "\r\n\r\n", 4, true);
+		writer_deinit(&w);
+
+		if (w.error || fflush(*compressed)) {
+			error_printf(_("Failed to write temporary file for WARC record (%d)\n"), errno);
+			set_exit_status(EXIT_STATUS_IO);
+			fclose(*compressed);
+			*compressed = NULL;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void warc_record_write(warc_record **_record, wget_http_response *resp, const char *uri)
+{
+	warc_record *record = *_record;
+	char request_id[48], response_id[48], info_id[sizeof(warcinfo_id)];
+	char digest[48] = "-";
+	wget_buffer request, response;
+	FILE *compressed = NULL;
+	bool built;
+
+	if (!record)
+		return;
+
+	if (record->error) {
+		// don't write a truncated record
+		error_printf(_("WARC record for '%s' not written\n"), uri);
+		warc_record_free(_record);
+		return;
+	}
+
+	if (record->payload_hash) {
+		unsigned char sha1[20];
+
+		wget_hash_deinit(&record->payload_hash, sha1);
+		memcpy(digest, "sha1:", 5);
+		base32_encode(digest + 5, sha1, sizeof(sha1));
+	}
+
+	generate_record_id(request_id, sizeof(request_id));
+	generate_record_id(response_id, sizeof(response_id));
+
+	// 'warcinfo_id' changes when the WARC file is rotated
+	wget_thread_mutex_lock(mutex);
+	wget_strlcpy(info_id, warcinfo_id, sizeof(info_id));
+	wget_thread_mutex_unlock(mutex);
+
+	// build and compress the records outside the lock
+	wget_buffer_init(&request, NULL, 1024 + record->request->length);
+	wget_buffer_init(&response, NULL, 2048);
+	built = build_records(record, resp, uri, info_id, request_id, response_id, digest, &request, &response, &compressed);
+
+	wget_thread_mutex_lock(mutex);
+
+	if (config.warc_max_size && offset >= config.warc_max_size) {
+		close_warc_file();
+		open_warc_file();
+	}
+
+	if (built && strcmp(info_id, warcinfo_id)) {
+		// the file has been rotated meanwhile, rare enough to rebuild within the lock
+		wget_strlcpy(info_id, warcinfo_id, sizeof(info_id));
+		built = build_records(record, resp, uri, info_id, request_id, response_id, digest, &request, &response, &compressed);
+	}
+
+	if (built && fd != -1) {
+		long long response_offset, response_length;
+		bool error;
+
+		error = safe_write(fd, request.data, request.length) != request.length;
+		offset += request.length;
+		response_offset = offset;
+
+		if (record->payload) {
+			error |= safe_write(fd, response.data, response.length) != response.length;
+			response_length = response.length;
+		} else {
+			// append the (compressed) spooled payload to the WARC file
+			record_writer w;
+
+			writer_init(&w, NULL, NULL, false);
+			if (compressed)
+				writer_add_file(&w, compressed);
+			else {
+				writer_add(&w, response.data, response.length, false);
+				writer_add_file(&w, record->spool);
+				writer_add(&w, "\r\n\r\n", 4, true);
+			}
+			writer_deinit(&w);
+
+			error |= w.error;
+			response_length = w.length;
+		}
+
+		offset += response_length;
+
+		if (error) {
+			error_printf(_("Failed to write WARC file '%s' (%d)\n"), filename, errno);
+			set_exit_status(EXIT_STATUS_IO);
+		}
+
+		if (cdx_fd != -1)
+			write_cdx_line(resp, uri, digest, record->date, response_length, response_offset);
+	}
+
+	wget_thread_mutex_unlock(mutex);
+
+	if (compressed)
+		fclose(compressed);
+
+	wget_buffer_deinit(&response);
+	wget_buffer_deinit(&request);
+
+	warc_record_free(_record);
+}
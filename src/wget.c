@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <limits.h>
 #include <string.h>
 #include <signal.h>
 #include <errno.h>
@@ -40,7 +41,6 @@
 #include <ctype.h>
 #include <time.h>
 #include <fnmatch.h>
-#include <regex.h>
 #include <sys/stat.h>
 #include <locale.h>
 
@@ -60,16 +60,6 @@
 #include "filename.h" // IS_PATH_WITH_DIR()
 #include "dirname.h" // last_component()
 
-#ifdef WITH_LIBPCRE2
-# define PCRE2_CODE_UNIT_WIDTH 8
-# include <pcre2.h>
-#elif defined WITH_LIBPCRE
-# include <pcre.h>
-# ifndef PCRE_STUDY_JIT_COMPILE
-#  define PCRE_STUDY_JIT_COMPILE 0
-# endif
-#endif
-
 #include "wget_main.h"
 #include "wget_log.h"
 #include "wget_job.h"
@@ -83,6 +73,12 @@
 #include "wget_stats.h"
 #include "wget_testing.h"
 #include "wget_utils.h"
+#include "wget_warc.h"
+#include "wget_dedup.h"
+#include "wget_http_cache.h"
+#include "wget_url_filter.h"
+#include "wget_robots_cache.h"
+#include "wget_parser_pool.h"
 
 #ifdef WITH_GPGME
 #  include "wget_gpgme.h"
@@ -147,7 +143,17 @@ static void
 	html_parse_localfile(JOB *job, int level, const char *fname, const char *encoding, const wget_iri *base),
 	css_parse(JOB *job, const char *data, size_t len, const char *encoding, const wget_iri *base),
 	css_parse_localfile(JOB *job, const char *fname, const char *encoding, const wget_iri *base),
-	fork_to_background(void);
+	fork_to_background(void),
+	init_static_headers(void),
+	deinit_static_headers(void),
+	close_connection(DOWNLOADER *downloader),
+	update_http_cache(wget_http_response *resp),
+	parse_robots_txt(JOB *job, const char *data),
+	parse_task_run(void *task),
+	parse_task_free(void *task);
+static bool
+	serve_from_http_cache(JOB *job),
+	robots_from_cache(JOB *job);
 
 static unsigned int WGET_GCC_PURE
 	hash_url(const char *url);
@@ -155,6 +161,7 @@ static int
 	read_xattr_metadata(const char *name, char *value, size_t size, int fd),
 	write_xattr_metadata(const char *name, const char *value, int fd),
 	write_xattr_last_modified(int64_t last_modified, int fd),
+	body_callback_context_free(void *unused, void *context),
 	set_file_metadata(const wget_iri *origin_url, const wget_iri *referrer_url, const char *mime_type, const char *charset, int64_t last_modified, FILE *fp),
 	http_send_request(const wget_iri *iri, const wget_iri *original_url, DOWNLOADER *downloader);
 wget_http_response
@@ -163,10 +170,18 @@ static long long WGET_GCC_NONNULL_ALL get_file_size(const char *fname);
 
 static wget_stringmap
 	*etags;
-static wget_hashmap
-	*known_urls;
+// URLs found in documents, sharded to let parser threads add links concurrently
+#define KNOWN_URLS_SHARDS 32
+static struct known_urls_shard {
+	wget_hashmap
+		*urls;
+	wget_thread_mutex
+		mutex;
+} known_urls[KNOWN_URLS_SHARDS];
 static DOWNLOADER
 	*downloaders;
+static int
+	parser_threads; // number of threads in the parser pool, 0 to parse on the downloader threads
 static void
 	*downloader_thread(void *p);
 static wget_thread_mutex
@@ -238,8 +253,8 @@ static wget_vector
 	*parents;
 static wget_thread_mutex
 	downloader_mutex,
+	http2_mutex,
 	main_mutex,
-	known_urls_mutex,
 	etag_mutex,
 	savefile_mutex,
 	netrc_mutex,
@@ -249,15 +264,20 @@ static wget_thread_cond
 	main_cond,   // is signaled whenever a job is done
 	worker_cond; // is signaled whenever a job is added
 
+// a job has been split into parts, so even a single job keeps all downloaders busy
+static bool
+	parts_queued;
+
 static void program_init(void)
 {
 	wget_global_init(0);
 	blacklist_init();
 	host_init();
+	job_module_init();
 
 	wget_thread_mutex_init(&downloader_mutex);
+	wget_thread_mutex_init(&http2_mutex);
 	wget_thread_mutex_init(&main_mutex);
-	wget_thread_mutex_init(&known_urls_mutex);
 	wget_thread_mutex_init(&etag_mutex);
 	wget_thread_mutex_init(&savefile_mutex);
 	wget_thread_mutex_init(&netrc_mutex);
@@ -291,7 +311,10 @@ static void program_init(void)
 	sigaction(SIGWINCH, &sig_action, NULL);
 #endif
 
-	known_urls = wget_hashmap_create(128, (wget_hashmap_hash_fn *) hash_url, (wget_hashmap_compare_fn *) strcmp);
+	for (int it = 0; it < KNOWN_URLS_SHARDS; it++) {
+		known_urls[it].urls = wget_hashmap_create(32, (wget_hashmap_hash_fn *) hash_url, (wget_hashmap_compare_fn *) strcmp);
+		wget_thread_mutex_init(&known_urls[it].mutex);
+	}
 
 	// Initialize the plugin system
 	plugin_db_init();
@@ -304,10 +327,11 @@ static void program_deinit(void)
 {
 	host_exit();
 	blacklist_exit();
+	job_module_exit();
 
 	wget_thread_mutex_destroy(&downloader_mutex);
+	wget_thread_mutex_destroy(&http2_mutex);
 	wget_thread_mutex_destroy(&main_mutex);
-	wget_thread_mutex_destroy(&known_urls_mutex);
 	wget_thread_mutex_destroy(&etag_mutex);
 	wget_thread_mutex_destroy(&savefile_mutex);
 	wget_thread_mutex_destroy(&netrc_mutex);
@@ -317,210 +341,6 @@ static void program_deinit(void)
 	wget_thread_cond_destroy(&worker_cond);
 }
 
-/* Check if 'subdir' is a subdirectory of 'dir'.
- * E.g. if 'dir' is `/something', match_subdir() will return true if and
- * only if 'subdir' begins with `/something/' or is exactly '/something'.
- */
-static bool match_subdir(const char *dir, const char *subdir, char ignore_case)
-{
-	if (*dir == '\0')
-		return (strcmp(subdir, "/")) ? false : true;
-
-	if (ignore_case)
-		for (; *dir && *subdir && (c_tolower(*dir) == c_tolower(*subdir)); ++dir, ++subdir)
-			;
-	else
-		while (*dir && *subdir && (*dir++ == *subdir++))
-			;
-
-	return *dir == 0 && (*subdir == 0 || *subdir == '/');
-}
-
-static int in_directory_pattern_list(const wget_vector *v, const char *fname)
-{
-	// if -I was given: exclude all be default
-	// if -X was given alone: include all be default
-	const char *pattern;
-	char *path;
-	bool default_exclude;
-
-	if (!fname)
-		return false;
-
-	if (*fname == '/')
-		fname++;
-
-	const char *e = strrchr(fname, '/');
-	if (!e)
-		//return default_exclude; // no path component found
-		path = wget_strdup("/");
-	else
-		path = wget_strmemdup(fname, e - fname);
-
-	pattern = wget_vector_get(v, 0);
-	default_exclude = (*pattern == INCLUDED_DIRECTORY_PREFIX);
-
-	for (int it = wget_vector_size(v) - 1; it >= 0; it--) {
-		pattern = wget_vector_get(v, it);
-
-		bool exclude = (*pattern != INCLUDED_DIRECTORY_PREFIX);
-
-		pattern++;
-
-		if (*pattern == '/')
-			pattern++;
-
-		debug_printf("directory[%d] '%s' - '%s' %c\n", it, pattern, path, "+-"[exclude]);
-
-		if (strpbrk(pattern, "*?[]")) {
-			// path="/we/all/love/wget" wouldn't match "/*/all/*" but "/*/all/*/*"
-			if (!fnmatch(pattern, path, FNM_PATHNAME | (config.ignore_case ? FNM_CASEFOLD : 0))) {
-				wget_free(path);
-				return exclude;
-			}
-		} else if (match_subdir(pattern, path, config.ignore_case)) {
-			// path="/we/all/love/wget" would match "/we/all/"
-			wget_free(path);
-			return exclude;
-		}
-	}
-
-	wget_free(path);
-
-	return default_exclude;
-}
-
-static int in_pattern_list(const wget_vector *v, const char *url)
-{
-	for (int it = 0; it < wget_vector_size(v); it++) {
-		const char *pattern = wget_vector_get(v, it);
-
-		debug_printf("pattern[%d] '%s' - %s\n", it, pattern, url);
-
-		if (strpbrk(pattern, "*?[]")) {
-			if (!fnmatch(pattern, url, config.ignore_case ? FNM_CASEFOLD : 0))
-				return 1;
-		} else if (config.ignore_case) {
-			if (wget_match_tail_nocase(url, pattern))
-				return 1;
-		} else if (wget_match_tail(url, pattern)) {
-			return 1;
-		}
-	}
-
-	return 0;
-}
-
-static int in_host_pattern_list(const wget_vector *v, const char *hostname)
-{
-	for (int it = 0; it < wget_vector_size(v); it++) {
-		const char *pattern = wget_vector_get(v, it);
-
-		debug_printf("host_pattern[%d] '%s' - %s\n", it, pattern, hostname);
-
-		if (strpbrk(pattern, "*?[]")) {
-			if (!fnmatch(pattern, hostname, 0))
-				return 1;
-		} else if (wget_match_tail(pattern, hostname)) {
-			return 1;
-		}
-	}
-
-	return 0;
-}
-
-static int regex_match_posix(const char *string, const char *pattern)
-{
-	int	status;
-	regex_t	re;
-
-	if (regcomp(&re, pattern, REG_EXTENDED|REG_NOSUB) != 0)
-		return 0;
-
-	status = regexec(&re, string, (size_t) 0, NULL, 0);
-
-	regfree(&re);
-
-	if (status != 0)
-		return 0;
-
-	return 1;
-}
-
-#ifdef WITH_LIBPCRE2
-static int regex_match_pcre(const char *string, const char *pattern)
-{
-	pcre2_code *re;
-	int errornumber;
-	PCRE2_SIZE erroroffset;
-	pcre2_match_data *match_data;
-	int rc, result = 0;
-
-	re = pcre2_compile((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED, 0, &errornumber, &erroroffset, NULL);
-	if (re == NULL)
-		return 0;
-
-	match_data = pcre2_match_data_create_from_pattern(re, NULL);
-
-	rc = pcre2_match(re, (PCRE2_SPTR) string, strlen(string), 0, 0, match_data, NULL);
-	if (rc >= 0)
-		result = 1;
-
-	pcre2_match_data_free(match_data);
-	pcre2_code_free(re);
-
-	return result;
-}
-#elif defined WITH_LIBPCRE
-static int regex_match_pcre(const char *string, const char *pattern)
-{
-	pcre *re;
-	pcre_extra *extra;
-	const char *error_msg;
-	int error;
-	int offsets[8];
-	int rc, result = 0;
-
-	re = pcre_compile(pattern, 0, &error_msg, &error, NULL);
-	if (re == NULL)
-		return 0;
-
-	error_msg = NULL;
-	extra = pcre_study(re, 0, &error_msg);
-	if (error_msg != NULL) {
-		pcre_free(re);
-		return 0;
-	}
-
-	rc = pcre_exec(re, extra, string, (int) strlen(string), 0, 0, offsets, 8);
-	if (rc >= 0)
-		result = 1;
-
-	if (extra != NULL)
-#ifdef PCRE_CONFIG_JIT
-		pcre_free_study(extra);
-#else
-		pcre_free(extra);
-#endif
-
-	pcre_free(re);
-
-	return result;
-}
-#endif
-
-static int regex_match(const char *string, const char *pattern)
-{
-#if defined WITH_LIBPCRE2 || defined WITH_LIBPCRE
-	if (config.regex_type == WGET_REGEX_TYPE_PCRE)
-		return regex_match_pcre(string, pattern);
-	else
-		return regex_match_posix(string, pattern);
-#else
-	return regex_match_posix(string, pattern);
-#endif
-}
-
 static void parse_localfile(JOB *job, const char *fname, const char *encoding, const char *mimetype, const wget_iri *base)
 {
 	int fd;
@@ -692,8 +512,12 @@ static void queue_url_from_local(const char *url, wget_iri *base, const char *en
 
 	if (config.recursive) {
 		if (!config.span_hosts && config.domains) {
-			if (wget_vector_find(config.domains, iri->host) < 0)
-				wget_vector_add(config.domains, wget_strdup(iri->host));
+			if (wget_vector_find(config.domains, iri->host) < 0) {
+				char *domain = wget_strdup(iri->host);
+
+				wget_vector_add(config.domains, domain);
+				url_filter_add_domain(domain);
+			}
 		}
 
 		if (!config.parent) {
@@ -717,15 +541,13 @@ static void queue_url_from_local(const char *url, wget_iri *base, const char *en
 	if (plugin_verdict.accept) {
 		new_job->ignore_patterns = 1;
 	} else if (config.recursive) {
-		if ((config.accept_patterns && !in_pattern_list(config.accept_patterns, new_job->iri->uri))
-				|| (config.accept_regex && !regex_match(new_job->iri->uri, config.accept_regex))) {
+		if (!url_filter_accepted(new_job->iri->uri)) {
 			new_job->head_first = 1; // send HEAD request
 			// if -r sends head we want to enable mime-type check to assure e.g. text/html to be downloaded and parsed
 			new_job->recursive_send_head = 1;
 		}
 
-		if ((config.reject_patterns && in_pattern_list(config.reject_patterns, new_job->iri->uri))
-				|| (config.reject_regex && regex_match(new_job->iri->uri, config.reject_regex))) {
+		if (url_filter_rejected(new_job->iri->uri)) {
 			new_job->head_first = 1; // send HEAD request
 			// if -r sends head we want to enable mime-type check to assure e.g. text/html to be downloaded and parsed
 			new_job->recursive_send_head = 1;
@@ -750,21 +572,32 @@ static void queue_url_from_local(const char *url, wget_iri *base, const char *en
 	plugin_db_forward_url_verdict_free(&plugin_verdict);
 }
 
-// Add URLs parsed from downloaded files
-// Needs to be thread-safe
-static void queue_url_from_remote(JOB *job, const char *encoding, const char *url, int flags, const char *download_name)
+// a URL that passed the checks that need no lock, waiting to be enqueued
+typedef struct {
+	wget_iri *
+		iri;
+	char *
+		download_name;
+	struct plugin_db_forward_url_verdict
+		plugin_verdict;
+	int
+		flags;
+	bool
+		http_fallback,
+		filtered; // not accepted by the URL filters, -r checks the MIME type with a HEAD request
+} ADMITTED_URL;
+
+// the checks that need no lock: parse the URL, ask the plugins and apply the URL filters
+static bool admit_url(JOB *job, const char *encoding, const char *url, int flags, ADMITTED_URL *admitted)
 {
-	JOB *new_job = NULL, job_buf;
 	wget_iri *iri;
-	HOST *host;
-	blacklist_entry *blacklistp;
 	struct plugin_db_forward_url_verdict plugin_verdict;
-	bool http_fallback = 0;
+	bool http_fallback = 0, filtered = 0;
 
 	if (flags & URL_FLG_REDIRECTION) { // redirect
 		if (job && job->redirection_level >= config.max_redirect) {
 			debug_printf("not requesting '%s'. (Max Redirections exceeded)\n", url);
-			return;
+			return false;
 		}
 	}
 
@@ -785,7 +618,7 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 
 	if (!iri) {
 		error_printf(_("Cannot resolve URI '%s'\n"), url);
-		return;
+		return false;
 	}
 
 	// Allow plugins to intercept URL
@@ -795,7 +628,7 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 		debug_printf("not requesting '%s'. (Plugin Verdict)\n", url);
 		plugin_db_forward_url_verdict_free(&plugin_verdict);
 		wget_iri_free(&iri);
-		return;
+		return false;
 	}
 
 	if (plugin_verdict.alt_iri) {
@@ -809,7 +642,7 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 		info_printf(_("URL '%s' not followed (unsupported scheme)\n"), url);
 		wget_iri_free(&iri);
 		plugin_db_forward_url_verdict_free(&plugin_verdict);
-		return;
+		return false;
 	}
 
 	if (iri->scheme == WGET_IRI_SCHEME_HTTP)
@@ -819,7 +652,7 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 		info_printf(_("URL '%s' not followed (https-only requested)\n"), url);
 		wget_iri_free(&iri);
 		plugin_db_forward_url_verdict_free(&plugin_verdict);
-		return;
+		return false;
 	}
 
 	if (iri->scheme == WGET_IRI_SCHEME_HTTP && config.https_enforce && !(flags & URL_FLG_SKIPFALLBACK)) {
@@ -828,7 +661,47 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 			http_fallback = 1;
 	}
 
-	wget_thread_mutex_lock(downloader_mutex);
+	if (config.recursive) {
+		const char *reason = NULL;
+
+		if (!url_filter_accepted(iri->uri))
+			reason = "doesn't match accept pattern";
+		else if (url_filter_rejected(iri->uri))
+			reason = "matches reject pattern";
+		else if (url_filter_directory_excluded(iri->path))
+			reason = "path excluded";
+
+		if (reason && config.filter_urls) {
+			debug_printf("not requesting '%s'. (%s)\n", iri->uri, reason);
+			wget_iri_free(&iri);
+			plugin_db_forward_url_verdict_free(&plugin_verdict);
+			return false;
+		}
+
+		filtered = reason && !plugin_verdict.accept;
+	}
+
+	admitted->iri = iri;
+	admitted->plugin_verdict = plugin_verdict;
+	admitted->flags = flags;
+	admitted->http_fallback = http_fallback;
+	admitted->filtered = filtered;
+
+	return true;
+}
+
+// the checks and changes that need downloader_mutex, and creating the job
+// returns the blacklist entry if the URL's file exists and should be parsed instead
+static blacklist_entry *enqueue_url(JOB *job, const char *encoding, ADMITTED_URL *admitted)
+{
+	JOB *new_job = NULL, job_buf;
+	wget_iri *iri = admitted->iri;
+	HOST *host;
+	blacklist_entry *blacklistp, *local = NULL;
+	struct plugin_db_forward_url_verdict *plugin_verdict = &admitted->plugin_verdict;
+	const char *download_name = admitted->download_name;
+	int flags = admitted->flags;
+	bool http_fallback = admitted->http_fallback;
 
 	if (!(blacklistp = blacklist_add(iri))) {
 		wget_iri_free(&iri);
@@ -854,9 +727,9 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 		if (!iri->host)
 			reason = _("missing ip/host/domain");
 		else if (job && strcmp(job->iri->host, iri->host)) {
-			if (!config.span_hosts && !in_host_pattern_list(config.domains, iri->host))
+			if (!config.span_hosts && !url_filter_in_domains(iri->host))
 				reason = _("no host-spanning requested");
-			else if (config.span_hosts && in_host_pattern_list(config.exclude_domains, iri->host))
+			else if (config.span_hosts && url_filter_in_exclude_domains(iri->host))
 				reason = _("domain explicitly excluded");
 		}
 
@@ -884,16 +757,16 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 		}
 
 		if (!ok) {
-			info_printf(_("URL '%s' not followed (parent ascending not allowed)\n"), url);
+			info_printf(_("URL '%s' not followed (parent ascending not allowed)\n"), iri->uri);
 			goto out;
 		}
 	}
 
 	if (!config.output_document) {
-		if (plugin_verdict.alt_local_filename) {
+		if (plugin_verdict->alt_local_filename) {
 			xfree(blacklistp->local_filename);
-			blacklistp->local_filename = plugin_verdict.alt_local_filename;
-			plugin_verdict.alt_local_filename = NULL;
+			blacklistp->local_filename = plugin_verdict->alt_local_filename;
+			plugin_verdict->alt_local_filename = NULL;
 		} else if (!(flags & URL_FLG_REDIRECTION) || config.trust_server_names || !job) {
 			// local_filename = get_local_filename(iri);
 		} else {
@@ -903,13 +776,9 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 
 		if (!config.clobber && blacklistp->local_filename && access(blacklistp->local_filename, F_OK) == 0) {
 			info_printf(_("URL '%s' not requested (file already exists)\n"), iri->uri);
-			wget_thread_mutex_unlock(downloader_mutex);
-			if (config.recursive && (!config.level || (job && job->level < config.level + config.page_requisites))) {
-				parse_localfile(job, blacklistp->local_filename, encoding, NULL, iri);
-			}
-			// do not 'goto out;' here
-			plugin_db_forward_url_verdict_free(&plugin_verdict);
-			return;
+			if (config.recursive && (!config.level || (job && job->level < config.level + config.page_requisites)))
+				local = blacklistp;
+			goto out;
 		}
 	}
 
@@ -924,16 +793,9 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 			}
 		}
 	} else if ((host = host_get(iri))) {
-		if (host->robots && iri->path && config.robots) {
-			// info_printf("%s: checking '%s' / '%s'\n", __func__, iri->path, iri->uri);
-			for (int it = 0, n = wget_robots_get_path_count(host->robots); it < n; it++) {
-				wget_string *path = wget_robots_get_path(host->robots, it);
-				// info_printf("%s: checked robot path '%.*s' / '%s' / '%s'\n", __func__, (int)path->len, path->path, iri->path, iri->uri);
-				if (path->len && !strncmp(path->p + 1, iri->path, path->len - 1)) {
-					info_printf(_("URL '%s' not followed (disallowed by robots.txt)\n"), iri->uri);
-					goto out;
-				}
-			}
+		if (config.robots && !host_robots_allowed(host, iri)) {
+			info_printf(_("URL '%s' not followed (disallowed by robots.txt)\n"), iri->uri);
+			goto out;
 		}
 	} else {
 		// this should really not ever happen
@@ -941,27 +803,6 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 		goto out;
 	}
 
-	if (config.recursive && config.filter_urls) {
-		if ((config.accept_patterns && !in_pattern_list(config.accept_patterns, iri->uri))
-			|| (config.accept_regex && !regex_match(iri->uri, config.accept_regex)))
-		{
-			debug_printf("not requesting '%s'. (doesn't match accept pattern)\n", iri->uri);
-			goto out;
-		}
-
-		if ((config.reject_patterns && in_pattern_list(config.reject_patterns, iri->uri))
-			|| (config.reject_regex && regex_match(iri->uri, config.reject_regex)))
-		{
-			debug_printf("not requesting '%s'. (matches reject pattern)\n", iri->uri);
-			goto out;
-		}
-
-		if (config.exclude_directories && in_directory_pattern_list(config.exclude_directories, iri->path)) {
-			debug_printf("not requesting '%s' (path excluded)\n", iri->uri);
-			goto out;
-		}
-	}
-
 	new_job = job_init(&job_buf, blacklistp, http_fallback);
 
 	if (job) {
@@ -993,28 +834,12 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 		}
 	}
 
-	if (plugin_verdict.accept) {
+	if (plugin_verdict->accept) {
 		new_job->ignore_patterns = 1;
-	} else if (config.recursive) {
-		if ((config.accept_patterns && !in_pattern_list(config.accept_patterns, new_job->iri->uri))
-				|| (config.accept_regex && !regex_match(new_job->iri->uri, config.accept_regex))) {
-			new_job->head_first = 1; // send HEAD request
-			// if -r sends head we want to enable mime-type check to assure e.g. text/html to be downloaded and parsed
-			new_job->recursive_send_head = 1;
-		}
-
-		if ((config.reject_patterns && in_pattern_list(config.reject_patterns, new_job->iri->uri))
-				|| (config.reject_regex && regex_match(new_job->iri->uri, config.reject_regex))) {
-			new_job->head_first = 1; // send HEAD request
-			// if -r sends head we want to enable mime-type check to assure e.g. text/html to be downloaded and parsed
-			new_job->recursive_send_head = 1;
-		}
-
-		if (config.exclude_directories && in_directory_pattern_list(config.exclude_directories, new_job->iri->path)) {
-			new_job->head_first = 1; // send HEAD request
-			// if -r sends head we want to enable mime-type check to assure e.g. text/html to be downloaded and parsed
-			new_job->recursive_send_head = 1;
-		}
+	} else if (admitted->filtered) {
+		new_job->head_first = 1; // send HEAD request
+		// if -r sends head we want to enable mime-type check to assure e.g. text/html to be downloaded and parsed
+		new_job->recursive_send_head = 1;
 	}
 
 	if (config.spider || config.chunk_size || config.mime_types || (!config.if_modified_since && config.timestamping))
@@ -1034,8 +859,64 @@ static void queue_url_from_remote(JOB *job, const char *encoding, const char *ur
 	wget_thread_cond_signal(worker_cond);
 
 out:
+	plugin_db_forward_url_verdict_free(plugin_verdict);
+	xfree(admitted->download_name);
+
+	return local;
+}
+
+static void parse_existing_file(JOB *job, const char *encoding, const blacklist_entry *local)
+{
+	parse_localfile(job, local->local_filename, encoding, NULL, local->iri);
+}
+
+// Add URLs parsed from downloaded files
+// Needs to be thread-safe
+static void queue_url_from_remote(JOB *job, const char *encoding, const char *url, int flags, const char *download_name)
+{
+	ADMITTED_URL admitted;
+	blacklist_entry *local;
+
+	if (!admit_url(job, encoding, url, flags, &admitted))
+		return;
+
+	admitted.download_name = wget_strdup(download_name);
+
+	wget_thread_mutex_lock(downloader_mutex);
+	local = enqueue_url(job, encoding, &admitted);
 	wget_thread_mutex_unlock(downloader_mutex);
-	plugin_db_forward_url_verdict_free(&plugin_verdict);
+
+	if (local)
+		parse_existing_file(job, encoding, local);
+}
+
+// enqueue the URLs admitted from one document within a single critical section
+static void enqueue_urls(JOB *job, const char *encoding, wget_vector *admitted_urls)
+{
+	wget_vector *local_files = NULL;
+	blacklist_entry *local;
+
+	if (wget_vector_size(admitted_urls) == 0)
+		return;
+
+	wget_thread_mutex_lock(downloader_mutex);
+
+	for (int it = 0; it < wget_vector_size(admitted_urls); it++) {
+		if ((local = enqueue_url(job, encoding, wget_vector_get(admitted_urls, it)))) {
+			if (!local_files) {
+				local_files = wget_vector_create(4, NULL);
+				wget_vector_set_destructor(local_files, NULL); // entries are owned by the blacklist
+			}
+			wget_vector_add(local_files, local);
+		}
+	}
+
+	wget_thread_mutex_unlock(downloader_mutex);
+
+	for (int it = 0; it < wget_vector_size(local_files); it++)
+		parse_existing_file(job, encoding, wget_vector_get(local_files, it));
+
+	wget_vector_free(&local_files);
 }
 
 
@@ -1169,6 +1050,7 @@ static void convert_links(void)
 								wget_error_printf(_("Failed to rename %s to %s (%d)"), conversion->filename, dstfile, errno);
 							}
 						}
+						dedup_unshare(conversion->filename, false);
 						if (!(fpout = fopen(conversion->filename, "wb")))
 							wget_error_printf(_("Failed to write open %s (%d)"), conversion->filename, errno);
 					}
@@ -1250,6 +1132,15 @@ int main(int argc, const char **argv)
 	}
 	set_exit_status(EXIT_STATUS_NO_ERROR);
 
+	if (warc_init() < 0 || dedup_init() < 0 || http_cache_init() < 0 || robots_cache_init() < 0 || url_filter_init() < 0)
+		goto out;
+
+	init_static_headers();
+
+	// the links are extracted by the parser pool while the downloaders send the next requests
+	if (config.recursive)
+		parser_threads = parser_pool_init(config.parser_threads, parse_task_run, parse_task_free);
+
 	for (; n < argc; n++) {
 		queue_url_from_local(argv[n], config.base, config.local_encoding, 0);
 	}
@@ -1378,7 +1269,7 @@ int main(int argc, const char **argv)
 			break;
 		}
 
-		for (;nthreads < config.max_threads && nthreads < queue_size(); nthreads++) {
+		for (;nthreads < config.max_threads && (nthreads < queue_size() || parts_queued); nthreads++) {
 			downloaders[nthreads].id = nthreads;
 
 			// The actual number of nthreads is updated in the loop iteration
@@ -1420,7 +1311,16 @@ int main(int argc, const char **argv)
 			error_printf(_("Failed to wait for downloader #%d (%d %d)\n"), n, rc, errno);
 	}
 
+	parser_pool_exit();
+
 	print_progress_report(start_time);
+	warc_exit();
+	dedup_exit();
+	http_cache_exit();
+	robots_cache_exit();
+	url_filter_exit();
+	deinit_static_headers();
+
 	if (!config.progress && (config.recursive || config.page_requisites || (config.input_file && quota != 0)) && quota) {
 		info_printf(_("Downloaded: %d files, %s bytes, %d redirects, %d errors\n"),
 			stats.ndownloads, wget_human_readable(quota_buf, sizeof(quota_buf), quota), stats.nredirects, stats.nerrors);
@@ -1469,7 +1369,10 @@ int main(int argc, const char **argv)
 			bar_deinit();
 		wget_vector_clear_nofree(parents);
 		wget_vector_free(&parents);
-		wget_hashmap_free(&known_urls);
+		for (int it = 0; it < KNOWN_URLS_SHARDS; it++) {
+			wget_hashmap_free(&known_urls[it].urls);
+			wget_thread_mutex_destroy(&known_urls[it].mutex);
+		}
 		wget_stringmap_free(&etags);
 
 		deinit();
@@ -1537,8 +1440,13 @@ static int try_connection(DOWNLOADER *downloader, const wget_iri *iri)
 			return WGET_E_SUCCESS;
 		}
 
+		if (wget_http_connection_can_coalesce(conn, iri)) {
+			debug_printf("reuse connection %s for %s\n", wget_http_get_host(conn), iri->host);
+			return WGET_E_SUCCESS;
+		}
+
 		debug_printf("close connection %s\n", wget_http_get_host(conn));
-		wget_http_close(&downloader->conn);
+		close_connection(downloader);
 	}
 
 	if ((rc = wget_http_open(&downloader->conn, iri)) == WGET_E_SUCCESS) {
@@ -1557,10 +1465,10 @@ static int establish_connection(DOWNLOADER *downloader, const wget_iri **iri)
 
 	downloader->final_error = 0;
 
-	if (downloader->job->part) {
+	if (downloader->part) {
 		JOB *job = downloader->job;
 		wget_metalink *metalink = job->metalink;
-		PART *part = job->part;
+		PART *part = downloader->part;
 		int mirror_count = wget_vector_size(metalink->mirrors);
 		int mirror_index;
 
@@ -1617,14 +1525,14 @@ static int establish_connection(DOWNLOADER *downloader, const wget_iri **iri)
 
 	if (rc == WGET_E_HANDSHAKE || rc == WGET_E_CERTIFICATE || rc == WGET_E_TLS_DISABLED) {
 		// TLS  failure
-		wget_http_close(&downloader->conn);
+		close_connection(downloader);
 		if (!downloader->job->http_fallback) {
 			host_final_failure(downloader->job->host);
 			set_exit_status(EXIT_STATUS_TLS);
 		}
 	} else if (rc == WGET_E_CONNECT) {
 		/* failed to connect */
-		wget_http_close(&downloader->conn);
+		close_connection(downloader);
 		if (!config.retry_connrefused && !downloader->job->http_fallback) {
 			host_final_failure(downloader->job->host);
 			set_exit_status(EXIT_STATUS_NETWORK);
@@ -1640,7 +1548,7 @@ static void add_statistics(wget_http_response *resp)
 	JOB *job = resp->req->user_data;
 
 	if (resp->code == 200) {
-		if (job->part)
+		if (job->parts)
 			atomic_increment_int(&stats.nchunks);
 		else
 			atomic_increment_int(&stats.ndownloads);
@@ -1655,10 +1563,9 @@ static void add_statistics(wget_http_response *resp)
 		stats_site_add(resp, NULL);
 }
 
-static int process_response_header(wget_http_response *resp)
+static int process_response_header(wget_http_response *resp, DOWNLOADER *downloader)
 {
 	JOB *job = resp->req->user_data;
-	DOWNLOADER *downloader = job->downloader;
 	const wget_iri *iri = job->iri;
 
 	if (resp->code < 400 || resp->code > 599)
@@ -1694,7 +1601,7 @@ static int process_response_header(wget_http_response *resp)
 	// For HTTP2 connections this flag is always set.
 	debug_printf("keep_alive=%d\n", resp->keep_alive);
 	if (!resp->keep_alive)
-		wget_http_close(&downloader->conn);
+		close_connection(downloader);
 
 	// do some statistics
 	add_statistics(resp);
@@ -1872,6 +1779,8 @@ static void process_head_response(wget_http_response *resp)
 
 		// start or resume downloading
 		if (!job_validate_file(job)) {
+			parts_queued = 1;
+
 			// wake up sleeping workers
 			wget_thread_cond_signal(worker_cond);
 			job->done = 0; // do not remove this job from queue yet
@@ -1890,17 +1799,56 @@ static void process_head_response(wget_http_response *resp)
 	}
 }
 
+// all parts of 'job' are done, check the integrity of the complete file
+static void validate_parts_job(DOWNLOADER *downloader, JOB *job)
+{
+	if (config.progress)
+		bar_print(downloader->id, "Checksumming...");
+	else if (job->metalink)
+		print_status(downloader, "%s checking...\n", job->metalink->name);
+	else
+		print_status(downloader, "%s checking...\n", job->blacklist_entry->local_filename);
+	if (job_validate_file(job)) {
+		if (config.progress)
+			bar_print(downloader->id, "Checksum OK");
+		else
+			debug_printf("checksum ok\n");
+		job->done = 1; // we are done with this job, main state machine will remove it
+	} else {
+		if (config.progress)
+			bar_print(downloader->id, "Checksum FAILED");
+		else
+			debug_printf("checksum failed\n");
+	}
+}
+
 // chunked or metalink partial download
-static void process_response_part(wget_http_response *resp)
+static void process_response_part(wget_http_response *resp, DOWNLOADER *downloader)
 {
 	JOB *job = resp->req->user_data;
-	DOWNLOADER *downloader = job->downloader;
-	PART *part = job->part;
+	PART *part = downloader->part;
 
 	// just update number bytes read (body only) for display purposes
 	if (resp->body)
 		quota_modify_read(resp->cur_downloaded);
 
+	if (downloader->whole_file) {
+		bool done;
+
+		downloader->whole_file = false;
+		print_status(downloader, "part %d: server sent the complete file\n", part->id);
+
+		wget_thread_mutex_lock(main_mutex);
+		done = job_file_done(job, part);
+		wget_thread_mutex_unlock(main_mutex);
+
+		if (done)
+			validate_parts_job(downloader, job);
+		else
+			downloader->job = NULL; // the downloader of the last part takes care of the job
+		return;
+	}
+
 	if (resp->code != 200 && resp->code != 206) {
 		print_status(downloader, "part %d download error %d\n", part->id, resp->code);
 	} else if (!resp->body) {
@@ -1908,63 +1856,160 @@ static void process_response_part(wget_http_response *resp)
 	} else if (resp->body->length != (size_t)part->length) {
 		print_status(downloader, "part %d download error '%zu bytes of %lld expected'\n",
 			part->id, resp->body->length, (long long)part->length);
+	} else if (part->corrupt && (!config.tries || ++part->failures < config.tries)) {
+		print_status(downloader, "part %d checksum failed\n", part->id);
 	} else {
+		if (part->corrupt)
+			print_status(downloader, "part %d checksum failed, giving up\n", part->id);
 		print_status(downloader, "part %d downloaded\n", part->id);
-		part->done = 1; // set this when downloaded ok
-	}
 
-	if (part->done) {
-		// check if all parts are done (downloaded + hash-checked)
-		int all_done = 1, it;
+		// feed the streaming checksum of the complete file
+		job_hash_part(job, part, resp->body->data, resp->body->length);
 
-		wget_thread_mutex_lock(downloader_mutex);
-		for (it = 0; it < wget_vector_size(job->parts); it++) {
-			PART *partp = wget_vector_get(job->parts, it);
-			if (!partp->done) {
-				all_done = 0;
-				break;
-			}
+		// check if all parts are done (downloaded + hash-checked)
+		if (!job_part_done(job, part)) {
+			downloader->job = NULL; // the downloader of the last part takes care of the job
+			return;
 		}
-		wget_thread_mutex_unlock(downloader_mutex);
 
-		if (all_done) {
-			// check integrity of complete file
-			if (config.progress)
-				bar_print(downloader->id, "Checksumming...");
-			else if (job->metalink)
-				print_status(downloader, "%s checking...\n", job->metalink->name);
-			else
-				print_status(downloader, "%s checking...\n", job->blacklist_entry->local_filename);
-			if (job_validate_file(job)) {
-				if (config.progress)
-					bar_print(downloader->id, "Checksum OK");
-				else
-					debug_printf("checksum ok\n");
-				job->done = 1; // we are done with this job, main state machine will remove it
-			} else {
-				if (config.progress)
-					bar_print(downloader->id, "Checksum FAILED");
-				else
-					debug_printf("checksum failed\n");
-			}
-		}
-	} else {
-		print_status(downloader, "part %d failed\n", part->id);
-		part->inuse = 0; // something was wrong, reload again later
+		validate_parts_job(downloader, job);
+		return;
 	}
+
+	print_status(downloader, "part %d failed\n", part->id);
+	part->inuse = 0; // something was wrong, reload again later
 }
 
-static void process_response(wget_http_response *resp)
-{
-	JOB *job = resp->req->user_data;
-	int process_decision = 0, recurse_decision = 0;
+enum {
+	BODY_HTML = 1,
+	BODY_CSS,
+	BODY_ATOM,
+	BODY_RSS,
+	BODY_SITEMAP_XML,
+	BODY_SITEMAP_GZ,
+	BODY_SITEMAP_TEXT
+};
 
-	// just update number bytes read (body only) for display purposes
-	if (resp->body)
-		quota_modify_read(resp->cur_downloaded);
+// a downloaded document waiting for the parser pool
+struct parse_task {
+	JOB *
+		job;
+	wget_buffer *
+		body;
+	char *
+		encoding;
+	int
+		type;
+};
 
-	// check if we got a RFC 6249 Metalink response
-	// HTTP/1.1 302 Found
+static int WGET_GCC_PURE body_type(const JOB *job, const char *content_type)
+{
+	if (!wget_strcasecmp_ascii(content_type, "text/html"))
+		return BODY_HTML;
+	if (!wget_strcasecmp_ascii(content_type, "application/xhtml+xml"))
+		return BODY_HTML; // xml_parse(sockfd, resp, job->iri);
+	if (!wget_strcasecmp_ascii(content_type, "text/css"))
+		return BODY_CSS;
+	if (!wget_strcasecmp_ascii(content_type, "application/atom+xml")) // see RFC4287, https://de.wikipedia.org/wiki/Atom_%28Format%29
+		return BODY_ATOM;
+	if (!wget_strcasecmp_ascii(content_type, "application/rss+xml")) // see https://cyber.harvard.edu/rss/rss.html
+		return BODY_RSS;
+
+	if (job->sitemap) {
+		if (!wget_strcasecmp_ascii(content_type, "application/xml"))
+			return BODY_SITEMAP_XML;
+		if (!wget_strcasecmp_ascii(content_type, "application/x-gzip"))
+			return BODY_SITEMAP_GZ;
+		if (!wget_strcasecmp_ascii(content_type, "text/plain"))
+			return BODY_SITEMAP_TEXT;
+	}
+
+	return 0;
+}
+
+static void parse_body(JOB *job, int type, const char *encoding, wget_buffer *body)
+{
+	switch (type) {
+	case BODY_HTML:
+		html_parse(job, job->level, job->blacklist_entry->local_filename, body->data, body->length, encoding, job->iri);
+		break;
+	case BODY_CSS:
+		css_parse(job, body->data, body->length, encoding, job->iri);
+		break;
+	case BODY_ATOM:
+		atom_parse(job, body->data, "utf-8", job->iri);
+		break;
+	case BODY_RSS:
+		rss_parse(job, body->data, "utf-8", job->iri);
+		break;
+	case BODY_SITEMAP_XML:
+		sitemap_parse_xml(job, body->data, "utf-8", job->iri);
+		break;
+	case BODY_SITEMAP_GZ:
+		sitemap_parse_xml_gz(job, body, "utf-8", job->iri);
+		break;
+	case BODY_SITEMAP_TEXT:
+		sitemap_parse_text(job, body->data, "utf-8", job->iri);
+		break;
+	default:
+		break;
+	}
+}
+
+static void parse_task_free(void *p)
+{
+	struct parse_task *task = p;
+
+	task->job->parse_task = NULL;
+	wget_buffer_free(&task->body);
+	xfree(task->encoding);
+	xfree(task);
+}
+
+// runs on a parser thread, the job stays queued until its links have been queued
+static void parse_task_run(void *p)
+{
+	struct parse_task *task = p;
+	JOB *job = task->job;
+
+	parse_body(job, task->type, task->encoding, task->body);
+
+	wget_thread_mutex_lock(main_mutex);
+	parse_task_free(task);
+	host_remove_job(job->host, job);
+	wget_thread_cond_signal(main_cond);
+	wget_thread_mutex_unlock(main_mutex);
+}
+
+static void parse_robots_txt(JOB *job, const char *data)
+{
+	// Parse the robots file and only if it was successful
+	if (wget_robots_parse(&job->host->robots, data, PACKAGE_NAME) != WGET_E_SUCCESS)
+		return;
+
+	// Sitemaps are not relevant as page requisites
+	if (config.page_requisites)
+		return;
+
+	// add sitemaps to be downloaded (format https://www.sitemaps.org/protocol.html)
+	for (int it = 0, n = wget_robots_get_sitemap_count(job->host->robots); it < n; it++) {
+		const char *sitemap = wget_robots_get_sitemap(job->host->robots, it);
+		debug_printf("adding sitemap '%s'\n", sitemap);
+		queue_url_from_remote(job, "utf-8", sitemap, URL_FLG_SITEMAP, NULL); // see https://www.sitemaps.org/protocol.html#escaping
+	}
+}
+
+static void process_response(wget_http_response *resp)
+{
+	JOB *job = resp->req->user_data;
+	int process_decision = 0, recurse_decision = 0;
+
+	// just update number bytes read (body only) for display purposes
+	if (resp->body)
+		quota_modify_read(resp->cur_downloaded);
+
+	// check if we got a RFC 6249 Metalink response
+	// HTTP/1.1 302 Found
 	// Date: Fri, 20 Apr 2012 15:00:40 GMT
 	// Server: Apache/2.2.22 (Linux/SUSE) mod_ssl/2.2.22 OpenSSL/1.0.0e DAV/2 SVN/1.7.4 mod_wsgi/3.3 Python/2.7.2 mod_asn/1.5 mod_mirrorbrain/2.17.0 mod_fastcgi/2.4.2
 	// X-Prefix: 87.128.0.0/10
@@ -2040,6 +2085,8 @@ static void process_response(wget_http_response *resp)
 					// sort mirrors by priority to download from highest priority first
 					wget_metalink_sort_mirrors(job->metalink);
 
+					parts_queued = 1;
+
 					// wake up sleeping workers
 					wget_thread_cond_signal(worker_cond);
 
@@ -2051,7 +2098,7 @@ static void process_response(wget_http_response *resp)
 	}
 
 	// Forward response to plugins
-	if (resp->code == 200 || resp->code == 206 || resp->code == 416 || (resp->code == 304 && config.timestamping)) {
+	if (resp->code == 200 || resp->code == 206 || resp->code == 416 || (resp->code == 304 && (config.timestamping || job->http_cache_revalidate))) {
 		process_decision = job->blacklist_entry->local_filename || resp->body ? 1 : 0;
 		recurse_decision = process_decision && config.recursive
 			&& (!config.level || job->level < config.level + config.page_requisites) ? 1 : 0;
@@ -2091,42 +2138,31 @@ static void process_response(wget_http_response *resp)
 		}
 	}
 
-	if (job->robotstxt &&
-			// Only if a file was downloaded
-			resp->body &&
-			// Parse the robots file and only if it was successful
-			(wget_robots_parse(&job->host->robots, resp->body->data, PACKAGE_NAME) == WGET_E_SUCCESS) &&
-			// Sitemaps are not relevant as page requisites
-			!config.page_requisites)
-	{
-		// add sitemaps to be downloaded (format https://www.sitemaps.org/protocol.html)
-		for (int it = 0, n = wget_robots_get_sitemap_count(job->host->robots); it < n; it++) {
-			const char *sitemap = wget_robots_get_sitemap(job->host->robots, it);
-			debug_printf("adding sitemap '%s'\n", sitemap);
-			queue_url_from_remote(job, "utf-8", sitemap, URL_FLG_SITEMAP, NULL); // see https://www.sitemaps.org/protocol.html#escaping
-		}
+	if (job->robotstxt) {
+		// Only if a file was downloaded
+		if (resp->body)
+			parse_robots_txt(job, resp->body->data);
 	} else if (resp->code == 200 || resp->code == 206) {
 		if (process_decision && recurse_decision) {
-			if (resp->content_type && resp->body) {
-				if (!wget_strcasecmp_ascii(resp->content_type, "text/html")) {
-					html_parse(job, job->level, job->blacklist_entry->local_filename, resp->body->data, resp->body->length, resp->content_type_encoding ? resp->content_type_encoding : config.remote_encoding, job->iri);
-				} else if (!wget_strcasecmp_ascii(resp->content_type, "application/xhtml+xml")) {
-					html_parse(job, job->level, job->blacklist_entry->local_filename, resp->body->data, resp->body->length, resp->content_type_encoding ? resp->content_type_encoding : config.remote_encoding, job->iri);
-					// xml_parse(sockfd, resp, job->iri);
-				} else if (!wget_strcasecmp_ascii(resp->content_type, "text/css")) {
-					css_parse(job, resp->body->data, resp->body->length, resp->content_type_encoding ? resp->content_type_encoding : config.remote_encoding, job->iri);
-				} else if (!wget_strcasecmp_ascii(resp->content_type, "application/atom+xml")) { // see RFC4287, https://de.wikipedia.org/wiki/Atom_%28Format%29
-					atom_parse(job, resp->body->data, "utf-8", job->iri);
-				} else if (!wget_strcasecmp_ascii(resp->content_type, "application/rss+xml")) { // see https://cyber.harvard.edu/rss/rss.html
-					rss_parse(job, resp->body->data, "utf-8", job->iri);
-				} else if (job->sitemap) {
-					if (!wget_strcasecmp_ascii(resp->content_type, "application/xml"))
-						sitemap_parse_xml(job, resp->body->data, "utf-8", job->iri);
-					else if (!wget_strcasecmp_ascii(resp->content_type, "application/x-gzip"))
-						sitemap_parse_xml_gz(job, resp->body, "utf-8", job->iri);
-					else if (!wget_strcasecmp_ascii(resp->content_type, "text/plain"))
-						sitemap_parse_text(job, resp->body->data, "utf-8", job->iri);
-				}
+			int type;
+
+			if (resp->content_type && resp->body && (type = body_type(job, resp->content_type))
+				&& !job->body_streamed) // links have been queued while downloading
+			{
+				const char *encoding = resp->content_type_encoding ? resp->content_type_encoding : config.remote_encoding;
+
+				if (parser_threads) {
+					// the downloader hands the body over to the parser pool
+					struct parse_task *task = wget_malloc(sizeof(struct parse_task));
+
+					task->job = job;
+					task->type = type;
+					task->encoding = wget_strdup(encoding);
+					task->body = resp->body;
+					resp->body = NULL;
+					job->parse_task = task;
+				} else
+					parse_body(job, type, encoding, resp->body);
 			}
 		}
 		else if (config.verify_sig != GPG_VERIFY_DISABLED
@@ -2192,7 +2228,7 @@ static void process_response(wget_http_response *resp)
 #endif
 		}
 	}
-	else if ((resp->code == 304 && config.timestamping) || resp->code == 416) { // local document is up-to-date
+	else if ((resp->code == 304 && (config.timestamping || job->http_cache_revalidate)) || resp->code == 416) { // local document is up-to-date
 		if (process_decision && recurse_decision) {
 			const char *local_filename;
 
@@ -2224,13 +2260,113 @@ enum actions {
 	ACTION_ERROR = 3
 };
 
+// number of requests to keep in flight on a shared HTTP/2 connection
+static int http2_max_pending(wget_http_connection *conn)
+{
+	int max_pending = wget_http_get_max_concurrent_streams(conn);
+
+	// not announced (yet), RFC 7540 6.5.2 recommends to allow at least 100 streams
+	if (max_pending == INT_MAX)
+		max_pending = 100;
+
+	if (config.http2_request_window && max_pending > config.http2_request_window)
+		max_pending = config.http2_request_window;
+
+	return max_pending;
+}
+
+// Shared HTTP/2 sessions are registered in downloader->http2_host, protected by http2_mutex.
+// Other downloaders hand hosts over to registered sessions for coalescing, but never touch
+// the connection of the owner: the owner checks it in verify_coalesced_host().
+static bool claim_http2_session(DOWNLOADER *downloader, HOST *host)
+{
+	if (!host_claim_http2_session(host))
+		return false;
+
+	wget_thread_mutex_lock(http2_mutex);
+	downloader->http2_host = host;
+	wget_thread_mutex_unlock(http2_mutex);
+
+	return true;
+}
+
+static void unregister_http2_session(DOWNLOADER *downloader)
+{
+	if (downloader->http2_host) {
+		wget_thread_mutex_lock(http2_mutex);
+		downloader->http2_host = NULL;
+		wget_thread_mutex_unlock(http2_mutex);
+	}
+}
+
+static void release_http2_session(DOWNLOADER *downloader, HOST *host, bool *http2_owner)
+{
+	if (*http2_owner) {
+		unregister_http2_session(downloader);
+		host_release_http2_session(host);
+		*http2_owner = false;
+	}
+}
+
+static void close_connection(DOWNLOADER *downloader)
+{
+	unregister_http2_session(downloader);
+	wget_http_close(&downloader->conn);
+
+	// the responses to the pending requests won't arrive any more
+	if (downloader->contexts) {
+		wget_list_browse(downloader->contexts, body_callback_context_free, NULL);
+		wget_list_free(&downloader->contexts);
+	}
+}
+
+// milliseconds to wait between requests to host, --wait or the Crawl-delay of robots.txt
+static int request_delay(const HOST *host)
+{
+	int delay = config.robots && host->robots ? wget_robots_get_crawl_delay(host->robots) : 0;
+
+	return delay > config.wait ? delay : config.wait;
+}
+
+// hand the jobs of job->host over to another downloader's HTTP/2 connection (RFC 7540 9.1.1)
+static bool coalesce_http2_session(DOWNLOADER *downloader, JOB *job)
+{
+	const wget_iri *iri = job->iri;
+	bool coalesced = false;
+
+	if (!config.http2 || job->metalink || request_delay(job->host) || iri->scheme != WGET_IRI_SCHEME_HTTPS)
+		return false;
+
+	// keep using our own connection to the host
+	if (downloader->conn && !wget_strcmp(wget_http_get_host(downloader->conn), iri->host))
+		return false;
+
+	wget_thread_mutex_lock(http2_mutex);
+
+	for (int it = 0; it < config.max_threads && !coalesced; it++) {
+		DOWNLOADER *owner = &downloaders[it];
+		HOST *via = owner->http2_host;
+
+		if (owner != downloader && via && via->scheme == iri->scheme && via->port == iri->port)
+			coalesced = host_coalesce_http2_session(job->host, via);
+	}
+
+	wget_thread_mutex_unlock(http2_mutex);
+
+	if (coalesced)
+		debug_printf("[%d] %s is handed over to another HTTP/2 connection\n", downloader->id, iri->host);
+
+	return coalesced;
+}
+
 void *downloader_thread(void *p)
 {
 	DOWNLOADER *downloader = p;
 	wget_http_response *resp = NULL;
 	JOB *job;
 	HOST *host = NULL;
-	int pending = 0, max_pending = 1, locked;
+	bool http2_owner = false; // we serve all jobs of 'host' through one HTTP/2 connection
+	int pending = 0, max_pending = 1, locked, wait;
 	long long pause = 0;
 	enum actions action = ACTION_GET_JOB;
 	char http_code[7];
@@ -2244,12 +2380,22 @@ void *downloader_thread(void *p)
 
 		switch (action) {
 		case ACTION_GET_JOB: // Get a job, connect, send request
+			// another downloader multiplexes all jobs of this host, leave it and serve other hosts
+			if (host && !pending && !http2_owner && downloader->conn
+				&& wget_http_get_protocol(downloader->conn) == WGET_PROTOCOL_HTTP_2_0
+				&& host_has_http2_session(host))
+			{
+				close_connection(downloader);
+				host = NULL;
+			}
+
 			if (!(job = host_get_job(host, &pause))) {
 				if (pending) {
 					wget_thread_mutex_unlock(main_mutex); locked = 0;
 					action = ACTION_GET_RESPONSE;
 				} else if (host) {
-					wget_http_close(&downloader->conn);
+					release_http2_session(downloader, host, &http2_owner);
+					close_connection(downloader);
 					host = NULL;
 				} else {
 					if (!wget_thread_support()) {
@@ -2264,38 +2410,81 @@ void *downloader_thread(void *p)
 				break;
 			}
 
+			downloader->part = job->part; // job->part is only valid until the next dequeue
+			downloader->whole_file = false;
 			wget_thread_mutex_unlock(main_mutex); locked = 0;
 
+			// only we use our connection, so we check whether it is valid for a host that another downloader handed over
+			if (http2_owner && job->host != host && downloader->conn) {
+				if (!wget_http_connection_can_coalesce(downloader->conn, job->iri)) {
+					debug_printf("[%d] HTTP/2 connection to %s is not valid for %s\n",
+						downloader->id, wget_http_get_host(downloader->conn), job->iri->host);
+					wget_thread_mutex_lock(main_mutex); locked = 1;
+					host_verify_http2_session(job->host, false);
+					wget_thread_cond_signal(worker_cond);
+					break;
+				}
+
+				host_verify_http2_session(job->host, true);
+			}
+
 			{
 				const wget_iri *iri = job->iri;
 				downloader->job = job;
 				job->downloader = downloader;
 
+				// the local file or robots.txt is still fresh, no need to ask the server
+				if (serve_from_http_cache(job) || robots_from_cache(job)) {
+					downloader->job = NULL;
+					job->downloader = NULL;
+					wget_thread_mutex_lock(main_mutex); locked = 1;
+					host_remove_job(job->host, job);
+					wget_thread_cond_signal(main_cond);
+					break;
+				}
+
 				if (++pending == 1) {
-					host = job->host;
+					// the owner of an HTTP/2 session also gets jobs of coalesced hosts
+					if (!http2_owner)
+						host = job->host;
+
+					if (!http2_owner && coalesce_http2_session(downloader, job)) {
+						wget_thread_mutex_lock(main_mutex); locked = 1;
+						host_release_jobs(host);
+						close_connection(downloader);
+						host = NULL;
+						pending = 0;
+						break;
+					}
 
 					if (establish_connection(downloader, &iri) != WGET_E_SUCCESS) {
 						if (job->http_fallback)
 							fallback_to_http(job);
 						else
-							host_increase_failure(host);
+							host_increase_failure(job->host);
 						action = ACTION_ERROR;
 						break;
 					}
 
 					job->iri = iri;
-					if (config.wait || job->metalink || !downloader->conn || wget_http_get_protocol(downloader->conn) != WGET_PROTOCOL_HTTP_2_0)
+					if (request_delay(host) || job->metalink || !downloader->conn || wget_http_get_protocol(downloader->conn) != WGET_PROTOCOL_HTTP_2_0) {
+						release_http2_session(downloader, host, &http2_owner);
 						max_pending = 1;
-					else
-						max_pending = config.http2_request_window;
+					} else {
+						// multiplex all jobs of this host over our connection instead of letting
+						// other downloaders open more connections
+						if (!http2_owner)
+							http2_owner = claim_http2_session(downloader, host);
+						max_pending = http2_owner ? http2_max_pending(downloader->conn) : 1;
+					}
 				}
 
 				// wait between sending requests
-				if (config.wait) {
+				if ((wait = request_delay(job->host))) {
 					if (config.random_wait)
-						wget_millisleep(rand() % config.wait + config.wait / 2); // (0.5 - 1.5) * config.wait
+						wget_millisleep(rand() % wait + wait / 2); // (0.5 - 1.5) * wait
 					else
-						wget_millisleep(config.wait);
+						wget_millisleep(wait);
 
 					if (terminate)
 						break;
@@ -2308,11 +2497,15 @@ void *downloader_thread(void *p)
 					if (job->http_fallback)
 						fallback_to_http(job);
 					else
-						host_increase_failure(host);
+						host_increase_failure(job->host);
 					action = ACTION_ERROR;
 					break;
 				}
 
+				// the server's stream limit is known after its SETTINGS frame has been received
+				if (http2_owner && downloader->conn)
+					max_pending = http2_max_pending(downloader->conn);
+
 				if (pending >= max_pending) {
 					action = ACTION_GET_RESPONSE;
 				} else {
@@ -2325,7 +2518,8 @@ void *downloader_thread(void *p)
 			resp = http_receive_response(downloader->conn);
 
 			if (!resp) {
-				// likely that the other side closed the connection, try again
+				// likely that the other side closed the connection, try again.
+				// There is no job to blame, the failure belongs to the host we are connected to.
 				host_increase_failure(host);
 				action = ACTION_ERROR;
 				break;
@@ -2361,27 +2555,48 @@ void *downloader_thread(void *p)
 				goto next;
 			}
 
+			if (job->robotstxt)
+				robots_cache_store(job->iri->uri, resp);
+
 			// general response check to see if we need further processing
-			if (process_response_header(resp) == 0) {
+			if (process_response_header(resp, downloader) == 0) {
 				if (job->head_first)
 					process_head_response(resp); // HEAD request/response
-				else if (job->part)
-					process_response_part(resp); // chunked/metalink GET download
-				else
+				else if (downloader->part)
+					process_response_part(resp, downloader); // chunked/metalink GET download
+				else {
 					process_response(resp); // GET + POST request/response
+					update_http_cache(resp);
+				}
 			}
 
 next:
-			host_reset_failure(host);
+			// 'host' is the owner of the connection, coalesced jobs belong to other hosts
+			host_reset_failure(job->host);
 
 			wget_http_free_request(&resp->req);
 			wget_http_free_response(&resp);
 
 			wget_thread_mutex_lock(main_mutex); locked = 1;
 
+			if (downloader->job && job->parse_task) {
+				// the parser pool removes the job when the links are queued
+				struct parse_task *task = job->parse_task;
+
+				job->used_by = 0; // not ours anymore, see host_release_jobs()
+				downloader->job = NULL;
+				wget_thread_mutex_unlock(main_mutex); locked = 0;
+
+				if (!parser_pool_submit(task))
+					parse_task_run(task);
+
+				wget_thread_mutex_lock(main_mutex); locked = 1;
+			}
 			// download of single-part file complete, remove from job queue
-			if (job->done) {
-				host_remove_job(host, job);
+			else if (!downloader->job) {
+				// our part is done, the job belongs to the downloader of the last part
+			} else if (job->done) {
+				host_remove_job(job->host, job);
 			} else {
 				job->inuse = 0;
 			}
@@ -2394,10 +2609,12 @@ next:
 			break;
 
 		case ACTION_ERROR:
-			wget_http_close(&downloader->conn);
+			close_connection(downloader);
 
 			wget_thread_mutex_lock(main_mutex); locked = 1;
 			host_release_jobs(host);
+			if (host)
+				release_http2_session(downloader, host, &http2_owner);
 			wget_thread_cond_signal(main_cond);
 
 			host = NULL;
@@ -2414,7 +2631,9 @@ next:
 out:
 	if (locked)
 		wget_thread_mutex_unlock(main_mutex);
-	wget_http_close(&downloader->conn);
+	if (host)
+		release_http2_session(downloader, host, &http2_owner);
+	close_connection(downloader);
 
 	// if we terminate, tell the other downloaders
 	wget_thread_cond_signal(worker_cond);
@@ -2494,6 +2713,21 @@ static unsigned int WGET_GCC_PURE hash_url(const char *url)
 	return hash;
 }
 
+// returns true if url has not been seen before
+static bool known_urls_add(const char *url)
+{
+	// the upper bits select the shard, the lower bits select the bucket within
+	struct known_urls_shard *shard = &known_urls[(hash_url(url) >> 16) % KNOWN_URLS_SHARDS];
+	bool added = false;
+
+	wget_thread_mutex_lock(shard->mutex);
+	if (!wget_hashmap_contains(shard->urls, url))
+		added = wget_hashmap_put(shard->urls, wget_strdup(url), NULL) == 0;
+	wget_thread_mutex_unlock(shard->mutex);
+
+	return added;
+}
+
 /*
  * helper function: percent-unescape, convert to utf-8, create URL string using base
  */
@@ -2530,18 +2764,106 @@ static int normalize_uri(const wget_iri *base, wget_string *url, const char *enc
 	return 0;
 }
 
+// resolve <base href> of a document, returns NULL if it is not usable
+static wget_iri *html_resolve_base(const wget_iri *base, wget_string *href, const char *encoding)
+{
+	wget_iri *newbase = NULL;
+	wget_buffer buf;
+	char sbuf[1024];
+
+	wget_buffer_init(&buf, sbuf, sizeof(sbuf));
+
+	if (normalize_uri(base, href, encoding, &buf) == 0) {
+		// info_printf("%.*s -> %s\n", (int)href->len, href->p, buf.data);
+		if (!base && !buf.length)
+			info_printf(_("BASE '%.*s' not usable (missing absolute base URI)\n"), (int)href->len, href->p);
+		else
+			newbase = wget_iri_parse(buf.data, "utf-8");
+	} else {
+		error_printf(_("Cannot resolve BASE URI %.*s\n"), (int)href->len, href->p);
+	}
+
+	wget_buffer_deinit(&buf);
+
+	return newbase;
+}
+
+// normalize and filter the URLs of a document without locks, enqueue the survivors in one go
+static void html_queue_urls(JOB *job, int level, const wget_iri *base, const char *encoding, wget_html_parsed_result *parsed)
+{
+	wget_buffer buf;
+	char sbuf[1024];
+	wget_vector *admitted_urls;
+	bool page_requisites = config.recursive && config.page_requisites && config.level && level < config.level;
+
+	//	info_printf(_("page_req %d: %d %d %d %d\n"), page_requisites, config.recursive, config.page_requisites, config.level, level);
+
+	wget_buffer_init(&buf, sbuf, sizeof(sbuf));
+
+	admitted_urls = wget_vector_create(wget_vector_size(parsed->uris) + 1, NULL);
+
+	for (int it = 0; it < wget_vector_size(parsed->uris); it++) {
+		wget_html_parsed_url *html_url = wget_vector_get(parsed->uris, it);
+		wget_string *url = &html_url->url;
+
+		/* do not follow action and formaction at all */
+		if (!wget_strcasecmp_ascii(html_url->attr, "action") || !wget_strcasecmp_ascii(html_url->attr, "formaction")) {
+			info_printf(_("URL '%.*s' not followed (action/formaction attribute)\n"), (int)url->len, url->p);
+			continue;
+		}
+
+		// with --page-requisites: just load inline URLs from the deepest level documents
+		if (page_requisites && !wget_strcasecmp_ascii(html_url->attr, "href")) {
+			// don't load from attribute 'A', 'AREA' and 'EMBED'
+			// only load from attribute 'LINK' when rel was 'icon shortcut' or 'stylesheet'
+			if (config.level && level >= config.level - 1) {
+				if ((c_tolower(*html_url->tag) == 'a'
+					&& (html_url->tag[1] == 0 || !wget_strcasecmp_ascii(html_url->tag,"area")))
+					|| !html_url->link_inline
+					|| !wget_strcasecmp_ascii(html_url->tag,"embed"))
+				{
+					info_printf(_("URL '%.*s' not followed (page requisites + level)\n"), (int)url->len, url->p);
+					continue;
+				}
+			}
+		}
+
+		if (normalize_uri(base, url, encoding, &buf))
+			continue;
+
+		// info_printf("%.*s -> %s\n", (int)url->len, url->p, buf.data);
+		if (!base && !buf.length)
+			info_printf(_("URL '%.*s' not followed (missing base URI)\n"), (int)url->len, url->p);
+		else {
+			// Blacklist for URLs before they are processed
+			if (known_urls_add(buf.data)) {
+				ADMITTED_URL admitted;
+
+				if (admit_url(job, "utf-8", buf.data, page_requisites ? URL_FLG_REQUISITE : 0, &admitted)) {
+					if (config.download_attr && html_url->download.p)
+						admitted.download_name = wget_strmemdup(html_url->download.p, html_url->download.len);
+					else
+						admitted.download_name = NULL;
+
+					wget_vector_add_memdup(admitted_urls, &admitted, sizeof(admitted));
+				}
+			}
+		}
+	}
+
+	enqueue_urls(job, "utf-8", admitted_urls);
+	wget_vector_free(&admitted_urls);
+
+	wget_buffer_deinit(&buf);
+}
+
 void html_parse(JOB *job, int level, const char *fname, const char *html, size_t html_len, const char *encoding, const wget_iri *base)
 {
 	wget_iri *allocated_base = NULL;
 	const char *reason;
 	char *utf8 = NULL;
-	wget_buffer buf;
-	char sbuf[1024];
 	int convert_links = config.convert_links && !config.delete_after;
 	int convert_file_only = config.convert_file_only && !config.delete_after;
-	bool page_requisites = config.recursive && config.page_requisites && config.level && level < config.level;
-
-	//	info_printf(_("page_req %d: %d %d %d %d\n"), page_requisites, config.recursive, config.page_requisites, config.level, level);
 
 	// https://html.spec.whatwg.org/#determining-the-character-encoding
 	if (encoding && encoding == config.remote_encoding) {
@@ -2614,75 +2936,10 @@ void html_parse(JOB *job, int level, const char *fname, const char *html, size_t
 
 	info_printf(_("URI content encoding = '%s' (%s)\n"), encoding, reason);
 
-	wget_buffer_init(&buf, sbuf, sizeof(sbuf));
-
-	if (parsed->base.p) {
-		if (normalize_uri(base, &parsed->base, encoding, &buf) == 0) {
-			// info_printf("%.*s -> %s\n", (int)parsed->base.len, parsed->base.p, buf.data);
-			if (!base && !buf.length)
-				info_printf(_("BASE '%.*s' not usable (missing absolute base URI)\n"), (int)parsed->base.len, parsed->base.p);
-			else {
-				wget_iri *newbase = wget_iri_parse(buf.data, "utf-8");
-				if (newbase)
-					base = allocated_base = newbase;
-			}
-		} else {
-			error_printf(_("Cannot resolve BASE URI %.*s\n"), (int)parsed->base.len, parsed->base.p);
-		}
-	}
-
-	wget_thread_mutex_lock(known_urls_mutex);
-
-	for (int it = 0; it < wget_vector_size(parsed->uris); it++) {
-		wget_html_parsed_url *html_url = wget_vector_get(parsed->uris, it);
-		wget_string *url = &html_url->url;
-
-		/* do not follow action and formaction at all */
-		if (!wget_strcasecmp_ascii(html_url->attr, "action") || !wget_strcasecmp_ascii(html_url->attr, "formaction")) {
-			info_printf(_("URL '%.*s' not followed (action/formaction attribute)\n"), (int)url->len, url->p);
-			continue;
-		}
-
-		// with --page-requisites: just load inline URLs from the deepest level documents
-		if (page_requisites && !wget_strcasecmp_ascii(html_url->attr, "href")) {
-			// don't load from attribute 'A', 'AREA' and 'EMBED'
-			// only load from attribute 'LINK' when rel was 'icon shortcut' or 'stylesheet'
-			if (config.level && level >= config.level - 1) {
-				if ((c_tolower(*html_url->tag) == 'a'
-					&& (html_url->tag[1] == 0 || !wget_strcasecmp_ascii(html_url->tag,"area")))
-					|| !html_url->link_inline
-					|| !wget_strcasecmp_ascii(html_url->tag,"embed"))
-				{
-					info_printf(_("URL '%.*s' not followed (page requisites + level)\n"), (int)url->len, url->p);
-					continue;
-				}
-			}
-		}
-
-		if (normalize_uri(base, url, encoding, &buf))
-			continue;
-
-		// info_printf("%.*s -> %s\n", (int)url->len, url->p, buf.data);
-		if (!base && !buf.length)
-			info_printf(_("URL '%.*s' not followed (missing base URI)\n"), (int)url->len, url->p);
-		else {
-			// Blacklist for URLs before they are processed
-			if (wget_hashmap_put(known_urls, wget_strmemdup(buf.data, buf.length), NULL) == 0) {
-				char *download_name;
-
-				if (config.download_attr && html_url->download.p)
-					download_name = wget_strmemdup(html_url->download.p, html_url->download.len);
-				else
-					download_name = NULL;
-
-				queue_url_from_remote(job, "utf-8", buf.data, page_requisites ? URL_FLG_REQUISITE : 0, download_name);
-				xfree(download_name);
-			}
-		}
-	}
-	wget_thread_mutex_unlock(known_urls_mutex);
+	if (parsed->base.p && (allocated_base = html_resolve_base(base, &parsed->base, encoding)))
+		base = allocated_base;
 
-	wget_buffer_deinit(&buf);
+	html_queue_urls(job, level, base, encoding, parsed);
 
 	if ((convert_links || convert_file_only) && !config.delete_after) {
 		for (int it = 0; it < wget_vector_size(parsed->uris); it++) {
@@ -2712,100 +2969,363 @@ void html_parse_localfile(JOB *job, int level, const char *fname, const char *en
 	xfree(data);
 }
 
-void sitemap_parse_xml(JOB *job, const char *data, const char *encoding, const wget_iri *base)
+// an HTML document whose links are queued while it is being downloaded
+struct html_stream {
+	JOB *
+		job;
+	wget_html_url_parser *
+		parser;
+	wget_iri *
+		base; // set by <base href>
+	const char *
+		encoding; // NULL: taken from the document head
+	const char *
+		reason;
+	bool
+		head_parsed,
+		nofollow;
+};
+
+// returns the BODY_... type of a response whose links may be queued while downloading, else 0
+static int stream_body_type(JOB *job, const wget_http_response *resp)
 {
-	wget_vector *urls, *sitemap_urls;
-	const char *p;
-	size_t baselen = 0;
+	if (!config.recursive || job->robotstxt || resp->code != 200
+		|| (config.level && job->level >= config.level + config.page_requisites)
+		|| !resp->content_type
+		|| (config.metalink && resp->links)
+		|| plugin_db_has_post_processor()) // plugins may refuse the file after download
+		return 0;
 
-	wget_sitemap_get_urls_inline(data, &urls, &sitemap_urls);
+	return body_type(job, resp->content_type);
+}
 
-	if (base) {
-		if ((p = strrchr(base->uri, '/')))
-			baselen = p - base->uri + 1; // + 1 to include /
-		else
-			baselen = strlen(base->uri);
+// returns NULL if the response has to be parsed as a whole, see process_response()
+static struct html_stream *html_stream_open(JOB *job, const wget_http_response *resp, const char **data, size_t *length)
+{
+	struct html_stream *html;
+	const unsigned char *bom = (const unsigned char *) *data;
+	const char *encoding, *reason;
+
+	if (stream_body_type(job, resp) != BODY_HTML
+		|| config.convert_links || config.convert_file_only) // need the positions within the whole file
+		return NULL;
+
+	// see html_parse()
+	encoding = resp->content_type_encoding ? resp->content_type_encoding : config.remote_encoding;
+
+	if (encoding && encoding == config.remote_encoding) {
+		reason = _("set by user");
+	} else if (*length < 3 || (bom[0] == 0xFE && bom[1] == 0xFF) || (bom[0] == 0xFF && bom[1] == 0xFE)) {
+		return NULL; // UTF-16 is converted as a whole
+	} else if (bom[0] == 0xEF && bom[1] == 0xBB && bom[2] == 0xBF) {
+		encoding = "UTF-8";
+		reason = _("set by BOM");
+		*data += 3;
+		*length -= 3;
+	} else
+		reason = _("set by server response");
+
+	if (!wget_strncasecmp_ascii(encoding, "UTF-16", 6))
+		return NULL;
+
+	if (!(html = wget_calloc(1, sizeof(struct html_stream))))
+		return NULL;
+
+	if (!(html->parser = wget_html_url_parser_init(config.follow_tags, config.ignore_tags))) {
+		xfree(html);
+		return NULL;
+	}
+
+	html->job = job;
+	html->encoding = encoding;
+	html->reason = reason;
+
+	return html;
+}
+
+static void html_stream_queue(struct html_stream *html, wget_html_parsed_result *parsed)
+{
+	if (!parsed || html->nofollow)
+		return;
+
+	if (config.robots && !parsed->follow) {
+		html->nofollow = 1;
+		return;
 	}
 
-	// process the sitemap urls here
-	info_printf(_("found %d url(s) (base=%s)\n"), wget_vector_size(urls), base ? base->uri : NULL);
-	wget_thread_mutex_lock(known_urls_mutex);
+	if (!html->head_parsed) {
+		if (!html->encoding) {
+			if (parsed->encoding) {
+				html->encoding = parsed->encoding;
+				html->reason = _("set by document");
+			} else {
+				html->encoding = "CP1252"; // default encoding for HTML5 (pre-HTML5 is iso-8859-1)
+				html->reason = _("default, encoding not specified");
+			}
+		}
+
+		info_printf(_("URI content encoding = '%s' (%s)\n"), html->encoding, html->reason);
+		html->head_parsed = 1;
+	}
+
+	if (parsed->base.p) {
+		wget_iri *base = html_resolve_base(html->job->iri, &parsed->base, html->encoding);
+
+		if (base) {
+			wget_iri_free(&html->base);
+			html->base = base;
+		}
+	}
+
+	html_queue_urls(html->job, html->job->level, html->base ? html->base : html->job->iri, html->encoding, parsed);
+}
+
+static void html_stream_feed(struct html_stream *html, const char *data, size_t length)
+{
+	html_stream_queue(html, wget_html_url_parser_feed(html->parser, data, length));
+}
+
+// queue the links of the rest of the document
+static void html_stream_free(struct html_stream **html)
+{
+	wget_html_url_parser_free(&(*html)->parser);
+	wget_iri_free(&(*html)->base);
+	xfree(*html);
+}
+
+static void html_stream_close(struct html_stream **html)
+{
+	html_stream_queue(*html, wget_html_url_parser_finish((*html)->parser));
+	html_stream_free(html);
+}
+
+// a sitemap or feed whose links are queued while it is being downloaded or read
+struct xml_stream {
+	JOB *
+		job;
+	const wget_iri *
+		base;
+	const char *
+		encoding;
+	wget_decompressor *
+		dc; // gunzips a BODY_SITEMAP_GZ
+	union {
+		wget_sitemap_url_parser *sitemap;
+		wget_atom_url_parser *atom;
+		wget_rss_url_parser *rss;
+	} parser;
+	size_t
+		baselen; // length of the directory of 'base'
+	int
+		type, // BODY_SITEMAP_XML, BODY_SITEMAP_GZ, BODY_ATOM or BODY_RSS
+		nurls, // number of URLs found so far
+		nsitemap_urls;
+};
+
+static void xml_stream_queue(struct xml_stream *xml, wget_vector *urls, int flags)
+{
+	char urlbuf[1024], *urlp;
+
 	for (int it = 0; it < wget_vector_size(urls); it++) {
 		wget_string *url = wget_vector_get(urls, it);
 
 		// A Sitemap file located at https://example.com/catalog/sitemap.xml can include any URLs starting with https://example.com/catalog/
 		// but not any other.
-		if (baselen && (url->len <= baselen || wget_strncasecmp(url->p, base->uri, baselen))) {
+		// TODO: sitemap index urls must have same scheme, port and host as base
+		if (!(flags & URL_FLG_SITEMAP) && xml->baselen
+			&& (url->len <= xml->baselen || wget_strncasecmp(url->p, xml->base->uri, xml->baselen)))
+		{
 			info_printf(_("URL '%.*s' not followed (not matching sitemap location)\n"), (int)url->len, url->p);
 			continue;
 		}
 
 		// Blacklist for URLs before they are processed
-		if (wget_hashmap_put(known_urls, (p = wget_strmemdup(url->p, url->len)), NULL)) {
-			// the dup'ed url has already been freed when we come here
+		if (!known_urls_add((urlp = wget_strmemcpy_a(urlbuf, sizeof(urlbuf), url->p, url->len))))
 			info_printf(_("URL '%.*s' not followed (already known)\n"), (int)url->len, url->p);
-			continue;
-		}
+		else
+			queue_url_from_remote(xml->job, xml->encoding, urlp, flags, NULL);
 
-		queue_url_from_remote(job, encoding, p, 0, NULL);
+		if (urlp != urlbuf)
+			xfree(urlp);
 	}
 
-	// process the sitemap index urls here
-	info_printf(_("found %d sitemap url(s) (base=%s)\n"), wget_vector_size(sitemap_urls), base ? base->uri : NULL);
-	for (int it = 0; it < wget_vector_size(sitemap_urls); it++) {
-		wget_string *url = wget_vector_get(sitemap_urls, it);
+	if (flags & URL_FLG_SITEMAP)
+		xml->nsitemap_urls += wget_vector_size(urls);
+	else
+		xml->nurls += wget_vector_size(urls);
+}
 
-		// TODO: url must have same scheme, port and host as base
+// parses the next piece of the plain XML, also the sink of the gzip decompressor
+static int xml_stream_parse(void *context, const char *data, size_t length)
+{
+	struct xml_stream *xml = context;
+	wget_vector *urls, *sitemap_urls = NULL;
 
-		// Blacklist for URLs before they are processed
-		if (wget_hashmap_put(known_urls, (p = wget_strmemdup(url->p, url->len)), NULL)) {
-			// the dup'ed url has already been freed when we come here
-			info_printf(_("URL '%.*s' not followed (already known)\n"), (int)url->len, url->p);
-			continue;
-		}
+	if (xml->type == BODY_ATOM)
+		wget_atom_url_parser_feed(xml->parser.atom, data, length, &urls);
+	else if (xml->type == BODY_RSS)
+		wget_rss_url_parser_feed(xml->parser.rss, data, length, &urls);
+	else
+		wget_sitemap_url_parser_feed(xml->parser.sitemap, data, length, &urls, &sitemap_urls);
 
-		queue_url_from_remote(job, encoding, p, URL_FLG_SITEMAP, NULL);
-	}
-	wget_thread_mutex_unlock(known_urls_mutex);
+	xml_stream_queue(xml, urls, 0);
+	xml_stream_queue(xml, sitemap_urls, URL_FLG_SITEMAP);
 
-	wget_vector_free(&urls);
-	wget_vector_free(&sitemap_urls);
-	// wget_sitemap_free_urls_inline(&res);
+	return 0;
 }
 
-static int get_unzipped(void *userdata, const char *data, size_t length)
+static void xml_stream_free(struct xml_stream **xml)
 {
-	wget_buffer_memcat((wget_buffer *)userdata, data, length);
+	wget_decompress_close((*xml)->dc);
 
-	return 0;
+	if ((*xml)->type == BODY_ATOM)
+		wget_atom_url_parser_free(&(*xml)->parser.atom);
+	else if ((*xml)->type == BODY_RSS)
+		wget_rss_url_parser_free(&(*xml)->parser.rss);
+	else
+		wget_sitemap_url_parser_free(&(*xml)->parser.sitemap);
+
+	xfree(*xml);
 }
 
-void sitemap_parse_xml_gz(JOB *job, wget_buffer *gzipped_data, const char *encoding, const wget_iri *base)
+// 'type' is one of BODY_SITEMAP_XML, BODY_SITEMAP_GZ, BODY_ATOM or BODY_RSS
+static struct xml_stream *xml_stream_open(JOB *job, int type, const char *encoding, const wget_iri *base)
 {
-	wget_buffer plain;
-	wget_decompressor *dc = NULL;
+	struct xml_stream *xml;
+	const char *p;
+	bool ok;
+
+	if (!(xml = wget_calloc(1, sizeof(struct xml_stream))))
+		return NULL;
 
-	wget_buffer_init(&plain, NULL, gzipped_data->length * 10);
+	xml->job = job;
+	xml->type = type;
+	xml->encoding = encoding;
 
-	if ((dc = wget_decompress_open(wget_content_encoding_gzip, get_unzipped, &plain))) {
-		wget_decompress(dc, gzipped_data->data, gzipped_data->length);
-		wget_decompress_close(dc);
+	if (type == BODY_ATOM)
+		ok = (xml->parser.atom = wget_atom_url_parser_init()) != NULL;
+	else if (type == BODY_RSS)
+		ok = (xml->parser.rss = wget_rss_url_parser_init()) != NULL;
+	else
+		ok = (xml->parser.sitemap = wget_sitemap_url_parser_init()) != NULL;
 
-		sitemap_parse_xml(job, plain.data, encoding, base);
-	} else
+	if (!ok) {
+		xfree(xml);
+		return NULL;
+	}
+
+	if (type == BODY_SITEMAP_GZ && !(xml->dc = wget_decompress_open(wget_content_encoding_gzip, xml_stream_parse, xml))) {
 		error_printf(_("Can't scan '%s' because no libz support enabled at compile time\n"), job->iri->uri);
+		xml_stream_free(&xml);
+		return NULL;
+	}
+
+	if ((xml->base = base)) {
+		if ((p = strrchr(base->uri, '/')))
+			xml->baselen = p - base->uri + 1; // + 1 to include /
+		else
+			xml->baselen = strlen(base->uri);
+	}
 
-	wget_buffer_deinit(&plain);
+	return xml;
 }
 
-void sitemap_parse_xml_localfile(JOB *job, const char *fname, const char *encoding, const wget_iri *base)
+// returns NULL if the response has to be parsed as a whole, see process_response()
+static struct xml_stream *xml_stream_open_response(JOB *job, const wget_http_response *resp)
 {
-	char *data;
+	int type = stream_body_type(job, resp);
 
-	if ((data = wget_read_file(fname, NULL)))
-		sitemap_parse_xml(job, data, encoding, base);
+	if (type != BODY_SITEMAP_XML && type != BODY_SITEMAP_GZ && type != BODY_ATOM && type != BODY_RSS)
+		return NULL;
 
-	xfree(data);
+	return xml_stream_open(job, type, "utf-8", job->iri);
+}
+
+static void xml_stream_feed(struct xml_stream *xml, const char *data, size_t length)
+{
+	if (xml->dc)
+		wget_decompress(xml->dc, data, length);
+	else
+		xml_stream_parse(xml, data, length);
+}
+
+// queue the links of the rest of the document
+static void xml_stream_close(struct xml_stream **xml)
+{
+	struct xml_stream *x = *xml;
+	wget_vector *urls, *sitemap_urls = NULL;
+
+	if (x->dc) {
+		wget_decompress_close(x->dc); // flushes the rest into xml_stream_parse()
+		x->dc = NULL;
+	}
+
+	if (x->type == BODY_ATOM)
+		wget_atom_url_parser_finish(x->parser.atom, &urls);
+	else if (x->type == BODY_RSS)
+		wget_rss_url_parser_finish(x->parser.rss, &urls);
+	else
+		wget_sitemap_url_parser_finish(x->parser.sitemap, &urls, &sitemap_urls);
+
+	xml_stream_queue(x, urls, 0);
+	xml_stream_queue(x, sitemap_urls, URL_FLG_SITEMAP);
+
+	info_printf(_("found %d url(s) (base=%s)\n"), x->nurls, x->base ? x->base->uri : NULL);
+	if (x->type == BODY_SITEMAP_XML || x->type == BODY_SITEMAP_GZ)
+		info_printf(_("found %d sitemap url(s) (base=%s)\n"), x->nsitemap_urls, x->base ? x->base->uri : NULL);
+
+	xml_stream_free(xml);
+}
+
+static void xml_parse(JOB *job, int type, const char *data, size_t length, const char *encoding, const wget_iri *base)
+{
+	struct xml_stream *xml;
+
+	if ((xml = xml_stream_open(job, type, encoding, base))) {
+		xml_stream_feed(xml, data, length);
+		xml_stream_close(&xml);
+	}
+}
+
+// reads the file in pieces, so that its size does not matter
+static void xml_parse_localfile(JOB *job, int type, const char *fname, const char *encoding, const wget_iri *base)
+{
+	struct xml_stream *xml;
+	char buf[16384];
+	ssize_t nbytes;
+	int fd;
+
+	if (!strcmp(fname, "-"))
+		fd = STDIN_FILENO;
+	else if ((fd = open(fname, O_RDONLY|O_BINARY)) == -1) {
+		error_printf(_("Failed to open %s\n"), fname);
+		return;
+	}
+
+	if ((xml = xml_stream_open(job, type, encoding, base))) {
+		while ((nbytes = read(fd, buf, sizeof(buf))) > 0)
+			xml_stream_feed(xml, buf, nbytes);
+
+		xml_stream_close(&xml);
+	}
+
+	if (fd != STDIN_FILENO)
+		close(fd);
+}
+
+void sitemap_parse_xml(JOB *job, const char *data, const char *encoding, const wget_iri *base)
+{
+	xml_parse(job, BODY_SITEMAP_XML, data, strlen(data), encoding, base);
+}
+
+void sitemap_parse_xml_gz(JOB *job, wget_buffer *gzipped_data, const char *encoding, const wget_iri *base)
+{
+	xml_parse(job, BODY_SITEMAP_GZ, gzipped_data->data, gzipped_data->length, encoding, base);
+}
+
+void sitemap_parse_xml_localfile(JOB *job, const char *fname, const char *encoding, const wget_iri *base)
+{
+	xml_parse_localfile(job, BODY_SITEMAP_XML, fname, encoding, base);
 }
 
 void sitemap_parse_text(JOB *job, const char *data, const char *encoding, const wget_iri *base)
@@ -2847,79 +3367,24 @@ void sitemap_parse_text(JOB *job, const char *data, const char *encoding, const
 	}
 }
 
-static void add_urls(JOB *job, wget_vector *urls, const char *encoding, const wget_iri *base)
-{
-	const char *p;
-	size_t baselen = 0;
-
-	if (base) {
-		if ((p = strrchr(base->uri, '/')))
-			baselen = p - base->uri + 1; // + 1 to include /
-		else
-			baselen = strlen(base->uri);
-	}
-
-	info_printf(_("found %d url(s) (base=%s)\n"), wget_vector_size(urls), base ? base->uri : NULL);
-
-	wget_thread_mutex_lock(known_urls_mutex);
-	for (int it = 0; it < wget_vector_size(urls); it++) {
-		wget_string *url = wget_vector_get(urls, it);
-
-		if (baselen && (url->len <= baselen || wget_strncasecmp(url->p, base->uri, baselen))) {
-			info_printf(_("URL '%.*s' not followed (not matching sitemap location)\n"), (int)url->len, url->p);
-			continue;
-		}
-
-		// Blacklist for URLs before they are processed
-		if (wget_hashmap_put(known_urls, (p = wget_strmemdup(url->p, url->len)), NULL)) {
-			// the dup'ed url has already been freed when we come here
-			info_printf(_("URL '%.*s' not followed (already known)\n"), (int)url->len, url->p);
-			continue;
-		}
-
-		queue_url_from_remote(job, encoding, p, 0, NULL);
-	}
-	wget_thread_mutex_unlock(known_urls_mutex);
-}
-
 void atom_parse(JOB *job, const char *data, const char *encoding, const wget_iri *base)
 {
-	wget_vector *urls;
-
-	wget_atom_get_urls_inline(data, &urls);
-	add_urls(job, urls, encoding, base);
-	wget_vector_free(&urls);
-	// wget_atom_free_urls_inline(&res);
+	xml_parse(job, BODY_ATOM, data, strlen(data), encoding, base);
 }
 
 void atom_parse_localfile(JOB *job, const char *fname, const char *encoding, const wget_iri *base)
 {
-	char *data;
-
-	if ((data = wget_read_file(fname, NULL)))
-		atom_parse(job, data, encoding, base);
-
-	xfree(data);
+	xml_parse_localfile(job, BODY_ATOM, fname, encoding, base);
 }
 
 void rss_parse(JOB *job, const char *data, const char *encoding, const wget_iri *base)
 {
-	wget_vector *urls;
-
-	wget_rss_get_urls_inline(data, &urls);
-	add_urls(job, urls, encoding, base);
-	wget_vector_free(&urls);
-	// wget_rss_free_urls_inline(&res);
+	xml_parse(job, BODY_RSS, data, strlen(data), encoding, base);
 }
 
 void rss_parse_localfile(JOB *job, const char *fname, const char *encoding, const wget_iri *base)
 {
-	char *data;
-
-	if ((data = wget_read_file(fname, NULL)))
-		rss_parse(job, data, encoding, base);
-
-	xfree(data);
+	xml_parse_localfile(job, BODY_RSS, fname, encoding, base);
 }
 
 void metalink_parse_localfile(const char *fname)
@@ -2944,6 +3409,8 @@ void metalink_parse_localfile(const char *fname)
 				// sort mirrors by priority to download from highest priority first
 				wget_metalink_sort_mirrors(metalink);
 
+				parts_queued = 1;
+
 				// we have to attach the job to a host - take the first mirror for this purpose
 				wget_metalink_mirror *mirror = wget_vector_get(metalink->mirrors, 0);
 
@@ -3207,6 +3674,11 @@ static int WGET_GCC_NONNULL((1)) prepare_file(wget_http_response *resp, const ch
 		return -1;
 	}
 
+	if (config.warc_file && fname != config.output_document) {
+		debug_printf("not saved '%s' (written into WARC file)\n", fname);
+		return -2;
+	}
+
 	// If the content-type header does not exist we assume file to be 'application/octet-stream'
 	if (config.mime_types && !check_mime_list(config.mime_types, resp->content_type ? resp->content_type : "application/octet-stream"))
 		return -2;
@@ -3281,23 +3753,21 @@ static int WGET_GCC_NONNULL((1)) prepare_file(wget_http_response *resp, const ch
 	}
 
 	if (! ignore_patterns) {
-		if ((config.accept_patterns && !in_pattern_list(config.accept_patterns, fname))
-				|| (config.accept_regex && !regex_match(fname, config.accept_regex)))
+		if (!url_filter_accepted(fname))
 		{
 			debug_printf("not saved '%s' (doesn't match accept pattern)\n", fname);
 			xfree(alloced_fname);
 			return -2;
 		}
 
-		if ((config.reject_patterns && in_pattern_list(config.reject_patterns, fname))
-				|| (config.reject_regex && regex_match(fname, config.reject_regex)))
+		if (url_filter_rejected(fname))
 		{
 			debug_printf("not saved '%s' (matches reject pattern)\n", fname);
 			xfree(alloced_fname);
 			return -2;
 		}
 
-		if (config.exclude_directories && in_directory_pattern_list(config.exclude_directories, path)) {
+		if (url_filter_directory_excluded(path)) {
 			debug_printf("not saved '%s' (directory excluded)\n", path);
 			xfree(alloced_fname);
 			return -2;
@@ -3376,6 +3846,10 @@ static int WGET_GCC_NONNULL((1)) prepare_file(wget_http_response *resp, const ch
 		}
 	}
 
+	// don't write through a hard link into the deduplication store
+	if (flag == O_TRUNC || flag == O_APPEND)
+		dedup_unshare(fname, flag == O_APPEND);
+
 	fd = open_unique(fname, O_WRONLY | flag | O_CREAT | O_NONBLOCK | O_BINARY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH,
 		multiple, unique, sizeof(unique));
 	// debug_printf("1 fd=%d flag=%02x (%02x %02x %02x) errno=%d %s\n",fd,flag,O_EXCL,O_TRUNC,O_APPEND,errno,fname);
@@ -3441,11 +3915,23 @@ static int WGET_GCC_NONNULL((1)) prepare_file(wget_http_response *resp, const ch
 // context used for header and body callback
 struct body_callback_context {
 	JOB *job;
+	PART *part; // chunk to download, may shrink while downloading (work stealing)
+	DOWNLOADER *downloader;
 	wget_buffer *body;
 	uint64_t max_memory;
 	uint64_t length;
+	warc_record *warc;
+	wget_hash_hd *dedup_hash;
+	wget_hash_hd *hash; // streaming checksum of the body
+	wget_digest_algorithm hash_type;
+	struct html_stream *html; // links are queued while downloading
+	struct xml_stream *xml; // same for sitemaps and feeds
+	wget_metalink_piece *piece; // expected piece checksum
+	wget_http_digest *digest; // expected Digest header checksum
 	int outfd;
 	int progress_slot;
+	bool part_stolen; // the tail of 'part' has been taken over by another downloader
+	bool whole_file; // the server ignored the Range header, the complete file is written from offset 0
 	long long limit_debt_bytes;
 	long long limit_prev_time_ms;
 };
@@ -3462,6 +3948,27 @@ static int get_requested_range(void *ctx, void *elem)
 		return 0;
 }
 
+static bool start_streaming_hash(struct body_callback_context *ctx, wget_digest_algorithm type)
+{
+	if (type == WGET_DIGTYPE_UNKNOWN || wget_hash_init(&ctx->hash, type) != WGET_E_SUCCESS)
+		return false;
+
+	ctx->hash_type = type;
+	return true;
+}
+
+// RFC 3230 / RFC 5843 digest algorithm names
+static wget_digest_algorithm get_digest_algorithm(const char *name)
+{
+	if (!wget_strcasecmp_ascii(name, "SHA"))
+		return WGET_DIGTYPE_SHA1;
+
+	if (!wget_strcasecmp_ascii(name, "MD5") || !wget_strncasecmp_ascii(name, "SHA-", 4))
+		return wget_hash_get_algorithm(name);
+
+	return WGET_DIGTYPE_UNKNOWN;
+}
+
 static int get_header(wget_http_response *resp, void *context)
 {
 	struct body_callback_context *ctx = (struct body_callback_context *)context;
@@ -3478,8 +3985,26 @@ static int get_header(wget_http_response *resp, void *context)
 
 	if (ctx->job->head_first || (config.metalink && metalink)) {
 		name = ctx->job->blacklist_entry->local_filename;
-	} else if ((part = ctx->job->part)) {
+	} else if ((part = ctx->part) && resp->code != 206 && part->position) {
+		// the server ignored our Range header, don't write the data to the wrong place
+		name = ctx->job->metalink->name;
+		ctx->part = NULL;
+
+		if (resp->code == 200) {
+			// stream the complete file instead of buffering it, it completes the job
+			dedup_unshare(name, true);
+			if ((ctx->outfd = open(name, O_WRONLY | O_CREAT | O_NONBLOCK | O_BINARY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
+				set_exit_status(EXIT_STATUS_IO);
+				ret = -1;
+				goto out;
+			}
+			ctx->whole_file = true;
+		} else
+			ctx->max_memory = ((uint64_t) 10) * (1 << 20);
+	} else if (part) {
 		name = ctx->job->metalink->name;
+		job_start_part(part);
+		dedup_unshare(ctx->job->metalink->name, true);
 		ctx->outfd = open(ctx->job->metalink->name, O_WRONLY | O_CREAT | O_NONBLOCK | O_BINARY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 		if (ctx->outfd == -1) {
 			set_exit_status(EXIT_STATUS_IO);
@@ -3492,6 +4017,11 @@ static int get_header(wget_http_response *resp, void *context)
 			ret = -1;
 			goto out;
 		}
+
+		// verify the piece checksum while downloading
+		wget_metalink_piece *piece = job_get_piece(ctx->job, part);
+		if (piece && start_streaming_hash(ctx, wget_hash_get_algorithm(piece->hash.type)))
+			ctx->piece = piece;
 	}
 	else if (config.content_disposition && resp->content_filename) {
 #ifdef _WIN32
@@ -3525,7 +4055,20 @@ static int get_header(wget_http_response *resp, void *context)
 
 		if (ctx->outfd == -1)
 			ret = -1;
+		else if (ctx->outfd >= 0 && config.dedup_dir && resp->code != 206 && dest != config.output_document)
+			wget_hash_init(&ctx->dedup_hash, DEDUP_DIGTYPE);
 
+		// RFC 3230 Digest covers the (encoded) instance, so we can only check complete unencoded bodies
+		if (ctx->outfd >= 0 && resp->digests && resp->code == 200 && resp->content_encoding == wget_content_encoding_identity) {
+			for (int it = 0; it < wget_vector_size(resp->digests); it++) {
+				wget_http_digest *digest = wget_vector_get(resp->digests, it);
+
+				if (start_streaming_hash(ctx, get_digest_algorithm(digest->algorithm))) {
+					ctx->digest = digest;
+					break;
+				}
+			}
+		}
 	}
 
 //	info_printf("Opened %d\n", ctx->outfd);
@@ -3637,8 +4180,41 @@ static int get_body(wget_http_response *resp, void *context, const char *data, s
 			info_printf(_("# got header %zu bytes:\n%s\n"), resp->header->length, resp->header->data);
 	}
 
+	if (ctx->part) {
+		size_t part_length = job_receive_part(ctx->part, length);
+
+		if (part_length < length) {
+			// another downloader took over the tail of our part, stop here
+			if (!ctx->part_stolen) {
+				ctx->part_stolen = 1;
+				wget_http_abort_connection(ctx->downloader->conn);
+			}
+
+			if (!(length = part_length))
+				return 0;
+		}
+	}
+
+	if (ctx->html) {
+		html_stream_feed(ctx->html, data, length);
+	} else if (ctx->xml) {
+		xml_stream_feed(ctx->xml, data, length);
+	} else if (ctx->length == 0 && length && !ctx->part && !ctx->whole_file) {
+		// queue the links of HTML documents, sitemaps and feeds while downloading
+		const char *html_data = data;
+		size_t html_length = length;
+
+		if ((ctx->html = html_stream_open(ctx->job, resp, &html_data, &html_length)))
+			html_stream_feed(ctx->html, html_data, html_length);
+		else if ((ctx->xml = xml_stream_open_response(ctx->job, resp)))
+			xml_stream_feed(ctx->xml, data, length);
+	}
+
 	ctx->length += length;
 
+	if (ctx->warc)
+		warc_record_append(ctx->warc, data, length);
+
 	if (ctx->outfd >= 0) {
 		size_t written = safe_write(ctx->outfd, data, length);
 
@@ -3660,11 +4236,25 @@ static int get_body(wget_http_response *resp, void *context, const char *data, s
 			set_exit_status(EXIT_STATUS_IO);
 			return -1;
 		}
+
+		if (ctx->dedup_hash)
+			wget_hash(ctx->dedup_hash, data, length);
+
+		if (ctx->hash)
+			wget_hash(ctx->hash, data, length);
 	}
 
-	if (ctx->max_memory == 0 || ctx->length < ctx->max_memory)
+	if (!ctx->whole_file && (ctx->max_memory == 0 || ctx->length < ctx->max_memory))
 		wget_buffer_memcat(ctx->body, data, length); // append new data to body
 
+	return 0;
+}
+
+// called by the downloader thread, while get_body() may run in a decompression worker
+static void body_received(wget_http_response *resp, void *context, size_t length)
+{
+	struct body_callback_context *ctx = (struct body_callback_context *)context;
+
 	if (config.progress) {
 		bar_set_downloaded(ctx->progress_slot, resp->cur_downloaded - resp->accounted_for);
 		resp->accounted_for = resp->cur_downloaded;
@@ -3672,8 +4262,6 @@ static int get_body(wget_http_response *resp, void *context, const char *data, s
 
 	if (config.limit_rate)
 		limit_transfer_rate(ctx, length);
-
-	return 0;
 }
 
 static void add_authorize_header(
@@ -3727,63 +4315,27 @@ static void add_authorize_header(
 	}
 }
 
-static wget_http_request *http_create_request(const wget_iri *iri, JOB *job)
+// headers that only depend on the configuration, plus user supplied headers (--header)
+static wget_vector *static_headers;
+// static_headers pre-serialized for HTTP/1.1, sent along with each request by wget_http_send_request()
+static wget_buffer *static_header_block;
+
+static void add_static_header(const char *name, const char *value)
+{
+	wget_http_header_param param = { .name = wget_strdup(name), .value = wget_strdup(value) };
+
+	wget_vector_add_memdup(static_headers, &param, sizeof(param));
+}
+
+static void init_static_headers(void)
 {
-	wget_http_request *req;
 	wget_buffer buf;
 	char sbuf[256];
-	const char *method;
 
 	wget_buffer_init(&buf, sbuf, sizeof(sbuf));
 
-	if(job->redirect_get && job->redirection_level > 0)
-		method = "GET";
-	else if(config.method) {
-		method = config.method;
-	} else {
-		if (job->head_first) {
-			method = "HEAD";
-		} else {
-			if (config.post_data || config.post_file)
-				method = "POST";
-			else
-				method = "GET";
-		}
-	}
-
-	if (!(req = wget_http_create_request(iri, method)))
-		return req;
-
-	if (config.continue_download || config.start_pos || (config.timestamping && config.if_modified_since)) {
-		const char *local_filename = config.output_document ? config.output_document : job->blacklist_entry->local_filename;
-
-		/* We never want to continue the robots job. Always grab a fresh copy
-		 * from the server. */
-		if (job->robotstxt == true) {
-			unlink(local_filename);
-		}
-
-		if (config.continue_download) {
-			long long file_size = get_file_size(local_filename);
-			if (file_size >= 0)
-				wget_http_add_header_printf(req, "Range", "bytes=%lld-", file_size);
-		}
-
-		if (config.start_pos)
-			wget_http_add_header_printf(req, "Range", "bytes=%lld-", config.start_pos);
-
-		if (config.timestamping && config.if_modified_since) {
-			int64_t mtime = get_file_lmtime(local_filename);
-
-			if (mtime) {
-				char http_date[32];
-
-				wget_http_print_date(mtime, http_date, sizeof(http_date));
-				wget_http_add_header(req, "If-Modified-Since", http_date);
-			}
-		}
-
-	}
+	static_headers = wget_vector_create(8, NULL);
+	wget_vector_set_destructor(static_headers, (wget_vector_destructor *) wget_http_free_param);
 
 	// 20.06.2012: www.google.de only sends gzip responses with one of the
 	// following header lines in the request.
@@ -3800,8 +4352,6 @@ static wget_http_request *http_create_request(const wget_iri *iri, JOB *job)
 	"Accept-Language: en-us,en;q=0.5\r\n");
 	 */
 
-	wget_buffer_reset(&buf);
-
 	// if compression is specified
 	if (config.compression) {
 		for (int it = 0; it < config.compression_methods[wget_content_encoding_max]; it++) {
@@ -3812,7 +4362,7 @@ static wget_http_request *http_create_request(const wget_iri *iri, JOB *job)
 		}
 
 		if (buf.length)
-			wget_http_add_header(req, "Accept-Encoding", buf.data);
+			add_static_header("Accept-Encoding", buf.data);
 	}
 
 	// no valid types provided or just default Accept-Encoding
@@ -3839,27 +4389,372 @@ static wget_http_request *http_create_request(const wget_iri *iri, JOB *job)
 		if (!buf.length)
 			wget_buffer_strcat(&buf, "identity");
 
-		wget_http_add_header(req, "Accept-Encoding", buf.data);
+		add_static_header("Accept-Encoding", buf.data);
 	}
 
-	wget_http_add_header(req, "Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8");
+	add_static_header("Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8");
 
 //	if (config.spider && !config.recursive)
 //		http_add_header_if_modified_since(time(NULL));
 //		http_add_header(req, "If-Modified-Since", "Wed, 29 Aug 2012 00:00:00 GMT");
 
 	if (config.user_agent)
-		wget_http_add_header(req, "User-Agent", config.user_agent);
+		add_static_header("User-Agent", config.user_agent);
 
 	if (config.keep_alive)
-		wget_http_add_header(req, "Connection", "keep-alive");
+		add_static_header("Connection", "keep-alive");
 
 	if (!config.cache) {
 		// no-cache means a server/proxy MUST NOT serve cached data
-		wget_http_add_header(req, "Cache-Control", "no-cache");
+		add_static_header("Cache-Control", "no-cache");
 
 		// Some older proxies just understand the Pragma: header
-		wget_http_add_header(req, "Pragma", "no-cache");
+		add_static_header("Pragma", "no-cache");
+	}
+
+	for (int i = 0; i < wget_vector_size(config.headers); i++) {
+		wget_http_header_param *param = wget_vector_get(config.headers, i);
+		int n = wget_vector_size(static_headers);
+		char replaced = 0;
+
+		// replace wget's HTTP headers by user-provided headers, except Cookie (which will just be added))
+		// per-request headers of the same name are removed by add_static_headers()
+		if (wget_strcasecmp_ascii(param->name, "Cookie")) {
+			for (int j = 0; j < n; j++) {
+				wget_http_header_param *h = wget_vector_get(static_headers, j);
+
+				if (!wget_strcasecmp_ascii(param->name, h->name)) {
+					xfree(h->name);
+					xfree(h->value);
+					h->name = wget_strdup(param->name);
+					h->value = wget_strdup(param->value);
+					replaced = 1;
+				}
+			}
+		}
+
+		if (!replaced)
+			add_static_header(param->name, param->value);
+	}
+
+	static_header_block = wget_buffer_alloc(512);
+
+	for (int it = 0; it < wget_vector_size(static_headers); it++) {
+		wget_http_header_param *param = wget_vector_get(static_headers, it);
+
+		wget_buffer_printf_append(static_header_block, "%s: %s\r\n", param->name, param->value);
+	}
+
+	wget_buffer_deinit(&buf);
+}
+
+static void deinit_static_headers(void)
+{
+	wget_vector_free(&static_headers);
+	wget_buffer_free(&static_header_block);
+}
+
+// digest of the request header values listed in a Vary header, NULL if they may change per request
+static char *http_cache_vary_key(const char *vary)
+{
+	static const char *per_request_headers[] = {
+		"Authorization", "Cookie", "If-Modified-Since", "If-None-Match",
+		"Proxy-Authorization", "Range", "Referer"
+	};
+	wget_buffer buf;
+	char sbuf[256], *key = NULL;
+
+	wget_buffer_init(&buf, sbuf, sizeof(sbuf));
+
+	for (const char *s = vary, *e; *s; s = *e ? e + 1 : e) {
+		const char *value = "";
+		size_t len;
+
+		while (c_isblank(*s)) s++;
+		for (e = s; *e && *e != ','; e++);
+		for (len = e - s; len && c_isblank(s[len - 1]); len--);
+
+		if (!len)
+			continue;
+
+		for (unsigned it = 0; it < countof(per_request_headers); it++) {
+			if (!wget_strncasecmp_ascii(s, per_request_headers[it], len) && !per_request_headers[it][len])
+				goto out;
+		}
+
+		for (int it = 0; it < wget_vector_size(static_headers); it++) {
+			wget_http_header_param *param = wget_vector_get(static_headers, it);
+
+			if (!wget_strncasecmp_ascii(s, param->name, len) && !param->name[len]) {
+				value = param->value;
+				break;
+			}
+		}
+
+		wget_buffer_printf_append(&buf, "%.*s: %s\n", (int) len, s, value);
+	}
+
+	key = wget_malloc(wget_hash_get_len(WGET_DIGTYPE_SHA256) * 2 + 1);
+	wget_hash_printf_hex(WGET_DIGTYPE_SHA256, key, wget_hash_get_len(WGET_DIGTYPE_SHA256) * 2 + 1, "%s", buf.data);
+
+out:
+	wget_buffer_deinit(&buf);
+
+	return key;
+}
+
+static bool serve_from_http_cache(JOB *job)
+{
+	HTTP_CACHE_ENTRY *entry;
+	const char *local_filename;
+	char *location;
+	bool fresh = false;
+
+	if (!config.http_cache_file || !config.cache
+		|| config.method || config.post_data || config.post_file
+		|| job->part || job->metalink || job->head_first || job->robotstxt)
+	{
+		return false;
+	}
+
+	// a known permanent redirect is followed without asking the server
+	if ((location = http_cache_get_redirect(job->iri->uri))) {
+		info_printf(_("Using cached redirect %s -> %s\n"), job->iri->uri, location);
+		job->redirect_get = 1;
+		queue_url_from_remote(job, "utf-8", location, URL_FLG_REDIRECTION, NULL);
+		atomic_increment_int(&stats.nredirects);
+		xfree(location);
+		return true;
+	}
+
+	if (!(entry = http_cache_get(job->iri->uri)))
+		return false;
+
+	if (entry->location || config.spider || config.output_document || !(local_filename = job->blacklist_entry->local_filename)) {
+		http_cache_free_entry(&entry);
+		return false;
+	}
+
+	if (entry->fresh_until > time(NULL) && entry->size == get_file_size(local_filename)) {
+		if (!entry->vary)
+			fresh = true;
+		else if (entry->vary_key) {
+			char *key = http_cache_vary_key(entry->vary);
+
+			fresh = key && !strcmp(key, entry->vary_key);
+			xfree(key);
+		}
+	}
+
+	if (fresh) {
+		info_printf(_("Using cached '%s' for %s\n"), local_filename, job->iri->uri);
+
+		if (config.recursive && (!config.level || job->level < config.level + config.page_requisites))
+			parse_localfile(job, local_filename, entry->content_type_encoding, entry->content_type, job->iri);
+	}
+
+	http_cache_free_entry(&entry);
+
+	return fresh;
+}
+
+static bool robots_from_cache(JOB *job)
+{
+	char *data;
+
+	if (!job->robotstxt || !(data = robots_cache_get(job->iri->uri)))
+		return false;
+
+	info_printf(_("Using cached robots.txt for %s\n"), job->iri->uri);
+
+	// an empty robots.txt means that there is none
+	if (*data)
+		parse_robots_txt(job, data);
+
+	xfree(data);
+
+	return true;
+}
+
+static void update_http_cache(wget_http_response *resp)
+{
+	JOB *job = resp->req->user_data;
+	const char *local_filename = job->blacklist_entry->local_filename;
+	long long size;
+
+	if (!config.http_cache_file || strcmp(resp->req->method, "GET"))
+		return;
+
+	if ((resp->code == 301 || resp->code == 308) && resp->location) {
+		wget_buffer uri_buf;
+		char uri_sbuf[1024];
+
+		wget_buffer_init(&uri_buf, uri_sbuf, sizeof(uri_sbuf));
+		wget_iri_relative_to_abs(job->iri, resp->location, (size_t) -1, &uri_buf);
+
+		if (uri_buf.length)
+			http_cache_store_redirect(job->iri->uri, resp, uri_buf.data);
+
+		wget_buffer_deinit(&uri_buf);
+		return;
+	}
+
+	if (config.spider || config.output_document || !local_filename)
+		return;
+
+	if (resp->code == 404 || resp->code == 410) {
+		http_cache_remove(job->iri->uri);
+		return;
+	}
+
+	if (resp->code == 304 && job->http_cache_revalidate) {
+		size = get_file_size(local_filename);
+	} else if (resp->code == 200 && !resp->length_inconsistent && !terminate
+		&& job->sig_filename && !strcmp(job->sig_filename, local_filename))
+	{
+		size = get_file_size(local_filename);
+	} else
+		return;
+
+	if (size >= 0) {
+		char *vary_key = resp->vary ? http_cache_vary_key(resp->vary) : NULL;
+
+		http_cache_store(job->iri->uri, resp, vary_key, size);
+		xfree(vary_key);
+	}
+}
+
+static void add_static_headers(wget_http_request *req, bool http2)
+{
+	// user-provided headers replace wget's per-request headers of the same name
+	for (int i = 0; i < wget_vector_size(config.headers); i++) {
+		wget_http_header_param *param = wget_vector_get(config.headers, i);
+
+		if (!wget_strcasecmp_ascii(param->name, "Cookie"))
+			continue;
+
+		for (int j = wget_vector_size(req->headers) - 1; j >= 0; j--) {
+			wget_http_header_param *h = wget_vector_get(req->headers, j);
+
+			if (!wget_strcasecmp_ascii(param->name, h->name))
+				wget_vector_remove(req->headers, j);
+		}
+	}
+
+	if (http2) {
+		for (int it = 0; it < wget_vector_size(static_headers); it++)
+			wget_http_add_header_param(req, wget_vector_get(static_headers, it));
+	} else
+		wget_http_request_set_header_block(req, static_header_block->data, static_header_block->length);
+}
+
+// HTTP/2 stream weight: documents that drive recursion are downloaded before large requisites
+static int http2_priority(const wget_iri *iri, JOB *job)
+{
+	static const char *const parsed_ext[] = {
+		".html", ".htm", ".xhtml", ".shtml", ".php", ".asp", ".aspx", ".jsp", ".css", ".xml", ".rss", ".atom"
+	};
+
+	if (job->robotstxt || job->sitemap)
+		return 256;
+
+	const char *path = iri->path ? iri->path : "", *ext;
+
+	if ((ext = strrchr(path, '/')))
+		path = ext + 1;
+
+	// directory index or no extension: most likely HTML
+	if (!(ext = strrchr(path, '.')))
+		return 256;
+
+	for (unsigned it = 0; it < countof(parsed_ext); it++) {
+		if (!wget_strcasecmp_ascii(ext, parsed_ext[it]))
+			return 256;
+	}
+
+	return 0; // default weight (16)
+}
+
+static wget_http_request *http_create_request(const wget_iri *iri, JOB *job, PART *part, bool http2)
+{
+	wget_http_request *req;
+	wget_buffer buf;
+	char sbuf[256];
+	const char *method;
+
+	wget_buffer_init(&buf, sbuf, sizeof(sbuf));
+
+	if(job->redirect_get && job->redirection_level > 0)
+		method = "GET";
+	else if(config.method) {
+		method = config.method;
+	} else {
+		if (job->head_first) {
+			method = "HEAD";
+		} else {
+			if (config.post_data || config.post_file)
+				method = "POST";
+			else
+				method = "GET";
+		}
+	}
+
+	if (!(req = wget_http_create_request(iri, method)))
+		return req;
+
+	// parts have their own Range header and no blacklist entry, resuming is done by job_validate_file()
+	if (!part && (config.continue_download || config.start_pos || (config.timestamping && config.if_modified_since))) {
+		const char *local_filename = config.output_document ? config.output_document : job->blacklist_entry->local_filename;
+
+		/* We never want to continue the robots job. Always grab a fresh copy
+		 * from the server. */
+		if (job->robotstxt == true) {
+			unlink(local_filename);
+		}
+
+		if (config.continue_download) {
+			long long file_size = get_file_size(local_filename);
+			if (file_size >= 0)
+				wget_http_add_header_printf(req, "Range", "bytes=%lld-", file_size);
+		}
+
+		if (config.start_pos)
+			wget_http_add_header_printf(req, "Range", "bytes=%lld-", config.start_pos);
+
+		if (config.timestamping && config.if_modified_since) {
+			int64_t mtime = get_file_lmtime(local_filename);
+
+			if (mtime) {
+				char http_date[32];
+
+				wget_http_print_date(mtime, http_date, sizeof(http_date));
+				wget_http_add_header(req, "If-Modified-Since", http_date);
+			}
+		}
+
+	}
+
+	// revalidate a stale file of the HTTP cache
+	job->http_cache_revalidate = 0;
+	if (!part && config.http_cache_file && config.cache && !config.output_document && !strcmp(method, "GET")) {
+		HTTP_CACHE_ENTRY *entry = http_cache_get(iri->uri);
+		const char *local_filename = job->blacklist_entry->local_filename;
+
+		if (entry && !entry->location && local_filename && entry->size == get_file_size(local_filename)) {
+			if (entry->etag)
+				wget_http_add_header(req, "If-None-Match", entry->etag);
+
+			if (entry->last_modified && !(config.timestamping && config.if_modified_since)) {
+				char http_date[32];
+
+				wget_http_print_date(entry->last_modified, http_date, sizeof(http_date));
+				wget_http_add_header(req, "If-Modified-Since", http_date);
+			}
+
+			job->http_cache_revalidate = 1;
+		}
+
+		http_cache_free_entry(&entry);
 	}
 
 	if (config.referer)
@@ -3884,9 +4779,9 @@ static wget_http_request *http_create_request(const wget_iri *iri, JOB *job)
 		add_authorize_header(req, job->proxy_challenges, config.http_proxy_username, config.http_proxy_password, 1);
 	}
 
-	if (job->part)
+	if (part)
 		wget_http_add_header_printf(req, "Range", "bytes=%llu-%llu",
-			(unsigned long long) job->part->position, (unsigned long long) job->part->position + job->part->length - 1);
+			(unsigned long long) part->position, (unsigned long long) part->position + part->length - 1);
 
 	// add cookies
 	if (config.cookies) {
@@ -3898,31 +4793,6 @@ static wget_http_request *http_create_request(const wget_iri *iri, JOB *job)
 		}
 	}
 
-	if (config.headers) {
-		for (int i = 0; i < wget_vector_size(config.headers); i++) {
-			wget_http_header_param *param = wget_vector_get(config.headers, i);
-			char replaced = 0;
-
-			// replace wget's HTTP headers by user-provided headers, except Cookie (which will just be added))
-			if (wget_strcasecmp_ascii(param->name, "Cookie")) {
-				for (int j = 0; j < wget_vector_size(req->headers); j++) {
-					wget_http_header_param *h = wget_vector_get(req->headers, j);
-
-					if (!wget_strcasecmp_ascii(param->name, h->name)) {
-						xfree(h->name);
-						xfree(h->value);
-						h->name = wget_strdup(param->name);
-						h->value = wget_strdup(param->value);
-						replaced = 1;
-					}
-				}
-			}
-
-			if (!replaced)
-				wget_http_add_header_param(req, param);
-		}
-	}
-
 	if (config.post_data) {
 		size_t length = strlen(config.post_data);
 
@@ -3951,6 +4821,13 @@ static wget_http_request *http_create_request(const wget_iri *iri, JOB *job)
 		}
 	}
 
+	if (req) {
+		add_static_headers(req, http2);
+
+		if (http2 && (config.recursive || config.page_requisites))
+			wget_http_request_set_int(req, WGET_HTTP_PRIORITY, http2_priority(iri, job));
+	}
+
 	wget_buffer_deinit(&buf);
 
 	return req;
@@ -3971,10 +4848,10 @@ int http_send_request(const wget_iri *iri, const wget_iri *original_url, DOWNLOA
 		// If the Content-Type header gives us not a parseable type, we are done.
 		print_status(downloader, "[%d] Checking '%s' ...\n", downloader->id, iri->uri);
 	} else {
-		if (job->part)
+		if (downloader->part)
 			print_status(downloader, "downloading part %d/%d (%lld-%lld) %s from %s\n",
-				job->part->id, wget_vector_size(job->parts),
-				(long long)job->part->position, (long long)(job->part->position + job->part->length - 1),
+				downloader->part->id, wget_vector_size(job->parts),
+				(long long)downloader->part->position, (long long)(downloader->part->position + downloader->part->length - 1),
 				job->metalink->name, iri->host);
 		else if (config.progress)
 			bar_print(downloader->id, iri->uri);
@@ -3982,7 +4859,8 @@ int http_send_request(const wget_iri *iri, const wget_iri *original_url, DOWNLOA
 			print_status(downloader, "[%d] Downloading '%s' ...\n", downloader->id, iri->uri);
 	}
 
-	wget_http_request *req = http_create_request(iri, downloader->job);
+	wget_http_request *req = http_create_request(iri, downloader->job, downloader->part,
+		wget_http_get_protocol(conn) == WGET_PROTOCOL_HTTP_2_0);
 
 	if (!req)
 		return WGET_E_UNKNOWN;
@@ -3994,28 +4872,106 @@ int http_send_request(const wget_iri *iri, const wget_iri *original_url, DOWNLOA
 		return rc;
 	}
 
-	struct body_callback_context *context = wget_calloc(1, sizeof(struct body_callback_context));
+	// freed by http_receive_response() or by close_connection() if the response doesn't arrive
+	struct body_callback_context *context = wget_list_append(&downloader->contexts,
+		&(struct body_callback_context) { .downloader = downloader }, sizeof(struct body_callback_context));
 
 	context->job = downloader->job;
-	context->max_memory = downloader->job->part ? 0 : ((uint64_t) 10) * (1 << 20);
+	context->part = downloader->part;
+	context->downloader = downloader;
+	context->max_memory = downloader->part ? 0 : ((uint64_t) 10) * (1 << 20);
 	context->outfd = -1;
 	context->body = wget_buffer_alloc(102400);
 	context->length = 0;
 	context->progress_slot = downloader->id;
 	context->job->original_url = original_url;
+	context->job->body_streamed = 0;
 	context->limit_debt_bytes = 0;
 	context->limit_prev_time_ms = wget_get_timemillis();
 
+	if (config.warc_file)
+		context->warc = warc_record_alloc(req);
+
 	// set callback functions
 	wget_http_request_set_header_cb(req, get_header, context);
 	wget_http_request_set_body_cb(req, get_body, context);
+	wget_http_request_set_recv_cb(req, body_received, context);
 
 	// keep the received response header in 'resp->header'
-	wget_http_request_set_int(req, WGET_HTTP_RESPONSE_KEEPHEADER, config.save_headers || config.server_response || (config.progress && config.spider) || (config.chunk_size && config.progress));
+	wget_http_request_set_int(req, WGET_HTTP_RESPONSE_KEEPHEADER, config.save_headers || config.server_response || (config.progress && config.spider) || (config.chunk_size && config.progress) || config.warc_file);
 	wget_http_request_set_int(req, WGET_HTTP_RESPONSE_IGNORELENGTH, config.ignore_length);
+	wget_http_request_set_int(req, WGET_HTTP_DECOMPRESS_OFFLOAD, config.decompress_offload);
 	return WGET_E_SUCCESS;
 }
 
+// free what has been set up for a response that didn't arrive, nothing is stored or queued
+static int body_callback_context_free(WGET_GCC_UNUSED void *unused, void *elem)
+{
+	struct body_callback_context *context = elem;
+
+	warc_record_free(&context->warc);
+
+	if (context->hash) {
+		unsigned char digest[wget_hash_get_len(context->hash_type)];
+
+		wget_hash_deinit(&context->hash, digest);
+	}
+
+	if (context->html)
+		html_stream_free(&context->html);
+	else if (context->xml)
+		xml_stream_free(&context->xml);
+
+	if (context->dedup_hash)
+		dedup_file(NULL, &context->dedup_hash);
+
+	if (context->outfd >= 0)
+		close(context->outfd);
+
+	wget_buffer_free(&context->body);
+
+	if (config.progress)
+		bar_slot_deregister(context->progress_slot);
+
+	return 0;
+}
+
+static void check_streaming_hash(struct body_callback_context *ctx, wget_http_response *resp)
+{
+	int len = wget_hash_get_len(ctx->hash_type);
+	unsigned char digest[len];
+
+	wget_hash_deinit(&ctx->hash, digest);
+
+	if (terminate || resp->length_inconsistent)
+		return;
+
+	if (ctx->piece) {
+		char digest_hex[len * 2 + 1];
+
+		// the part doesn't cover the piece any more if its tail has been stolen
+		if (job_get_piece(ctx->job, ctx->part) != ctx->piece)
+			return;
+
+		wget_memtohex(digest, len, digest_hex, sizeof(digest_hex));
+
+		if (!wget_strcasecmp_ascii(digest_hex, ctx->piece->hash.hash_hex))
+			ctx->part->verified = 1;
+		else
+			ctx->part->corrupt = 1;
+	} else if (ctx->digest) {
+		char *encoded = wget_base64_encode_alloc((const char *) digest, len);
+
+		if (strcmp(encoded, ctx->digest->encoded_digest)) {
+			error_printf(_("Digest %s mismatch for '%s'\n"), ctx->digest->algorithm, ctx->job->sig_filename);
+			set_exit_status(EXIT_STATUS_REMOTE);
+		} else
+			debug_printf("Digest %s OK for '%s'\n", ctx->digest->algorithm, ctx->job->sig_filename);
+
+		xfree(encoded);
+	}
+}
+
 wget_http_response *http_receive_response(wget_http_connection *conn)
 {
 	wget_http_response *resp = wget_http_get_response_cb(conn);
@@ -4024,9 +4980,14 @@ wget_http_response *http_receive_response(wget_http_connection *conn)
 		return NULL;
 
 	struct body_callback_context *context = resp->req->body_user_data;
+	DOWNLOADER *downloader = context->downloader;
+	bool part_stolen = context->part_stolen;
 
 	resp->body = context->body;
 
+	if (context->warc)
+		warc_record_write(&context->warc, resp, context->job->iri->uri);
+
 	if (context->outfd >= 0) {
 		if (resp->last_modified) {
 			/* If program was aborted, we store file times one second less than the server time.
@@ -4049,13 +5010,45 @@ wget_http_response *http_receive_response(wget_http_connection *conn)
 		context->outfd = -1;
 	}
 
+	if (context->whole_file) {
+		// process_response_part() completes the job if the file has been received completely
+		context->downloader->whole_file = !terminate && !resp->length_inconsistent
+			&& context->length == (uint64_t) context->job->metalink->size;
+	}
+
+	if (part_stolen)
+		resp->length_inconsistent = false;
+
+	// process_response() won't parse the body again
+	if (context->html) {
+		html_stream_close(&context->html);
+		context->job->body_streamed = 1;
+	} else if (context->xml) {
+		xml_stream_close(&context->xml);
+		context->job->body_streamed = 1;
+	}
+
+	if (context->hash)
+		check_streaming_hash(context, resp);
+
+	if (context->dedup_hash) {
+		// incomplete downloads are not added to the store
+		bool complete = !terminate && !resp->length_inconsistent;
+
+		dedup_file(complete ? context->job->sig_filename : NULL, &context->dedup_hash);
+	}
+
 	if (config.progress)
 		bar_slot_deregister(context->progress_slot);
 
 	if (resp->length_inconsistent)
 		set_exit_status(EXIT_STATUS_PROTOCOL);
 
-	xfree(context);
+	wget_list_remove(&downloader->contexts, context);
+
+	// the aborted connection still carries the rest of the response
+	if (part_stolen)
+		close_connection(downloader);
 
 	return resp;
 }
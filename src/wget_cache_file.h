@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Header file for persistent cache files with one entry per URL and line
+ *
+ */
+
+#ifndef SRC_WGET_CACHE_FILE_H
+#define SRC_WGET_CACHE_FILE_H
+
+#include <wget.h>
+
+typedef void cache_file_load_entry_fn(const char *url, char *fields);
+
+typedef struct {
+	const char *
+		name; // e.g. "HTTP cache", used in messages and in the file header
+	const char *
+		format; // description of the fields, written into the file header
+	cache_file_load_entry_fn *
+		load_entry; // parses the fields of a line and adds the entry to 'entries'
+	wget_stringmap_browse_fn *
+		save_entry; // writes an entry as line to the FILE * given as context
+	wget_stringmap_value_destructor *
+		free_entry;
+	wget_stringmap *
+		entries; // entries by URL, the key is owned by the entry
+	wget_stringmap *
+		removed; // URLs removed in this run, not to be merged in from the file at exit
+	wget_thread_mutex
+		mutex; // protects 'entries' and 'removed'
+} CACHE_FILE;
+
+void cache_file_init(CACHE_FILE *cache, const char *fname, int max);
+void cache_file_exit(CACHE_FILE *cache, const char *fname);
+void cache_file_put(CACHE_FILE *cache, const char *url, void *entry);
+void cache_file_remove(CACHE_FILE *cache, const char *url);
+const char *cache_file_next_field(char **linep);
+
+#endif /* SRC_WGET_CACHE_FILE_H */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Header file for the content-addressed deduplication store
+ *
+ */
+
+#ifndef SRC_WGET_DEDUP_H
+#define SRC_WGET_DEDUP_H
+
+#include <stdbool.h>
+
+#include <wget.h>
+
+// digest type used for content addressing
+#define DEDUP_DIGTYPE WGET_DIGTYPE_SHA256
+
+int dedup_init(void);
+void dedup_exit(void);
+void dedup_file(const char *fname, wget_hash_hd **hash);
+void dedup_unshare(const char *fname, bool keep_content);
+
+#endif /* SRC_WGET_DEDUP_H */
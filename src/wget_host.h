@@ -35,7 +35,8 @@ struct JOB;
 typedef struct JOB JOB;
 
 // everything host/domain specific should go here
-typedef struct {
+typedef struct HOST HOST;
+struct HOST {
 	const char
 		*host;
 	JOB
@@ -55,7 +56,13 @@ typedef struct {
 		port;
 	bool
 		blocked : 1; // host may be blocked after too many errors or even one final error
-} HOST;
+	HOST
+		*http2_via; // host whose HTTP/2 connection also serves this queue (connection coalescing)
+	bool
+		http2_session, // one downloader serves the queue through a shared HTTP/2 connection
+		http2_verified, // the owner of the connection of http2_via has checked that it is valid for this host
+		http2_refused; // an HTTP/2 connection to another host was not valid for this host, don't coalesce again
+};
 
 void host_init(void);
 void host_exit(void);
@@ -66,6 +73,7 @@ HOST *host_get(const wget_iri *iri) WGET_GCC_NONNULL((1));
 JOB *host_get_job(HOST *host, long long *pause);
 void host_add_job(HOST *host, const JOB *job) WGET_GCC_NONNULL((1,2));
 void host_add_robotstxt_job(HOST *host, const wget_iri *iri, const char *encoding, bool http_fallback) WGET_GCC_NONNULL((1,2));
+bool host_robots_allowed(const HOST *host, const wget_iri *iri) WGET_GCC_NONNULL((1,2));
 void host_release_jobs(HOST *host);
 void host_remove_job(HOST *host, JOB *job) WGET_GCC_NONNULL((1,2));
 void host_queue_free(HOST *host) WGET_GCC_NONNULL((1));
@@ -73,6 +81,11 @@ void hosts_free(void);
 void host_increase_failure(HOST *host) WGET_GCC_NONNULL((1));
 void host_final_failure(HOST *host) WGET_GCC_NONNULL((1));
 void host_reset_failure(HOST *host) WGET_GCC_NONNULL((1));
+bool host_claim_http2_session(HOST *host) WGET_GCC_NONNULL((1));
+void host_release_http2_session(HOST *host) WGET_GCC_NONNULL((1));
+bool host_has_http2_session(HOST *host) WGET_GCC_NONNULL((1));
+bool host_coalesce_http2_session(HOST *host, HOST *via) WGET_GCC_NONNULL((1,2));
+void host_verify_http2_session(HOST *host, bool valid) WGET_GCC_NONNULL((1));
 
 int queue_size(void) WGET_GCC_PURE;
 int queue_empty(void) WGET_GCC_PURE;
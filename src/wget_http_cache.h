@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Header file for the local HTTP cache index
+ *
+ */
+
+#ifndef SRC_WGET_HTTP_CACHE_H
+#define SRC_WGET_HTTP_CACHE_H
+
+#include <wget.h>
+
+// what we know about a downloaded file
+typedef struct {
+	const char *
+		url;
+	const char *
+		etag; // validator for If-None-Match
+	const char *
+		content_type;
+	const char *
+		content_type_encoding;
+	const char *
+		vary; // Vary header of the stored response
+	const char *
+		vary_key; // digest of the varied request header values, NULL if they change per request
+	const char *
+		location; // target of a permanent redirect, NULL for downloaded files
+	int64_t
+		fresh_until; // the file may be used without asking the server until then
+	int64_t
+		last_modified; // validator for If-Modified-Since
+	long long
+		size; // size of the local file, to detect local modifications, -1 for redirects
+} HTTP_CACHE_ENTRY;
+
+int http_cache_init(void);
+void http_cache_exit(void);
+HTTP_CACHE_ENTRY *http_cache_get(const char *url);
+void http_cache_free_entry(HTTP_CACHE_ENTRY **entry);
+char *http_cache_get_redirect(const char *url);
+void http_cache_store(const char *url, const wget_http_response *resp, const char *vary_key, long long size);
+void http_cache_store_redirect(const char *url, const wget_http_response *resp, const char *location);
+void http_cache_remove(const char *url);
+
+#endif /* SRC_WGET_HTTP_CACHE_H */
@@ -39,14 +39,23 @@ typedef struct {
 	off_t
 		position;
 	off_t
-		length;
+		length; // may shrink while downloading when another downloader steals the tail
+	off_t
+		downloaded; // number of bytes received so far
+	long long
+		start_ms, // time when the response started, used to measure the throughput
+		last_ms; // time when data has been received last
 	int
-		id;
+		id,
+		failures; // number of checksum failures
 	wget_thread_id
 		used_by;
+	// no bit fields, the flags are written by several downloaders, not all of them hold parts_mutex
 	bool
-		inuse : 1,
-		done : 1;
+		inuse,
+		done,
+		verified, // piece hash checked while downloading
+		corrupt; // piece hash mismatch detected while downloading
 } PART;
 
 typedef struct DOWNLOADER DOWNLOADER;
@@ -84,6 +93,20 @@ struct JOB {
 		*part; // current chunk to download
 	DOWNLOADER
 		*downloader;
+	struct parse_task
+		*parse_task; // body waiting for the parser pool
+
+	// Streaming hash of the complete (metalink) file, fed by the downloaded parts
+	wget_hash_hd
+		*file_hash;
+	wget_vector
+		*file_hash_pending; // parts downloaded ahead of 'file_hash_pos'
+	off_t
+		file_hash_pos; // the file has been hashed up to this position
+	int
+		file_hash_idx; // index into metalink->hashes
+	signed char
+		file_hash_result; // 0: unknown, 1: checksum ok, -1: checksum failed
 
 	wget_thread_id
 		used_by; // keep track of who uses this job, for host_release_jobs()
@@ -110,7 +133,9 @@ struct JOB {
 		ignore_patterns : 1, // Ignore accept/reject patterns
 		http_fallback : 1, // When true, we try again on error, using HTTP (instead of HTTPS)
 		recursive_send_head : 1, // Indicate whether the HEAD request is sent by the recursive mode
-		redirect_get : 1; // Indicate whether to use GET method for redirection request
+		redirect_get : 1, // Indicate whether to use GET method for redirection request
+		http_cache_revalidate : 1, // the request revalidates a stale file of the HTTP cache
+		body_streamed : 1; // the links of the body have been queued while downloading
 };
 
 struct DOWNLOADER {
@@ -118,8 +143,14 @@ struct DOWNLOADER {
 		thread;
 	JOB
 		*job;
+	PART
+		*part; // chunk this downloader is working on (job->part is just used for dequeuing)
 	wget_http_connection
 		*conn;
+	HOST
+		*http2_host; // host of the shared HTTP/2 session served by this downloader, see claim_http2_session()
+	wget_list
+		*contexts; // body callback contexts of the requests pending on 'conn', see http_send_request()
 	char
 		*buf;
 	size_t
@@ -130,9 +161,20 @@ struct DOWNLOADER {
 		cond;
 	bool
 		final_error : 1;
+	bool
+		whole_file; // the server answered the request for 'part' with the complete file
 };
 
+void job_module_init(void);
+void job_module_exit(void);
 JOB *job_init(JOB *job, blacklist_entry *blacklistp, bool http_fallback) WGET_GCC_NONNULL((2));
+wget_metalink_piece *job_get_piece(JOB *job, PART *part) WGET_GCC_NONNULL_ALL;
+PART *job_steal_part(JOB *job, long long *pause) WGET_GCC_NONNULL((1));
+void job_start_part(PART *part) WGET_GCC_NONNULL_ALL;
+size_t job_receive_part(PART *part, size_t length) WGET_GCC_NONNULL_ALL;
+bool job_part_done(JOB *job, PART *part) WGET_GCC_NONNULL_ALL;
+bool job_file_done(JOB *job, PART *part) WGET_GCC_NONNULL_ALL;
+void job_hash_part(JOB *job, PART *part, const char *data, size_t length) WGET_GCC_NONNULL((1,2));
 int job_validate_file(JOB *job) WGET_GCC_NONNULL((1));
 void job_create_parts(JOB *job) WGET_GCC_NONNULL((1));
 void job_free(JOB *job) WGET_GCC_NONNULL((1));
@@ -118,7 +118,11 @@ struct config {
 		*use_askpass_bin,
 		*hostname,
 		*dns_cache_preload,
-		*method;
+		*method,
+		*warc_file,
+		*dedup_dir,
+		*http_cache_file,
+		*robots_cache_file;
 	wget_vector
 		*compression,
 		*domains,
@@ -168,7 +172,8 @@ struct config {
 	long long
 		quota,
 		limit_rate, // bytes
-		start_pos; // bytes
+		start_pos, // bytes
+		warc_max_size; // bytes
 	int
 		http2_request_window,
 		backups,
@@ -183,7 +188,8 @@ struct config {
 		dns_timeout, // ms
 		read_timeout, // ms
 		max_redirect,
-		max_threads;
+		max_threads,
+		parser_threads; // -1: number of CPU cores
 	uint16_t
 		default_http_port,
 		default_https_port;
@@ -236,6 +242,7 @@ struct config {
 		inet4_only,
 		inet6_only,
 		delete_after,
+		decompress_offload,
 		strict_comments,
 		protocol_directories,
 		host_directories,
@@ -251,6 +258,7 @@ struct config {
 		cookies,
 		spider,
 		dns_caching,
+		alt_svc,
 		download_attr,
 		check_certificate,
 		check_hostname,
@@ -280,7 +288,9 @@ struct config {
 		ocsp_nonce,
 		recursive,
 		tls_false_start,
-		tcp_fastopen;
+		tcp_fastopen,
+		warc_cdx,
+		warc_compression;
 };
 
 extern struct config
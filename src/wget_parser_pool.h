@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Header file for the parser thread pool
+ *
+ */
+
+#ifndef SRC_WGET_PARSER_POOL_H
+#define SRC_WGET_PARSER_POOL_H
+
+#include <stdbool.h>
+
+typedef void parser_pool_task_fn(void *task);
+
+int parser_pool_init(int n, parser_pool_task_fn *run, parser_pool_task_fn *discard);
+void parser_pool_exit(void);
+bool parser_pool_submit(void *task);
+
+#endif /* SRC_WGET_PARSER_POOL_H */
@@ -98,6 +98,9 @@ void plugin_db_forward_url_verdict_free(struct plugin_db_forward_url_verdict *ve
 int plugin_db_forward_downloaded_file(const wget_iri *iri, int64_t size, const char *filename, const void *data,
 		wget_vector *recurse_iris);
 
+// Returns 1 if any plugin wants to see the downloaded files
+int plugin_db_has_post_processor(void);
+
 // Sends 'finalize' signal to all plugins and unloads all plugins
 void plugin_db_finalize(int exitcode);
 
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Header file for the persistent robots.txt cache
+ *
+ */
+
+#ifndef SRC_WGET_ROBOTS_CACHE_H
+#define SRC_WGET_ROBOTS_CACHE_H
+
+#include <wget.h>
+
+int robots_cache_init(void);
+void robots_cache_exit(void);
+char *robots_cache_get(const char *url);
+void robots_cache_store(const char *url, const wget_http_response *resp);
+
+#endif /* SRC_WGET_ROBOTS_CACHE_H */
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Header file for the precompiled URL filters
+ *
+ */
+
+#ifndef SRC_WGET_URL_FILTER_H
+#define SRC_WGET_URL_FILTER_H
+
+#include <stdbool.h>
+
+int url_filter_init(void);
+void url_filter_exit(void);
+bool url_filter_accepted(const char *s);
+bool url_filter_rejected(const char *s);
+bool url_filter_directory_excluded(const char *path);
+bool url_filter_in_domains(const char *host);
+bool url_filter_in_exclude_domains(const char *host);
+void url_filter_add_domain(const char *host);
+
+#endif /* SRC_WGET_URL_FILTER_H */
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Header file for WARC output routines
+ *
+ */
+
+#ifndef SRC_WGET_WARC_H
+#define SRC_WGET_WARC_H
+
+#include <wget.h>
+
+typedef struct warc_record_st warc_record;
+
+int warc_init(void);
+void warc_exit(void);
+warc_record *warc_record_alloc(wget_http_request *req);
+void warc_record_append(warc_record *record, const char *data, size_t length);
+void warc_record_write(warc_record **record, wget_http_response *resp, const char *uri);
+void warc_record_free(warc_record **record);
+
+#endif /* SRC_WGET_WARC_H */
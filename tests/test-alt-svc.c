@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h> // exit()
+#include "libtest.h"
+
+/* test for --alt-svc: use an alternative service and fall back to the origin if it fails */
+
+int main(void)
+{
+	wget_test_url_t urls[]={
+		{	.name = "/index1.html",
+			.code = "200 Dontcare",
+			.body = "<html><a href=\"page1.html\">page1</a></html>",
+			.headers = {
+				"Content-Type: text/html",
+				// the plain HTTP server doesn't speak TLS
+				"Alt-Svc: h2=\":{{port}}\", http%2F1.1=\":{{port}}\"; ma=60",
+			},
+			.https_only = 1
+		},
+		{	.name = "/index2.html",
+			.code = "200 Dontcare",
+			.body = "<html><a href=\"page2.html\">page2</a></html>",
+			.headers = {
+				"Content-Type: text/html",
+				// same server under another name, the certificate is checked against the origin
+				"Alt-Svc: http%2F1.1=\"127.0.0.1:{{sslport}}\"; ma=60",
+			},
+			.https_only = 1
+		},
+		{	.name = "/page1.html",
+			.code = "200 Dontcare",
+			.body = "<html>hello1</html>",
+			.headers = {
+				"Content-Type: text/html",
+			},
+			.https_only = 1
+		},
+		{	.name = "/page2.html",
+			.code = "200 Dontcare",
+			.body = "<html>hello2</html>",
+			.headers = {
+				"Content-Type: text/html",
+			},
+			.https_only = 1
+		},
+	};
+
+	// functions won't come back if an error occurs
+	wget_test_start_server(
+		WGET_TEST_RESPONSE_URLS, &urls, countof(urls),
+		WGET_TEST_FEATURE_MHD,
+		WGET_TEST_FEATURE_TLS,
+		0);
+
+	// the alternative fails, page1.html is loaded from the origin
+	wget_test(
+		// WGET_TEST_KEEP_TMPFILES, 1,
+		WGET_TEST_OPTIONS, "--ca-certificate=" SRCDIR "/certs/x509-ca-cert.pem --no-ocsp --alt-svc --no-http-keep-alive -r -nH",
+		WGET_TEST_REQUEST_URL, "https://localhost:{{sslport}}/index1.html",
+		WGET_TEST_EXPECTED_ERROR_CODE, 0,
+		WGET_TEST_EXPECTED_FILES, &(wget_test_file_t []) {
+			{ urls[0].name + 1, urls[0].body },
+			{ urls[2].name + 1, urls[2].body },
+			{	NULL } },
+		0);
+
+	// page2.html is loaded from the alternative
+	wget_test(
+		// WGET_TEST_KEEP_TMPFILES, 1,
+		WGET_TEST_OPTIONS, "--ca-certificate=" SRCDIR "/certs/x509-ca-cert.pem --no-ocsp --alt-svc --no-http-keep-alive -r -nH",
+		WGET_TEST_REQUEST_URL, "https://localhost:{{sslport}}/index2.html",
+		WGET_TEST_EXPECTED_ERROR_CODE, 0,
+		WGET_TEST_EXPECTED_FILES, &(wget_test_file_t []) {
+			{ urls[1].name + 1, urls[1].body },
+			{ urls[3].name + 1, urls[3].body },
+			{	NULL } },
+		0);
+
+	exit(EXIT_SUCCESS);
+}
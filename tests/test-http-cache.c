@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h> // exit()
+#include "libtest.h"
+
+/* test for --http-cache-file: fresh files are not requested, stale files are revalidated */
+
+// Fri, 09 Oct 2004 08:30:00 GMT
+#define LAST_MODIFIED 1097310600
+// Fri, 01 Jan 2100 00:00:00 GMT
+#define FRESH_UNTIL 4102444800
+
+int main(void)
+{
+	wget_test_url_t urls[]={
+		{	.name = "/fresh.html",
+			.code = "200 Dontcare",
+			.body = "<html>new</html>",
+			.headers = {
+				"Content-Type: text/html",
+			}
+		},
+		{	.name = "/stale.html",
+			.code = "200 Dontcare",
+			.body = "<html>new</html>",
+			.headers = {
+				"Content-Type: text/html",
+				"Cache-Control: max-age=3600",
+			},
+			.expected_req_headers = {
+				"If-None-Match: \"v1\"",
+			},
+			.modified = LAST_MODIFIED // the server answers with 304
+		},
+		{	.name = "/vary.html",
+			.code = "200 Dontcare",
+			.body = "<html>new</html>",
+			.headers = {
+				"Content-Type: text/html",
+				"Vary: X-Test",
+			}
+		},
+	};
+	char cache[3][256], key[65];
+
+	// cache entries as written by wget2, see src/http_cache.c
+	wget_snprintf(cache[0], sizeof(cache[0]),
+		"http://localhost:{{port}}/fresh.html %lld %d 6 \"v1\" text/html - - - -\n",
+		(long long) FRESH_UNTIL, LAST_MODIFIED);
+	wget_snprintf(cache[1], sizeof(cache[1]),
+		"http://localhost:{{port}}/stale.html 1 %d 6 \"v1\" text/html - - - -\n",
+		LAST_MODIFIED);
+	wget_hash_printf_hex(WGET_DIGTYPE_SHA256, key, sizeof(key), "X-Test: a\n");
+	wget_snprintf(cache[2], sizeof(cache[2]),
+		"http://localhost:{{port}}/vary.html %lld %d 6 \"v1\" text/html - X-Test %s -\n",
+		(long long) FRESH_UNTIL, LAST_MODIFIED, key);
+
+	// functions won't come back if an error occurs
+	wget_test_start_server(
+		WGET_TEST_RESPONSE_URLS, &urls, countof(urls),
+		WGET_TEST_FEATURE_MHD,
+		0);
+
+	// a fresh file is not requested again
+	wget_test(
+		// WGET_TEST_KEEP_TMPFILES, 1,
+		WGET_TEST_OPTIONS, "--http-cache-file=cache.txt",
+		WGET_TEST_REQUEST_URL, urls[0].name + 1,
+		WGET_TEST_EXPECTED_ERROR_CODE, 0,
+		WGET_TEST_EXISTING_FILES, &(wget_test_file_t []) {
+			{ urls[0].name + 1, "cached" },
+			{ "cache.txt", cache[0] },
+			{	NULL } },
+		WGET_TEST_EXPECTED_FILES, &(wget_test_file_t []) {
+			{ urls[0].name + 1, "cached" },
+			{ "cache.txt", NULL },
+			{	NULL } },
+		0);
+
+	// --no-cache asks the server
+	wget_test(
+		// WGET_TEST_KEEP_TMPFILES, 1,
+		WGET_TEST_OPTIONS, "--http-cache-file=cache.txt --no-cache",
+		WGET_TEST_REQUEST_URL, urls[0].name + 1,
+		WGET_TEST_EXPECTED_ERROR_CODE, 0,
+		WGET_TEST_EXISTING_FILES, &(wget_test_file_t []) {
+			{ urls[0].name + 1, "cached" },
+			{ "cache.txt", cache[0] },
+			{	NULL } },
+		WGET_TEST_EXPECTED_FILES, &(wget_test_file_t []) {
+			{ urls[0].name + 1, urls[0].body },
+			{ "cache.txt", NULL },
+			{	NULL } },
+		0);
+
+	// a stale file is revalidated with a conditional request, the 304 keeps the local file
+	wget_test(
+		// WGET_TEST_KEEP_TMPFILES, 1,
+		WGET_TEST_OPTIONS, "--http-cache-file=cache.txt",
+		WGET_TEST_REQUEST_URL, urls[1].name + 1,
+		WGET_TEST_EXPECTED_ERROR_CODE, 0,
+		WGET_TEST_EXISTING_FILES, &(wget_test_file_t []) {
+			{ urls[1].name + 1, "cached" },
+			{ "cache.txt", cache[1] },
+			{	NULL } },
+		WGET_TEST_EXPECTED_FILES, &(wget_test_file_t []) {
+			{ urls[1].name + 1, "cached" },
+			{ "cache.txt", NULL },
+			{	NULL } },
+		0);
+
+	// the same varied request header values use the entry
+	wget_test(
+		// WGET_TEST_KEEP_TMPFILES, 1,
+		WGET_TEST_OPTIONS, "--http-cache-file=cache.txt --header=\"X-Test: a\"",
+		WGET_TEST_REQUEST_URL, urls[2].name + 1,
+		WGET_TEST_EXPECTED_ERROR_CODE, 0,
+		WGET_TEST_EXISTING_FILES, &(wget_test_file_t []) {
+			{ urls[2].name + 1, "cached" },
+			{ "cache.txt", cache[2] },
+			{	NULL } },
+		WGET_TEST_EXPECTED_FILES, &(wget_test_file_t []) {
+			{ urls[2].name + 1, "cached" },
+			{ "cache.txt", NULL },
+			{	NULL } },
+		0);
+
+	// other varied request header values don't
+	wget_test(
+		// WGET_TEST_KEEP_TMPFILES, 1,
+		WGET_TEST_OPTIONS, "--http-cache-file=cache.txt --header=\"X-Test: b\"",
+		WGET_TEST_REQUEST_URL, urls[2].name + 1,
+		WGET_TEST_EXPECTED_ERROR_CODE, 0,
+		WGET_TEST_EXISTING_FILES, &(wget_test_file_t []) {
+			{ urls[2].name + 1, "cached" },
+			{ "cache.txt", cache[2] },
+			{	NULL } },
+		WGET_TEST_EXPECTED_FILES, &(wget_test_file_t []) {
+			{ urls[2].name + 1, urls[2].body },
+			{ "cache.txt", NULL },
+			{	NULL } },
+		0);
+
+	exit(EXIT_SUCCESS);
+}
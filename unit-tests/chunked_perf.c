@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * testing performance of the chunked transfer-encoding decoder
+ *
+ * Usage: chunked_perf [chunk-size...]
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wget.h>
+
+#define INPUT_SIZE (64 * 1024 * 1024)
+#define READ_SIZE  102400 // size of the connection buffer
+
+static void perf_chunk_size(size_t chunk_size)
+{
+	wget_buffer *input = wget_buffer_alloc(INPUT_SIZE + 1024);
+	char *chunk = wget_malloc(chunk_size);
+	size_t decoded = 0, slices = 0;
+
+	memset(chunk, 'x', chunk_size);
+
+	while (input->length < INPUT_SIZE) {
+		wget_buffer_printf_append(input, "%zx\r\n", chunk_size);
+		wget_buffer_memcat(input, chunk, chunk_size);
+		wget_buffer_memcat(input, "\r\n", 2);
+	}
+	wget_buffer_strcat(input, "0\r\n\r\n");
+
+	wget_http_chunked_decoder *decoder = wget_http_chunked_decoder_alloc();
+	long long start = wget_get_timemillis();
+
+	for (size_t pos = 0; pos < input->length && !wget_http_chunked_decoder_done(decoder); pos += READ_SIZE) {
+		size_t n = input->length - pos < READ_SIZE ? input->length - pos : READ_SIZE, consumed, body_length;
+		const char *body;
+
+		for (const char *p = input->data + pos; n > 0; p += consumed, n -= consumed) {
+			if (wget_http_chunked_decode(decoder, p, n, &consumed, &body, &body_length)) {
+				wget_fprintf(stderr, "Failed to decode\n");
+				exit(EXIT_FAILURE);
+			}
+			if (body_length) {
+				decoded += body_length;
+				slices++;
+			}
+		}
+	}
+
+	long long ms = wget_get_timemillis() - start;
+
+	printf("chunk size %8zu: %zu MB input, %zu MB body, %zu slices in %lld ms",
+		chunk_size, input->length >> 20, decoded >> 20, slices, ms);
+	if (ms > 0)
+		printf(" (%lld MB/s)", (long long) (input->length / 1000 / ms));
+	printf("\n");
+
+	wget_http_chunked_decoder_free(&decoder);
+	wget_buffer_free(&input);
+	wget_xfree(chunk);
+}
+
+int main(int argc, const char *const *argv)
+{
+	static const size_t chunk_sizes[] = { 1, 16, 256, 4096, 65536, 1048576, 16777216 };
+
+	if (argc > 1) {
+		for (int it = 1; it < argc; it++)
+			perf_chunk_size((size_t) atoll(argv[it]));
+	} else {
+		for (unsigned it = 0; it < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); it++)
+			perf_chunk_size(chunk_sizes[it]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * testing performance of the CSS URL scanner
+ *
+ * Usage: css_parse_perf [-n rounds] file...
+ * e.g.   css_parse_perf -n 1000 files/main.css
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wget.h>
+
+typedef struct {
+	char *
+		data;
+	size_t
+		size;
+} css_file;
+
+static void count_uri(void *ctx, WGET_GCC_UNUSED const char *url, WGET_GCC_UNUSED size_t len, WGET_GCC_UNUSED size_t pos)
+{
+	(*(long long *) ctx)++;
+}
+
+int main(int argc, const char *const *argv)
+{
+	int it, rounds = 100, nfiles = 0, first = 1;
+	long long nbytes = 0, nurls = 0;
+	css_file *files = wget_calloc(argc, sizeof(css_file));
+
+	if (argc > 2 && !strcmp(argv[1], "-n")) {
+		rounds = atoi(argv[2]);
+		first = 3;
+	}
+
+	for (it = first; it < argc; it++) {
+		css_file *f = &files[nfiles];
+
+		if (!(f->data = wget_read_file(argv[it], &f->size))) {
+			wget_fprintf(stderr, "Failed to read %s\n", argv[it]);
+			continue;
+		}
+
+		nbytes += f->size;
+		nfiles++;
+	}
+
+	long long start = wget_get_timemillis();
+
+	for (int round = 0; round < rounds; round++) {
+		for (it = 0; it < nfiles; it++)
+			wget_css_parse_buffer(files[it].data, files[it].size, count_uri, NULL, &nurls);
+	}
+
+	long long ms = wget_get_timemillis() - start;
+
+	printf("parsed %lld bytes with %lld URLs from %d files in %lld ms",
+		nbytes * rounds, nurls, nfiles, ms);
+	if (ms > 0)
+		printf(" (%.1f MB/s)", (double) nbytes * rounds / ms / 1000);
+	printf("\n");
+
+	for (it = 0; it < nfiles; it++)
+		wget_xfree(files[it].data);
+	wget_xfree(files);
+
+	return 0;
+}
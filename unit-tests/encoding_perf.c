@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * testing performance of the charset conversions
+ *
+ * Usage: encoding_perf [-n rounds]
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wget.h>
+
+#define countof(a) (sizeof(a)/sizeof(*(a)))
+
+// URL parts as they are converted while parsing the links of a non-UTF-8 page
+static const struct {
+	const char *
+		encoding;
+	const char *
+		s;
+} urls[] = {
+	{ "iso-8859-1", "/produkte/k\xFC" "chen/m\xF6" "bel.html" },
+	{ "iso-8859-1", "/search?q=stra\xDF" "e" },
+	{ "windows-1252", "/news/2020/\x93quoted\x94-title.html" },
+	{ "windows-1252", "/caf\xE9/menu.html" },
+	{ "SHIFT_JIS", "/\x93\xFA\x96\x7B/index.html" },
+	{ "koi8-r", "/\xD2\xC5\xC3\xC5\xD0\xD4\xD9/" },
+};
+
+static const char *ascii_urls[] = {
+	"https://www.example.com/path/to/a/document.html",
+	"/static/css/main.css?v=1234567890",
+	"images/logo.png",
+	"https://cdn.example.com/assets/js/vendor/library-with-a-long-name.min.js",
+};
+
+int main(int argc, const char *const *argv)
+{
+	int rounds = 100000;
+	long long start, ms, nbytes = 0;
+	unsigned it;
+
+	if (argc > 2 && !strcmp(argv[1], "-n"))
+		rounds = atoi(argv[2]);
+
+	start = wget_get_timemillis();
+	for (int round = 0; round < rounds; round++) {
+		for (it = 0; it < countof(urls); it++) {
+			char *utf8;
+
+			if (wget_memiconv(urls[it].encoding, urls[it].s, strlen(urls[it].s), "utf-8", &utf8, NULL) == 0)
+				wget_xfree(utf8);
+		}
+	}
+	ms = wget_get_timemillis() - start;
+	printf("converted %lld URL parts in %lld ms\n", (long long) rounds * countof(urls), ms);
+
+	start = wget_get_timemillis();
+	for (int round = 0; round < rounds * 10; round++) {
+		for (it = 0; it < countof(ascii_urls); it++)
+			nbytes += wget_str_needs_encoding(ascii_urls[it]) + wget_str_is_valid_utf8(ascii_urls[it]);
+	}
+	ms = wget_get_timemillis() - start;
+	printf("checked %lld ASCII URLs in %lld ms\n", nbytes / 2, ms);
+
+	// a Latin-1 document of 1 MB
+	size_t size = 1024 * 1024;
+	char *doc = wget_malloc(size);
+
+	for (size_t pos = 0; pos < size; pos++)
+		doc[pos] = pos % 64 == 63 ? '\n' : pos % 16 == 7 ? (char) 0xE4 : (char) ('a' + pos % 26);
+
+	nbytes = 0;
+	start = wget_get_timemillis();
+	for (int round = 0; round < rounds / 1000 + 1; round++) {
+		char *utf8;
+		size_t n;
+
+		if (wget_memiconv("iso-8859-1", doc, size, "utf-8", &utf8, &n) == 0) {
+			nbytes += size;
+			wget_xfree(utf8);
+		}
+	}
+	ms = wget_get_timemillis() - start;
+	printf("converted %lld bytes of Latin-1 in %lld ms", nbytes, ms);
+	if (ms > 0)
+		printf(" (%.1f MB/s)", (double) nbytes / ms / 1000);
+	printf("\n");
+
+	// the same document with some UTF-8 characters
+	for (size_t pos = 0; pos < size - 1; pos++)
+		doc[pos] = pos % 1024 == 1000 ? (char) 0xC3 : pos % 1024 == 1001 ? (char) 0xA4 : (char) ('a' + pos % 26);
+	doc[size - 1] = 0;
+
+	nbytes = 0;
+	start = wget_get_timemillis();
+	for (int round = 0; round < rounds / 100 + 1; round++) {
+		doc[round % 1000] = 'a' + round % 26; // keep the compiler from hoisting the pure function call
+		nbytes += wget_str_is_valid_utf8(doc) ? size : 0;
+	}
+	ms = wget_get_timemillis() - start;
+	printf("validated %lld bytes of UTF-8 in %lld ms", nbytes, ms);
+	if (ms > 0)
+		printf(" (%.1f MB/s)", (double) nbytes / ms / 1000);
+	printf("\n");
+
+	wget_xfree(doc);
+
+	return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * testing performance of the HTML URL extraction
+ *
+ * Usage: html_parse_perf [-n rounds] file...
+ * e.g.   html_parse_perf -n 1000 ../fuzz/libwget_html_url_fuzzer.in/*
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wget.h>
+
+int main(int argc, const char *const *argv)
+{
+	int it, rounds = 100, nfiles = 0, first = 1;
+	long long nbytes = 0, nurls = 0;
+	wget_vector *files = wget_vector_create(64, NULL);
+
+	if (argc > 2 && !strcmp(argv[1], "-n")) {
+		rounds = atoi(argv[2]);
+		first = 3;
+	}
+
+	for (it = first; it < argc; it++) {
+		char *buf;
+		size_t size;
+
+		if (!(buf = wget_read_file(argv[it], &size))) {
+			wget_fprintf(stderr, "Failed to read %s\n", argv[it]);
+			continue;
+		}
+
+		wget_vector_add(files, buf);
+		nbytes += strlen(buf); // the parser stops at the first 0 byte
+		nfiles++;
+	}
+
+	long long start = wget_get_timemillis();
+
+	for (int round = 0; round < rounds; round++) {
+		for (it = 0; it < nfiles; it++) {
+			wget_html_parsed_result *res = wget_html_get_urls_inline(wget_vector_get(files, it), NULL, NULL);
+
+			nurls += wget_vector_size(res->uris);
+			wget_html_free_urls_inline(&res);
+		}
+	}
+
+	long long ms = wget_get_timemillis() - start;
+
+	printf("parsed %lld bytes with %lld URLs from %d files in %lld ms",
+		nbytes * rounds, nurls, nfiles, ms);
+	if (ms > 0)
+		printf(" (%.1f MB/s)", (double) nbytes * rounds / ms / 1000);
+	printf("\n");
+
+	wget_vector_free(&files);
+
+	return 0;
+}
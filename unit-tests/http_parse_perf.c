@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * testing performance of the HTTP response header parser
+ *
+ * Usage: http_parse_perf [-n rounds] file...
+ * e.g.   http_parse_perf -n 1000 ../fuzz/libwget_http_parse_fuzzer.in/*
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <wget.h>
+
+int main(int argc, const char *const *argv)
+{
+	int fd, it, rounds = 100, nfiles = 0, first = 1;
+	long long nresponses = 0, nheaders = 0;
+	struct stat st;
+	wget_vector *files = wget_vector_create(64, NULL);
+
+	if (argc > 2 && !strcmp(argv[1], "-n")) {
+		rounds = atoi(argv[2]);
+		first = 3;
+	}
+
+	for (it = first; it < argc; it++) {
+		char *buf;
+
+		if ((fd = open(argv[it], O_RDONLY | O_BINARY)) == -1) {
+			wget_fprintf(stderr, "Failed to read open %s\n", argv[it]);
+			continue;
+		}
+
+		if (fstat(fd, &st) || !(buf = wget_malloc(st.st_size + 1))
+			|| read(fd, buf, st.st_size) != (ssize_t) st.st_size)
+		{
+			wget_fprintf(stderr, "Failed to read %s\n", argv[it]);
+			close(fd);
+			continue;
+		}
+
+		buf[st.st_size] = 0;
+		wget_vector_add(files, buf);
+		close(fd);
+		nfiles++;
+	}
+
+	long long start = wget_get_timemillis();
+
+	for (int round = 0; round < rounds; round++) {
+		for (it = 0; it < nfiles; it++) {
+			const char *data = wget_vector_get(files, it);
+			char *copy = wget_strdup(data); // the parser modifies its input
+			wget_http_response *resp = wget_http_parse_response_header(copy);
+
+			if (resp) {
+				for (const char *p = data; (p = strchr(p, '\n')); p++)
+					nheaders++;
+				nresponses++;
+				wget_http_free_response(&resp);
+			}
+
+			wget_xfree(copy);
+		}
+	}
+
+	long long ms = wget_get_timemillis() - start;
+
+	printf("parsed %lld responses with %lld header lines from %d files in %lld ms",
+		nresponses, nheaders, nfiles, ms);
+	if (ms > 0)
+		printf(" (%lld headers/s)", nheaders * 1000 / ms);
+	printf("\n");
+
+	wget_vector_free(&files);
+
+	return 0;
+}
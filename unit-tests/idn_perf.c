@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of Wget.
+ *
+ * Wget is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Wget is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Wget.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * testing performance of parsing links with internationalized hostnames
+ *
+ * Usage: idn_perf [-n rounds]
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wget.h>
+
+#define countof(a) (sizeof(a)/sizeof(*(a)))
+
+// links as found on the pages of a few IDN sites, most of them pointing to the same hosts
+static const char *hosts[] = {
+	"bücher.example",
+	"www.bücher.example",
+	"straße.example.de",
+	"müller-bäckerei.example",
+	"räksmörgås.example.se",
+	"пример.испытание",
+	"例え.テスト",
+	"碼標準萬國碼.com",
+	"παράδειγμα.δοκιμή",
+	"www.example.com", // an ASCII host in between
+};
+
+static const char *paths[] = {
+	"/",
+	"/index.html",
+	"/katalog/neu?seite=2",
+	"/img/logo.png",
+	"/css/main.css",
+	"/über-uns.html",
+};
+
+int main(int argc, const char *const *argv)
+{
+	int rounds = 20000;
+	long long start, ms, nlinks = 0;
+	char url[256];
+
+	if (argc > 2 && !strcmp(argv[1], "-n"))
+		rounds = atoi(argv[2]);
+
+	start = wget_get_timemillis();
+	for (int round = 0; round < rounds; round++) {
+		for (unsigned it = 0; it < countof(hosts); it++) {
+			for (unsigned it2 = 0; it2 < countof(paths); it2++) {
+				wget_iri *iri;
+
+				wget_snprintf(url, sizeof(url), "https://%s%s", hosts[it], paths[it2]);
+				if ((iri = wget_iri_parse(url, "utf-8"))) {
+					nlinks++;
+					wget_iri_free(&iri);
+				}
+			}
+		}
+	}
+	ms = wget_get_timemillis() - start;
+	printf("parsed %lld links in %lld ms\n", nlinks, ms);
+
+	// distinct hosts, each of them converted once
+	nlinks = 0;
+	start = wget_get_timemillis();
+	for (int n = 0; n < rounds; n++) {
+		const char *s;
+
+		wget_snprintf(url, sizeof(url), "host%d.bücher.example", n);
+		if ((s = wget_str_to_ascii(url)) != url) {
+			nlinks++;
+			wget_xfree(s);
+		}
+	}
+	ms = wget_get_timemillis() - start;
+	printf("converted %lld distinct hosts in %lld ms\n", nlinks, ms);
+
+	return 0;
+}
@@ -21,6 +21,10 @@
 #include <unistd.h>
 #include <string.h>
 
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
 #include <wget.h>
 
 #define uncompressed_body "x"
@@ -90,6 +94,80 @@ static int get_decompressed(void *userdata, const char *data, size_t length)
 
 #include "../libwget/private.h"
 
+#ifdef WITH_ZLIB
+// data that spans several output buffers, fed in small pieces
+static void test_large(bool offload)
+{
+	size_t plain_len = 3 * 1024 * 1024 + 17;
+	char *plain_data = wget_malloc(plain_len);
+	uLongf compressed_len = compressBound((uLong) plain_len);
+	unsigned char *compressed = wget_malloc(compressed_len);
+	wget_buffer plain;
+	wget_decompressor *dc;
+
+	for (size_t it = 0; it < plain_len; it++)
+		plain_data[it] = (char) ('a' + (it * 7 + it / 1000) % 26);
+
+	CHECK(compress2(compressed, &compressed_len, (unsigned char *) plain_data, (uLong) plain_len, 9) == Z_OK);
+
+	wget_buffer_init(&plain, NULL, plain_len);
+
+	CHECK((dc = wget_decompress_open(wget_content_encoding_deflate, get_decompressed, &plain)));
+
+	if (dc) {
+		CHECK(wget_decompress_set_offload(dc, offload) == WGET_E_SUCCESS || !wget_thread_support());
+
+		for (size_t pos = 0; pos < compressed_len; pos += 1000)
+			wget_decompress(dc, (char *) compressed + pos, compressed_len - pos < 1000 ? compressed_len - pos : 1000);
+		wget_decompress_close(dc);
+
+		CHECK(plain.length == plain_len);
+		CHECK(plain.length == plain_len && memcmp(plain.data, plain_data, plain_len) == 0);
+	}
+
+	wget_buffer_deinit(&plain);
+	wget_xfree(compressed);
+	wget_xfree(plain_data);
+}
+
+// more offloaded decompressors than worker threads, fed interleaved
+static void test_shared_workers(void)
+{
+	enum { NDC = 10 };
+	size_t plain_len = 256 * 1024;
+	char *plain_data = wget_malloc(plain_len);
+	uLongf compressed_len = compressBound((uLong) plain_len);
+	unsigned char *compressed = wget_malloc(compressed_len);
+	wget_buffer plain[NDC];
+	wget_decompressor *dc[NDC];
+
+	for (size_t it = 0; it < plain_len; it++)
+		plain_data[it] = (char) ('a' + (it * 13 + it / 500) % 26);
+
+	CHECK(compress2(compressed, &compressed_len, (unsigned char *) plain_data, (uLong) plain_len, 9) == Z_OK);
+
+	for (int it = 0; it < NDC; it++) {
+		wget_buffer_init(&plain[it], NULL, plain_len);
+		dc[it] = wget_decompress_open(wget_content_encoding_deflate, get_decompressed, &plain[it]);
+		wget_decompress_set_offload(dc[it], true);
+	}
+
+	for (size_t pos = 0; pos < compressed_len; pos += 100) {
+		for (int it = 0; it < NDC; it++)
+			wget_decompress(dc[it], (char *) compressed + pos, compressed_len - pos < 100 ? compressed_len - pos : 100);
+	}
+
+	for (int it = 0; it < NDC; it++) {
+		wget_decompress_close(dc[it]);
+		CHECK(plain[it].length == plain_len && memcmp(plain[it].data, plain_data, plain_len) == 0);
+		wget_buffer_deinit(&plain[it]);
+	}
+
+	wget_xfree(compressed);
+	wget_xfree(plain_data);
+}
+#endif
+
 int main(WGET_GCC_UNUSED int argc, const char **argv)
 {
 	// if VALGRIND testing is enabled, we have to call ourselves with valgrind checking
@@ -135,9 +213,30 @@ int main(WGET_GCC_UNUSED int argc, const char **argv)
 			CHECK(plain.length == sizeof(uncompressed_body) - 1);
 			CHECK(memcmp(plain.data, uncompressed_body, sizeof(uncompressed_body) - 1) == 0);
 		}
+
+		// byte by byte in a worker thread
+		wget_buffer_reset(&plain);
+		CHECK((dc = wget_decompress_open(content_encoding, get_decompressed, &plain)));
+
+		if (dc) {
+			wget_decompress_set_offload(dc, true);
+			for (size_t pos = 0; pos < t->body_len; pos++)
+				wget_decompress(dc, t->body + pos, 1);
+			wget_decompress_close(dc);
+
+			CHECK(plain.length == sizeof(uncompressed_body) - 1);
+			CHECK(memcmp(plain.data, uncompressed_body, sizeof(uncompressed_body) - 1) == 0);
+		}
 	}
 
+#ifdef WITH_ZLIB
+	test_large(false);
+	test_large(true);
+	test_shared_workers();
+#endif
+
 	wget_buffer_deinit(&plain);
+	wget_decompress_exit();
 
 	if (failed) {
 		wget_info_printf("Summary: %d out of %d tests failed\n", failed, ok + failed);
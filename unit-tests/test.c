@@ -36,15 +36,23 @@
 #include <dirent.h>
 #include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <c-ctype.h>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
 
 #include <wget.h>
 #include "../libwget/private.h"
 
 #include "../src/wget_options.h"
 #include "../src/wget_log.h"
+#include "../src/wget_url_filter.h"
+#include "../src/wget_warc.h"
+#include "../src/wget_dedup.h"
+#include "../src/wget_http_cache.h"
 
 static int
 	ok,
@@ -1077,6 +1085,391 @@ static void test_parser(void)
 	info_printf("%d XML, %d HTML and %d CSS files parsed\n", xml, html, css);
 }
 
+// print the URLs of a parse result, for comparing whole and incremental parsing
+static void html_urls_append(wget_buffer *buf, const wget_html_parsed_result *res)
+{
+	for (int it = 0; it < wget_vector_size(res->uris); it++) {
+		wget_html_parsed_url *url = wget_vector_get(res->uris, it);
+
+		wget_buffer_printf_append(buf, "%s/%s %.*s %.*s\n", url->tag, url->attr,
+			(int) url->url.len, url->url.p, (int) url->download.len, url->download.p ? url->download.p : "");
+	}
+}
+
+// append the URLs of an incremental parse result, returns false if the head was not parsed at once
+static bool html_urls_append_batch(wget_buffer *buf, const wget_html_parsed_result *res, int *batches, int *bases, const char **encoding)
+{
+	if (!res)
+		return true;
+
+	if (!(*batches)++ && (!res->base.p || wget_vector_size(res->uris) < 2))
+		return false;
+
+	html_urls_append(buf, res);
+	*bases += res->base.p != NULL;
+	*encoding = res->encoding;
+
+	return true;
+}
+
+static void test_html_url_parser(void)
+{
+	static const char html[] =
+		"<!DOCTYPE html>\n"
+		"<html><head><meta charset=\"iso-8859-1\">\n"
+		"<base href=\"http://example.com/dir/\">\n"
+		"<link rel=\"stylesheet\" href=\"s.css\"><link href=\"x.ico\" rel=\"shortcut icon\">\n"
+		"<script>var s = \"</scr\" + \"ipt>\"; if (a < b) x = \"<a href='no.html'>\";\n"
+		"<!-- document.write(\"</script>\") --></script>\n"
+		"<!-- <a href=\"comment.html\"> -->\n"
+		"</head><body background='body.png'>\n"
+		"<a href = \"a1.html\" download=\"file name\">x</a>\n"
+		"<a download='d2' href=\"a2.html\">y</a>\n"
+		"<img src=\"i1.png\" srcset=\"i2.png 1x, i3.png 2x\" alt=\"a > b\">\n"
+		"<area href=area.html><td width=100>cell</td><a href=\"x.html\">\n"
+		"<![CDATA[ <a href=\"cdata.html\"> ]]><?pi <a href=\"pi.html\"> ?>\n"
+		"<SCRIPT src=\"js.js\"></SCRIPT   ><a href='last.html'>end";
+	size_t len = sizeof(html) - 1;
+	wget_buffer expected, buf;
+	wget_html_parsed_result *res;
+
+	wget_buffer_init(&expected, NULL, 0);
+	wget_buffer_init(&buf, NULL, 0);
+
+	res = wget_html_get_urls_inline(html, NULL, NULL);
+	html_urls_append(&expected, res);
+	wget_html_free_urls_inline(&res);
+
+	for (size_t chunk = 1; chunk <= len; chunk = chunk * 2 + 1) {
+		wget_html_url_parser *parser = wget_html_url_parser_init(NULL, NULL);
+		const char *encoding = NULL;
+		int batches = 0, bases = 0;
+
+		wget_buffer_reset(&buf);
+
+		bool head_complete = true;
+
+		for (size_t pos = 0; pos < len && head_complete; pos += chunk) {
+			res = wget_html_url_parser_feed(parser, html + pos, pos + chunk < len ? chunk : len - pos);
+			head_complete = html_urls_append_batch(&buf, res, &batches, &bases, &encoding);
+		}
+
+		if (head_complete)
+			html_urls_append_batch(&buf, wget_html_url_parser_finish(parser), &batches, &bases, &encoding);
+
+		if (!strcmp(buf.data, expected.data) && bases == 1 && !wget_strcmp(encoding, "iso-8859-1")
+			&& (batches > 2 || chunk > len / 4))
+		{
+			ok++;
+		} else {
+			failed++;
+			info_printf("Failed incremental HTML parsing with chunk size %zu (%d batches):\n%s\nexpected:\n%s\n",
+				chunk, batches, buf.data, expected.data);
+		}
+
+		wget_html_url_parser_free(&parser);
+	}
+
+	wget_buffer_deinit(&buf);
+	wget_buffer_deinit(&expected);
+}
+
+static void xml_token_append(void *ctx, int flags, const char *dir, const char *attr, const char *val, size_t len, size_t pos)
+{
+	wget_buffer_printf_append(ctx, "%d %s %s %zu:%.*s\n", flags, dir, attr ? attr : "-", pos, (int) len, val ? val : "");
+}
+
+static void wget_strings_append(wget_buffer *buf, wget_vector *v)
+{
+	for (int it = 0; it < wget_vector_size(v); it++) {
+		wget_string *s = wget_vector_get(v, it);
+
+		wget_buffer_printf_append(buf, "%.*s\n", (int) s->len, s->p);
+	}
+}
+
+typedef struct {
+	size_t
+		content, // bytes of content reported
+		comment; // bytes of comments reported
+	int
+		links; // href attributes reported
+} xml_counts;
+
+static void xml_token_count(void *ctx, int flags, WGET_GCC_UNUSED const char *dir, const char *attr, WGET_GCC_UNUSED const char *val, size_t len, WGET_GCC_UNUSED size_t pos)
+{
+	xml_counts *counts = ctx;
+
+	if (flags & XML_FLG_CONTENT)
+		counts->content += len;
+	else if (flags & XML_FLG_COMMENT)
+		counts->comment += len;
+	else if ((flags & XML_FLG_ATTRIBUTE) && !wget_strcasecmp_ascii(attr, "href"))
+		counts->links++;
+}
+
+// feed 'size' bytes of 'c', returns the number of bytes parsed meanwhile
+static size_t xml_parser_feed_repeated(wget_xml_parser *parser, char c, size_t size)
+{
+	static char data[64 * 1024];
+	size_t parsed = 0;
+
+	memset(data, c, sizeof(data));
+
+	for (size_t n = 0; n < size; n += sizeof(data))
+		parsed += wget_xml_parser_feed(parser, data, sizeof(data));
+
+	return parsed;
+}
+
+static void test_xml_parser_limit(void)
+{
+	static const size_t size = 16 * 1024 * 1024;
+	wget_xml_parser *parser;
+	xml_counts counts;
+	size_t parsed;
+
+	// a head without end is parsed when the input exceeds the limit
+	memset(&counts, 0, sizeof(counts));
+	parser = wget_xml_parser_init(xml_token_count, &counts, XML_HINT_HTML);
+	wget_xml_parser_feed(parser, "<html><head><link href=\"x.css\"><title>", 38);
+	parsed = xml_parser_feed_repeated(parser, 'x', size);
+	if (counts.links == 1 && parsed > size / 4 && counts.content > size / 4)
+		ok++;
+	else {
+		failed++;
+		info_printf("Failed to parse an endless HTML head (%zu bytes parsed, %zu reported, %d links)\n", parsed, counts.content, counts.links);
+	}
+	wget_xml_parser_free(&parser);
+
+	// an endless comment is dropped, parsing goes on behind its end
+	memset(&counts, 0, sizeof(counts));
+	parser = wget_xml_parser_init(xml_token_count, &counts, XML_HINT_HTML);
+	wget_xml_parser_feed(parser, "<html><body><!--", 16);
+	xml_parser_feed_repeated(parser, 'x', size);
+	wget_xml_parser_feed(parser, "--><a href=\"y.html\">", 20);
+	if (counts.links == 1 && counts.comment == 0)
+		ok++;
+	else {
+		failed++;
+		info_printf("Failed to drop an endless HTML comment (%zu bytes reported, %d links)\n", counts.comment, counts.links);
+	}
+	wget_xml_parser_free(&parser);
+
+	// an endless XML text node is reported in pieces
+	memset(&counts, 0, sizeof(counts));
+	parser = wget_xml_parser_init(xml_token_count, &counts, 0);
+	wget_xml_parser_feed(parser, "<urlset><url><loc>", 18);
+	parsed = xml_parser_feed_repeated(parser, 'x', size);
+	if (parsed > size / 4 && counts.content > size / 4)
+		ok++;
+	else {
+		failed++;
+		info_printf("Failed to parse an endless XML text node (%zu bytes parsed)\n", parsed);
+	}
+	wget_xml_parser_finish(parser);
+	if (counts.content == size)
+		ok++;
+	else {
+		failed++;
+		info_printf("Failed to parse an endless XML text node (%zu of %zu bytes)\n", counts.content, size);
+	}
+	wget_xml_parser_free(&parser);
+}
+
+static void test_xml_parser(void)
+{
+	static const char xml[] =
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<!-- <urlset><url><loc>http://example.com/comment</loc></url></urlset> -->\n"
+		"<sitemapindex xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">\n"
+		" <sitemap><loc> http://example.com/s1.xml.gz </loc></sitemap>\n"
+		" <sitemap><loc>http://example.com/s2.xml</loc><lastmod>2004-10-01</lastmod></sitemap>\n"
+		"</sitemapindex>\n"
+		"<urlset a=b c = 'd' e>\n"
+		" <url><loc>http://example.com/a.html</loc><image /></url>\n"
+		" <url><![CDATA[ x ]]><loc>http://example.com/b.html</loc></url>\n"
+		" <\"url\"><loc>http://example.com/quoted</loc></\"url\">\n"
+		" <url><x /y><loc>http://example.com/error</loc></url>\n"
+		"</urlset>\n"
+		"</stray><urlset><url><loc>http://example.com/behind</loc></url></urlset>";
+	size_t len = sizeof(xml) - 1;
+	wget_buffer expected, buf, expected_urls, urls_buf;
+	wget_vector *urls, *sitemap_urls;
+
+	wget_buffer_init(&expected, NULL, 0);
+	wget_buffer_init(&buf, NULL, 0);
+	wget_buffer_init(&expected_urls, NULL, 0);
+	wget_buffer_init(&urls_buf, NULL, 0);
+
+	wget_xml_parse_buffer(xml, xml_token_append, &expected, 0);
+
+	wget_sitemap_get_urls_inline(xml, &urls, &sitemap_urls);
+	wget_strings_append(&expected_urls, urls);
+	wget_strings_append(&expected_urls, sitemap_urls);
+	wget_vector_free(&urls);
+	wget_vector_free(&sitemap_urls);
+
+	for (size_t chunk = 1; chunk <= len; chunk = chunk * 2 + 1) {
+		wget_xml_parser *parser = wget_xml_parser_init(xml_token_append, &buf, 0);
+		wget_sitemap_url_parser *sitemap = wget_sitemap_url_parser_init();
+		wget_buffer url_list, sitemap_list;
+
+		wget_buffer_init(&url_list, NULL, 0);
+		wget_buffer_init(&sitemap_list, NULL, 0);
+		wget_buffer_reset(&buf);
+		wget_buffer_reset(&urls_buf);
+
+		for (size_t pos = 0; pos < len; pos += chunk) {
+			size_t n = pos + chunk < len ? chunk : len - pos;
+
+			wget_xml_parser_feed(parser, xml + pos, n);
+			wget_sitemap_url_parser_feed(sitemap, xml + pos, n, &urls, &sitemap_urls);
+			wget_strings_append(&url_list, urls);
+			wget_strings_append(&sitemap_list, sitemap_urls);
+		}
+
+		wget_xml_parser_finish(parser);
+		wget_sitemap_url_parser_finish(sitemap, &urls, &sitemap_urls);
+		wget_strings_append(&url_list, urls);
+		wget_strings_append(&sitemap_list, sitemap_urls);
+
+		wget_buffer_memcat(&urls_buf, url_list.data, url_list.length);
+		wget_buffer_memcat(&urls_buf, sitemap_list.data, sitemap_list.length);
+
+		if (!strcmp(buf.data, expected.data) && !strcmp(urls_buf.data, expected_urls.data))
+			ok++;
+		else {
+			failed++;
+			info_printf("Failed incremental XML parsing with chunk size %zu:\n%s\nexpected:\n%s\n%s\nexpected:\n%s\n",
+				chunk, buf.data, expected.data, urls_buf.data, expected_urls.data);
+		}
+
+		wget_buffer_deinit(&sitemap_list);
+		wget_buffer_deinit(&url_list);
+		wget_sitemap_url_parser_free(&sitemap);
+		wget_xml_parser_free(&parser);
+	}
+
+	// the syntax error leaves <url>, the rest of the document closes the top level
+	if (strstr(expected_urls.data, "http://example.com/quoted\n") && !strstr(expected_urls.data, "error")
+		&& !strstr(expected_urls.data, "behind"))
+		ok++;
+	else {
+		failed++;
+		info_printf("Unexpected sitemap URLs:\n%s\n", expected_urls.data);
+	}
+
+	wget_buffer_deinit(&urls_buf);
+	wget_buffer_deinit(&expected_urls);
+	wget_buffer_deinit(&buf);
+	wget_buffer_deinit(&expected);
+}
+
+static void test_html_parser(void)
+{
+	static const char html[] =
+		"<html><head><title>t</title><script></script></head>\n"
+		"<body><script>var a = '<a href=\"no\">';</script><a href=\"x.html\">x</a>\n"
+		"<SCRIPT ><!-- </script> --></script ><style></style><script></script\n>\n"
+		"<script></script></body></html>\n"
+		"<script></script>";
+	size_t len = sizeof(html) - 1;
+	wget_buffer expected, buf;
+
+	wget_buffer_init(&expected, NULL, 0);
+	wget_buffer_init(&buf, NULL, 0);
+
+	wget_xml_parse_buffer(html, xml_token_append, &expected, XML_HINT_HTML);
+
+	// every possible split of the tags, also the ones of empty <script> elements
+	for (size_t chunk = 1; chunk <= len; chunk++) {
+		wget_xml_parser *parser = wget_xml_parser_init(xml_token_append, &buf, XML_HINT_HTML);
+
+		wget_buffer_reset(&buf);
+
+		for (size_t pos = 0; pos < len; pos += chunk)
+			wget_xml_parser_feed(parser, html + pos, pos + chunk < len ? chunk : len - pos);
+
+		wget_xml_parser_finish(parser);
+
+		if (!strcmp(buf.data, expected.data))
+			ok++;
+		else {
+			failed++;
+			info_printf("Failed incremental HTML parsing with chunk size %zu:\n%s\nexpected:\n%s\n", chunk, buf.data, expected.data);
+		}
+
+		wget_xml_parser_free(&parser);
+	}
+
+	// the empty script elements are reported like any other
+	size_t scripts = 0;
+	for (const char *p = expected.data; (p = strstr(p, "20 script ")); p++)
+		scripts++;
+	if (scripts == 6)
+		ok++;
+	else {
+		failed++;
+		info_printf("Unexpected HTML tokens (%zu scripts):\n%s\n", scripts, expected.data);
+	}
+
+	wget_buffer_deinit(&buf);
+	wget_buffer_deinit(&expected);
+}
+
+static void css_uri_append(void *ctx, const char *url, size_t len, size_t pos)
+{
+	wget_buffer_printf_append(ctx, "%zu:%.*s ", pos, (int) len, url);
+}
+
+static void css_encoding_append(void *ctx, const char *encoding, size_t len)
+{
+	wget_buffer_printf_append(ctx, "charset=%.*s ", (int) len, encoding);
+}
+
+static void test_css_parser(void)
+{
+	static const struct css_test_data {
+		const char *
+			css;
+		const char *
+			result;
+	} test_data[] = {
+		{ "@charset \"utf-8\";@import 'a.css';@IMPORT url( b.css ) screen;", "charset=utf-8 26:a.css 46:b.css " },
+		{ "a{background:url(x.png)}b{background:URL( \"y y.png\" )}", "17:x.png 43:y y.png " },
+		{ "a{b:url(x\\).png)}c{b:url(y\\41 )}d{b:url()}", "8:x\\).png 25:y\\41 40: " },
+		{ "/* url(c1.png) */a{b:url(/*x*/c.png)}/* url(", "25:/*x*/c.png " },
+		{ "a{content:\"url(s1.png)\\\" url(s2.png)\"}b{content:'\\'url(s3.png)", "" },
+		{ "a{content:\"bad\nurl(n.png)}", "19:n.png " },
+		{ "a{b:myurl(x.png) -url(y.png) #url(z.png) 5url(w.png) \\url(v.png) \\41 url(u.png)}", "" },
+		{ "<!--url(cdo.png)-->url(cdc.png)", "8:cdo.png 23:cdc.png " },
+		{ "a{b:url(x y.png)}c{b:url( url(z.png))}d{b:url('q.png'x)}e{b:url(ok.png)}", "64:ok.png " },
+		{ "@import\"i.css\"@import url(\"j.css\")@charset 'x'@import \"k.css", "8:i.css 27:j.css charset=x " },
+		{ "@\\69mport \"x.css\";@\\49 MPORT url(y.css);@imp\\ort'z.css'", "11:x.css 33:y.css 49:z.css " },
+		{ "@importx \"n1.css\";@\\0import \"n2.css\";@\\63harset \"c\";@media{a{b:url(m.png)}}", "67:m.png " },
+	};
+	wget_buffer buf;
+
+	wget_buffer_init(&buf, NULL, 256);
+
+	for (unsigned it = 0; it < countof(test_data); it++) {
+		const struct css_test_data *t = &test_data[it];
+
+		wget_buffer_reset(&buf);
+		wget_css_parse_buffer(t->css, strlen(t->css), css_uri_append, css_encoding_append, &buf);
+
+		if (!strcmp(buf.data, t->result))
+			ok++;
+		else {
+			failed++;
+			info_printf("Failed [%u]: wget_css_parse_buffer(%s) -> '%s' (expected '%s')\n", it, t->css, buf.data, t->result);
+		}
+	}
+
+	wget_buffer_deinit(&buf);
+}
+
 static void test_cookies(void)
 {
 #ifdef WITH_LIBPSL
@@ -2052,6 +2445,132 @@ static void test_striconv(void)
 	xfree(result);
 	xfree(utf16le);
 	xfree(utf16be);
+
+	static const struct test_data {
+		const char *
+			encoding;
+		const char *
+			src;
+		const char *
+			result; // NULL: conversion fails
+	} test_data[] = {
+		{ "iso-8859-1", "abc\xE4\xF6\xFC\xDF", "abcäöüß" },
+		{ "Latin1", "\xA0\xFF", "\xC2\xA0ÿ" },
+		{ "windows-1252", "\x80 \x93quoted\x94 \x9F\xE9", "€ “quoted” Ÿé" },
+		{ "CP1252", "undefined \x81", NULL },
+		{ "us-ascii", "http://example.com/", "http://example.com/" },
+		{ "ASCII", "http://example.com/\xE4", NULL },
+		{ "SHIFT_JIS", "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", "‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾" },
+	};
+
+	for (unsigned it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+
+		// convert twice, the second conversion reuses the iconv descriptor
+		for (int round = 0; round < 2; round++) {
+			result = NULL;
+			n = 0;
+
+			if (wget_memiconv(t->encoding, t->src, strlen(t->src), "UTF-8", &result, &n)) {
+				if (!t->result)
+					ok++;
+				else {
+					info_printf("Failed to convert '%s' from %s\n", t->src, t->encoding);
+					failed++;
+				}
+			} else if (t->result && !strcmp(result, t->result) && n == strlen(t->result)) {
+				ok++;
+			} else {
+				info_printf("Converting '%s' from %s: got '%s', expected '%s'\n", t->src, t->encoding, result, t->result);
+				failed++;
+			}
+
+			xfree(result);
+		}
+	}
+}
+
+static void test_utf8(void)
+{
+	static const struct test_data {
+		const char *
+			s;
+		bool
+			needs_encoding,
+			valid_utf8;
+	} test_data[] = {
+		{ "", 0, 1 },
+		{ "http://example.com/path/to/a/file.html", 0, 1 },
+		{ "http://example.com/path/to/a/fileä.html", 1, 1 },
+		{ "http://example.com/path/to/a/file.html?q=ä", 1, 1 },
+		{ "http://example.com/path/to/a/file.html?q=\xE4", 1, 0 },
+		{ "http://example.com/path/to/a/file.html?q=\xE2\x82", 1, 0 },
+		{ "€uro", 1, 1 },
+		{ "\xF0\x9F\x98\x80 smiley and a few more characters", 1, 1 },
+		{ "\xF8\x88\x80\x80\x80", 1, 0 },
+	};
+
+	for (unsigned it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+
+		if (wget_str_needs_encoding(t->s) == t->needs_encoding && wget_str_is_valid_utf8(t->s) == t->valid_utf8)
+			ok++;
+		else {
+			info_printf("Failed UTF-8 check of '%s'\n", t->s);
+			failed++;
+		}
+	}
+}
+
+static void test_str_to_ascii(void)
+{
+#if defined WITH_LIBIDN || defined WITH_LIBIDN2
+	static const struct test_data {
+		const char *
+			host;
+		const char *
+			result; // NULL if not converted
+	} test_data[] = {
+		{ "example.com", "example.com" },
+		{ "碼標準萬國碼.com", "xn--9cs565brid46mda086o.com" },
+		{ "bücher.example", "xn--bcher-kva.example" },
+		{ "bücher-aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa.example", NULL }, // label too long
+		{ "\xE4.example", NULL },
+	};
+
+	// the second round is served from the cache, the third after the cache has been cleared,
+	// the fourth after the cache and its mutex have been freed and set up again
+	for (int round = 0; round < 4; round++) {
+		for (unsigned it = 0; it < countof(test_data); it++) {
+			const struct test_data *t = &test_data[it];
+			const char *s = wget_str_to_ascii(t->host);
+
+			if (t->result ? !wget_strcmp(s, t->result) : s == t->host)
+				ok++;
+			else {
+				info_printf("Failed [%d/%u]: toASCII(%s) -> %s (expected %s)\n", round, it, t->host, s, t->result);
+				failed++;
+			}
+
+			if (s != t->host)
+				wget_xfree(s);
+		}
+
+		if (round == 1) {
+			for (int n = 0; n < 1100; n++) {
+				char host[32];
+				const char *s;
+
+				wget_snprintf(host, sizeof(host), "ä%d.example", n);
+				if ((s = wget_str_to_ascii(host)) != host)
+					wget_xfree(s);
+			}
+		} else if (round == 2) {
+			wget_encoding_exit();
+			wget_encoding_init();
+		}
+	}
+#endif
 }
 
 static void test_bitmap(void)
@@ -2370,6 +2889,118 @@ static void test_robots(void)
 
 		wget_robots_free(&robots);
 	}
+
+	static const struct allow_data {
+		const char *
+			data;
+		const char *
+			path;
+		bool
+			allowed;
+		int
+			crawl_delay;
+	} allow_data[] = {
+		{ "User-agent: *\nDisallow: /cgi-bin/\n", "/cgi-bin/x", 0, 0 },
+		{ "User-agent: *\nDisallow: /cgi-bin/\n", "/cgi-bin", 1, 0 },
+		{ "User-agent: *\nDisallow: /cgi-bin/\n", "/index.html", 1, 0 },
+		{ "User-agent: *\nDisallow: /\n", "/robots.txt", 1, 0 },
+		{ "User-agent: *\nDisallow: \n", "/", 1, 0 },
+		// the longest match wins
+		{ "User-agent: *\nDisallow: /p\nAllow: /page\n", "/page.html", 1, 0 },
+		{ "User-agent: *\nAllow: /p\nDisallow: /page\n", "/page.html", 0, 0 },
+		{ "User-agent: *\nAllow: /p\nDisallow: /page\n", "/p.html", 1, 0 },
+		{ "User-agent: *\nAllow: /folder\nDisallow: /folder/\n", "/folder/page", 0, 0 },
+		// Allow wins a tie
+		{ "User-agent: *\nDisallow: /page\nAllow: /page\n", "/page", 1, 0 },
+		{ "User-agent: *\nAllow: /page\nDisallow: /page\n", "/page", 1, 0 },
+		{ "User-agent: *\nDisallow: /a*x\nDisallow: /b*x\nAllow: /*ax\n", "/ax", 1, 0 },
+		{ "User-agent: *\nDisallow: /a*x\nDisallow: /*ax\nAllow: /b*x\n", "/ax", 0, 0 },
+		// wildcards and end anchors
+		{ "User-agent: *\nDisallow: /*.php$\n", "/index.php", 0, 0 },
+		{ "User-agent: *\nDisallow: /*.php$\n", "/index.php?x=1", 1, 0 },
+		{ "User-agent: *\nDisallow: /*.php$\n", "/dir/a.php.php", 0, 0 },
+		{ "User-agent: *\nDisallow: /*.php\n", "/index.php?x=1", 0, 0 },
+		{ "User-agent: *\nDisallow: /*?\n", "/search?q=1", 0, 0 },
+		{ "User-agent: *\nDisallow: /*?\n", "/search", 1, 0 },
+		{ "User-agent: *\nDisallow: /a*b*c\n", "/axxbyyc/d", 0, 0 },
+		{ "User-agent: *\nDisallow: /a*b*c\n", "/axxbyy", 1, 0 },
+		{ "User-agent: *\nDisallow: /\nAllow: /$\n", "/", 1, 0 },
+		{ "User-agent: *\nDisallow: /\nAllow: /$\n", "/page", 0, 0 },
+		{ "User-agent: *\nDisallow: /private\nAllow: /private/*.html\n", "/private/a.html", 1, 0 },
+		{ "User-agent: *\nDisallow: /private/\nAllow: /*.gif$\n", "/private/a.gif", 0, 0 },
+		{ "User-agent: *\nDisallow: /private/secret\nAllow: /*.gif\n", "/private/secret.gif", 0, 0 },
+		// group selection
+		{ "User-agent: *\nDisallow: /\n\nUser-agent: wget2\nDisallow: \n", "/page", 1, 0 },
+		{ "User-agent: wget2\nDisallow: /a\n\nUser-agent: *\nDisallow: /b\n", "/b", 1, 0 },
+		{ "User-agent: wget2/1.0\nDisallow: /a\n", "/a", 0, 0 },
+		{ "User-agent: WGET2\nDisallow: /a\n", "/a", 0, 0 },
+		{ "User-agent: wget2-bot\nDisallow: /a\n", "/a", 1, 0 },
+		{ "User-agent: other\nUser-agent: wget2\nDisallow: /a\n", "/a", 0, 0 },
+		{ "User-agent: wget2\nDisallow: /a\nUser-agent: other\nDisallow: /b\n", "/b", 1, 0 },
+		{ "User-agent: *\nDisallow: /a\n\nUser-agent: *\nDisallow: /b\n", "/b", 0, 0 },
+		{ "Disallow: /a\nUser-agent: *\nDisallow: /b\n", "/a", 1, 0 },
+		// comments and whitespace
+		{ "# comment\nuser-agent : * # all\n  disallow:/a # not /b\n", "/a", 0, 0 },
+		{ "# comment\nuser-agent : * # all\n  disallow:/a # not /b\n", "/b", 1, 0 },
+		{ "User-agent: *\r\nDisallow: /a\r\n", "/a", 0, 0 },
+		// Crawl-delay
+		{ "User-agent: *\nCrawl-delay: 2\n", "/", 1, 2000 },
+		{ "User-agent: *\nCrawl-delay: 0.5\nUser-agent: wget2\nCrawl-delay: 1\n", "/", 1, 1000 },
+		{ "User-agent: wget2\nDisallow: /\nUser-agent: *\nCrawl-delay: 3\n", "/", 0, 0 },
+	};
+
+	for (unsigned it = 0; it < countof(allow_data); it++) {
+		const struct allow_data *t = &allow_data[it];
+		wget_robots *robots;
+
+		if (wget_robots_parse(&robots, t->data, PACKAGE_NAME) != WGET_E_SUCCESS) {
+			info_printf("Failed to parse: \"%s\" on robots\n", t->data);
+			failed++;
+			continue;
+		}
+
+		if (wget_robots_is_allowed(robots, t->path) == t->allowed
+			&& wget_robots_get_crawl_delay(robots) == t->crawl_delay)
+		{
+			ok++;
+		} else {
+			failed++;
+			info_printf("Failed [%u]: wget_robots_is_allowed(%s) != %d (crawl-delay %d)\n",
+				it, t->path, t->allowed, wget_robots_get_crawl_delay(robots));
+		}
+
+		wget_robots_free(&robots);
+	}
+
+	// many rules
+	{
+		wget_buffer buf;
+		wget_robots *robots;
+
+		wget_buffer_init(&buf, NULL, 0);
+		wget_buffer_strcat(&buf, "User-agent: *\n");
+		for (int it = 0; it < 5000; it++)
+			wget_buffer_printf_append(&buf, "Disallow: /dir%d/\nAllow: /dir%d/public\n", it, it);
+
+		if (wget_robots_parse(&robots, buf.data, PACKAGE_NAME) == WGET_E_SUCCESS) {
+			if (wget_robots_get_path_count(robots) == 5000
+				&& !wget_robots_is_allowed(robots, "/dir4999/private")
+				&& wget_robots_is_allowed(robots, "/dir4999/public/a")
+				&& wget_robots_is_allowed(robots, "/dir5000/"))
+			{
+				ok++;
+			} else {
+				failed++;
+				info_printf("Failed robots.txt with many rules\n");
+			}
+			wget_robots_free(&robots);
+		} else {
+			failed++;
+			info_printf("Failed to parse robots.txt with many rules\n");
+		}
+
+		wget_buffer_deinit(&buf);
+	}
 }
 
 static void test_set_proxy(void)
@@ -2420,6 +3051,33 @@ static void test_set_proxy(void)
 	}
 }
 
+static void test_request_header_block(void)
+{
+	static const char block[] = "Accept: */*\r\ncontent-length: 3\r\n";
+	wget_buffer buf;
+	const char *s;
+
+	wget_buffer_init(&buf, NULL, 256);
+
+	wget_iri *iri = wget_iri_parse("http://localhost/post", NULL);
+	wget_http_request *req = wget_http_create_request(iri, "POST");
+	wget_http_request_set_body(req, NULL, wget_strdup("a=b"), 3);
+
+	// wget adds a Content-Length header for the body
+	wget_http_request_to_buffer(req, &buf, 0);
+	CHECK((s = strstr(buf.data, "Content-Length: 3\r\n")) && !strstr(s + 1, "Content-Length"));
+
+	// unless a header in the header block already has one
+	wget_http_request_set_header_block(req, block, sizeof(block) - 1);
+	wget_http_request_to_buffer(req, &buf, 0);
+	CHECK(!strstr(buf.data, "Content-Length"));
+	CHECK(strstr(buf.data, "\r\nAccept: */*\r\ncontent-length: 3\r\n\r\na=b") != NULL);
+
+	wget_http_free_request(&req);
+	wget_iri_free(&iri);
+	wget_buffer_deinit(&buf);
+}
+
 static void test_parse_response_header(void)
 {
 	char *response_text = wget_strdup(
@@ -2465,9 +3123,848 @@ static void test_parse_response_header(void)
 	xfree(resp->content_type_encoding);
 	xfree(resp);
 	xfree(response_text);
-}
 
-static unsigned alloc_flags;
+	static const struct test_data {
+		const char *
+			header;
+		short
+			major, minor, code;
+		const char *
+			reason;
+		size_t
+			content_length;
+		char
+			content_length_valid;
+	} test_data[] = {
+		{ "HTTP/1.1 404 Not Found\r\nContent-Length: 12\r\n\r\n", 1, 1, 404, "Not Found", 12, 1 },
+		{ " HTTP/1.0 200\r\nCONTENT-LENGTH: 3\r\n\r\n", 1, 0, 200, "", 3, 1 },
+		{ "ICY 200 OK\r\ncontent-length:5\r\n\r\n", 0, 0, 200, "OK", 5, 1 },
+		// abbreviated or extended header names must not match known headers
+		{ "HTTP/1.1 200 OK\r\nContent: 7\r\nContent-Lengthx: 7\r\nC: 7\r\n\r\n", 1, 1, 200, "OK", 0, 0 },
+	};
+
+	for (unsigned it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+		char *header = wget_strdup(t->header);
+
+		resp = wget_http_parse_response_header(header);
+
+		if (resp && resp->major == t->major && resp->minor == t->minor && resp->code == t->code
+			&& !strcmp(resp->reason, t->reason)
+			&& resp->content_length == t->content_length && resp->content_length_valid == t->content_length_valid)
+		{
+			ok++;
+		} else {
+			failed++;
+			info_printf("Failed [%u]: wget_http_parse_response_header(%s)\n", it, t->header);
+		}
+
+		wget_http_free_response(&resp);
+		xfree(header);
+	}
+}
+
+static void test_parse_cache_control(void)
+{
+	static const struct test_data {
+		const char *
+			input;
+		int64_t
+			maxage;
+		bool
+			no_store,
+			no_cache;
+	} test_data[] = {
+		{ "", -1, 0, 0 },
+		{ "max-age=3600", 3600, 0, 0 },
+		{ "public, max-age=\"60\", must-revalidate", 60, 0, 0 },
+		{ "no-cache=\"Set-Cookie, Set-Cookie2\", max-age=10", 10, 0, 1 },
+		{ "private,no-store", -1, 1, 0 },
+		{ "max-age=abc", 0, 0, 0 },
+		{ "s-maxage=100 , NO-CACHE", -1, 0, 1 },
+	};
+
+	for (unsigned it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+		int64_t maxage;
+		bool no_store, no_cache;
+
+		wget_http_parse_cache_control(t->input, &maxage, &no_store, &no_cache);
+
+		if (maxage == t->maxage && no_store == t->no_store && no_cache == t->no_cache)
+			ok++;
+		else {
+			failed++;
+			info_printf("Failed [%u]: wget_http_parse_cache_control(%s) -> %lld %d %d\n",
+				it, t->input, (long long) maxage, no_store, no_cache);
+		}
+	}
+
+	char header[] =
+		"HTTP/1.1 200 OK\r\n"
+		"Date: Sun, 11 Jun 2017 09:45:54 GMT\r\n"
+		"Expires: 0\r\n"
+		"Age: 42\r\n"
+		"Cache-Control: max-age=600\r\n"
+		"Cache-Control: no-cache\r\n"
+		"Vary: Accept-Encoding\r\n"
+		"Vary: Accept-Language\r\n"
+		"\r\n";
+	wget_http_response *resp = wget_http_parse_response_header(header);
+
+	if (resp->date == wget_http_parse_full_date("Sun, 11 Jun 2017 09:45:54 GMT") && resp->expires == 1 && resp->age == 42
+		&& resp->cache_maxage_valid && resp->cache_maxage == 600 && resp->cache_no_cache && !resp->cache_no_store
+		&& !wget_strcmp(resp->vary, "Accept-Encoding, Accept-Language"))
+	{
+		ok++;
+	} else {
+		failed++;
+		info_printf("Failed to parse caching headers (vary='%s')\n", resp->vary);
+	}
+
+	wget_http_free_response(&resp);
+}
+
+static void test_chunked_decoder(void)
+{
+	static const struct test_data {
+		const char *
+			input;
+		const char *
+			body;
+		bool
+			done,
+			valid;
+	} test_data[] = {
+		{ "0\r\n\r\n", "", 1, 1 },
+		{ "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n", "hello world", 1, 1 },
+		{ "A;name=value\r\n0123456789\r\n00\r\nExpires: 0\r\nX: y\r\n\r\n", "0123456789", 1, 1 },
+		{ "1\nx\n0\n\n", "x", 1, 1 },
+		{ "3\r\nabc\r\n", "abc", 0, 1 },
+		{ "3\r\nabcd\r\n0\r\n\r\n", "abc", 0, 0 },
+		{ "x\r\n", "", 0, 0 },
+		{ "10000000000000000\r\n", "", 0, 0 },
+	};
+
+	for (unsigned it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+		size_t length = strlen(t->input);
+
+		// decode everything at once and byte by byte
+		for (size_t step = length; step > 0; step = step == 1 ? 0 : 1) {
+			wget_http_chunked_decoder *decoder = wget_http_chunked_decoder_alloc();
+			wget_buffer *body = wget_buffer_alloc(32);
+			const char *slice;
+			size_t consumed, slice_length;
+			bool valid = true;
+
+			for (size_t pos = 0; pos < length && valid && !wget_http_chunked_decoder_done(decoder); pos += step) {
+				size_t n = pos + step > length ? length - pos : step;
+
+				for (const char *p = t->input + pos; n > 0; p += consumed, n -= consumed) {
+					if (wget_http_chunked_decode(decoder, p, n, &consumed, &slice, &slice_length) != WGET_E_SUCCESS) {
+						valid = false;
+						break;
+					}
+					wget_buffer_memcat(body, slice, slice_length);
+					if (wget_http_chunked_decoder_done(decoder))
+						break;
+				}
+			}
+
+			if (valid == t->valid && wget_http_chunked_decoder_done(decoder) == t->done
+				&& (!valid || !strcmp(body->data, t->body)))
+			{
+				ok++;
+			} else {
+				failed++;
+				info_printf("Failed [%u/%zu]: wget_http_chunked_decode(%s) -> '%s' (valid=%d, done=%d)\n",
+					it, step, t->input, body->data, valid, wget_http_chunked_decoder_done(decoder));
+			}
+
+			wget_buffer_free(&body);
+			wget_http_chunked_decoder_free(&decoder);
+		}
+	}
+}
+
+static void test_alt_svc(void)
+{
+	static const struct test_data {
+		const char *
+			input;
+		int
+			count;
+		const char *
+			protocol;
+		const char *
+			host;
+		uint16_t
+			port;
+		int64_t
+			maxage;
+	} test_data[] = {
+		{ "clear", 0, NULL, NULL, 0, 0 },
+		{ "h3=\":443\"", 1, "h3", NULL, 443, 86400 },
+		{ "h3=\":443\"; ma=3600, h3-29=\":443\"; ma=3600", 2, "h3", NULL, 443, 3600 },
+		{ "h2=\"alt.example.com:8443\";ma=60;persist=1", 1, "h2", "alt.example.com", 8443, 60 },
+		{ "w%3Dx%3Ay=\"[::1]:1234\"", 1, "w=x:y", "::1", 1234, 86400 },
+		{ "h3=\":0\", h3=\"host\", h3=443, h3=\":443\"", 1, "h3", NULL, 443, 86400 },
+		{ "h3=\":443\"; ma=-5", 1, "h3", NULL, 443, 0 },
+	};
+
+	for (unsigned it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+		wget_vector *alt_svcs = wget_vector_create(2, NULL);
+		wget_http_altsvc *altsvc;
+
+		wget_vector_set_destructor(alt_svcs, (wget_vector_destructor *) wget_http_free_alt_svc);
+		wget_http_parse_alt_svcs(t->input, alt_svcs);
+		altsvc = wget_vector_get(alt_svcs, 0);
+
+		if (wget_vector_size(alt_svcs) == t->count
+			&& (!t->count
+				|| (!strcmp(altsvc->protocol, t->protocol) && !wget_strcmp(altsvc->host, t->host)
+					&& altsvc->port == t->port && altsvc->maxage == t->maxage)))
+		{
+			ok++;
+		} else {
+			failed++;
+			info_printf("Failed [%u]: wget_http_parse_alt_svcs(%s) found %d alternatives\n", it, t->input, wget_vector_size(alt_svcs));
+		}
+
+		wget_http_free_alt_svcs(&alt_svcs);
+	}
+
+	wget_altsvc_cache *cache;
+	wget_http_response *resp;
+	const char *alt_host = NULL;
+	uint16_t alt_port = 0;
+	char header[] =
+		"HTTP/1.1 200 OK\r\n"
+		"Alt-Svc: h3=\":8443\"; ma=3600, h3=\"alt.example.com:443\", h2=\":443\"; ma=0\r\n"
+		"\r\n";
+
+	if (wget_altsvc_cache_init(&cache) != WGET_E_SUCCESS) {
+		failed++;
+		info_printf("Failed to init Alt-Svc cache\n");
+		return;
+	}
+
+	resp = wget_http_parse_response_header(header);
+	wget_altsvc_cache_update(cache, "example.com", 443, resp->alt_svcs);
+	wget_http_free_response(&resp);
+
+	// first h3 alternative is used, h2 expired immediately
+	if (wget_altsvc_cache_get(cache, "example.com", 443, "h3", &alt_host, &alt_port) == WGET_E_SUCCESS
+		&& !strcmp(alt_host, "example.com") && alt_port == 8443
+		&& wget_altsvc_cache_get(cache, "example.com", 443, "h2", &alt_host, &alt_port) == WGET_E_UNKNOWN
+		&& wget_altsvc_cache_get(cache, "example.com", 80, "h3", &alt_host, &alt_port) == WGET_E_UNKNOWN)
+		ok++;
+	else {
+		failed++;
+		info_printf("Failed: wget_altsvc_cache_get() returned %s:%hu\n", alt_host, alt_port);
+	}
+	xfree(alt_host);
+
+	// a broken alternative falls back to the next one
+	wget_altsvc_cache_mark_broken(cache, "example.com", 443, "h3", "example.com", 8443);
+	if (wget_altsvc_cache_get(cache, "example.com", 443, "h3", &alt_host, &alt_port) == WGET_E_SUCCESS
+		&& !strcmp(alt_host, "alt.example.com") && alt_port == 443)
+		ok++;
+	else {
+		failed++;
+		info_printf("Failed: wget_altsvc_cache_get() did not skip broken alternative\n");
+	}
+	xfree(alt_host);
+
+	// broken state survives a refresh of the alternatives
+	wget_vector *alt_svcs = wget_vector_create(2, NULL);
+	wget_vector_set_destructor(alt_svcs, (wget_vector_destructor *) wget_http_free_alt_svc);
+	wget_http_parse_alt_svcs("h3=\":8443\"", alt_svcs);
+	wget_altsvc_cache_update(cache, "example.com", 443, alt_svcs);
+	if (wget_altsvc_cache_get(cache, "example.com", 443, "h3", &alt_host, &alt_port) == WGET_E_UNKNOWN)
+		ok++;
+	else {
+		failed++;
+		info_printf("Failed: wget_altsvc_cache_update() lost broken state\n");
+		xfree(alt_host);
+	}
+
+	// 'clear' removes all alternatives
+	wget_vector_clear(alt_svcs);
+	wget_http_parse_alt_svcs("clear", alt_svcs);
+	wget_altsvc_cache_update(cache, "example.com", 443, alt_svcs);
+	wget_altsvc_cache_mark_broken(cache, "example.com", 443, "h3", "example.com", 8443);
+	if (wget_altsvc_cache_get(cache, "example.com", 443, "h3", &alt_host, &alt_port) == WGET_E_UNKNOWN)
+		ok++;
+	else {
+		failed++;
+		info_printf("Failed: Alt-Svc 'clear' did not remove alternatives\n");
+		xfree(alt_host);
+	}
+
+	wget_http_free_alt_svcs(&alt_svcs);
+	wget_altsvc_cache_free(&cache);
+}
+
+static wget_vector *string_vector(const char *const *strings)
+{
+	wget_vector *v = wget_vector_create(4, NULL);
+
+	for (; *strings; strings++)
+		wget_vector_add(v, wget_strdup(*strings));
+
+	return v;
+}
+
+static void test_url_filter(void)
+{
+	static const char *const accept[] = { "*.htm?", ".pdf", "/robots.txt", NULL };
+	static const char *const reject[] = { "*/private/*", ".gif", NULL };
+	static const char *const directories[] = { "+/pub", "-/pub/private", "-*/tmp", "+/pub/private/ok", NULL };
+	static const char *const domains[] = { "www.example.com", "*.example.org", NULL };
+	static const struct test_data {
+		const char *
+			string;
+		bool
+			accepted,
+			rejected,
+			accepted_nocase;
+	} test_data[] = {
+		{ "http://x/index.html", 1, 0, 1 },
+		{ "http://x/index.HTML", 0, 0, 1 },
+		{ "http://x/a.pdf", 1, 0, 1 },
+		{ "http://x/a.Pdf", 0, 0, 1 },
+		{ "http://x/robots.txt", 1, 0, 1 },
+		{ "http://x/xrobots.txt", 0, 0, 0 },
+		{ "http://x/private/a.pdf", 1, 1, 1 },
+		{ "http://x/a.gif", 0, 1, 0 },
+		{ "pdf", 0, 0, 0 },
+		{ "", 0, 0, 0 },
+	};
+	static const struct dir_test_data {
+		const char *
+			path;
+		bool
+			excluded;
+	} dir_test_data[] = {
+		{ "pub/a.txt", 0 },
+		{ "/pub/sub/a.txt", 0 },
+		{ "pub", 1 }, // root directory
+		{ "pubx/a.txt", 1 },
+		{ "pub/private/a.txt", 1 },
+		{ "pub/private/ok/a.txt", 0 },
+		{ "pub/private/ok/tmp/a.txt", 0 }, // the last matching entry wins
+		{ "pub/tmp/a.txt", 1 },
+		{ "pub/sub/tmp/a.txt", 0 }, // no match for '*' with FNM_PATHNAME
+		{ "other/a.txt", 1 },
+		{ NULL, 0 },
+	};
+	static const struct host_test_data {
+		const char *
+			host;
+		bool
+			in_domains;
+	} host_test_data[] = {
+		{ "www.example.com", 1 },
+		{ "example.com", 1 },
+		{ "com", 1 },
+		{ "ftp.example.com", 0 },
+		{ "www.example.org", 1 },
+		{ "example.org", 0 },
+	};
+
+	config.accept_patterns = string_vector(accept);
+	config.reject_patterns = string_vector(reject);
+	config.exclude_directories = string_vector(directories);
+	config.domains = string_vector(domains);
+
+	for (int ignore_case = 0; ignore_case <= 1; ignore_case++) {
+		config.ignore_case = ignore_case;
+		url_filter_init();
+
+		for (unsigned it = 0; it < countof(test_data); it++) {
+			const struct test_data *t = &test_data[it];
+			bool accepted = url_filter_accepted(t->string), rejected = url_filter_rejected(t->string);
+
+			if (accepted == (ignore_case ? t->accepted_nocase : t->accepted) && rejected == t->rejected)
+				ok++;
+			else {
+				failed++;
+				info_printf("Failed [%u/%d]: url_filter(%s) -> accepted %d, rejected %d\n", it, ignore_case, t->string, accepted, rejected);
+			}
+		}
+
+		url_filter_exit();
+	}
+	config.ignore_case = 0;
+
+	url_filter_init();
+
+	for (unsigned it = 0; it < countof(dir_test_data); it++) {
+		const struct dir_test_data *t = &dir_test_data[it];
+		bool excluded = url_filter_directory_excluded(t->path);
+
+		if (excluded == t->excluded)
+			ok++;
+		else {
+			failed++;
+			info_printf("Failed [%u]: url_filter_directory_excluded(%s) -> %d (expected %d)\n", it, t->path, excluded, t->excluded);
+		}
+	}
+
+	for (unsigned it = 0; it < countof(host_test_data); it++) {
+		const struct host_test_data *t = &host_test_data[it];
+		bool in_domains = url_filter_in_domains(t->host);
+
+		if (in_domains == t->in_domains)
+			ok++;
+		else {
+			failed++;
+			info_printf("Failed [%u]: url_filter_in_domains(%s) -> %d (expected %d)\n", it, t->host, in_domains, t->in_domains);
+		}
+	}
+
+	// domains of start URLs are added at runtime
+	char *domain = wget_strdup("ftp.example.com");
+	wget_vector_add(config.domains, domain);
+	url_filter_add_domain(domain);
+	CHECK(url_filter_in_domains("ftp.example.com"));
+	CHECK(!url_filter_in_exclude_domains("ftp.example.com"));
+
+	// regular expressions are compiled once
+	config.accept_regex = wget_strdup("\\.(html|css)$");
+	config.reject_regex = wget_strdup("[0-9]{4}");
+	url_filter_exit();
+	url_filter_init();
+	CHECK(url_filter_accepted("http://x/a.html"));
+	CHECK(!url_filter_accepted("http://x/a.pdf")); // patterns and regex must both match
+	CHECK(url_filter_rejected("http://x/2020/a.html"));
+	CHECK(!url_filter_rejected("http://x/20/a.html"));
+	wget_vector_free(&config.accept_patterns);
+	url_filter_exit();
+	url_filter_init();
+	CHECK(url_filter_accepted("http://x/a.html"));
+	CHECK(url_filter_accepted("http://x/a.css"));
+	CHECK(!url_filter_accepted("http://x/a.htm"));
+	url_filter_exit();
+
+	xfree(config.accept_regex);
+	xfree(config.reject_regex);
+	wget_vector_free(&config.reject_patterns);
+	wget_vector_free(&config.exclude_directories);
+	wget_vector_free(&config.domains);
+}
+
+static unsigned alloc_flags;
+
+static char *read_warc_file(const char *fname, size_t *size)
+{
+	wget_buffer buf;
+	char tmp[16384];
+	int nbytes;
+
+	wget_buffer_init(&buf, NULL, 4096);
+
+#ifdef WITH_ZLIB
+	// gzread() also decompresses the concatenated per-record gzip members and plain files
+	gzFile gz;
+
+	if (!(gz = gzopen(fname, "rb"))) {
+		wget_buffer_deinit(&buf);
+		return NULL;
+	}
+
+	while ((nbytes = gzread(gz, tmp, sizeof(tmp))) > 0)
+		wget_buffer_memcat(&buf, tmp, nbytes);
+
+	gzclose(gz);
+#else
+	FILE *fp;
+
+	if (!(fp = fopen(fname, "rb"))) {
+		wget_buffer_deinit(&buf);
+		return NULL;
+	}
+
+	while ((nbytes = (int) fread(tmp, 1, sizeof(tmp), fp)) > 0)
+		wget_buffer_memcat(&buf, tmp, nbytes);
+
+	fclose(fp);
+#endif
+
+	*size = buf.length;
+	return buf.data;
+}
+
+static int count_matches(const char *data, size_t size, const char *s)
+{
+	const char *p, *end = data + size;
+	size_t len = strlen(s);
+	int n = 0;
+
+	for (p = data; (p = memmem(p, end - p, s, len)); p += len)
+		n++;
+
+	return n;
+}
+
+static void test_warc(void)
+{
+	// the second payload is large enough to be spooled into a temporary file
+	size_t sizes[2] = { 13, 1536 * 1024 };
+	char *payload = wget_malloc(sizes[1]);
+
+	for (size_t pos = 0; pos < sizes[1]; pos++)
+		payload[pos] = 'a' + (pos * 7) % 26;
+
+	for (int compression = 0; compression < 2; compression++) {
+#ifndef WITH_ZLIB
+		if (compression)
+			break;
+#endif
+		const char *fname = compression ? "test_warc.warc.gz" : "test_warc.warc";
+		wget_iri *iri = wget_iri_parse("http://example.com/file.txt", NULL);
+
+		config.warc_file = wget_strdup("test_warc");
+		config.warc_compression = compression;
+		config.warc_cdx = 1;
+		config.warc_max_size = 0;
+
+		CHECK(warc_init() == 0);
+
+		for (unsigned it = 0; it < countof(sizes); it++) {
+			wget_http_request *req = wget_http_create_request(iri, "GET");
+			warc_record *record = warc_record_alloc(req);
+			char *header = wget_aprintf("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n\r\n", sizes[it]);
+			wget_http_response *resp = wget_http_parse_response_header(header);
+
+			for (size_t pos = 0; pos < sizes[it]; pos += 4096)
+				warc_record_append(record, payload + pos, sizes[it] - pos < 4096 ? sizes[it] - pos : 4096);
+
+			warc_record_write(&record, resp, iri->uri);
+			CHECK(record == NULL);
+
+			wget_http_free_response(&resp);
+			wget_http_free_request(&req);
+			xfree(header);
+		}
+
+		warc_exit();
+		xfree(config.warc_file);
+		wget_iri_free(&iri);
+
+		size_t size;
+		char *data = read_warc_file(fname, &size);
+
+		CHECK(data != NULL);
+		if (data) {
+			CHECK(count_matches(data, size, "WARC-Type: warcinfo\r\n") == 1);
+			CHECK(count_matches(data, size, "WARC-Type: request\r\n") == 2);
+			CHECK(count_matches(data, size, "WARC-Type: response\r\n") == 2);
+			CHECK(count_matches(data, size, "WARC-Payload-Digest: sha1:") == 2);
+
+			// the payload follows the HTTP header and is followed by the record end marker
+			for (unsigned it = 0; it < countof(sizes); it++) {
+				wget_buffer expected;
+
+				wget_buffer_init(&expected, NULL, sizes[it] + 64);
+				wget_buffer_printf(&expected, "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", sizes[it]);
+				wget_buffer_memcat(&expected, payload, sizes[it]);
+				wget_buffer_memcat(&expected, "\r\n\r\n", 4);
+				CHECK(memmem(data, size, expected.data, expected.length) != NULL);
+				wget_buffer_deinit(&expected);
+			}
+
+			xfree(data);
+		}
+
+		if ((data = wget_read_file("test_warc.cdx", &size))) {
+			CHECK(count_matches(data, size, "\n") == 3);
+			CHECK(count_matches(data, size, "http://example.com/file.txt ") == 2);
+			xfree(data);
+		} else
+			CHECK(!"test_warc.cdx not found");
+
+		unlink(fname);
+		unlink("test_warc.cdx");
+	}
+
+	xfree(payload);
+}
+
+static void write_test_file(const char *fname, const char *data, int flags)
+{
+	int fd;
+
+	if ((fd = open(fname, O_WRONLY | O_CREAT | flags, 0644)) != -1) {
+		if (write(fd, data, strlen(data)) != (ssize_t) strlen(data))
+			info_printf("Failed to write %s\n", fname);
+		close(fd);
+	} else
+		info_printf("Failed to open %s\n", fname);
+}
+
+static bool file_content_is(const char *fname, const char *expected)
+{
+	size_t size;
+	char *data = wget_read_file(fname, &size);
+	bool same = data && size == strlen(expected) && !memcmp(data, expected, size);
+
+	xfree(data);
+	return same;
+}
+
+// what a completed download does: the file content has been hashed while writing
+static void dedup_test_file(const char *fname)
+{
+	wget_hash_hd *hash;
+	size_t size;
+	char *data = wget_read_file(fname, &size);
+
+	if (data && wget_hash_init(&hash, DEDUP_DIGTYPE) == 0) {
+		wget_hash(hash, data, size);
+		dedup_file(fname, &hash);
+	}
+
+	xfree(data);
+}
+
+static void test_dedup(void)
+{
+	static const char content[] = "deduplicated content\n";
+	unsigned char digest[32];
+	char hex[65], object[128], objdir[64];
+	struct stat st_a, st_b;
+
+	wget_hash_fast(DEDUP_DIGTYPE, content, strlen(content), digest);
+	wget_memtohex(digest, sizeof(digest), hex, sizeof(hex));
+	wget_snprintf(objdir, sizeof(objdir), ".test_dedup/store/%.2s", hex);
+	wget_snprintf(object, sizeof(object), "%s/%s", objdir, hex + 2);
+
+	mkdir(".test_dedup", 0755);
+	config.dedup_dir = wget_strdup(".test_dedup/store");
+	CHECK(dedup_init() == 0);
+
+	write_test_file(".test_dedup/a", content, O_TRUNC);
+	write_test_file(".test_dedup/b", content, O_TRUNC);
+	dedup_test_file(".test_dedup/a");
+	dedup_test_file(".test_dedup/b");
+
+	// a, b and the store object share one inode
+	CHECK(stat(".test_dedup/a", &st_a) == 0 && stat(".test_dedup/b", &st_b) == 0);
+	CHECK(st_a.st_ino == st_b.st_ino && st_a.st_nlink == 3);
+
+	// re-download b with different content, like prepare_file() does
+	dedup_unshare(".test_dedup/b", false);
+	write_test_file(".test_dedup/b", "new content\n", O_TRUNC);
+	CHECK(file_content_is(".test_dedup/b", "new content\n"));
+	CHECK(file_content_is(".test_dedup/a", content));
+	CHECK(file_content_is(object, content));
+
+	// continue a download of a (HTTP 206)
+	dedup_unshare(".test_dedup/a", true);
+	write_test_file(".test_dedup/a", "appended\n", O_APPEND);
+	CHECK(file_content_is(".test_dedup/a", "deduplicated content\nappended\n"));
+	CHECK(file_content_is(object, content));
+	CHECK(stat(object, &st_a) == 0 && st_a.st_nlink == 1);
+
+	// an object modified outside of wget is not linked but replaced
+	write_test_file(object, "DEDUPLICATED CONTENT\n", O_TRUNC);
+	write_test_file(".test_dedup/c", content, O_TRUNC);
+	dedup_test_file(".test_dedup/c");
+	CHECK(file_content_is(".test_dedup/c", content));
+	CHECK(file_content_is(object, content));
+
+	dedup_exit();
+	xfree(config.dedup_dir);
+
+	unlink(".test_dedup/a");
+	unlink(".test_dedup/b");
+	unlink(".test_dedup/c");
+	unlink(object);
+	rmdir(objdir);
+	unlink(".test_dedup/store/index");
+	rmdir(".test_dedup/store");
+	rmdir(".test_dedup");
+}
+
+static void http_cache_store_text(const char *url, const char *response_text, const char *vary_key, long long size)
+{
+	char *header = wget_strdup(response_text);
+	wget_http_response *resp = wget_http_parse_response_header(header);
+
+	http_cache_store(url, resp, vary_key, size);
+
+	wget_http_free_response(&resp);
+	xfree(header);
+}
+
+static void test_http_cache(void)
+{
+	static const char url[] = "https://example.com/index.html";
+	HTTP_CACHE_ENTRY *entry;
+	int64_t now = time(NULL);
+
+	unlink(".test_http_cache");
+	config.http_cache_file = wget_strdup(".test_http_cache");
+	CHECK(http_cache_init() == 0);
+
+	// a 200 response creates the entry
+	http_cache_store_text(url,
+		"HTTP/1.1 200 OK\r\nETag: \"v1\"\r\nCache-Control: max-age=60\r\nContent-Type: text/html\r\n\r\n", NULL, 10);
+	CHECK((entry = http_cache_get(url)));
+	if (entry) {
+		CHECK(!strcmp(entry->etag, "\"v1\""));
+		CHECK(entry->fresh_until >= now + 60 && entry->fresh_until <= time(NULL) + 60);
+		CHECK(entry->size == 10 && !entry->vary && !entry->location);
+		http_cache_free_entry(&entry);
+	}
+
+	// a 304 response updates the validator and the freshness, but not the size
+	http_cache_store_text(url,
+		"HTTP/1.1 304 Not Modified\r\nETag: \"v2\"\r\nCache-Control: max-age=3600\r\n\r\n", NULL, 10);
+	CHECK((entry = http_cache_get(url)));
+	if (entry) {
+		CHECK(!strcmp(entry->etag, "\"v2\""));
+		CHECK(entry->fresh_until >= now + 3600);
+		CHECK(entry->size == 10 && !strcmp(entry->content_type, "text/html"));
+		http_cache_free_entry(&entry);
+	}
+
+	// a 304 response doesn't create an entry
+	http_cache_store_text("https://example.com/other.html",
+		"HTTP/1.1 304 Not Modified\r\nCache-Control: max-age=3600\r\n\r\n", NULL, 10);
+	CHECK(!http_cache_get("https://example.com/other.html"));
+
+	// the varied request header values are kept along with the entry
+	http_cache_store_text(url,
+		"HTTP/1.1 200 OK\r\nETag: \"v3\"\r\nVary: Accept-Encoding, X-Test\r\n\r\n", "key1", 12);
+	CHECK((entry = http_cache_get(url)));
+	if (entry) {
+		CHECK(!strcmp(entry->vary, "Accept-Encoding,X-Test") && !strcmp(entry->vary_key, "key1"));
+		CHECK(entry->size == 12 && entry->fresh_until == 0);
+		http_cache_free_entry(&entry);
+	}
+
+	// entries survive a restart
+	http_cache_exit();
+	CHECK(http_cache_init() == 0);
+	CHECK((entry = http_cache_get(url)));
+	if (entry) {
+		CHECK(!strcmp(entry->etag, "\"v3\"") && !strcmp(entry->vary_key, "key1") && entry->size == 12);
+		http_cache_free_entry(&entry);
+	}
+
+	// responses that must not be reused remove the entry
+	http_cache_store_text(url, "HTTP/1.1 200 OK\r\nETag: \"v4\"\r\nVary: *\r\n\r\n", NULL, 12);
+	CHECK(!http_cache_get(url));
+	http_cache_store_text(url, "HTTP/1.1 200 OK\r\nETag: \"v4\"\r\n\r\n", NULL, 12);
+	CHECK((entry = http_cache_get(url)));
+	http_cache_free_entry(&entry);
+	http_cache_store_text(url, "HTTP/1.1 200 OK\r\nETag: \"v5\"\r\nCache-Control: no-store\r\n\r\n", NULL, 12);
+	CHECK(!http_cache_get(url));
+
+	// removed entries are not merged in again from the file at exit
+	http_cache_store_text("https://example.com/other.html", "HTTP/1.1 200 OK\r\nETag: \"o1\"\r\n\r\n", NULL, 5);
+	http_cache_remove("https://example.com/other.html");
+	http_cache_store_text("https://example.com/other.html", "HTTP/1.1 200 OK\r\nETag: \"o2\"\r\n\r\n", NULL, 5);
+	http_cache_exit();
+	CHECK(http_cache_init() == 0);
+	CHECK(!http_cache_get(url));
+	CHECK((entry = http_cache_get("https://example.com/other.html")));
+	if (entry) {
+		CHECK(!strcmp(entry->etag, "\"o2\""));
+		http_cache_free_entry(&entry);
+	}
+
+	http_cache_exit();
+	xfree(config.http_cache_file);
+	unlink(".test_http_cache");
+}
+
+static void test_http_cache_redirect(void)
+{
+	static const char
+		url_a[] = "https://example.com/a",
+		url_b[] = "https://example.com/b",
+		url_c[] = "https://example.com/c",
+		url_stale[] = "https://example.com/stale";
+	wget_http_response resp = { .code = 301 };
+	char *location;
+	int64_t now = time(NULL);
+
+	unlink(".test_http_cache");
+	write_test_file(".test_http_cache", "https://example.com/stale 1 0 -1 - - - - - https://example.com/a\n", O_TRUNC);
+	config.http_cache_file = wget_strdup(".test_http_cache");
+	CHECK(http_cache_init() == 0);
+
+	// hit
+	resp.cache_maxage = 600;
+	resp.cache_maxage_valid = 1;
+	http_cache_store_redirect(url_a, &resp, url_b);
+	CHECK((location = http_cache_get_redirect(url_a)) && !strcmp(location, url_b));
+	xfree(location);
+
+	HTTP_CACHE_ENTRY *entry = http_cache_get(url_a);
+	CHECK(entry && entry->size == -1 && entry->fresh_until >= now + 600);
+	http_cache_free_entry(&entry);
+
+	// heuristic freshness without Cache-Control or Expires
+	resp.cache_maxage_valid = 0;
+	http_cache_store_redirect(url_b, &resp, url_c);
+	CHECK((entry = http_cache_get(url_b)) && entry->fresh_until >= now + 86400);
+	http_cache_free_entry(&entry);
+
+	// the chain is followed hop by hop
+	CHECK((location = http_cache_get_redirect(url_b)) && !strcmp(location, url_c));
+	xfree(location);
+	CHECK((location = http_cache_get_redirect(url_a)) && !strcmp(location, url_b));
+	xfree(location);
+
+	// expiry
+	CHECK(!http_cache_get_redirect(url_stale));
+	CHECK((entry = http_cache_get(url_stale)) && entry->fresh_until == 1);
+	http_cache_free_entry(&entry);
+
+	resp.cache_maxage = 0;
+	resp.cache_maxage_valid = 1;
+	http_cache_store_redirect(url_b, &resp, url_c);
+	CHECK(!http_cache_get(url_b) && !http_cache_get_redirect(url_b));
+
+	resp.cache_maxage_valid = 0;
+	resp.cache_no_cache = 1;
+	http_cache_store_redirect(url_b, &resp, url_c);
+	CHECK(!http_cache_get(url_b));
+	resp.cache_no_cache = 0;
+
+	// a -> b -> c -> a: the loop is removed where it is entered
+	resp.cache_maxage = 600;
+	resp.cache_maxage_valid = 1;
+	http_cache_store_redirect(url_b, &resp, url_c);
+	http_cache_store_redirect(url_c, &resp, url_a);
+	CHECK(!http_cache_get_redirect(url_a));
+	CHECK(!http_cache_get(url_a));
+	CHECK((location = http_cache_get_redirect(url_b)) && !strcmp(location, url_c));
+	xfree(location);
+	CHECK((location = http_cache_get_redirect(url_c)) && !strcmp(location, url_a));
+	xfree(location);
+
+	// a -> a
+	http_cache_store_redirect(url_a, &resp, url_a);
+	CHECK(!http_cache_get_redirect(url_a));
+
+	// a loop behind the redirect doesn't affect it
+	http_cache_store_redirect(url_a, &resp, url_b);
+	http_cache_store_redirect(url_c, &resp, url_b);
+	CHECK((location = http_cache_get_redirect(url_a)) && !strcmp(location, url_b));
+	xfree(location);
+
+	http_cache_exit();
+	xfree(config.http_cache_file);
+	unlink(".test_http_cache");
+}
 
 static void *test_malloc(size_t size)
 {
@@ -2534,6 +4031,8 @@ int main(int argc, const char **argv)
 	test_vector();
 	test_stringmap();
 	test_striconv();
+	test_utf8();
+	test_str_to_ascii();
 	test_bitmap();
 
 	if (failed) {
@@ -2547,6 +4046,11 @@ int main(int argc, const char **argv)
 	test_iri_relative_to_absolute();
 	test_iri_compare();
 	test_parser();
+	test_html_url_parser();
+	test_xml_parser_limit();
+	test_xml_parser();
+	test_html_parser();
+	test_css_parser();
 
 	test_cookies();
 	test_hsts();
@@ -2556,7 +4060,16 @@ int main(int argc, const char **argv)
 	test_netrc();
 	test_robots();
 	test_set_proxy();
+	test_request_header_block();
 	test_parse_response_header();
+	test_parse_cache_control();
+	test_chunked_decoder();
+	test_alt_svc();
+	test_url_filter();
+	test_warc();
+	test_dedup();
+	test_http_cache();
+	test_http_cache_redirect();
 
 	selftest_options() ? failed++ : ok++;
 